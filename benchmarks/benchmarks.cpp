@@ -0,0 +1,593 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/optional.hpp>
+#include <gst/gst.h>
+#include <nxplay/alloc_tracking.hpp>
+#include <nxplay/init_gstreamer.hpp>
+#include <nxplay/log.hpp>
+#include <nxplay/main_pipeline.hpp>
+#include <nxplay/media.hpp>
+#include <nxplay/tag_list.hpp>
+#include "tokenizer.hpp"
+
+
+
+namespace
+{
+
+
+typedef std::chrono::steady_clock clock_type;
+// Runs the benchmarked operation p_num_iterations times
+typedef std::function < void(std::size_t const p_num_iterations) > benchmark_function;
+
+
+struct benchmark
+{
+	std::string m_name;
+	benchmark_function m_function;
+};
+
+
+struct settings
+{
+	settings()
+		: m_min_sample_time(std::chrono::milliseconds(50))
+		, m_num_samples(15)
+		, m_num_warmup_samples(2)
+		, m_fixed_num_iterations(0)
+		, m_playback_duration(std::chrono::seconds(10))
+	{
+	}
+
+	clock_type::duration m_min_sample_time;
+	unsigned int m_num_samples;
+	unsigned int m_num_warmup_samples;
+	// If nonzero, calibration is skipped, and this many iterations are run per sample
+	std::size_t m_fixed_num_iterations;
+	std::string m_filter;
+	std::string m_output_filename;
+	// If set, the allocations during steady-state playback of this URI are measured
+	std::string m_playback_uri;
+	clock_type::duration m_playback_duration;
+};
+
+
+struct result
+{
+	std::string m_name;
+	std::size_t m_num_iterations;
+	// Nanoseconds per iteration, one entry per sample, sorted
+	std::vector < double > m_samples;
+	// Only measured if nxplay was built with allocation tracking
+	boost::optional < double > m_allocations_per_iteration;
+};
+
+
+struct playback_result
+{
+	std::chrono::duration < double > m_duration;
+	guint64 m_num_allocations;
+	guint64 m_num_bytes;
+	guint64 m_num_streaming_thread_allocations;
+};
+
+
+// Keeps the compiler from optimizing away computations whose results are otherwise unused
+template < typename T >
+inline void do_not_optimize(T const &p_value)
+{
+#ifdef __GNUC__
+	asm volatile("" : : "g"(&p_value) : "memory");
+#else
+	static void const * volatile sink;
+	sink = &p_value;
+#endif
+}
+
+
+double run_sample(benchmark const &p_benchmark, std::size_t const p_num_iterations)
+{
+	auto start = clock_type::now();
+	p_benchmark.m_function(p_num_iterations);
+	return std::chrono::duration < double, std::nano > (clock_type::now() - start).count();
+}
+
+
+// Doubles the number of iterations until one sample takes at least the minimum
+// sample time, so that the timer resolution and the clock reading overhead
+// are negligible compared to the measured duration
+std::size_t calibrate(benchmark const &p_benchmark, settings const &p_settings)
+{
+	double min_sample_time = std::chrono::duration < double, std::nano > (p_settings.m_min_sample_time).count();
+	std::size_t num_iterations = 1;
+
+	while (true)
+	{
+		double duration = run_sample(p_benchmark, num_iterations);
+		if (duration >= min_sample_time)
+			return num_iterations;
+
+		// Jump close to the target right away if the duration is already meaningful
+		if (duration > (min_sample_time / 100.0))
+			num_iterations = std::max(num_iterations + 1, std::size_t(num_iterations * min_sample_time * 1.2 / duration));
+		else
+			num_iterations *= 2;
+	}
+}
+
+
+result run_benchmark(benchmark const &p_benchmark, settings const &p_settings)
+{
+	result res;
+	res.m_name = p_benchmark.m_name;
+	res.m_num_iterations = (p_settings.m_fixed_num_iterations != 0) ? p_settings.m_fixed_num_iterations : calibrate(p_benchmark, p_settings);
+
+	// Warmup samples fill caches and let the CPU clock settle;
+	// their results are discarded
+	for (unsigned int i = 0; i < p_settings.m_num_warmup_samples; ++i)
+		run_sample(p_benchmark, res.m_num_iterations);
+
+	// All samples use the same iteration count, so they are comparable
+	for (unsigned int i = 0; i < p_settings.m_num_samples; ++i)
+		res.m_samples.push_back(run_sample(p_benchmark, res.m_num_iterations) / res.m_num_iterations);
+
+	std::sort(res.m_samples.begin(), res.m_samples.end());
+
+	// Counted in a separate run, to keep the counting out of the timed samples
+	if (nxplay::is_alloc_tracking_enabled())
+	{
+		guint64 num_allocations_before = nxplay::get_num_allocations();
+		p_benchmark.m_function(res.m_num_iterations);
+		res.m_allocations_per_iteration = double(nxplay::get_num_allocations() - num_allocations_before) / res.m_num_iterations;
+	}
+
+	return res;
+}
+
+
+// Plays the URI, and once it is playing and had some time to settle,
+// counts the allocations over the playback duration
+boost::optional < playback_result > run_playback_benchmark(settings const &p_settings)
+{
+	nxplay::main_pipeline::callbacks callbacks;
+	nxplay::main_pipeline pipeline(callbacks);
+
+	nxplay::main_pipeline::command_future future = pipeline.play_media_async(pipeline.get_new_token(), nxplay::media(p_settings.m_playback_uri), true);
+	if ((future.wait_for(std::chrono::seconds(30)) != std::future_status::ready) || (future.get().m_outcome != nxplay::main_pipeline::command_completed))
+	{
+		std::cerr << "Could not start playing " << p_settings.m_playback_uri << "\n";
+		return boost::none;
+	}
+
+	// Startup allocations (stream setup, initial tags etc.)
+	// are not part of the steady state
+	std::this_thread::sleep_for(std::chrono::seconds(2));
+
+	nxplay::reset_alloc_stats();
+	std::this_thread::sleep_for(p_settings.m_playback_duration);
+	nxplay::alloc_stats stats = nxplay::get_alloc_stats();
+
+	if (pipeline.get_current_state() != nxplay::state_playing)
+	{
+		std::cerr << "Playback did not stay in the playing state during the measurement; is the media long enough?\n";
+		return boost::none;
+	}
+
+	pipeline.stop();
+
+	playback_result res;
+	res.m_duration = stats.m_duration;
+	res.m_num_allocations = stats.m_num_allocations;
+	res.m_num_bytes = stats.m_num_bytes;
+	res.m_num_streaming_thread_allocations = stats.m_num_streaming_thread_allocations;
+	return res;
+}
+
+
+double get_median(std::vector < double > const &p_sorted_values)
+{
+	std::size_t n = p_sorted_values.size();
+	return ((n % 2) == 1) ? p_sorted_values[n / 2] : ((p_sorted_values[n / 2 - 1] + p_sorted_values[n / 2]) / 2.0);
+}
+
+
+double get_mean(std::vector < double > const &p_values)
+{
+	double sum = 0.0;
+	for (double value : p_values)
+		sum += value;
+	return sum / p_values.size();
+}
+
+
+std::string json_escape(std::string const &p_string)
+{
+	std::stringstream sstr;
+	for (char c : p_string)
+	{
+		switch (c)
+		{
+			case '"': sstr << "\\\""; break;
+			case '\\': sstr << "\\\\"; break;
+			default:
+				if (static_cast < unsigned char > (c) < 0x20)
+					sstr << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+				else
+					sstr << c;
+		}
+	}
+	return sstr.str();
+}
+
+
+void write_json(std::ostream &p_out, settings const &p_settings, std::vector < result > const &p_results, boost::optional < playback_result > const &p_playback_result)
+{
+	p_out << "{\n";
+	p_out << "  \"alloc_tracking_enabled\": " << (nxplay::is_alloc_tracking_enabled() ? "true" : "false") << ",\n";
+	p_out << "  \"min_sample_time_ms\": " << std::chrono::duration_cast < std::chrono::milliseconds > (p_settings.m_min_sample_time).count() << ",\n";
+	p_out << "  \"num_samples\": " << p_settings.m_num_samples << ",\n";
+	p_out << "  \"num_warmup_samples\": " << p_settings.m_num_warmup_samples << ",\n";
+	p_out << "  \"benchmarks\": [\n";
+
+	for (std::size_t i = 0; i < p_results.size(); ++i)
+	{
+		result const &res = p_results[i];
+
+		// Benchmark names only contain identifier characters, so they need no escaping
+		p_out << "    {\n";
+		p_out << "      \"name\": \"" << res.m_name << "\",\n";
+		p_out << "      \"iterations_per_sample\": " << res.m_num_iterations << ",\n";
+		p_out << "      \"ns_per_iteration\": {";
+		p_out << " \"min\": " << res.m_samples.front();
+		p_out << ", \"median\": " << get_median(res.m_samples);
+		p_out << ", \"mean\": " << get_mean(res.m_samples);
+		p_out << ", \"max\": " << res.m_samples.back();
+		p_out << " },\n";
+		if (res.m_allocations_per_iteration)
+			p_out << "      \"allocations_per_iteration\": " << *(res.m_allocations_per_iteration) << ",\n";
+		p_out << "      \"samples\": [";
+		for (std::size_t j = 0; j < res.m_samples.size(); ++j)
+			p_out << ((j == 0) ? " " : ", ") << res.m_samples[j];
+		p_out << " ]\n";
+		p_out << "    }" << (((i + 1) < p_results.size()) ? "," : "") << "\n";
+	}
+
+	p_out << "  ]" << (p_playback_result ? "," : "") << "\n";
+
+	if (p_playback_result)
+	{
+		double seconds = p_playback_result->m_duration.count();
+		p_out << "  \"playback\": {\n";
+		p_out << "    \"uri\": \"" << json_escape(p_settings.m_playback_uri) << "\",\n";
+		p_out << "    \"duration_s\": " << seconds << ",\n";
+		p_out << "    \"allocations_per_second\": " << (p_playback_result->m_num_allocations / seconds) << ",\n";
+		p_out << "    \"bytes_per_second\": " << (p_playback_result->m_num_bytes / seconds) << ",\n";
+		p_out << "    \"streaming_thread_allocations_per_second\": " << (p_playback_result->m_num_streaming_thread_allocations / seconds) << "\n";
+		p_out << "  }\n";
+	}
+
+	p_out << "}\n";
+}
+
+
+nxplay::tag_list const & get_reference_tags()
+{
+	static nxplay::tag_list const tags = nxplay::from_string(
+		"taglist, title=(string)\"Some title of typical length\", artist=(string)\"Some artist\", "
+		"album=(string)\"Some album\", genre=(string)\"Electronic\", track-number=(uint)7, "
+		"bitrate=(uint)192000, nominal-bitrate=(uint)192000, codec=(string)\"MPEG-1 Layer 3 (MP3)\";"
+	);
+	return tags;
+}
+
+
+// Same as the reference tags, except for the title, the track number, and the bitrate,
+// which is what a tag update typically looks like when the next song of a stream starts
+nxplay::tag_list const & get_updated_tags()
+{
+	static nxplay::tag_list const tags = nxplay::from_string(
+		"taglist, title=(string)\"Another title of typical length\", artist=(string)\"Some artist\", "
+		"album=(string)\"Some album\", genre=(string)\"Electronic\", track-number=(uint)8, "
+		"bitrate=(uint)160000, nominal-bitrate=(uint)192000, codec=(string)\"MPEG-1 Layer 3 (MP3)\";"
+	);
+	return tags;
+}
+
+
+std::vector < benchmark > create_benchmarks()
+{
+	std::vector < benchmark > benchmarks;
+
+	benchmarks.push_back({ "tag_list_copy", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &tags = get_reference_tags();
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::tag_list copy(tags);
+			do_not_optimize(copy);
+		}
+	} });
+
+	benchmarks.push_back({ "tag_list_insert", [](std::size_t const p_num_iterations)
+	{
+		// Replacing tags with the same values keeps the list size
+		// constant, so all iterations do the same amount of work
+		nxplay::tag_list tags(get_reference_tags());
+		nxplay::tag_list const &update = get_updated_tags();
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			tags.insert(update, GST_TAG_MERGE_REPLACE);
+			do_not_optimize(tags);
+		}
+	} });
+
+	benchmarks.push_back({ "tag_list_equal", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &tags = get_reference_tags();
+		nxplay::tag_list copy(tags);
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			bool equal = (tags == copy);
+			do_not_optimize(equal);
+		}
+	} });
+
+	benchmarks.push_back({ "tag_list_not_equal", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &tags = get_reference_tags();
+		nxplay::tag_list const &update = get_updated_tags();
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			bool equal = (tags == update);
+			do_not_optimize(equal);
+		}
+	} });
+
+	benchmarks.push_back({ "tag_list_get_value_string", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &tags = get_reference_tags();
+		std::string title;
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::get_value(tags, GST_TAG_TITLE, title, 0);
+			do_not_optimize(title);
+		}
+	} });
+
+	benchmarks.push_back({ "tag_list_get_value_uint", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &tags = get_reference_tags();
+		guint bitrate = 0;
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::get_value(tags, GST_TAG_BITRATE, bitrate, 0);
+			do_not_optimize(bitrate);
+		}
+	} });
+
+	benchmarks.push_back({ "calculate_new_tags", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &reference = get_reference_tags();
+		nxplay::tag_list const &update = get_updated_tags();
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::tag_list new_tags = nxplay::calculate_new_tags(reference, update);
+			do_not_optimize(new_tags);
+		}
+	} });
+
+	benchmarks.push_back({ "calculate_new_tags_unchanged", [](std::size_t const p_num_iterations)
+	{
+		nxplay::tag_list const &reference = get_reference_tags();
+		nxplay::tag_list copy(reference);
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::tag_list new_tags = nxplay::calculate_new_tags(reference, copy);
+			do_not_optimize(new_tags);
+		}
+	} });
+
+	benchmarks.push_back({ "media_copy", [](std::size_t const p_num_iterations)
+	{
+		nxplay::media source("http://example.com/streams/some-station/high-quality.mp3", std::string("payload"));
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::media copy(source);
+			do_not_optimize(copy);
+		}
+	} });
+
+	benchmarks.push_back({ "media_move", [](std::size_t const p_num_iterations)
+	{
+		// Each iteration does one move construction and one move assignment
+		nxplay::media source("http://example.com/streams/some-station/high-quality.mp3", std::string("payload"));
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			nxplay::media moved(std::move(source));
+			do_not_optimize(moved);
+			source = std::move(moved);
+		}
+	} });
+
+	benchmarks.push_back({ "log_msg_filtered", [](std::size_t const p_num_iterations)
+	{
+		// The usual case in production: the level is disabled,
+		// so only the level check is paid for
+		nxplay::set_min_log_level(nxplay::log_level_info);
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+			NXPLAY_LOG_MSG(debug, "filtered message with a value: " << i);
+	} });
+
+	benchmarks.push_back({ "log_msg_written", [](std::size_t const p_num_iterations)
+	{
+		// Measures formatting and dispatching; the write function itself does nothing
+		nxplay::set_min_log_level(nxplay::log_level_trace);
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+			NXPLAY_LOG_MSG(debug, "written message with a value: " << i);
+		nxplay::set_min_log_level(nxplay::log_level_info);
+	} });
+
+	benchmarks.push_back({ "tokenize_line", [](std::size_t const p_num_iterations)
+	{
+		std::string const line("play \"http://example.com/some path/with spaces.mp3\" no extra\\ token 'quoted value'");
+		for (std::size_t i = 0; i < p_num_iterations; ++i)
+		{
+			cmdline_player::tokens tokens = cmdline_player::tokenize_line(line);
+			do_not_optimize(tokens);
+		}
+	} });
+
+	return benchmarks;
+}
+
+
+void print_usage(char const *p_program_name)
+{
+	std::cerr << "Usage: " << p_program_name << " [-t <min sample time in ms>] [-s <num samples>] [-w <num warmup samples>] [-n <iterations per sample>] [-f <name filter>] [-o <JSON output file>] [-p <URI> [-d <duration in s>]] [-l]\n\n";
+	std::cerr << "  -t : run each sample for at least this long; the iteration count is calibrated accordingly (default: 50)\n";
+	std::cerr << "  -s : number of measured samples per benchmark (default: 15)\n";
+	std::cerr << "  -w : number of discarded warmup samples per benchmark (default: 2)\n";
+	std::cerr << "  -n : use this fixed iteration count instead of calibrating it\n";
+	std::cerr << "  -f : only run benchmarks whose names contain this string\n";
+	std::cerr << "  -o : write the JSON results to this file instead of stdout\n";
+	std::cerr << "  -p : after the benchmarks, play this URI and measure the allocations per second during steady-state playback\n";
+	std::cerr << "       (requires nxplay to be built with allocation tracking)\n";
+	std::cerr << "  -d : duration of the playback measurement in seconds (default: 10)\n";
+	std::cerr << "  -l : list the benchmarks and exit\n";
+}
+
+
+}
+
+
+int main(int argc, char *argv[])
+{
+	settings bench_settings;
+	bool list_only = false;
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+
+			if (arg == "-l")
+			{
+				list_only = true;
+				continue;
+			}
+
+			if ((i + 1) >= argc)
+			{
+				print_usage(argv[0]);
+				return -1;
+			}
+
+			std::string value = argv[++i];
+
+			if (arg == "-t")
+				bench_settings.m_min_sample_time = std::chrono::milliseconds(std::stoul(value));
+			else if (arg == "-s")
+				bench_settings.m_num_samples = std::stoul(value);
+			else if (arg == "-w")
+				bench_settings.m_num_warmup_samples = std::stoul(value);
+			else if (arg == "-n")
+				bench_settings.m_fixed_num_iterations = std::stoul(value);
+			else if (arg == "-f")
+				bench_settings.m_filter = value;
+			else if (arg == "-o")
+				bench_settings.m_output_filename = value;
+			else if (arg == "-p")
+				bench_settings.m_playback_uri = value;
+			else if (arg == "-d")
+				bench_settings.m_playback_duration = std::chrono::seconds(std::stoul(value));
+			else
+			{
+				print_usage(argv[0]);
+				return -1;
+			}
+		}
+	}
+	catch (std::exception const &)
+	{
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	if (bench_settings.m_num_samples == 0)
+	{
+		std::cerr << "At least one sample is required\n";
+		return -1;
+	}
+
+	std::vector < benchmark > benchmarks = create_benchmarks();
+
+	if (list_only)
+	{
+		for (auto const &b : benchmarks)
+			std::cout << b.m_name << "\n";
+		return 0;
+	}
+
+	if (!nxplay::init_gstreamer(&argc, &argv))
+	{
+		std::cerr << "Could not initialize GStreamer\n";
+		return -1;
+	}
+
+	// Log messages must not reach stderr during the measurements
+	nxplay::set_log_write_function([](std::chrono::steady_clock::duration const, nxplay::log_levels const, char const *, int const, char const *, std::string const &) {});
+	nxplay::set_min_log_level(nxplay::log_level_info);
+
+	std::vector < result > results;
+	for (auto const &b : benchmarks)
+	{
+		if (!bench_settings.m_filter.empty() && (b.m_name.find(bench_settings.m_filter) == std::string::npos))
+			continue;
+
+		std::cerr << "Running " << b.m_name << " ... " << std::flush;
+		results.push_back(run_benchmark(b, bench_settings));
+		std::cerr << get_median(results.back().m_samples) << " ns per iteration (median)\n";
+	}
+
+	boost::optional < playback_result > playback_res;
+	if (!bench_settings.m_playback_uri.empty())
+	{
+		if (nxplay::is_alloc_tracking_enabled())
+		{
+			std::cerr << "Measuring allocations during playback of " << bench_settings.m_playback_uri << " ... " << std::flush;
+			playback_res = run_playback_benchmark(bench_settings);
+			if (playback_res)
+				std::cerr << (playback_res->m_num_allocations / playback_res->m_duration.count()) << " allocations per second\n";
+		}
+		else
+			std::cerr << "Skipping the playback measurement, since nxplay was built without allocation tracking\n";
+	}
+
+	if (bench_settings.m_output_filename.empty())
+		write_json(std::cout, bench_settings, results, playback_res);
+	else
+	{
+		std::ofstream out(bench_settings.m_output_filename.c_str());
+		if (!out)
+		{
+			std::cerr << "Could not open " << bench_settings.m_output_filename << " for writing\n";
+			nxplay::deinit_gstreamer();
+			return -1;
+		}
+		write_json(out, bench_settings, results, playback_res);
+	}
+
+	nxplay::deinit_gstreamer();
+
+	return 0;
+}
@@ -1,12 +1,16 @@
 #include <functional>
 #include <map>
+#include <sstream>
 #include <stdexcept>
 #include <iostream>
 #include <iomanip>
+#include <nxplay/alloc_tracking.hpp>
 #include <nxplay/log.hpp>
+#include <nxplay/ingress_scheduler.hpp>
 #include <nxplay/init_gstreamer.hpp>
 #include <nxplay/main_pipeline.hpp>
 #include <nxplay/soft_volume_control.hpp>
+#include <nxplay/spectrum_analyzer.hpp>
 #include "tokenizer.hpp"
 
 extern "C"
@@ -161,6 +165,21 @@ int main(int argc, char *argv[])
 		{
 			std::cerr << "Media with uri " << p_current_media.get_uri() << " and token " << p_token << " about to end\n";
 		};
+		callbacks.m_buffer_health_callback = [](nxplay::media const &p_media, guint64 const p_token, bool const p_is_current_media, nxplay::main_pipeline::buffer_health const &p_health)
+		{
+			std::cerr << "Buffer health of media with URI " << p_media.get_uri() << " and token " << p_token << "  current: " << p_is_current_media;
+			std::cerr << "  buffered: ";
+			if (p_health.m_buffered_duration)
+				std::cerr << (*(p_health.m_buffered_duration) / GST_MSECOND) << " ms";
+			else
+				std::cerr << "<unknown>";
+			std::cerr << "  ingress: " << p_health.m_ingress_rate << " B/s  consumption: " << p_health.m_consumption_rate << " B/s  underrun in: ";
+			if (p_health.m_time_to_underrun)
+				std::cerr << (*(p_health.m_time_to_underrun) / GST_MSECOND) << " ms";
+			else
+				std::cerr << "<never>";
+			std::cerr << "\n";
+		};
 		callbacks.m_info_callback = [](std::string const &p_info_message)
 		{
 			std::cerr << "Info message: " << p_info_message << "\n";
@@ -187,7 +206,22 @@ int main(int argc, char *argv[])
 		};
 
 		nxplay::soft_volume_control volobj;
-		nxplay::main_pipeline pipeline(callbacks, GST_SECOND * 5, 500, false, { &volobj });
+		nxplay::spectrum_analyzer spectrum;
+		nxplay::main_pipeline pipeline(callbacks, GST_SECOND * 5, 500, false, { &volobj, &spectrum });
+
+
+		auto wait_for_command = [](nxplay::main_pipeline::command_future &&p_future)
+		{
+			nxplay::main_pipeline::command_result result = p_future.get();
+			char const *outcome = "";
+			switch (result.m_outcome)
+			{
+				case nxplay::main_pipeline::command_completed: outcome = "completed"; break;
+				case nxplay::main_pipeline::command_superseded: outcome = "superseded"; break;
+				case nxplay::main_pipeline::command_failed: outcome = "failed"; break;
+			}
+			std::cerr << "Command " << outcome << " in state " << nxplay::get_state_name(result.m_state) << " after " << (result.m_latency.count() / 1000) << " ms\n";
+		};
 
 
 		// Set up command map
@@ -203,6 +237,18 @@ int main(int argc, char *argv[])
 			1, "<URI> <now yes/no>",
 			"plays new media with a given URI; if the second parameter is \"no\", the media will be played after the current one, or right now if nothing is currently playing"
 		};
+		commands["playmirrored"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				nxplay::media media(p_tokens[1]);
+				media.set_mirror_uris(std::vector < std::string > (p_tokens.begin() + 2, p_tokens.end()));
+				pipeline.play_media(pipeline.get_new_token(), std::move(media), true);
+				return true;
+			},
+			2, "<URI> <mirror URI> [<mirror URI> ...]",
+			"plays new media with a given URI right now; if its server stalls, the mirror URIs are tried in the given order (see mirrorfailover)"
+		};
 		commands["pause"] =
 		{
 			[&](cmdline_player::tokens const &p_tokens) { pipeline.set_paused(p_tokens[1] == "yes"); return true; },
@@ -225,6 +271,31 @@ int main(int argc, char *argv[])
 			0, "",
 			"stops any current playback"
 		};
+		commands["softstop"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens) { pipeline.set_soft_stop_enabled(p_tokens[1] == "yes"); return true; },
+			1, "<enable yes/no>",
+			"enables/disables soft stops, which keep the output device open and pool stream elements while stopped"
+		};
+		commands["latencystats"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				static char const *names[nxplay::main_pipeline::num_command_types] = { "play", "pause", "resume", "stop" };
+				std::cerr << "Command latencies:\n";
+				for (int i = 0; i < nxplay::main_pipeline::num_command_types; ++i)
+				{
+					nxplay::main_pipeline::command_latency_stats stats = pipeline.get_command_latency_stats(nxplay::main_pipeline::command_types(i));
+					std::cerr << "  " << names[i] << ": commands: " << stats.m_num_commands;
+					if (stats.m_num_commands > 0)
+						std::cerr << "  last: " << stats.m_last_latency.count() << " us  min: " << stats.m_min_latency.count() << " us  max: " << stats.m_max_latency.count() << " us  mean: " << (stats.m_total_latency.count() / stats.m_num_commands) << " us";
+					std::cerr << "\n";
+				}
+				return true;
+			},
+			0, "",
+			"prints how long play, pause, resume, and stop commands took until the pipeline reached the resulting state"
+		};
 		commands["seek"] =
 		{
 			[&](cmdline_player::tokens const &p_tokens)
@@ -236,6 +307,53 @@ int main(int argc, char *argv[])
 			1, "<seek position in milliseconds>",
 			"seeks to the given position if playback allows for seeking"
 		};
+		commands["playwait"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				wait_for_command(pipeline.play_media_async(pipeline.get_new_token(), nxplay::media(p_tokens[1]), true));
+				return true;
+			},
+			1, "<URI>",
+			"plays new media with a given URI right now, and waits until it is playing"
+		};
+		commands["pausewait"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				wait_for_command(pipeline.set_paused_async(p_tokens[1] == "yes"));
+				return true;
+			},
+			1, "<pause yes/no>",
+			"pauses or unpauses, and waits until the pipeline is paused or playing"
+		};
+		commands["seekwait"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				gint64 pos = std::stoll(p_tokens[1]);
+				wait_for_command(pipeline.set_current_position_async(pos * GST_MSECOND, nxplay::position_unit_nanoseconds));
+				return true;
+			},
+			1, "<seek position in milliseconds>",
+			"seeks to the given position, and waits until seeking finished"
+		};
+		commands["playat"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				nxplay::main_pipeline::command_batch batch;
+				batch.set_buffer_size_limit(guint(std::stol(p_tokens[3])));
+				batch.play_media(pipeline.get_new_token(), nxplay::media(p_tokens[1]), true);
+				batch.set_current_position(std::stoll(p_tokens[2]) * GST_MSECOND, nxplay::position_unit_nanoseconds);
+				if (p_tokens.size() > 4)
+					batch.set_paused(p_tokens[4] == "yes");
+				pipeline.execute_batch(std::move(batch));
+				return true;
+			},
+			3, "<URI> <start position in milliseconds> <buffer size> <paused yes/no>",
+			"plays new media with a given URI right now, starting at the given position with the given buffer size limit; all of this is applied as one batch"
+		};
 		commands["tell"] =
 		{
 			[&](cmdline_player::tokens const &) { std::cerr << "Current position in ms: " << pipeline.get_current_position(nxplay::position_unit_nanoseconds) / GST_MSECOND; return true; },
@@ -287,6 +405,383 @@ int main(int argc, char *argv[])
 			2, "<low threshold> <high threshold>",
 			"sets the current stream's buffer timeout, in milliseconds"
 		};
+		commands["memusage"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::main_pipeline::memory_usage usage = pipeline.get_memory_usage();
+				auto print_stream_usage = [](char const *p_label, boost::optional < nxplay::main_pipeline::stream_memory_usage > const &p_usage)
+				{
+					if (p_usage)
+						std::cerr << "  " << p_label << " stream: buffer " << p_usage->m_compressed_buffer << "/" << p_usage->m_compressed_buffer_limit << " bytes  tags " << p_usage->m_tags << " bytes\n";
+					else
+						std::cerr << "  " << p_label << " stream: <none>\n";
+				};
+				std::cerr << "Memory usage:\n";
+				print_stream_usage("current", usage.m_current_stream);
+				print_stream_usage("next", usage.m_next_stream);
+				std::cerr << "  output buffer: " << usage.m_output_buffer << " bytes\n";
+				std::cerr << "  total: " << usage.m_total << " bytes\n";
+				return true;
+			},
+			0, "",
+			"prints the pipeline's current memory usage"
+		};
+		commands["setbudget"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 budget = std::stoull(p_tokens[1]);
+				nxplay::set_global_buffer_budget((budget == 0) ? boost::none : boost::optional < guint64 > (budget));
+				return true;
+			},
+			1, "<budget>",
+			"sets the global buffer budget in bytes for all streams; 0 disables the budget"
+		};
+		commands["setingresslimit"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 limit = std::stoull(p_tokens[1]);
+				nxplay::set_global_ingress_limit((limit == 0) ? boost::none : boost::optional < guint64 > (limit));
+				return true;
+			},
+			1, "<limit>",
+			"sets the global ingress limit in bytes per second for all streams; 0 disables the limit"
+		};
+		commands["ingressstats"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				static char const * const class_names[nxplay::num_ingress_classes] = { "current", "next", "probe" };
+				std::cerr << "Ingress statistics:\n";
+				for (int i = 0; i < nxplay::num_ingress_classes; ++i)
+				{
+					nxplay::ingress_class_stats stats = nxplay::get_ingress_class_stats(nxplay::ingress_classes(i));
+					std::cerr << "  " << class_names[i] << ": clients: " << stats.m_num_clients << "  throughput: " << stats.m_throughput << " B/s  total: " << stats.m_total_bytes << " bytes  delayed: " << (stats.m_total_delay / GST_MSECOND) << " ms\n";
+				}
+				return true;
+			},
+			0, "",
+			"prints the ingress statistics of the current, next, and probe classes"
+		};
+		commands["setlogratelimit"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				double messages_per_second = std::stod(p_tokens[1]);
+				unsigned int burst_size = (p_tokens.size() > 2) ? std::stoul(p_tokens[2]) : 10;
+				if (messages_per_second <= 0.0)
+				{
+					nxplay::log_suppressed_message_summaries();
+					nxplay::disable_log_rate_limit();
+				}
+				else
+					nxplay::set_log_rate_limit(messages_per_second, std::max(burst_size, 1u));
+				return true;
+			},
+			1, "<messages per second> <burst size>",
+			"limits the number of log messages per second for each call site; the burst size defaults to 10; 0 disables rate limiting"
+		};
+		commands["setloglevel"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				if (p_tokens[1] == "global")
+				{
+					pipeline.get_log_context().unset_min_log_level();
+					return true;
+				}
+
+				for (int level = nxplay::log_level_trace; level <= nxplay::log_level_error; ++level)
+				{
+					if (p_tokens[1] == nxplay::get_log_level_name(nxplay::log_levels(level)))
+					{
+						pipeline.get_log_context().set_min_log_level(nxplay::log_levels(level));
+						return true;
+					}
+				}
+
+				std::cerr << "Unknown log level \"" << p_tokens[1] << "\"\n";
+				return true;
+			},
+			1, "<log level>",
+			"sets the pipeline's minimum log level (trace, debug, info, warning, error); \"global\" uses the global log level again"
+		};
+		commands["subscribe"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				static std::map < std::string, unsigned int > const event_types = {
+					{ "tags",        nxplay::main_pipeline::event_tags },
+					{ "bufferlevel", nxplay::main_pipeline::event_buffer_level },
+					{ "position",    nxplay::main_pipeline::event_position },
+					{ "duration",    nxplay::main_pipeline::event_duration },
+					{ "abouttoend",  nxplay::main_pipeline::event_media_about_to_end },
+					{ "bufferhealth", nxplay::main_pipeline::event_buffer_health },
+					{ "all",         nxplay::main_pipeline::event_all }
+				};
+
+				auto iter = event_types.find(p_tokens[1]);
+				if (iter == event_types.end())
+				{
+					std::cerr << "Unknown event type \"" << p_tokens[1] << "\"\n";
+					return true;
+				}
+
+				unsigned int mask = pipeline.get_event_subscriptions();
+				if (p_tokens[2] == "yes")
+					mask |= iter->second;
+				else
+					mask &= ~(iter->second);
+				pipeline.set_event_subscriptions(mask);
+
+				return true;
+			},
+			2, "<event type> <subscribe yes/no>",
+			"subscribes to/unsubscribes from an event type (tags, bufferlevel, position, duration, abouttoend, bufferhealth, all)"
+		};
+		commands["eventsavings"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::main_pipeline::event_savings savings = pipeline.get_event_savings();
+				std::cerr << "Work skipped thanks to event subscriptions:\n";
+				std::cerr << "  tag messages:          " << savings.m_skipped_tag_messages << "\n";
+				std::cerr << "  buffer level queries:  " << savings.m_skipped_buffer_level_queries << "\n";
+				std::cerr << "  position queries:      " << savings.m_skipped_position_queries << "\n";
+				std::cerr << "  duration queries:      " << savings.m_skipped_duration_queries << "\n";
+				return true;
+			},
+			0, "",
+			"prints how much work was skipped because event types were unsubscribed"
+		};
+		commands["proactivebuffering"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 threshold = std::stoull(p_tokens[1]);
+				if (threshold == 0)
+					pipeline.set_proactive_buffering(boost::none);
+				else
+					pipeline.set_proactive_buffering(threshold * GST_MSECOND);
+				return true;
+			},
+			1, "<min time to underrun in ms>",
+			"starts buffering as soon as an underrun is predicted within the given time; 0 disables proactive buffering"
+		};
+		commands["faststart"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 min_buffered = std::stoull(p_tokens[1]);
+				if (min_buffered == 0)
+				{
+					pipeline.set_fast_start(boost::none);
+					return true;
+				}
+
+				nxplay::main_pipeline::fast_start_settings settings;
+				settings.m_min_buffered_duration = min_buffered * GST_MSECOND;
+				if (p_tokens.size() > 2)
+					settings.m_safety_margin = std::stoul(p_tokens[2]);
+				pipeline.set_fast_start(settings);
+				return true;
+			},
+			1, "<min buffered duration in ms> [<safety margin in percent>]",
+			"starts playback as soon as the given duration is buffered and the network is fast enough; 0 disables fast start"
+		};
+		commands["startupstats"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::main_pipeline::startup_stats stats = pipeline.get_startup_stats();
+				auto print_policy_stats = [](char const *p_name, nxplay::main_pipeline::startup_policy_stats const &p_stats)
+				{
+					std::cerr << "  " << p_name << ": starts: " << p_stats.m_num_starts << "  rebuffers: " << p_stats.m_num_rebuffers;
+					if (p_stats.m_num_starts > 0)
+						std::cerr << "  last time to first audio: " << (p_stats.m_last_time_to_first_audio.count() / 1000) << " ms  mean: " << (p_stats.m_total_time_to_first_audio.count() / 1000 / p_stats.m_num_starts) << " ms";
+					std::cerr << "\n";
+				};
+				std::cerr << "Startup statistics:\n";
+				print_policy_stats("threshold", stats.m_threshold_starts);
+				print_policy_stats("fast start", stats.m_fast_starts);
+				return true;
+			},
+			0, "",
+			"prints time to first audio and rebuffer counts of the startup policies"
+		};
+		commands["throttlenext"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 pause_below = std::stoull(p_tokens[1]);
+				if (pause_below == 0)
+				{
+					pipeline.set_next_stream_throttling(boost::none);
+					return true;
+				}
+
+				nxplay::main_pipeline::next_stream_throttling throttling;
+				throttling.m_pause_below = pause_below * GST_MSECOND;
+				throttling.m_resume_above = (p_tokens.size() > 2) ? (std::stoull(p_tokens[2]) * GST_MSECOND) : (throttling.m_pause_below * 3);
+				pipeline.set_next_stream_throttling(throttling);
+				return true;
+			},
+			1, "<pause below ms> [<resume above ms>]",
+			"pauses the next stream's ingress while the current stream's buffer health is low; 0 disables throttling"
+		};
+		commands["throughput"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::main_pipeline::ingress_throughput throughput = pipeline.get_ingress_throughput();
+				std::cerr << "Ingress throughput:\n";
+				std::cerr << "  current stream: ";
+				if (throughput.m_current_stream)
+					std::cerr << *(throughput.m_current_stream) << " B/s\n";
+				else
+					std::cerr << "<none>\n";
+				std::cerr << "  next stream:    ";
+				if (throughput.m_next_stream)
+					std::cerr << *(throughput.m_next_stream) << " B/s\n";
+				else
+					std::cerr << "<none>\n";
+				std::cerr << "  next stream throttled: " << throughput.m_next_stream_throttled << " (" << throughput.m_num_next_stream_throttles << " times so far)\n";
+				return true;
+			},
+			0, "",
+			"prints the ingress throughput of the current and next streams"
+		};
+		commands["mirrorfailover"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 timeout = std::stoull(p_tokens[1]);
+				if (timeout == 0)
+					pipeline.set_mirror_failover(boost::none);
+				else
+					pipeline.set_mirror_failover(timeout * GST_MSECOND);
+				return true;
+			},
+			1, "<stall timeout in ms>",
+			"switches to the next mirror URI if no data arrives for the given time; 0 disables failover"
+		};
+		commands["failoverstats"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::main_pipeline::mirror_failover_stats stats = pipeline.get_mirror_failover_stats();
+				std::cerr << "Mirror failover statistics:\n";
+				std::cerr << "  stalls: " << stats.m_num_stalls << "  failovers: " << stats.m_num_failovers;
+				if (stats.m_num_failovers > 0)
+					std::cerr << "  last failover time: " << (stats.m_last_failover_time.count() / 1000) << " ms  mean: " << (stats.m_total_failover_time.count() / 1000 / stats.m_num_failovers) << " ms";
+				std::cerr << "\n";
+				return true;
+			},
+			0, "",
+			"prints the number of ingress stalls and mirror failovers, and the failover times"
+		};
+		commands["sourcereconnect"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				guint64 stall_timeout = std::stoull(p_tokens[1]);
+				if (stall_timeout == 0)
+				{
+					pipeline.set_source_reconnect(boost::none);
+					return true;
+				}
+
+				nxplay::main_pipeline::source_reconnect_settings settings;
+				settings.m_stall_timeout = stall_timeout * GST_MSECOND;
+				if (p_tokens.size() > 2)
+					settings.m_max_reconnects = std::stoul(p_tokens[2]);
+				pipeline.set_source_reconnect(settings);
+				return true;
+			},
+			1, "<stall timeout in ms> [<max reconnects>]",
+			"reconnects sources that stopped delivering data or failed, continuing at the current position; 0 disables reconnecting"
+		};
+		commands["reconnectstats"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::main_pipeline::source_reconnect_stats stats = pipeline.get_source_reconnect_stats();
+				std::cerr << "Source reconnect statistics:\n";
+				std::cerr << "  reconnects: " << stats.m_num_reconnects << "  recoveries: " << stats.m_num_recoveries << "  failures: " << stats.m_num_failures;
+				if (stats.m_num_recoveries > 0)
+					std::cerr << "  last recovery time: " << (stats.m_last_recovery_time.count() / 1000) << " ms  mean: " << (stats.m_total_recovery_time.count() / 1000 / stats.m_num_recoveries) << " ms";
+				std::cerr << "\n";
+				return true;
+			},
+			0, "",
+			"prints the number of source reconnects and failures, and the recovery times"
+		};
+		commands["alignedtags"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				pipeline.set_playback_aligned_tags(p_tokens[1] == "yes");
+				return true;
+			},
+			1, "<enable yes/no>",
+			"enables/disables reporting tags when the audio they belong to is played instead of when they are received"
+		};
+		commands["setf32"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				pipeline.set_float32_processing(p_tokens[1] == "yes");
+				return true;
+			},
+			1, "<enable yes/no>",
+			"enables/disables float32 processing mode; takes effect with the next play command that plays right away"
+		};
+		commands["setquantization"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				std::map < std::string, nxplay::main_pipeline::dither_methods > dither_methods = {
+					{ "none", nxplay::main_pipeline::dither_none },
+					{ "rpdf", nxplay::main_pipeline::dither_rpdf },
+					{ "tpdf", nxplay::main_pipeline::dither_tpdf },
+					{ "tpdf-hf", nxplay::main_pipeline::dither_tpdf_hf }
+				};
+				std::map < std::string, nxplay::main_pipeline::noise_shaping_methods > noise_shaping_methods = {
+					{ "none", nxplay::main_pipeline::noise_shaping_none },
+					{ "error-feedback", nxplay::main_pipeline::noise_shaping_error_feedback },
+					{ "simple", nxplay::main_pipeline::noise_shaping_simple },
+					{ "medium", nxplay::main_pipeline::noise_shaping_medium },
+					{ "high", nxplay::main_pipeline::noise_shaping_high }
+				};
+
+				auto dither_iter = dither_methods.find(p_tokens[1]);
+				auto noise_shaping_iter = noise_shaping_methods.find(p_tokens[2]);
+				if ((dither_iter == dither_methods.end()) || (noise_shaping_iter == noise_shaping_methods.end()))
+				{
+					std::cerr << "Unknown dither or noise shaping method\n";
+					return true;
+				}
+
+				pipeline.set_output_quantization(dither_iter->second, noise_shaping_iter->second);
+				return true;
+			},
+			2, "<dither none/rpdf/tpdf/tpdf-hf> <noise shaping none/error-feedback/simple/medium/high>",
+			"sets how samples are quantized if the sink requires an integer format; takes effect the next time playback starts"
+		};
+		commands["allocstats"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				nxplay::print_alloc_stats(std::cerr, nxplay::get_alloc_stats());
+				if ((p_tokens.size() > 1) && (p_tokens[1] == "reset"))
+					nxplay::reset_alloc_stats();
+				return true;
+			},
+			0, "[reset]",
+			"prints heap allocation statistics since the last reset (requires a build with --enable-alloc-tracking); with \"reset\", resets the counters afterwards"
+		};
 		commands["setvolume"] =
 		{
 			[&](cmdline_player::tokens const &p_tokens)
@@ -329,6 +824,37 @@ int main(int argc, char *argv[])
 			0, "",
 			"checks if playback is currently muted"
 		};
+		commands["spectrum"] =
+		{
+			[&](cmdline_player::tokens const &)
+			{
+				nxplay::spectrum_frame const &frame = spectrum.read_spectrum();
+				if (frame.m_sequence_number == 0)
+				{
+					std::cerr << "No spectrum available yet\n";
+					return true;
+				}
+
+				std::ostringstream levels;
+				levels << std::fixed << std::setprecision(1);
+				for (auto level : frame.m_band_levels)
+					levels << " " << level;
+				std::cerr << "Spectrum #" << frame.m_sequence_number << " (dB):" << levels.str() << "\n";
+				return true;
+			},
+			0, "",
+			"prints the band levels of the latest spectrum"
+		};
+		commands["setspectrumbands"] =
+		{
+			[&](cmdline_player::tokens const &p_tokens)
+			{
+				spectrum.set_bands(std::stoul(p_tokens[1]), std::stof(p_tokens[2]), std::stof(p_tokens[3]));
+				return true;
+			},
+			3, "<num bands> <min frequency> <max frequency>",
+			"sets the number of spectrum bands and their frequency range in Hz"
+		};
 		commands["help"] =
 		{
 			[&](cmdline_player::tokens const &) { print_commands(commands); return true; },
@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+#include <nxplay/log.hpp>
+#include <nxplay/init_gstreamer.hpp>
+#include <nxplay/fingerprint.hpp>
+
+
+
+namespace
+{
+
+
+void print_usage(char const *p_program_name)
+{
+	std::cerr << "Usage: " << p_program_name << " index [-j <num threads>] <index file> <file or URI> [<file or URI> ...]\n";
+	std::cerr << "       " << p_program_name << " lookup <index file> <file or URI> [<file or URI> ...]\n\n";
+	std::cerr << "  index  : fingerprint the given media and write an index file\n";
+	std::cerr << "  lookup : find media in the index that are duplicates of the given media\n";
+	std::cerr << "  -j     : number of worker threads (default: one per CPU core)\n";
+}
+
+
+// Turns filenames into URIs; URIs are passed through
+std::string to_uri(std::string const &p_name)
+{
+	if (gst_uri_is_valid(p_name.c_str()))
+		return p_name;
+
+	gchar *uri_cstr = gst_filename_to_uri(p_name.c_str(), nullptr);
+	if (uri_cstr == nullptr)
+		return p_name;
+
+	std::string uri(uri_cstr);
+	g_free(uri_cstr);
+	return uri;
+}
+
+
+int run_index(int argc, char *argv[], int arg_index)
+{
+	unsigned int num_threads = 0;
+	if ((arg_index < argc) && (std::strcmp(argv[arg_index], "-j") == 0) && ((arg_index + 1) < argc))
+	{
+		num_threads = std::atoi(argv[arg_index + 1]);
+		arg_index += 2;
+	}
+
+	if ((argc - arg_index) < 2)
+	{
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	std::string index_filename = argv[arg_index++];
+
+	std::vector < std::string > uris;
+	for (; arg_index < argc; ++arg_index)
+		uris.push_back(to_uri(argv[arg_index]));
+
+	auto start_time = std::chrono::steady_clock::now();
+	std::vector < nxplay::fingerprinted_media > media = nxplay::compute_fingerprints(uris, num_threads);
+	auto wall_time = std::chrono::steady_clock::now() - start_time;
+
+	std::size_t num_failed = 0, num_hashes = 0;
+	for (auto const &entry : media)
+	{
+		if (entry.m_is_valid)
+			num_hashes += entry.m_fingerprint.size();
+		else
+			++num_failed;
+	}
+
+	std::cout << "Media: " << media.size() << " (" << num_failed << " failed)  hashes: " << num_hashes << "  wall time: " << std::chrono::duration_cast < std::chrono::milliseconds > (wall_time).count() << " ms\n";
+
+	return nxplay::write_fingerprint_index(index_filename, media) ? 0 : -1;
+}
+
+
+int run_lookup(int argc, char *argv[], int arg_index)
+{
+	if ((argc - arg_index) < 2)
+	{
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	nxplay::fingerprint_index index;
+	if (!index.open(argv[arg_index++]))
+		return -1;
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (; arg_index < argc; ++arg_index)
+	{
+		std::string uri = to_uri(argv[arg_index]);
+
+		nxplay::fingerprint query;
+		if (!nxplay::compute_fingerprint(uri, query))
+		{
+			std::cout << uri << ": <failed>\n";
+			continue;
+		}
+
+		// Only the lookup itself is timed, not the fingerprinting of the query
+		auto start_time = std::chrono::steady_clock::now();
+		std::vector < nxplay::fingerprint_index::match > matches = index.lookup(query);
+		auto lookup_time = std::chrono::steady_clock::now() - start_time;
+
+		std::cout << uri << ": " << matches.size() << " match(es), lookup took " << (std::chrono::duration_cast < std::chrono::microseconds > (lookup_time).count() / 1000.0) << " ms\n";
+		for (auto const &match : matches)
+			std::cout << "  score " << match.m_score << "  offset " << match.m_time_offset << " s  " << match.m_uri << "\n";
+	}
+
+	return 0;
+}
+
+
+}
+
+
+int main(int argc, char *argv[])
+{
+	nxplay::set_min_log_level(nxplay::log_level_info);
+	nxplay::set_stderr_output();
+
+	if (!nxplay::init_gstreamer(&argc, &argv))
+	{
+		std::cerr << "Could not initialize GStreamer - exiting\n";
+		return -1;
+	}
+
+	int ret = -1;
+
+	if ((argc >= 2) && (std::strcmp(argv[1], "index") == 0))
+		ret = run_index(argc, argv, 2);
+	else if ((argc >= 2) && (std::strcmp(argv[1], "lookup") == 0))
+		ret = run_lookup(argc, argv, 2);
+	else
+		print_usage(argv[0]);
+
+	nxplay::deinit_gstreamer();
+
+	return ret;
+}
@@ -0,0 +1,85 @@
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <nxplay/binary_log.hpp>
+#include <nxplay/log.hpp>
+
+
+
+namespace
+{
+
+
+void print_usage(char const *p_program_name)
+{
+	std::cerr << "Usage: " << p_program_name << " [-l <min log level>] <binary log file>\n\n";
+	std::cerr << "  -l : only print messages with this level or higher (trace, debug, info, warning, error)\n";
+}
+
+
+bool parse_log_level(std::string const &p_name, nxplay::log_levels &p_log_level)
+{
+	for (int level = nxplay::log_level_trace; level <= nxplay::log_level_error; ++level)
+	{
+		if (p_name == nxplay::get_log_level_name(nxplay::log_levels(level)))
+		{
+			p_log_level = nxplay::log_levels(level);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+}
+
+
+int main(int argc, char *argv[])
+{
+	nxplay::log_levels min_log_level = nxplay::log_level_trace;
+
+	int arg_index = 1;
+	if ((arg_index + 1 < argc) && (std::strcmp(argv[arg_index], "-l") == 0))
+	{
+		if (!parse_log_level(argv[arg_index + 1], min_log_level))
+		{
+			print_usage(argv[0]);
+			return -1;
+		}
+		arg_index += 2;
+	}
+
+	if ((argc - arg_index) != 1)
+	{
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	nxplay::binary_log_reader reader;
+	if (!reader.open(argv[arg_index]))
+	{
+		std::cerr << "Could not open binary log file " << argv[arg_index] << "\n";
+		return -1;
+	}
+
+	nxplay::binary_log_reader::entry entry;
+	while (reader.read_next(entry))
+	{
+		if (entry.m_log_level < min_log_level)
+			continue;
+
+		// Same layout as the default stderr output, plus the pipeline
+		// ID and media token if the message is associated with them
+		auto ms = std::chrono::duration_cast < std::chrono::milliseconds > (entry.m_timestamp).count();
+		std::cout << "[" << std::setfill(' ') << std::setw(6) << (ms / 1000) << "." << std::setfill('0') << std::setw(3) << (ms % 1000) << std::setfill(' ') << "] ";
+		std::cout << nxplay::get_log_level_name(entry.m_log_level, true) << " ";
+		std::cout << "[" << entry.m_srcfile << ":" << entry.m_srcline << " " << entry.m_srcfunction << "]  ";
+		if (entry.m_pipeline_id != 0)
+			std::cout << "<pipeline " << entry.m_pipeline_id << " token " << entry.m_token << "> ";
+		std::cout << entry.m_message << "\n";
+	}
+
+	return 0;
+}
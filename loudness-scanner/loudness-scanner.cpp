@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+#include <nxplay/log.hpp>
+#include <nxplay/init_gstreamer.hpp>
+#include <nxplay/loudness_scanner.hpp>
+
+
+
+namespace
+{
+
+
+void print_usage(char const *p_program_name)
+{
+	std::cerr << "Usage: " << p_program_name << " [-j <num threads>] [-a] <result file> <file or URI> [<file or URI> ...]\n\n";
+	std::cerr << "  -j : number of worker threads (default: one per CPU core)\n";
+	std::cerr << "  -a : treat files in the same directory as one album\n";
+}
+
+
+// Turns filenames into URIs; URIs are passed through
+std::string to_uri(std::string const &p_name)
+{
+	if (gst_uri_is_valid(p_name.c_str()))
+		return p_name;
+
+	gchar *uri_cstr = gst_filename_to_uri(p_name.c_str(), nullptr);
+	if (uri_cstr == nullptr)
+		return p_name;
+
+	std::string uri(uri_cstr);
+	g_free(uri_cstr);
+	return uri;
+}
+
+
+}
+
+
+int main(int argc, char *argv[])
+{
+	nxplay::set_min_log_level(nxplay::log_level_info);
+	nxplay::set_stderr_output();
+
+	if (!nxplay::init_gstreamer(&argc, &argv))
+	{
+		std::cerr << "Could not initialize GStreamer - exiting\n";
+		return -1;
+	}
+
+	unsigned int num_threads = 0;
+	bool albums_by_directory = false;
+
+	int arg_index = 1;
+	for (; arg_index < argc; ++arg_index)
+	{
+		if ((std::strcmp(argv[arg_index], "-j") == 0) && ((arg_index + 1) < argc))
+			num_threads = std::atoi(argv[++arg_index]);
+		else if (std::strcmp(argv[arg_index], "-a") == 0)
+			albums_by_directory = true;
+		else
+			break;
+	}
+
+	if ((argc - arg_index) < 2)
+	{
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	std::string result_filename = argv[arg_index++];
+
+	std::vector < nxplay::loudness_scan_job > jobs;
+	for (; arg_index < argc; ++arg_index)
+	{
+		std::string uri = to_uri(argv[arg_index]);
+		std::string album_id;
+		if (albums_by_directory)
+			album_id = uri.substr(0, uri.rfind('/'));
+		jobs.emplace_back(uri, album_id);
+	}
+
+	nxplay::loudness_scan_stats stats;
+	std::vector < nxplay::loudness_result > results = nxplay::scan_loudness(jobs, num_threads, &stats);
+
+	std::cout << std::fixed << std::setprecision(2);
+	for (auto const &result : results)
+	{
+		if (!result.m_is_valid)
+		{
+			std::cout << result.m_uri << ": <failed>\n";
+			continue;
+		}
+
+		std::cout << result.m_uri << ":\n"
+		          << "  duration: " << result.m_duration << " s  integrated: " << result.m_integrated_loudness << " LUFS  range: " << result.m_loudness_range << " LU\n"
+		          << "  sample peak: " << result.m_sample_peak << "  true peak: " << result.m_true_peak << "\n"
+		          << "  track gain: " << result.m_track_gain << " dB  album gain: " << result.m_album_gain << " dB  album peak: " << result.m_album_true_peak << "\n";
+	}
+
+	std::cout << "\n"
+	          << "Media: " << stats.m_num_media << " (" << stats.m_num_failed_media << " failed)  threads: " << stats.m_num_threads << "\n"
+	          << "Audio duration: " << (stats.m_audio_duration / 3600.0) << " h  wall time: " << std::chrono::duration_cast < std::chrono::milliseconds > (stats.m_wall_time).count() << " ms\n"
+	          << "Throughput: " << stats.get_media_per_second() << " media/s  " << stats.get_audio_hours_per_second() << " hours of audio/s\n";
+
+	int ret = 0;
+	if (!nxplay::write_loudness_result_file(result_filename, results))
+		ret = -1;
+
+	nxplay::deinit_gstreamer();
+
+	return ret;
+}
@@ -0,0 +1,369 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <thread>
+#include "alloc_tracking.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace alloc_tracking_internal
+{
+
+
+namespace
+{
+
+
+// NOTE: everything in this unnamed namespace is used from within
+// operator new, so it must be constant-initialized (operator new can be
+// called before dynamic initialization happens) and must never allocate.
+
+// All members are atomic, since get_alloc_stats() and reset_alloc_stats()
+// access slots while other threads claim and release them.
+struct thread_slot
+{
+	std::atomic < bool > m_in_use;
+	std::atomic < std::thread::id > m_thread_id;
+	std::atomic < guint64 > m_num_allocations;
+	std::atomic < guint64 > m_num_bytes;
+};
+
+// Threads claim a free slot upon their first allocation, and release it
+// when they exit, adding their counts to other_threads_slot. GStreamer
+// creates new streaming threads for every stream, so without releasing,
+// the slots would run out after a few streams. Threads which find no
+// free slot are counted in other_threads_slot as well.
+std::size_t const max_num_thread_slots = 64;
+thread_slot thread_slots[max_num_thread_slots];
+thread_slot other_threads_slot;
+thread_local thread_slot *current_thread_slot = nullptr;
+
+
+// Releases the slot of the current thread when the thread exits.
+// Its constructor is constexpr and it has no other state than
+// m_slot, so it does not need dynamic initialization. Registering
+// the destructor does not use operator new.
+struct thread_slot_releaser
+{
+	constexpr thread_slot_releaser()
+		: m_slot(nullptr)
+	{
+	}
+
+	~thread_slot_releaser()
+	{
+		if (m_slot == nullptr)
+			return;
+
+		other_threads_slot.m_num_allocations.fetch_add(m_slot->m_num_allocations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		other_threads_slot.m_num_bytes.fetch_add(m_slot->m_num_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		m_slot->m_in_use.store(false, std::memory_order_release);
+
+		// Destructors of other thread-local objects may still allocate
+		current_thread_slot = &other_threads_slot;
+		m_slot = nullptr;
+	}
+
+	thread_slot *m_slot;
+};
+
+thread_local thread_slot_releaser current_thread_slot_releaser;
+
+thread_local call_site *current_call_site = nullptr;
+std::atomic < call_site* > call_site_list(nullptr);
+
+std::atomic < guint64 > total_num_allocations(0);
+std::atomic < guint64 > total_num_bytes(0);
+std::atomic < guint64 > total_num_streaming_thread_allocations(0);
+
+
+#ifdef NXPLAY_ALLOC_TRACKING
+
+void record_allocation(std::size_t const p_size)
+{
+	total_num_allocations.fetch_add(1, std::memory_order_relaxed);
+	total_num_bytes.fetch_add(p_size, std::memory_order_relaxed);
+
+	thread_slot *slot = current_thread_slot;
+	if (slot == nullptr)
+	{
+		slot = &other_threads_slot;
+
+		for (auto &candidate : thread_slots)
+		{
+			bool in_use = false;
+			if (candidate.m_in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+			{
+				candidate.m_thread_id.store(std::this_thread::get_id(), std::memory_order_relaxed);
+				candidate.m_num_allocations.store(0, std::memory_order_relaxed);
+				candidate.m_num_bytes.store(0, std::memory_order_relaxed);
+				current_thread_slot_releaser.m_slot = &candidate;
+				slot = &candidate;
+				break;
+			}
+		}
+
+		current_thread_slot = slot;
+	}
+
+	slot->m_num_allocations.fetch_add(1, std::memory_order_relaxed);
+	slot->m_num_bytes.fetch_add(p_size, std::memory_order_relaxed);
+
+	call_site *site = current_call_site;
+	if (site != nullptr)
+	{
+		site->m_num_allocations.fetch_add(1, std::memory_order_relaxed);
+		site->m_num_bytes.fetch_add(p_size, std::memory_order_relaxed);
+		if (site->m_is_streaming_thread)
+			total_num_streaming_thread_allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+
+void* tracked_malloc(std::size_t const p_size)
+{
+	record_allocation(p_size);
+	// malloc(0) may return a null pointer, but operator new must not
+	return std::malloc((p_size == 0) ? 1 : p_size);
+}
+
+#endif
+
+
+// Stored as a tick count, so it can be atomic
+std::atomic < std::chrono::steady_clock::rep > last_reset_time(std::chrono::steady_clock::now().time_since_epoch().count());
+
+
+} // unnamed namespace end
+
+
+call_site::call_site(char const *p_name, bool const p_is_streaming_thread)
+	: m_name(p_name)
+	, m_is_streaming_thread(p_is_streaming_thread)
+	, m_num_calls(0)
+	, m_num_allocations(0)
+	, m_num_bytes(0)
+	, m_next(call_site_list.load())
+{
+	while (!call_site_list.compare_exchange_weak(m_next, this))
+	{
+	}
+}
+
+
+scope::scope(call_site &p_call_site)
+	: m_previous_call_site(current_call_site)
+{
+	current_call_site = &p_call_site;
+	p_call_site.m_num_calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+scope::~scope()
+{
+	current_call_site = m_previous_call_site;
+}
+
+
+} // namespace alloc_tracking_internal end
+
+
+bool is_alloc_tracking_enabled()
+{
+#ifdef NXPLAY_ALLOC_TRACKING
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+alloc_stats get_alloc_stats()
+{
+	using namespace alloc_tracking_internal;
+
+	alloc_stats stats;
+
+	stats.m_duration = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(last_reset_time.load()));
+	stats.m_num_allocations = total_num_allocations.load();
+	stats.m_num_bytes = total_num_bytes.load();
+	stats.m_num_streaming_thread_allocations = total_num_streaming_thread_allocations.load();
+
+	for (call_site *site = call_site_list.load(); site != nullptr; site = site->m_next)
+	{
+		alloc_site_stats site_stats;
+		site_stats.m_name = site->m_name;
+		site_stats.m_is_streaming_thread = site->m_is_streaming_thread;
+		site_stats.m_num_calls = site->m_num_calls.load();
+		site_stats.m_num_allocations = site->m_num_allocations.load();
+		site_stats.m_num_bytes = site->m_num_bytes.load();
+		stats.m_sites.push_back(std::move(site_stats));
+	}
+
+	for (auto const &slot : thread_slots)
+	{
+		if (!slot.m_in_use.load(std::memory_order_acquire))
+			continue;
+
+		std::stringstream sstr;
+		sstr << slot.m_thread_id.load(std::memory_order_relaxed);
+
+		alloc_thread_stats thread_stats;
+		thread_stats.m_thread_id = sstr.str();
+		thread_stats.m_num_allocations = slot.m_num_allocations.load();
+		thread_stats.m_num_bytes = slot.m_num_bytes.load();
+		stats.m_threads.push_back(std::move(thread_stats));
+	}
+
+	if (other_threads_slot.m_num_allocations.load() != 0)
+	{
+		alloc_thread_stats thread_stats;
+		thread_stats.m_thread_id = "exited and other threads";
+		thread_stats.m_num_allocations = other_threads_slot.m_num_allocations.load();
+		thread_stats.m_num_bytes = other_threads_slot.m_num_bytes.load();
+		stats.m_threads.push_back(std::move(thread_stats));
+	}
+
+	return stats;
+}
+
+
+guint64 get_num_allocations()
+{
+	return alloc_tracking_internal::total_num_allocations.load();
+}
+
+
+void reset_alloc_stats()
+{
+	using namespace alloc_tracking_internal;
+
+	// This is not atomic as a whole; allocations happening while the
+	// counters are reset may be partially counted, which is acceptable
+	// for statistics.
+
+	total_num_allocations = 0;
+	total_num_bytes = 0;
+	total_num_streaming_thread_allocations = 0;
+
+	for (call_site *site = call_site_list.load(); site != nullptr; site = site->m_next)
+	{
+		site->m_num_calls = 0;
+		site->m_num_allocations = 0;
+		site->m_num_bytes = 0;
+	}
+
+	for (auto &slot : thread_slots)
+	{
+		slot.m_num_allocations = 0;
+		slot.m_num_bytes = 0;
+	}
+	other_threads_slot.m_num_allocations = 0;
+	other_threads_slot.m_num_bytes = 0;
+
+	last_reset_time = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+
+void print_alloc_stats(std::ostream &p_out, alloc_stats const &p_stats)
+{
+	if (!is_alloc_tracking_enabled())
+	{
+		p_out << "allocation tracking is not enabled in this build\n";
+		return;
+	}
+
+	double seconds = std::chrono::duration_cast < std::chrono::duration < double > > (p_stats.m_duration).count();
+	auto per_second = [seconds](guint64 const p_value) { return (seconds > 0.0) ? (p_value / seconds) : 0.0; };
+
+	p_out << "allocations in the last " << seconds << " seconds: " << p_stats.m_num_allocations << " (" << per_second(p_stats.m_num_allocations) << "/s), " << p_stats.m_num_bytes << " bytes\n";
+	p_out << "allocations in streaming thread call sites: " << p_stats.m_num_streaming_thread_allocations << " (" << per_second(p_stats.m_num_streaming_thread_allocations) << "/s)\n";
+
+	p_out << "per call site:\n";
+	for (auto const &site : p_stats.m_sites)
+	{
+		p_out << "  " << site.m_name << (site.m_is_streaming_thread ? " [streaming]" : "") << ": " << site.m_num_calls << " calls, " << site.m_num_allocations << " allocations (" << per_second(site.m_num_allocations) << "/s), " << site.m_num_bytes << " bytes";
+		if (site.m_is_streaming_thread && (site.m_num_allocations > 0))
+			p_out << "  <-- allocates in streaming thread";
+		p_out << "\n";
+	}
+
+	p_out << "per thread:\n";
+	for (auto const &thread : p_stats.m_threads)
+		p_out << "  " << thread.m_thread_id << ": " << thread.m_num_allocations << " allocations (" << per_second(thread.m_num_allocations) << "/s), " << thread.m_num_bytes << " bytes\n";
+}
+
+
+} // namespace nxplay end
+
+
+
+#ifdef NXPLAY_ALLOC_TRACKING
+
+void* operator new(std::size_t p_size)
+{
+	void *ptr = nxplay::alloc_tracking_internal::tracked_malloc(p_size);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+
+void* operator new[](std::size_t p_size)
+{
+	void *ptr = nxplay::alloc_tracking_internal::tracked_malloc(p_size);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+
+void* operator new(std::size_t p_size, std::nothrow_t const &) noexcept
+{
+	return nxplay::alloc_tracking_internal::tracked_malloc(p_size);
+}
+
+
+void* operator new[](std::size_t p_size, std::nothrow_t const &) noexcept
+{
+	return nxplay::alloc_tracking_internal::tracked_malloc(p_size);
+}
+
+
+void operator delete(void *p_ptr) noexcept
+{
+	std::free(p_ptr);
+}
+
+
+void operator delete[](void *p_ptr) noexcept
+{
+	std::free(p_ptr);
+}
+
+
+void operator delete(void *p_ptr, std::nothrow_t const &) noexcept
+{
+	std::free(p_ptr);
+}
+
+
+void operator delete[](void *p_ptr, std::nothrow_t const &) noexcept
+{
+	std::free(p_ptr);
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_ALLOC_TRACKING_HPP
+#define NXPLAY_ALLOC_TRACKING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Allocation statistics of one nxplay call site.
+struct alloc_site_stats
+{
+	/// Name of the call site (typically the function name)
+	std::string m_name;
+	/// true if the call site runs in a GStreamer streaming thread (pad probes etc.)
+	bool m_is_streaming_thread;
+	/// Number of times the call site was entered
+	guint64 m_num_calls;
+	/// Number of heap allocations made while inside the call site
+	guint64 m_num_allocations;
+	/// Number of bytes allocated while inside the call site
+	guint64 m_num_bytes;
+};
+
+
+/// Allocation statistics of one thread.
+/**
+ * Threads which exited are summarized in one entry, together with threads
+ * that could not get an entry of their own because too many threads are
+ * running at the same time.
+ */
+struct alloc_thread_stats
+{
+	/// String representation of the thread ID, or a description of the summary entry
+	std::string m_thread_id;
+	guint64 m_num_allocations;
+	guint64 m_num_bytes;
+};
+
+
+/// Allocation statistics since the last reset_alloc_stats() call.
+struct alloc_stats
+{
+	/// Time passed since the last reset; useful for calculating allocations per second
+	std::chrono::steady_clock::duration m_duration;
+	guint64 m_num_allocations;
+	guint64 m_num_bytes;
+	/// Number of allocations made while inside streaming thread call sites
+	guint64 m_num_streaming_thread_allocations;
+	std::vector < alloc_site_stats > m_sites;
+	std::vector < alloc_thread_stats > m_threads;
+};
+
+
+/// Returns true if nxplay was built with allocation tracking.
+/**
+ * Allocation tracking is a debugging aid that is enabled at configure time
+ * with the --enable-alloc-tracking switch. It replaces the global operator
+ * new/delete to count heap allocations per thread and per nxplay call site.
+ * Only C++ allocations are counted; GLib and GStreamer allocations are not
+ * (GLib ignores custom allocator vtables since version 2.46).
+ *
+ * If allocation tracking is disabled, the functions below return empty
+ * statistics, and the scope macros expand to nothing.
+ */
+bool is_alloc_tracking_enabled();
+/// Returns the allocation statistics gathered since the last reset.
+alloc_stats get_alloc_stats();
+/// Returns the number of allocations counted since the last reset.
+/**
+ * Unlike get_alloc_stats(), this does not allocate itself, so it can be
+ * used for measuring the allocations of a piece of code.
+ */
+guint64 get_num_allocations();
+/// Resets all allocation counters to zero.
+void reset_alloc_stats();
+/// Writes a human-readable summary of the given statistics to the output stream.
+void print_alloc_stats(std::ostream &p_out, alloc_stats const &p_stats);
+
+
+namespace alloc_tracking_internal
+{
+
+
+// One static instance exists per call site. Instances are chained into a
+// global list upon construction. They must not allocate, since they are
+// used from within operator new.
+struct call_site
+{
+	call_site(char const *p_name, bool const p_is_streaming_thread);
+
+	char const *m_name;
+	bool m_is_streaming_thread;
+	std::atomic < guint64 > m_num_calls;
+	std::atomic < guint64 > m_num_allocations;
+	std::atomic < guint64 > m_num_bytes;
+	call_site *m_next;
+};
+
+
+// Marks the current thread as being inside a call site for the duration
+// of the scope. Scopes can nest; the innermost one gets the allocations.
+class scope
+{
+public:
+	explicit scope(call_site &p_call_site);
+	~scope();
+
+private:
+	scope(scope const &) = delete;
+	scope& operator = (scope const &) = delete;
+
+	call_site *m_previous_call_site;
+};
+
+
+} // namespace alloc_tracking_internal end
+
+
+#ifdef NXPLAY_ALLOC_TRACKING
+
+#define NXPLAY_ALLOC_SCOPE_IMPL(NAME, IS_STREAMING_THREAD) \
+	static ::nxplay::alloc_tracking_internal::call_site nxplay_alloc_call_site_internal_5917264(NAME, IS_STREAMING_THREAD); \
+	::nxplay::alloc_tracking_internal::scope nxplay_alloc_scope_internal_5917264(nxplay_alloc_call_site_internal_5917264)
+
+#else
+
+#define NXPLAY_ALLOC_SCOPE_IMPL(NAME, IS_STREAMING_THREAD) \
+	do {} while (false)
+
+#endif
+
+
+/// Marks the rest of the enclosing scope as an nxplay call site for allocation tracking.
+#define NXPLAY_ALLOC_SCOPE(NAME) NXPLAY_ALLOC_SCOPE_IMPL(NAME, false)
+/// Like NXPLAY_ALLOC_SCOPE, but for code running in GStreamer streaming threads.
+/**
+ * Allocations inside these scopes are counted separately, since they happen
+ * in the real-time data path and should be avoided.
+ */
+#define NXPLAY_STREAMING_ALLOC_SCOPE(NAME) NXPLAY_ALLOC_SCOPE_IMPL(NAME, true)
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "binary_log.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+// File layout: a header (magic + version), followed by records. Each
+// record starts with a type byte and a 32-bit payload size, so readers
+// (and the ring buffer) can skip records without knowing their type.
+// Values are stored in host byte order.
+char const log_file_magic[4] = { 'N', 'X', 'B', 'L' };
+std::uint32_t const log_file_version = 1;
+
+std::size_t const record_header_size = 5;
+
+enum record_types
+{
+	record_type_call_site = 1,
+	record_type_message = 2
+};
+
+
+template < typename T >
+void append_value(std::vector < std::uint8_t > &p_record, T const p_value)
+{
+	std::uint8_t const *bytes = reinterpret_cast < std::uint8_t const * > (&p_value);
+	p_record.insert(p_record.end(), bytes, bytes + sizeof(T));
+}
+
+
+void append_string(std::vector < std::uint8_t > &p_record, char const *p_string, std::size_t const p_length)
+{
+	append_value < std::uint32_t > (p_record, std::uint32_t(p_length));
+	p_record.insert(p_record.end(), p_string, p_string + p_length);
+}
+
+
+void begin_record(std::vector < std::uint8_t > &p_record, record_types const p_type)
+{
+	p_record.clear();
+	p_record.push_back(std::uint8_t(p_type));
+	append_value < std::uint32_t > (p_record, 0);
+}
+
+
+void end_record(std::vector < std::uint8_t > &p_record)
+{
+	std::uint32_t payload_size = std::uint32_t(p_record.size() - record_header_size);
+	std::memcpy(&p_record[1], &payload_size, sizeof(payload_size));
+}
+
+
+template < typename T >
+bool read_value(std::vector < std::uint8_t > const &p_payload, std::size_t &p_offset, T &p_value)
+{
+	if ((p_offset + sizeof(T)) > p_payload.size())
+		return false;
+	std::memcpy(&p_value, &p_payload[p_offset], sizeof(T));
+	p_offset += sizeof(T);
+	return true;
+}
+
+
+bool read_string(std::vector < std::uint8_t > const &p_payload, std::size_t &p_offset, std::string &p_string)
+{
+	std::uint32_t length;
+	if (!read_value(p_payload, p_offset, length) || ((p_offset + length) > p_payload.size()))
+		return false;
+	p_string.assign(reinterpret_cast < char const * > (&p_payload[p_offset]), length);
+	p_offset += length;
+	return true;
+}
+
+
+void write_header(std::ofstream &p_file)
+{
+	p_file.write(log_file_magic, sizeof(log_file_magic));
+	p_file.write(reinterpret_cast < char const * > (&log_file_version), sizeof(log_file_version));
+}
+
+
+} // unnamed namespace end
+
+
+binary_log_writer::binary_log_writer()
+	: m_file_mode(false)
+	, m_ring_begin(0)
+	, m_ring_size(0)
+{
+}
+
+
+binary_log_writer::~binary_log_writer()
+{
+	close();
+}
+
+
+bool binary_log_writer::open_file(std::string const &p_filename)
+{
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	m_file.close();
+	m_ring.clear();
+	m_call_site_ids.clear();
+	m_call_site_records.clear();
+
+	m_file.open(p_filename, std::ios::binary | std::ios::trunc);
+	m_file_mode = bool(m_file);
+	if (!m_file_mode)
+		return false;
+
+	write_header(m_file);
+	return true;
+}
+
+
+void binary_log_writer::open_ring_buffer(std::size_t const p_capacity)
+{
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	m_file.close();
+	m_file_mode = false;
+	m_call_site_ids.clear();
+	m_call_site_records.clear();
+
+	m_ring.assign(p_capacity, 0);
+	m_ring_begin = 0;
+	m_ring_size = 0;
+}
+
+
+bool binary_log_writer::dump_ring_buffer(std::string const &p_filename)
+{
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	if (m_ring.empty())
+		return false;
+
+	std::ofstream file(p_filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	write_header(file);
+
+	// The call site definitions come first, since the ring buffer
+	// might no longer contain the original definition records
+	for (auto const &record : m_call_site_records)
+		file.write(reinterpret_cast < char const * > (&record[0]), record.size());
+
+	// Write the ring buffer contents, which might wrap around
+	std::size_t first_part_size = std::min(m_ring_size, m_ring.size() - m_ring_begin);
+	file.write(reinterpret_cast < char const * > (&m_ring[m_ring_begin]), first_part_size);
+	if (first_part_size < m_ring_size)
+		file.write(reinterpret_cast < char const * > (&m_ring[0]), m_ring_size - first_part_size);
+
+	return bool(file);
+}
+
+
+void binary_log_writer::close()
+{
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	m_file.close();
+	m_file_mode = false;
+	m_ring.clear();
+	m_ring.shrink_to_fit();
+	m_ring_begin = 0;
+	m_ring_size = 0;
+}
+
+
+void binary_log_writer::write(std::chrono::steady_clock::duration const p_timestamp, log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction, std::string const &p_message)
+{
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	if (!m_file_mode && m_ring.empty())
+		return;
+
+	std::uint32_t call_site_id = get_call_site_id_nolock(p_log_level, p_srcfile, p_srcline, p_srcfunction);
+
+	begin_record(m_record, record_type_message);
+	append_value < std::uint32_t > (m_record, call_site_id);
+	append_value < std::int64_t > (m_record, std::chrono::duration_cast < std::chrono::nanoseconds > (p_timestamp).count());
+	log_context_scope const *scope = get_current_log_context_scope();
+	append_value < std::uint32_t > (m_record, (scope != nullptr) ? scope->get_context().get_id() : 0);
+	append_value < std::uint64_t > (m_record, (scope != nullptr) ? scope->get_token() : 0);
+	m_record.insert(m_record.end(), p_message.begin(), p_message.end());
+	end_record(m_record);
+
+	append_record_nolock(m_record);
+}
+
+
+log_write_function binary_log_writer::get_log_write_function()
+{
+	return [this](std::chrono::steady_clock::duration const p_timestamp, log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction, std::string const &p_message)
+	{
+		write(p_timestamp, p_log_level, p_srcfile, p_srcline, p_srcfunction, p_message);
+	};
+}
+
+
+std::uint32_t binary_log_writer::get_call_site_id_nolock(log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction)
+{
+	call_site_key key(p_srcfile, p_srcline, p_log_level);
+
+	auto iter = m_call_site_ids.find(key);
+	if (iter != m_call_site_ids.end())
+		return iter->second;
+
+	std::uint32_t id = std::uint32_t(m_call_site_ids.size());
+	m_call_site_ids[key] = id;
+
+	std::vector < std::uint8_t > record;
+	begin_record(record, record_type_call_site);
+	append_value < std::uint32_t > (record, id);
+	append_value < std::uint8_t > (record, std::uint8_t(p_log_level));
+	append_value < std::int32_t > (record, p_srcline);
+	append_string(record, p_srcfile, std::strlen(p_srcfile));
+	append_string(record, p_srcfunction, std::strlen(p_srcfunction));
+	end_record(record);
+
+	if (m_file_mode)
+		m_file.write(reinterpret_cast < char const * > (&record[0]), record.size());
+	else
+		m_call_site_records.push_back(std::move(record));
+
+	return id;
+}
+
+
+void binary_log_writer::append_record_nolock(std::vector < std::uint8_t > const &p_record)
+{
+	if (m_file_mode)
+		m_file.write(reinterpret_cast < char const * > (&p_record[0]), p_record.size());
+	else
+		append_to_ring_nolock(p_record);
+}
+
+
+void binary_log_writer::append_to_ring_nolock(std::vector < std::uint8_t > const &p_record)
+{
+	std::size_t capacity = m_ring.size();
+	if (p_record.size() > capacity)
+		return;
+
+	// Drop the oldest records until the new one fits
+	while ((m_ring_size + p_record.size()) > capacity)
+	{
+		std::uint8_t header[record_header_size];
+		for (std::size_t i = 0; i < record_header_size; ++i)
+			header[i] = m_ring[(m_ring_begin + i) % capacity];
+
+		std::uint32_t payload_size;
+		std::memcpy(&payload_size, &header[1], sizeof(payload_size));
+
+		std::size_t record_size = record_header_size + payload_size;
+		m_ring_begin = (m_ring_begin + record_size) % capacity;
+		m_ring_size -= record_size;
+	}
+
+	std::size_t write_offset = (m_ring_begin + m_ring_size) % capacity;
+	std::size_t first_part_size = std::min(p_record.size(), capacity - write_offset);
+	std::memcpy(&m_ring[write_offset], &p_record[0], first_part_size);
+	if (first_part_size < p_record.size())
+		std::memcpy(&m_ring[0], &p_record[first_part_size], p_record.size() - first_part_size);
+
+	m_ring_size += p_record.size();
+}
+
+
+bool binary_log_reader::open(std::string const &p_filename)
+{
+	m_file.close();
+	m_file.clear();
+	m_call_sites.clear();
+
+	m_file.open(p_filename, std::ios::binary);
+	if (!m_file)
+		return false;
+
+	char magic[4];
+	std::uint32_t version;
+	m_file.read(magic, sizeof(magic));
+	m_file.read(reinterpret_cast < char * > (&version), sizeof(version));
+
+	return m_file && (std::memcmp(magic, log_file_magic, sizeof(magic)) == 0) && (version == log_file_version);
+}
+
+
+bool binary_log_reader::read_next(entry &p_entry)
+{
+	std::vector < std::uint8_t > payload;
+
+	while (true)
+	{
+		std::uint8_t type;
+		std::uint32_t payload_size;
+		m_file.read(reinterpret_cast < char * > (&type), sizeof(type));
+		m_file.read(reinterpret_cast < char * > (&payload_size), sizeof(payload_size));
+		if (!m_file)
+			return false;
+
+		payload.resize(payload_size);
+		if (payload_size > 0)
+			m_file.read(reinterpret_cast < char * > (&payload[0]), payload_size);
+		if (!m_file)
+			return false;
+
+		std::size_t offset = 0;
+
+		switch (type)
+		{
+			case record_type_call_site:
+			{
+				std::uint32_t id;
+				std::uint8_t log_level;
+				std::int32_t srcline;
+				call_site site;
+
+				if (!read_value(payload, offset, id) || !read_value(payload, offset, log_level) || !read_value(payload, offset, srcline) || !read_string(payload, offset, site.m_srcfile) || !read_string(payload, offset, site.m_srcfunction))
+					return false;
+
+				site.m_log_level = log_levels(log_level);
+				site.m_srcline = srcline;
+				m_call_sites[id] = site;
+				break;
+			}
+
+			case record_type_message:
+			{
+				std::uint32_t call_site_id;
+				std::int64_t timestamp;
+
+				if (!read_value(payload, offset, call_site_id) || !read_value(payload, offset, timestamp) || !read_value(payload, offset, p_entry.m_pipeline_id) || !read_value(payload, offset, p_entry.m_token))
+					return false;
+
+				auto iter = m_call_sites.find(call_site_id);
+				if (iter == m_call_sites.end())
+					return false;
+
+				p_entry.m_timestamp = std::chrono::duration_cast < std::chrono::steady_clock::duration > (std::chrono::nanoseconds(timestamp));
+				p_entry.m_log_level = iter->second.m_log_level;
+				p_entry.m_srcfile = iter->second.m_srcfile;
+				p_entry.m_srcline = iter->second.m_srcline;
+				p_entry.m_srcfunction = iter->second.m_srcfunction;
+				p_entry.m_message.assign(reinterpret_cast < char const * > (payload.data() + offset), payload.size() - offset);
+				return true;
+			}
+
+			default:
+				// Unknown record types are skipped, so newer
+				// writers stay compatible with older readers
+				break;
+		}
+	}
+}
+
+
+} // namespace nxplay end
@@ -0,0 +1,158 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_BINARY_LOG_HPP
+#define NXPLAY_BINARY_LOG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "log.hpp"
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Writes log messages in a compact binary format.
+/**
+ * This is an alternative to the default stderr output that avoids all text
+ * formatting and padding at log time. Each source location is written only
+ * once, as a call site definition record with an ID; messages then only
+ * refer to this ID. Every message record contains a nanosecond timestamp,
+ * the pipeline ID and media token of the active log_context_scope (0 if
+ * there is none), and the message text. Use binary_log_reader
+ * (or the log-decoder tool) to turn the records into text again.
+ *
+ * The writer can either append records to a file, or keep the most recent
+ * records in a fixed-size in-memory ring buffer that can be dumped to a file
+ * on demand (for example, after an error was detected). The latter makes it
+ * possible to keep trace-level logging enabled in production.
+ *
+ * All functions are thread safe. To route log messages to the writer:
+ *
+ * @code
+ * nxplay::binary_log_writer writer;
+ * writer.open_ring_buffer(4 * 1024 * 1024);
+ * nxplay::set_log_write_function(writer.get_log_write_function());
+ * @endcode
+ *
+ * The writer must outlive its use as the log write function.
+ */
+class binary_log_writer
+{
+public:
+	binary_log_writer();
+	~binary_log_writer();
+
+	/// Opens a log file; records are appended to it as they are written. Closes any previously opened output.
+	bool open_file(std::string const &p_filename);
+	/// Sets up an in-memory ring buffer with the given capacity in bytes. Closes any previously opened output.
+	void open_ring_buffer(std::size_t const p_capacity);
+	/// Writes the current contents of the ring buffer to a log file.
+	/**
+	 * The ring buffer itself is not modified.
+	 *
+	 * @return true if writing succeeded, false if it failed or no ring buffer is open
+	 */
+	bool dump_ring_buffer(std::string const &p_filename);
+	/// Closes the file or ring buffer; subsequent records are discarded.
+	void close();
+
+	/// Writes a message record. The arguments correspond to those of log_write_function.
+	void write(std::chrono::steady_clock::duration const p_timestamp, log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction, std::string const &p_message);
+
+	/// Returns a log write function that calls write().
+	log_write_function get_log_write_function();
+
+private:
+	binary_log_writer(binary_log_writer const &) = delete;
+	binary_log_writer& operator = (binary_log_writer const &) = delete;
+
+	typedef std::tuple < char const *, int, log_levels > call_site_key;
+
+	std::uint32_t get_call_site_id_nolock(log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction);
+	void append_record_nolock(std::vector < std::uint8_t > const &p_record);
+	void append_to_ring_nolock(std::vector < std::uint8_t > const &p_record);
+
+	std::mutex m_mutex;
+
+	// Call sites are keyed by the source file string pointer; since these
+	// come from __FILE__, the pointers are stable and unique per file
+	std::map < call_site_key, std::uint32_t > m_call_site_ids;
+	// Definition records of all call sites; in ring buffer mode, these are
+	// kept here, since the ring buffer might overwrite them
+	std::vector < std::vector < std::uint8_t > > m_call_site_records;
+
+	std::ofstream m_file;
+	bool m_file_mode;
+
+	std::vector < std::uint8_t > m_ring;
+	std::size_t m_ring_begin, m_ring_size;
+
+	// Scratch space for records, to avoid allocations per message
+	std::vector < std::uint8_t > m_record;
+};
+
+
+/// Reads log files written by binary_log_writer.
+class binary_log_reader
+{
+public:
+	/// One decoded message record.
+	struct entry
+	{
+		std::chrono::steady_clock::duration m_timestamp;
+		log_levels m_log_level;
+		std::string m_srcfile;
+		int m_srcline;
+		std::string m_srcfunction;
+		std::uint32_t m_pipeline_id;
+		std::uint64_t m_token;
+		std::string m_message;
+	};
+
+	/// Opens and validates the given log file.
+	bool open(std::string const &p_filename);
+
+	/// Reads the next message record.
+	/**
+	 * Call site definition records are processed internally.
+	 *
+	 * @return true if a message was read, false at the end of the file or if the file is corrupted
+	 */
+	bool read_next(entry &p_entry);
+
+private:
+	struct call_site
+	{
+		log_levels m_log_level;
+		std::string m_srcfile;
+		int m_srcline;
+		std::string m_srcfunction;
+	};
+
+	std::ifstream m_file;
+	std::map < std::uint32_t, call_site > m_call_sites;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
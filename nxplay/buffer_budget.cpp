@@ -0,0 +1,171 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "buffer_budget.hpp"
+#include "log.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+// Lower bound for grants. A queue2 max-size-bytes value of 0 would mean
+// "unlimited", and tiny buffers cause constant rebuffering, so never go
+// below this value, even if it means exceeding the budget.
+guint const min_grant = 64 * 1024;
+
+
+struct budget_internal
+{
+	static budget_internal& instance()
+	{
+		static budget_internal budget;
+		return budget;
+	}
+
+	// Must be called with the mutex locked
+	void redistribute()
+	{
+		// Serve clients in order of priority. stable_sort keeps the
+		// registration order among clients with the same priority.
+		std::vector < buffer_budget_client* > sorted_clients(m_clients);
+		std::stable_sort(sorted_clients.begin(), sorted_clients.end(), [](buffer_budget_client const *p_first, buffer_budget_client const *p_second)
+		{
+			return p_first->get_priority() < p_second->get_priority();
+		});
+
+		guint64 remaining = m_budget ? *m_budget : G_MAXUINT64;
+
+		for (auto client : sorted_clients)
+		{
+			guint requested = client->get_requested();
+			guint granted = requested;
+
+			if (m_budget)
+			{
+				granted = guint(std::min(guint64(requested), remaining));
+				granted = std::max(granted, std::min(requested, min_grant));
+				remaining -= std::min(guint64(granted), remaining);
+			}
+
+			guint old_granted = client->get_granted();
+			if (client->set_granted(granted))
+			{
+				NXPLAY_LOG_MSG(debug, "buffer budget grant for client " << guintptr(client) << " changed from " << old_granted << " to " << granted << " bytes (requested: " << requested << " bytes)");
+				client->notify_grant_changed();
+			}
+		}
+	}
+
+	std::mutex m_mutex;
+	boost::optional < guint64 > m_budget;
+	std::vector < buffer_budget_client* > m_clients;
+};
+
+
+} // unnamed namespace end
+
+
+void set_global_buffer_budget(boost::optional < guint64 > const &p_budget)
+{
+	budget_internal &budget = budget_internal::instance();
+	std::unique_lock < std::mutex > lock(budget.m_mutex);
+	budget.m_budget = p_budget;
+	budget.redistribute();
+}
+
+
+boost::optional < guint64 > get_global_buffer_budget()
+{
+	budget_internal &budget = budget_internal::instance();
+	std::unique_lock < std::mutex > lock(budget.m_mutex);
+	return budget.m_budget;
+}
+
+
+buffer_budget_client::buffer_budget_client(grant_changed_callback const &p_grant_changed_callback)
+	: m_grant_changed_callback(p_grant_changed_callback)
+	, m_requested(0)
+	, m_priority(buffer_priority_next_paused)
+	, m_granted(0)
+{
+	budget_internal &budget = budget_internal::instance();
+	std::unique_lock < std::mutex > lock(budget.m_mutex);
+	budget.m_clients.push_back(this);
+}
+
+
+buffer_budget_client::~buffer_budget_client()
+{
+	budget_internal &budget = budget_internal::instance();
+	std::unique_lock < std::mutex > lock(budget.m_mutex);
+
+	auto iter = std::find(budget.m_clients.begin(), budget.m_clients.end(), this);
+	if (iter != budget.m_clients.end())
+		budget.m_clients.erase(iter);
+
+	// Give the bytes of this client back to the others
+	budget.redistribute();
+}
+
+
+void buffer_budget_client::set_request(guint const p_requested_bytes, buffer_priorities const p_priority)
+{
+	budget_internal &budget = budget_internal::instance();
+	std::unique_lock < std::mutex > lock(budget.m_mutex);
+
+	if ((m_requested == p_requested_bytes) && (m_priority == p_priority))
+		return;
+
+	m_requested = p_requested_bytes;
+	m_priority = p_priority;
+
+	budget.redistribute();
+}
+
+
+guint buffer_budget_client::get_granted() const
+{
+	return m_granted.load();
+}
+
+
+guint buffer_budget_client::get_requested() const
+{
+	return m_requested;
+}
+
+
+buffer_priorities buffer_budget_client::get_priority() const
+{
+	return m_priority;
+}
+
+
+bool buffer_budget_client::set_granted(guint const p_granted)
+{
+	return m_granted.exchange(p_granted) != p_granted;
+}
+
+
+void buffer_budget_client::notify_grant_changed()
+{
+	if (m_grant_changed_callback)
+		m_grant_changed_callback();
+}
+
+
+} // namespace nxplay end
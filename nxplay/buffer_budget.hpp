@@ -0,0 +1,106 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_BUFFER_BUDGET_HPP
+#define NXPLAY_BUFFER_BUDGET_HPP
+
+#include <atomic>
+#include <functional>
+#include <gst/gst.h>
+#include <boost/optional.hpp>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Priorities for allocations from the global buffer budget.
+/**
+ * Lower values are served first. Current streams come before next streams,
+ * and streams of playing pipelines come before those of paused/idle ones.
+ */
+enum buffer_priorities
+{
+	buffer_priority_current_playing = 0,
+	buffer_priority_current_paused,
+	buffer_priority_next_playing,
+	buffer_priority_next_paused
+};
+
+
+/// Sets the process-wide budget for stream buffers, in bytes.
+/**
+ * Each stream's buffer size is normally defined by its own playback_properties.
+ * If a global budget is set, the buffer sizes of all streams in all pipelines
+ * are additionally capped so their sum stays within the budget. Streams with
+ * higher priority (see buffer_priorities) get their requested size first;
+ * lower priority streams get what is left. Every stream always gets at least
+ * a small minimum size, so the budget can be exceeded slightly if there are
+ * many streams.
+ *
+ * Once streams go away or lower their requests, the freed bytes are given back
+ * to the other streams.
+ *
+ * Budget changes take effect asynchronously; the pipelines apply the new
+ * limits in their internal threads.
+ *
+ * @param p_budget New budget in bytes, or boost::none to disable the budget
+ *        (this is the default)
+ */
+void set_global_buffer_budget(boost::optional < guint64 > const &p_budget);
+/// Returns the currently set global buffer budget, or boost::none if none is set.
+boost::optional < guint64 > get_global_buffer_budget();
+
+
+/// Participant in the global buffer budget.
+/**
+ * Each stream owns one client. The client announces how many bytes the stream
+ * would like to use and with what priority, and receives the number of bytes
+ * it is allowed to use. If the granted value changes because of other clients,
+ * the grant changed callback is invoked. This callback may be called from any
+ * thread while internal locks are held, so it must not block; typically it
+ * just schedules an update.
+ */
+class buffer_budget_client
+{
+public:
+	typedef std::function < void() > grant_changed_callback;
+
+	explicit buffer_budget_client(grant_changed_callback const &p_grant_changed_callback);
+	~buffer_budget_client();
+
+	/// Updates the request. If the values changed, the budget is redistributed.
+	void set_request(guint const p_requested_bytes, buffer_priorities const p_priority);
+	/// Returns the number of bytes this client may currently use.
+	guint get_granted() const;
+
+	// Used internally by the budget governor
+	guint get_requested() const;
+	buffer_priorities get_priority() const;
+	bool set_granted(guint const p_granted);
+	void notify_grant_changed();
+
+private:
+	buffer_budget_client(buffer_budget_client const &) = delete;
+	buffer_budget_client& operator = (buffer_budget_client const &) = delete;
+
+	grant_changed_callback m_grant_changed_callback;
+	guint m_requested;
+	buffer_priorities m_priority;
+	std::atomic < guint > m_granted;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <assert.h>
+#include <cmath>
+#include "fft.hpp"
+
+
+namespace nxplay
+{
+
+
+real_fft::real_fft(std::size_t const p_size)
+	: m_size(p_size)
+	, m_half_size(p_size / 2)
+	, m_window(p_size)
+	, m_bit_reversal(p_size / 2)
+	, m_twiddle_re(p_size / 2)
+	, m_twiddle_im(p_size / 2)
+	, m_split_re(p_size / 2 + 1)
+	, m_split_im(p_size / 2 + 1)
+	, m_work_re(p_size / 2)
+	, m_work_im(p_size / 2)
+{
+	assert((p_size >= 4) && ((p_size & (p_size - 1)) == 0));
+
+	double window_sum = 0.0;
+	for (std::size_t i = 0; i < m_size; ++i)
+	{
+		m_window[i] = float(0.5 - 0.5 * std::cos(2.0 * M_PI * i / m_size));
+		window_sum += m_window[i];
+	}
+
+	// A full scale sine has a spectral peak magnitude of window_sum / 2
+	m_normalization = float(4.0 / (window_sum * window_sum));
+
+	std::size_t num_bits = 0;
+	while ((std::size_t(1) << num_bits) < m_half_size)
+		++num_bits;
+	for (std::size_t i = 0; i < m_half_size; ++i)
+	{
+		std::size_t reversed = 0;
+		for (std::size_t bit = 0; bit < num_bits; ++bit)
+		{
+			if (i & (std::size_t(1) << bit))
+				reversed |= std::size_t(1) << (num_bits - 1 - bit);
+		}
+		m_bit_reversal[i] = reversed;
+	}
+
+	// Twiddles for the size N/2 complex FFT
+	for (std::size_t i = 0; i < m_half_size; ++i)
+	{
+		m_twiddle_re[i] = float(std::cos(-2.0 * M_PI * i / m_half_size));
+		m_twiddle_im[i] = float(std::sin(-2.0 * M_PI * i / m_half_size));
+	}
+
+	// Twiddles for the final split step (based on the full size N)
+	for (std::size_t i = 0; i <= m_half_size; ++i)
+	{
+		m_split_re[i] = float(std::cos(-2.0 * M_PI * i / m_size));
+		m_split_im[i] = float(std::sin(-2.0 * M_PI * i / m_size));
+	}
+}
+
+
+std::size_t real_fft::get_size() const
+{
+	return m_size;
+}
+
+
+std::size_t real_fft::get_num_bins() const
+{
+	return m_half_size + 1;
+}
+
+
+void real_fft::compute_power_spectrum(float const *p_input, float *p_power)
+{
+	float *re = &m_work_re[0];
+	float *im = &m_work_im[0];
+
+	// Pack even samples into the real parts and odd samples into the
+	// imaginary parts, apply the window, and reorder for the iterative FFT
+	for (std::size_t i = 0; i < m_half_size; ++i)
+	{
+		std::size_t j = m_bit_reversal[i];
+		re[j] = p_input[i * 2 + 0] * m_window[i * 2 + 0];
+		im[j] = p_input[i * 2 + 1] * m_window[i * 2 + 1];
+	}
+
+	// Iterative radix-2 decimation-in-time FFT of size N/2
+	for (std::size_t length = 2; length <= m_half_size; length *= 2)
+	{
+		std::size_t half_length = length / 2;
+		std::size_t twiddle_step = m_half_size / length;
+
+		for (std::size_t start = 0; start < m_half_size; start += length)
+		{
+			float *re_a = re + start, *im_a = im + start;
+			float *re_b = re_a + half_length, *im_b = im_a + half_length;
+
+			for (std::size_t k = 0; k < half_length; ++k)
+			{
+				float tw_re = m_twiddle_re[k * twiddle_step];
+				float tw_im = m_twiddle_im[k * twiddle_step];
+				float t_re = re_b[k] * tw_re - im_b[k] * tw_im;
+				float t_im = re_b[k] * tw_im + im_b[k] * tw_re;
+				re_b[k] = re_a[k] - t_re;
+				im_b[k] = im_a[k] - t_im;
+				re_a[k] += t_re;
+				im_a[k] += t_im;
+			}
+		}
+	}
+
+	// Split step: get the spectrum of the real input out of the
+	// spectrum of the packed complex sequence
+	for (std::size_t k = 0; k <= m_half_size; ++k)
+	{
+		std::size_t k1 = (k == m_half_size) ? 0 : k;
+		std::size_t k2 = (k == 0) ? 0 : (m_half_size - k);
+
+		// even part: (Z[k] + conj(Z[N/2-k])) / 2
+		float even_re = (re[k1] + re[k2]) * 0.5f;
+		float even_im = (im[k1] - im[k2]) * 0.5f;
+		// odd part: (Z[k] - conj(Z[N/2-k])) / 2i
+		float odd_re = (im[k1] + im[k2]) * 0.5f;
+		float odd_im = (re[k2] - re[k1]) * 0.5f;
+
+		float x_re = even_re + m_split_re[k] * odd_re - m_split_im[k] * odd_im;
+		float x_im = even_im + m_split_re[k] * odd_im + m_split_im[k] * odd_re;
+
+		p_power[k] = (x_re * x_re + x_im * x_im) * m_normalization;
+	}
+}
+
+
+} // namespace nxplay end
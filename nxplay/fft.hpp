@@ -0,0 +1,69 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_FFT_HPP
+#define NXPLAY_FFT_HPP
+
+#include <cstddef>
+#include <vector>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// FFT for real-valued input, producing power spectra.
+/**
+ * The transform of N real samples is computed with a complex FFT of size N/2
+ * and a final split step. Data is kept in separate real/imaginary arrays, so
+ * the butterfly loops operate on contiguous floats and can be vectorized by
+ * the compiler. Twiddle factors, the bit reversal table and the window are
+ * precomputed in the constructor.
+ *
+ * Instances contain work buffers, so one instance must not be used by
+ * multiple threads at the same time.
+ */
+class real_fft
+{
+public:
+	/// Sets up the FFT for the given size, which must be a power of two and at least 4.
+	explicit real_fft(std::size_t const p_size);
+
+	/// Returns the number of input samples.
+	std::size_t get_size() const;
+	/// Returns the number of output bins (size / 2 + 1).
+	std::size_t get_num_bins() const;
+
+	/// Applies a Hann window to the input and computes its power spectrum.
+	/**
+	 * @param p_input get_size() input samples
+	 * @param p_power Array of get_num_bins() values that receives the squared
+	 *        magnitudes, normalized so a full scale sine produces a peak of
+	 *        about 1.0 (ignoring window leakage)
+	 */
+	void compute_power_spectrum(float const *p_input, float *p_power);
+
+private:
+	std::size_t m_size, m_half_size;
+	std::vector < float > m_window;
+	std::vector < std::size_t > m_bit_reversal;
+	std::vector < float > m_twiddle_re, m_twiddle_im;
+	std::vector < float > m_split_re, m_split_im;
+	std::vector < float > m_work_re, m_work_im;
+	float m_normalization;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
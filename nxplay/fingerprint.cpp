@@ -0,0 +1,466 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include "fft.hpp"
+#include "fingerprint.hpp"
+#include "log.hpp"
+#include "offline_decoder.hpp"
+#include "parallel_jobs.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+// Analysis parameters. At 11025 Hz, one frame is ~46 ms, and the
+// FFT bins are ~10.8 Hz wide.
+guint const analysis_rate = 11025;
+std::size_t const fft_size = 1024;
+std::size_t const hop_size = 512;
+
+// Peaks are searched in these bands (bin indices; ~300 Hz to ~5 kHz).
+// One peak at most is picked per band and frame.
+std::size_t const band_edges[] = { 28, 50, 90, 160, 280, 464 };
+std::size_t const num_bands = sizeof(band_edges) / sizeof(std::size_t) - 1;
+// Peaks must be this many dB above the frame's mean level
+float const peak_threshold = 10.0f;
+
+// Each peak is paired with up to this many peaks in the following frames
+std::size_t const fan_out = 5;
+guint32 const max_time_delta = 63;
+
+// Hashes that occur more often than this in the index carry almost no
+// information, and are skipped during lookups
+std::size_t const max_postings_per_hash = 5000;
+
+char const index_file_magic[4] = { 'N', 'X', 'F', 'P' };
+guint32 const index_file_version = 1;
+std::size_t const index_file_header_size = 24;
+std::size_t const index_media_entry_size = 8;
+std::size_t const index_posting_size = 12;
+
+
+struct peak
+{
+	guint32 m_frame;
+	guint32 m_bin;
+};
+
+
+template < typename T >
+void write_value(std::vector < guint8 > &p_data, std::size_t const p_offset, T const p_value)
+{
+	std::memcpy(&p_data[p_offset], &p_value, sizeof(T));
+}
+
+
+template < typename T >
+T read_value(guint8 const *p_data, std::size_t const p_offset)
+{
+	T value;
+	std::memcpy(&value, p_data + p_offset, sizeof(T));
+	return value;
+}
+
+
+void find_peaks(std::vector < float > const &p_power, guint32 const p_frame, std::vector < peak > &p_peaks)
+{
+	std::size_t first_bin = band_edges[0], last_bin = band_edges[num_bands];
+
+	std::vector < float > levels(last_bin + 1);
+	float mean_level = 0.0f;
+	for (std::size_t bin = first_bin - 1; bin <= last_bin; ++bin)
+	{
+		levels[bin] = 10.0f * std::log10(p_power[bin] + 1e-10f);
+		if (bin >= first_bin)
+			mean_level += levels[bin];
+	}
+	mean_level /= (last_bin - first_bin + 1);
+
+	for (std::size_t band = 0; band < num_bands; ++band)
+	{
+		std::size_t best_bin = band_edges[band];
+		for (std::size_t bin = band_edges[band] + 1; bin < band_edges[band + 1]; ++bin)
+		{
+			if (levels[bin] > levels[best_bin])
+				best_bin = bin;
+		}
+
+		bool is_local_maximum = (levels[best_bin] >= levels[best_bin - 1]) && (levels[best_bin] >= levels[best_bin + 1]);
+		if (is_local_maximum && (levels[best_bin] > (mean_level + peak_threshold)))
+		{
+			peak new_peak;
+			new_peak.m_frame = p_frame;
+			new_peak.m_bin = guint32(best_bin);
+			p_peaks.push_back(new_peak);
+		}
+	}
+}
+
+
+} // unnamed namespace end
+
+
+double get_fingerprint_frame_duration()
+{
+	return double(hop_size) / analysis_rate;
+}
+
+
+bool compute_fingerprint(std::string const &p_uri, fingerprint &p_fingerprint)
+{
+	real_fft fft(fft_size);
+	std::vector < float > samples;
+	std::vector < float > power(fft.get_num_bins());
+	std::vector < peak > peaks;
+	guint32 frame = 0;
+
+	p_fingerprint.clear();
+
+	// Compute the spectrogram frame by frame while decoding, and
+	// only keep the peaks
+	bool success = decode_media_offline(p_uri, [&](decoded_format const &, float const *p_samples, std::size_t const p_num_frames)
+	{
+		samples.insert(samples.end(), p_samples, p_samples + p_num_frames);
+
+		std::size_t offset = 0;
+		for (; (offset + fft_size) <= samples.size(); offset += hop_size)
+		{
+			fft.compute_power_spectrum(&samples[offset], &power[0]);
+			find_peaks(power, frame++, peaks);
+		}
+		samples.erase(samples.begin(), samples.begin() + offset);
+
+		return true;
+	}, analysis_rate, 1);
+
+	if (!success)
+		return false;
+
+	// Pair each peak with the next peaks that follow it in time
+	for (std::size_t i = 0; i < peaks.size(); ++i)
+	{
+		std::size_t num_pairs = 0;
+		for (std::size_t j = i + 1; (j < peaks.size()) && (num_pairs < fan_out); ++j)
+		{
+			guint32 time_delta = peaks[j].m_frame - peaks[i].m_frame;
+			if (time_delta == 0)
+				continue;
+			if (time_delta > max_time_delta)
+				break;
+
+			fingerprint_hash hash;
+			hash.m_hash = (peaks[i].m_bin << 16) | (peaks[j].m_bin << 6) | time_delta;
+			hash.m_time = peaks[i].m_frame;
+			p_fingerprint.push_back(hash);
+			++num_pairs;
+		}
+	}
+
+	NXPLAY_LOG_MSG(debug, "computed fingerprint with " << p_fingerprint.size() << " hashes out of " << frame << " frames for media with URI " << p_uri);
+
+	return true;
+}
+
+
+fingerprinted_media::fingerprinted_media()
+	: m_is_valid(false)
+{
+}
+
+
+std::vector < fingerprinted_media > compute_fingerprints(std::vector < std::string > const &p_uris, unsigned int const p_num_threads)
+{
+	std::vector < fingerprinted_media > results(p_uris.size());
+
+	run_parallel_jobs(p_uris.size(), p_num_threads, [&](std::size_t const p_index)
+	{
+		fingerprinted_media &result = results[p_index];
+		result.m_uri = p_uris[p_index];
+		result.m_is_valid = compute_fingerprint(result.m_uri, result.m_fingerprint);
+		if (!result.m_is_valid)
+			NXPLAY_LOG_MSG(warning, "could not fingerprint media with URI " << result.m_uri);
+	});
+
+	return results;
+}
+
+
+bool write_fingerprint_index(std::string const &p_filename, std::vector < fingerprinted_media > const &p_media)
+{
+	struct posting
+	{
+		guint32 m_hash, m_media_index, m_time;
+	};
+
+	std::vector < posting > postings;
+	std::string string_table;
+	std::vector < guint8 > media_table(p_media.size() * index_media_entry_size);
+
+	for (std::size_t i = 0; i < p_media.size(); ++i)
+	{
+		write_value < guint32 > (media_table, i * index_media_entry_size + 0, guint32(string_table.size()));
+		write_value < guint32 > (media_table, i * index_media_entry_size + 4, guint32(p_media[i].m_uri.size()));
+		string_table += p_media[i].m_uri;
+
+		for (auto const &hash : p_media[i].m_fingerprint)
+		{
+			posting new_posting = { hash.m_hash, guint32(i), hash.m_time };
+			postings.push_back(new_posting);
+		}
+	}
+
+	std::sort(postings.begin(), postings.end(), [](posting const &p_first, posting const &p_second)
+	{
+		if (p_first.m_hash != p_second.m_hash)
+			return p_first.m_hash < p_second.m_hash;
+		if (p_first.m_media_index != p_second.m_media_index)
+			return p_first.m_media_index < p_second.m_media_index;
+		return p_first.m_time < p_second.m_time;
+	});
+
+	std::size_t postings_offset = index_file_header_size + media_table.size();
+
+	std::vector < guint8 > header(index_file_header_size);
+	std::memcpy(&header[0], index_file_magic, sizeof(index_file_magic));
+	write_value < guint32 > (header, 4, index_file_version);
+	write_value < guint32 > (header, 8, guint32(p_media.size()));
+	write_value < guint32 > (header, 12, guint32(postings.size()));
+	write_value < guint32 > (header, 16, guint32(postings_offset));
+	write_value < guint32 > (header, 20, guint32(postings_offset + postings.size() * index_posting_size));
+
+	std::vector < guint8 > posting_table(postings.size() * index_posting_size);
+	for (std::size_t i = 0; i < postings.size(); ++i)
+	{
+		write_value < guint32 > (posting_table, i * index_posting_size + 0, postings[i].m_hash);
+		write_value < guint32 > (posting_table, i * index_posting_size + 4, postings[i].m_media_index);
+		write_value < guint32 > (posting_table, i * index_posting_size + 8, postings[i].m_time);
+	}
+
+	std::ofstream file(p_filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		NXPLAY_LOG_MSG(error, "could not open fingerprint index file " << p_filename << " for writing");
+		return false;
+	}
+
+	file.write(reinterpret_cast < char const * > (&header[0]), header.size());
+	if (!media_table.empty())
+		file.write(reinterpret_cast < char const * > (&media_table[0]), media_table.size());
+	if (!posting_table.empty())
+		file.write(reinterpret_cast < char const * > (&posting_table[0]), posting_table.size());
+	file.write(string_table.data(), string_table.size());
+
+	if (!file)
+	{
+		NXPLAY_LOG_MSG(error, "could not write fingerprint index file " << p_filename);
+		return false;
+	}
+
+	NXPLAY_LOG_MSG(debug, "wrote fingerprint index with " << p_media.size() << " media and " << postings.size() << " postings to " << p_filename);
+
+	return true;
+}
+
+
+fingerprint_index::fingerprint_index()
+	: m_mapped_file(nullptr)
+	, m_data(nullptr)
+	, m_size(0)
+	, m_num_media(0)
+	, m_num_postings(0)
+	, m_postings_offset(0)
+	, m_string_table_offset(0)
+{
+}
+
+
+fingerprint_index::~fingerprint_index()
+{
+	close();
+}
+
+
+bool fingerprint_index::open(std::string const &p_filename)
+{
+	close();
+
+	GError *error = nullptr;
+	m_mapped_file = g_mapped_file_new(p_filename.c_str(), FALSE, &error);
+	if (m_mapped_file == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not open fingerprint index file " << p_filename << ": " << error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	m_data = reinterpret_cast < guint8 const * > (g_mapped_file_get_contents(m_mapped_file));
+	m_size = g_mapped_file_get_length(m_mapped_file);
+
+	if ((m_size < index_file_header_size) || (std::memcmp(m_data, index_file_magic, sizeof(index_file_magic)) != 0) || (read_value < guint32 > (m_data, 4) != index_file_version))
+	{
+		NXPLAY_LOG_MSG(error, "file " << p_filename << " is not a valid fingerprint index file");
+		close();
+		return false;
+	}
+
+	m_num_media = read_value < guint32 > (m_data, 8);
+	m_num_postings = read_value < guint32 > (m_data, 12);
+	m_postings_offset = read_value < guint32 > (m_data, 16);
+	m_string_table_offset = read_value < guint32 > (m_data, 20);
+
+	if ((m_postings_offset != (index_file_header_size + m_num_media * index_media_entry_size)) || (m_string_table_offset != (m_postings_offset + m_num_postings * index_posting_size)) || (m_size < m_string_table_offset))
+	{
+		NXPLAY_LOG_MSG(error, "fingerprint index file " << p_filename << " is truncated or corrupted");
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+
+void fingerprint_index::close()
+{
+	if (m_mapped_file != nullptr)
+	{
+		g_mapped_file_unref(m_mapped_file);
+		m_mapped_file = nullptr;
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_num_media = 0;
+	m_num_postings = 0;
+	m_postings_offset = 0;
+	m_string_table_offset = 0;
+}
+
+
+bool fingerprint_index::is_open() const
+{
+	return m_mapped_file != nullptr;
+}
+
+
+std::size_t fingerprint_index::get_num_media() const
+{
+	return m_num_media;
+}
+
+
+std::string fingerprint_index::get_uri(std::size_t const p_media_index) const
+{
+	if (p_media_index >= m_num_media)
+		return std::string();
+
+	std::size_t entry_offset = index_file_header_size + p_media_index * index_media_entry_size;
+	std::size_t uri_offset = m_string_table_offset + read_value < guint32 > (m_data, entry_offset + 0);
+	std::size_t uri_length = read_value < guint32 > (m_data, entry_offset + 4);
+
+	if ((uri_offset + uri_length) > m_size)
+		return std::string();
+
+	return std::string(reinterpret_cast < char const * > (m_data + uri_offset), uri_length);
+}
+
+
+std::vector < fingerprint_index::match > fingerprint_index::lookup(fingerprint const &p_query, std::size_t const p_max_num_matches, guint32 const p_min_score) const
+{
+	std::vector < match > matches;
+	if (!is_open())
+		return matches;
+
+	auto posting_hash = [&](std::size_t const p_index)
+	{
+		return read_value < guint32 > (m_data, m_postings_offset + p_index * index_posting_size);
+	};
+
+	// Count matches per (media, time offset) pair. The key contains the
+	// media index in the upper 32 bits and the time offset (biased to
+	// make it unsigned) in the lower 32 bits.
+	std::unordered_map < guint64, guint32 > offset_counts;
+
+	for (auto const &query_hash : p_query)
+	{
+		// Binary search for the first posting with this hash
+		std::size_t low = 0, high = m_num_postings;
+		while (low < high)
+		{
+			std::size_t middle = low + (high - low) / 2;
+			if (posting_hash(middle) < query_hash.m_hash)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+
+		std::size_t end = low;
+		while ((end < m_num_postings) && (posting_hash(end) == query_hash.m_hash) && ((end - low) <= max_postings_per_hash))
+			++end;
+		if ((end - low) > max_postings_per_hash)
+			continue;
+
+		for (std::size_t i = low; i < end; ++i)
+		{
+			std::size_t offset = m_postings_offset + i * index_posting_size;
+			guint32 media_index = read_value < guint32 > (m_data, offset + 4);
+			guint32 time = read_value < guint32 > (m_data, offset + 8);
+			guint32 biased_time_offset = guint32(gint64(time) - gint64(query_hash.m_time) + G_MAXINT32);
+			++offset_counts[(guint64(media_index) << 32) | biased_time_offset];
+		}
+	}
+
+	// The score of each media is the count of its best time offset
+	std::map < guint32, std::pair < guint32, guint32 > > best_offsets;
+	for (auto const &entry : offset_counts)
+	{
+		guint32 media_index = guint32(entry.first >> 32);
+		auto &best = best_offsets[media_index];
+		if (entry.second > best.first)
+			best = std::make_pair(entry.second, guint32(entry.first & 0xFFFFFFFF));
+	}
+
+	for (auto const &entry : best_offsets)
+	{
+		if (entry.second.first < p_min_score)
+			continue;
+
+		match new_match;
+		new_match.m_media_index = entry.first;
+		new_match.m_score = entry.second.first;
+		new_match.m_time_offset = (gint64(entry.second.second) - G_MAXINT32) * get_fingerprint_frame_duration();
+		matches.push_back(new_match);
+	}
+
+	std::sort(matches.begin(), matches.end(), [](match const &p_first, match const &p_second)
+	{
+		return p_first.m_score > p_second.m_score;
+	});
+
+	if (matches.size() > p_max_num_matches)
+		matches.resize(p_max_num_matches);
+
+	for (auto &found_match : matches)
+		found_match.m_uri = get_uri(found_match.m_media_index);
+
+	return matches;
+}
+
+
+} // namespace nxplay end
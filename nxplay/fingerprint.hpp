@@ -0,0 +1,158 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_FINGERPRINT_HPP
+#define NXPLAY_FINGERPRINT_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// One hash of an audio fingerprint.
+/**
+ * Hashes are built out of pairs of spectral peaks: the frequencies of both
+ * peaks and their distance in time. m_time is the time of the first peak,
+ * in units of fingerprint frames (see get_fingerprint_frame_duration()).
+ */
+struct fingerprint_hash
+{
+	guint32 m_hash;
+	guint32 m_time;
+};
+
+
+/// Audio fingerprint; hashes are sorted by time.
+typedef std::vector < fingerprint_hash > fingerprint;
+
+
+/// Returns the duration of one fingerprint frame, in seconds.
+double get_fingerprint_frame_duration();
+
+
+/// Computes the fingerprint of the given media.
+/**
+ * The media is decoded with decode_media_offline(), downmixed to mono, and
+ * resampled to a low rate. Its spectrogram is computed with real_fft, and
+ * the most prominent spectral peaks are paired to form hashes. Since these
+ * only depend on the relative positions of peaks, they are robust against
+ * different encodings, bitrates, and volume levels.
+ *
+ * GStreamer must have been initialized before calling this function.
+ *
+ * @param p_uri URI of the media to fingerprint
+ * @param p_fingerprint Fingerprint to fill
+ * @return true if fingerprinting succeeded
+ */
+bool compute_fingerprint(std::string const &p_uri, fingerprint &p_fingerprint);
+
+
+/// Fingerprint of one media, as produced by compute_fingerprints().
+struct fingerprinted_media
+{
+	fingerprinted_media();
+
+	std::string m_uri;
+	/// false if the media could not be decoded
+	bool m_is_valid;
+	fingerprint m_fingerprint;
+};
+
+
+/// Computes the fingerprints of many media in parallel.
+/**
+ * @param p_uris URIs of the media to fingerprint
+ * @param p_num_threads Number of worker threads; 0 means one thread per CPU core
+ * @return Fingerprints, in the same order as p_uris
+ */
+std::vector < fingerprinted_media > compute_fingerprints(std::vector < std::string > const &p_uris, unsigned int const p_num_threads = 0);
+
+
+/// Writes an inverted index of the given fingerprints to a file.
+/**
+ * The index maps each hash to the media and times it occurs in. It consists of
+ * a header, a media table, a posting table sorted by hash, and a string table.
+ * Values are stored in host byte order. Use fingerprint_index for lookups.
+ *
+ * @return true if writing succeeded
+ */
+bool write_fingerprint_index(std::string const &p_filename, std::vector < fingerprinted_media > const &p_media);
+
+
+/// Read-only access to fingerprint index files written by write_fingerprint_index().
+/**
+ * The file is memory-mapped, and lookups are done with binary searches directly
+ * in the mapped posting table, so opening is cheap and lookups take only
+ * milliseconds even for large indices.
+ */
+class fingerprint_index
+{
+public:
+	/// Media found by lookup().
+	struct match
+	{
+		std::size_t m_media_index;
+		std::string m_uri;
+		/// Number of hashes that matched with a consistent time offset
+		guint32 m_score;
+		/// Position of the query within the matching media, in seconds
+		double m_time_offset;
+	};
+
+	fingerprint_index();
+	~fingerprint_index();
+
+	/// Opens and validates the given index file. Any previously opened file is closed.
+	bool open(std::string const &p_filename);
+	void close();
+	bool is_open() const;
+
+	/// Returns the number of media in the index.
+	std::size_t get_num_media() const;
+	/// Returns the URI of the media with the given index.
+	std::string get_uri(std::size_t const p_media_index) const;
+
+	/// Looks up media that are similar to the given fingerprint.
+	/**
+	 * For each media, matching hashes are counted per time offset. A media
+	 * that contains the query (or vice versa) produces many matches at the
+	 * same offset, while random hash collisions spread over many offsets.
+	 * The score of a media is the highest count of a single offset.
+	 *
+	 * @param p_query Fingerprint to look up
+	 * @param p_max_num_matches Maximum number of matches to return
+	 * @param p_min_score Minimum score for a media to be considered a match
+	 * @return Matches, sorted by descending score
+	 */
+	std::vector < match > lookup(fingerprint const &p_query, std::size_t const p_max_num_matches = 10, guint32 const p_min_score = 30) const;
+
+private:
+	fingerprint_index(fingerprint_index const &) = delete;
+	fingerprint_index& operator = (fingerprint_index const &) = delete;
+
+	GMappedFile *m_mapped_file;
+	guint8 const *m_data;
+	std::size_t m_size;
+	std::size_t m_num_media, m_num_postings;
+	std::size_t m_postings_offset, m_string_table_offset;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "ingress_scheduler.hpp"
+#include "log.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+typedef std::chrono::steady_clock clock_type;
+
+// Classes which did not receive data for this long do not
+// take part in the sharing anymore, so their share goes
+// to the classes that are still receiving data
+auto const class_idle_timeout = std::chrono::milliseconds(500);
+// Waits are done in slices, to react quickly to changed rates
+// and to pads that start flushing
+auto const wait_slice = std::chrono::milliseconds(20);
+// Length of the window the throughput is measured over
+auto const throughput_window = std::chrono::seconds(1);
+// Unused rate can be saved up for bursts of this duration
+double const max_burst_duration = 0.1;
+// Lower bound for the burst size, so that a single buffer never
+// has to wait longer than its own transfer time
+double const min_burst_size = 16 * 1024;
+
+
+struct class_state
+{
+	class_state()
+		: m_weight(1)
+		, m_tokens(0.0)
+		, m_total_bytes(0)
+		, m_total_delay(0)
+		, m_window_bytes(0)
+		, m_throughput(0)
+		, m_num_clients(0)
+	{
+		m_last_refill = m_last_activity = m_window_start = clock_type::now() - class_idle_timeout;
+	}
+
+	guint m_weight;
+	boost::optional < guint64 > m_limit;
+
+	// Token bucket. Tokens are bytes; they can become negative,
+	// in which case clients wait until the bucket is refilled.
+	double m_tokens;
+	clock_type::time_point m_last_refill;
+	clock_type::time_point m_last_activity;
+
+	guint64 m_total_bytes;
+	guint64 m_total_delay;
+	guint64 m_window_bytes;
+	clock_type::time_point m_window_start;
+	guint64 m_throughput;
+	unsigned int m_num_clients;
+};
+
+
+struct scheduler_internal
+{
+	static scheduler_internal& instance()
+	{
+		static scheduler_internal scheduler;
+		return scheduler;
+	}
+
+	scheduler_internal()
+	{
+		m_classes[ingress_class_current].m_weight = 6;
+		m_classes[ingress_class_next].m_weight = 3;
+		m_classes[ingress_class_probe].m_weight = 1;
+	}
+
+	// All of the functions below must be called with the mutex locked
+
+	bool is_active(int const p_class, clock_type::time_point const p_now) const
+	{
+		return (p_now - m_classes[p_class].m_last_activity) < class_idle_timeout;
+	}
+
+	// Returns the rate of the given class, in bytes per second,
+	// or boost::none if the class is not limited at all
+	boost::optional < double > get_rate(int const p_class, clock_type::time_point const p_now) const
+	{
+		class_state const &state = m_classes[p_class];
+		boost::optional < double > rate;
+
+		if (m_limit)
+		{
+			// Weighted fair sharing between the active classes
+			guint total_weight = 0;
+			for (int i = 0; i < num_ingress_classes; ++i)
+			{
+				if ((i == p_class) || is_active(i, p_now))
+					total_weight += m_classes[i].m_weight;
+			}
+
+			rate = (total_weight == 0) ? double(*m_limit) : (double(*m_limit) * state.m_weight / total_weight);
+		}
+
+		if (state.m_limit)
+			rate = rate ? std::min(*rate, double(*(state.m_limit))) : double(*(state.m_limit));
+
+		return rate;
+	}
+
+	void refill(int const p_class, clock_type::time_point const p_now)
+	{
+		class_state &state = m_classes[p_class];
+		auto rate = get_rate(p_class, p_now);
+
+		if (rate)
+		{
+			double elapsed = std::chrono::duration < double > (p_now - state.m_last_refill).count();
+			double max_tokens = std::max(*rate * max_burst_duration, min_burst_size);
+			state.m_tokens = std::min(state.m_tokens + *rate * elapsed, max_tokens);
+		}
+		else
+			state.m_tokens = 0.0;
+
+		state.m_last_refill = p_now;
+	}
+
+	void account(int const p_class, gsize const p_num_bytes, clock_type::time_point const p_now)
+	{
+		class_state &state = m_classes[p_class];
+
+		state.m_total_bytes += p_num_bytes;
+		state.m_last_activity = p_now;
+
+		auto window_length = p_now - state.m_window_start;
+		if (window_length >= throughput_window)
+		{
+			state.m_throughput = guint64(state.m_window_bytes / std::chrono::duration < double > (window_length).count());
+			state.m_window_bytes = 0;
+			state.m_window_start = p_now;
+		}
+		state.m_window_bytes += p_num_bytes;
+	}
+
+	std::mutex m_mutex;
+	boost::optional < guint64 > m_limit;
+	class_state m_classes[num_ingress_classes];
+};
+
+
+} // unnamed namespace end
+
+
+ingress_class_stats::ingress_class_stats()
+	: m_throughput(0)
+	, m_total_bytes(0)
+	, m_total_delay(0)
+	, m_num_clients(0)
+{
+}
+
+
+void set_global_ingress_limit(boost::optional < guint64 > const &p_limit)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	scheduler.m_limit = p_limit;
+
+	if (p_limit)
+		NXPLAY_LOG_MSG(debug, "global ingress limit set to " << *p_limit << " bytes per second");
+	else
+		NXPLAY_LOG_MSG(debug, "global ingress limit disabled");
+}
+
+
+boost::optional < guint64 > get_global_ingress_limit()
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	return scheduler.m_limit;
+}
+
+
+void set_ingress_class_weight(ingress_classes const p_class, guint const p_weight)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	scheduler.m_classes[p_class].m_weight = p_weight;
+}
+
+
+guint get_ingress_class_weight(ingress_classes const p_class)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	return scheduler.m_classes[p_class].m_weight;
+}
+
+
+void set_ingress_class_limit(ingress_classes const p_class, boost::optional < guint64 > const &p_limit)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	scheduler.m_classes[p_class].m_limit = p_limit;
+}
+
+
+boost::optional < guint64 > get_ingress_class_limit(ingress_classes const p_class)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	return scheduler.m_classes[p_class].m_limit;
+}
+
+
+ingress_class_stats get_ingress_class_stats(ingress_classes const p_class)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+
+	class_state const &state = scheduler.m_classes[p_class];
+	ingress_class_stats stats;
+	stats.m_total_bytes = state.m_total_bytes;
+	stats.m_total_delay = state.m_total_delay;
+	stats.m_num_clients = state.m_num_clients;
+
+	// If the class stopped receiving data, the last finished
+	// window is outdated; use the current one instead
+	auto window_length = clock_type::now() - state.m_window_start;
+	if (window_length >= (throughput_window * 2))
+		stats.m_throughput = guint64(state.m_window_bytes / std::chrono::duration < double > (window_length).count());
+	else
+		stats.m_throughput = state.m_throughput;
+
+	return stats;
+}
+
+
+ingress_client::ingress_client(ingress_classes const p_class)
+	: m_class(p_class)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	++(scheduler.m_classes[p_class].m_num_clients);
+}
+
+
+ingress_client::~ingress_client()
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+	--(scheduler.m_classes[m_class].m_num_clients);
+}
+
+
+void ingress_client::set_class(ingress_classes const p_class)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+
+	int old_class = m_class.exchange(p_class);
+	--(scheduler.m_classes[old_class].m_num_clients);
+	++(scheduler.m_classes[p_class].m_num_clients);
+}
+
+
+ingress_classes ingress_client::get_class() const
+{
+	return ingress_classes(m_class.load());
+}
+
+
+void ingress_client::throttle(gsize const p_num_bytes, GstPad *p_pad)
+{
+	scheduler_internal &scheduler = scheduler_internal::instance();
+	std::unique_lock < std::mutex > lock(scheduler.m_mutex);
+
+	int cls = m_class;
+	class_state &state = scheduler.m_classes[cls];
+
+	auto start = clock_type::now();
+	scheduler.account(cls, p_num_bytes, start);
+	scheduler.refill(cls, start);
+	state.m_tokens -= double(p_num_bytes);
+
+	// Wait until the bucket is no longer in debt. The rate is checked
+	// again after each slice, since other classes may have become
+	// active or inactive in the meantime, changing this class' share.
+	auto now = start;
+	while (state.m_tokens < 0.0)
+	{
+		auto rate = scheduler.get_rate(cls, now);
+		if (!rate)
+		{
+			// Limits were lifted while waiting
+			state.m_tokens = 0.0;
+			break;
+		}
+
+		auto debt_duration = std::chrono::duration < double > ((*rate > 0.0) ? (-state.m_tokens / *rate) : 1.0);
+		auto wait_duration = std::min(std::chrono::duration_cast < clock_type::duration > (debt_duration), std::chrono::duration_cast < clock_type::duration > (wait_slice));
+
+		lock.unlock();
+		std::this_thread::sleep_for(wait_duration);
+		lock.lock();
+
+		now = clock_type::now();
+		// A waiting client still counts as receiving data
+		state.m_last_activity = now;
+		scheduler.refill(cls, now);
+
+		if (GST_PAD_IS_FLUSHING(p_pad))
+			break;
+	}
+
+	state.m_total_delay += std::chrono::duration_cast < std::chrono::nanoseconds > (now - start).count();
+}
+
+
+} // namespace nxplay end
@@ -0,0 +1,143 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_INGRESS_SCHEDULER_HPP
+#define NXPLAY_INGRESS_SCHEDULER_HPP
+
+#include <atomic>
+#include <gst/gst.h>
+#include <boost/optional.hpp>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Classes of ingress traffic, in order of importance.
+enum ingress_classes
+{
+	/// Current streams of playing pipelines
+	ingress_class_current = 0,
+	/// Next streams, and current streams of paused pipelines
+	ingress_class_next,
+	/// Data read for analysis instead of playback (see decode_media_offline())
+	ingress_class_probe,
+
+	num_ingress_classes
+};
+
+
+/// Ingress statistics of one class.
+struct ingress_class_stats
+{
+	/// Throughput over the last second or so, in bytes per second
+	guint64 m_throughput;
+	/// Number of bytes received by this class so far
+	guint64 m_total_bytes;
+	/// Total time clients of this class were delayed to stay within the limits, in nanoseconds
+	guint64 m_total_delay;
+	/// Number of clients currently in this class
+	unsigned int m_num_clients;
+
+	ingress_class_stats();
+};
+
+
+/// Sets the process-wide ingress limit, in bytes per second.
+/**
+ * Normally, all streams in all pipelines read data as fast as the network
+ * allows. On shared links, prefetching by many streams then starves the
+ * streams that are actually playing. If a global limit is set, the
+ * ingress of all streams is shaped so the sum stays within the limit.
+ *
+ * The limit is shared between the ingress classes by their weights (see
+ * set_ingress_class_weight()). Only classes that currently receive data
+ * take part in the sharing, so if for example no next streams are loading,
+ * their share goes to the other classes. Within one class, clients share
+ * the class' rate.
+ *
+ * Streams are throttled by delaying the data as it enters their buffers,
+ * which in turn makes the source read more slowly from the network.
+ *
+ * @param p_limit New limit in bytes per second, or boost::none to disable
+ *        the global limit (this is the default)
+ */
+void set_global_ingress_limit(boost::optional < guint64 > const &p_limit);
+/// Returns the currently set global ingress limit, or boost::none if none is set.
+boost::optional < guint64 > get_global_ingress_limit();
+
+/// Sets the weight of an ingress class.
+/**
+ * The default weights are 6 for ingress_class_current, 3 for
+ * ingress_class_next, and 1 for ingress_class_probe. A weight of 0
+ * makes a class receive nothing while other classes receive data.
+ */
+void set_ingress_class_weight(ingress_classes const p_class, guint const p_weight);
+/// Returns the weight of an ingress class.
+guint get_ingress_class_weight(ingress_classes const p_class);
+
+/// Sets a limit for an ingress class, in bytes per second.
+/**
+ * This limit applies in addition to the class' share of the global limit,
+ * and also works if no global limit is set.
+ *
+ * @param p_class Class to limit
+ * @param p_limit New limit in bytes per second, or boost::none for no
+ *        limit (this is the default)
+ */
+void set_ingress_class_limit(ingress_classes const p_class, boost::optional < guint64 > const &p_limit);
+/// Returns the limit of an ingress class, or boost::none if it has none.
+boost::optional < guint64 > get_ingress_class_limit(ingress_classes const p_class);
+
+/// Returns the ingress statistics of a class.
+ingress_class_stats get_ingress_class_stats(ingress_classes const p_class);
+
+
+/// Participant in the global ingress scheduling.
+/**
+ * Each stream owns one client, which is informed about every chunk of data
+ * the stream receives. If the stream exceeds its share, throttle() blocks
+ * the calling streaming thread for as long as necessary.
+ */
+class ingress_client
+{
+public:
+	explicit ingress_client(ingress_classes const p_class);
+	~ingress_client();
+
+	/// Moves the client to another class.
+	void set_class(ingress_classes const p_class);
+	/// Returns the class the client is currently in.
+	ingress_classes get_class() const;
+
+	/// Accounts for newly received data, and waits if the limits require it.
+	/**
+	 * This is meant to be called from a pad probe. The wait ends early if
+	 * p_pad starts flushing, so that shutting down and seeking are not delayed.
+	 *
+	 * @param p_num_bytes Number of newly received bytes
+	 * @param p_pad Pad the data arrived at
+	 */
+	void throttle(gsize const p_num_bytes, GstPad *p_pad);
+
+private:
+	ingress_client(ingress_client const &) = delete;
+	ingress_client& operator = (ingress_client const &) = delete;
+
+	std::atomic < int > m_class;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -7,6 +7,7 @@
  * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
  */
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <cstring>
@@ -90,8 +91,14 @@ void stderr_logfunc(std::chrono::steady_clock::duration const p_timestamp, log_l
 		std::cerr << std::setfill(' ') << std::setw(location_str_padding) << "";
 	std::cerr << "] ";
 
+	// print the pipeline ID and token if the message belongs to a pipeline
+	std::cerr << "  ";
+	log_context_scope const *scope = get_current_log_context_scope();
+	if (scope != nullptr)
+		std::cerr << "<pipeline " << scope->get_context().get_id() << " token " << scope->get_token() << "> ";
+
 	// print the actual log message
-	std::cerr << "  " << p_message;
+	std::cerr << p_message;
 
 	// end the line
 	std::cerr << "\n";
@@ -119,6 +126,20 @@ struct logger_internal
 };
 
 
+// Rate limiting configuration, in nanoseconds. An emission interval of 0
+// means rate limiting is disabled. These are namespace-scope atomics with
+// constant initialization, so they can be used by log calls made during
+// static initialization.
+std::atomic < std::int64_t > rate_limit_emission_interval(0);
+std::atomic < std::int64_t > rate_limit_burst_window(0);
+
+// List of call sites that dropped messages at least once
+std::atomic < log_rate_limiter* > rate_limited_call_sites(nullptr);
+
+std::atomic < std::uint32_t > next_log_context_id(1);
+thread_local log_context_scope const *current_log_context_scope = nullptr;
+
+
 }
 
 
@@ -186,4 +207,188 @@ log_levels get_min_log_level()
 }
 
 
+log_context::log_context()
+	: m_id(next_log_context_id.fetch_add(1))
+	, m_min_log_level(-1)
+	, m_current_token(0)
+{
+}
+
+
+std::uint32_t log_context::get_id() const
+{
+	return m_id;
+}
+
+
+void log_context::set_min_log_level(log_levels const p_min_log_level)
+{
+	m_min_log_level.store(int(p_min_log_level), std::memory_order_relaxed);
+}
+
+
+void log_context::unset_min_log_level()
+{
+	m_min_log_level.store(-1, std::memory_order_relaxed);
+}
+
+
+bool log_context::is_log_level_enabled(log_levels const p_log_level) const
+{
+	int min_log_level = m_min_log_level.load(std::memory_order_relaxed);
+	if (min_log_level < 0)
+		return p_log_level >= get_min_log_level();
+	else
+		return int(p_log_level) >= min_log_level;
+}
+
+
+void log_context::set_current_token(std::uint64_t const p_token)
+{
+	m_current_token.store(p_token, std::memory_order_relaxed);
+}
+
+
+std::uint64_t log_context::get_current_token() const
+{
+	return m_current_token.load(std::memory_order_relaxed);
+}
+
+
+log_context_scope::log_context_scope(log_context const &p_context)
+	: m_context(p_context)
+	, m_has_token(false)
+	, m_token(0)
+	, m_previous_scope(current_log_context_scope)
+{
+	current_log_context_scope = this;
+}
+
+
+log_context_scope::log_context_scope(log_context const &p_context, std::uint64_t const p_token)
+	: m_context(p_context)
+	, m_has_token(true)
+	, m_token(p_token)
+	, m_previous_scope(current_log_context_scope)
+{
+	current_log_context_scope = this;
+}
+
+
+log_context_scope::~log_context_scope()
+{
+	current_log_context_scope = m_previous_scope;
+}
+
+
+log_context const & log_context_scope::get_context() const
+{
+	return m_context;
+}
+
+
+std::uint64_t log_context_scope::get_token() const
+{
+	return m_has_token ? m_token : m_context.get_current_token();
+}
+
+
+log_context_scope const * get_current_log_context_scope()
+{
+	return current_log_context_scope;
+}
+
+
+bool is_log_level_enabled(log_levels const p_log_level)
+{
+	log_context_scope const *scope = current_log_context_scope;
+	if (scope != nullptr)
+		return scope->get_context().is_log_level_enabled(p_log_level);
+	else
+		return p_log_level >= get_min_log_level();
+}
+
+
+void set_log_rate_limit(double const p_messages_per_second, unsigned int const p_burst_size)
+{
+	assert(p_messages_per_second > 0.0);
+	assert(p_burst_size >= 1);
+
+	std::int64_t emission_interval = std::max(std::int64_t(1), std::int64_t(1000000000.0 / p_messages_per_second));
+	rate_limit_burst_window = emission_interval * p_burst_size;
+	rate_limit_emission_interval = emission_interval;
+}
+
+
+void disable_log_rate_limit()
+{
+	rate_limit_emission_interval = 0;
+}
+
+
+void log_suppressed_message_summaries()
+{
+	for (log_rate_limiter *call_site = rate_limited_call_sites.load(std::memory_order_acquire); call_site != nullptr; call_site = call_site->m_next)
+	{
+		std::uint64_t num_suppressed = call_site->m_num_suppressed.exchange(0);
+		if (num_suppressed != 0)
+			log_message(call_site->m_log_level, call_site->m_srcfile, call_site->m_srcline, call_site->m_srcfunction, std::to_string(num_suppressed) + " message(s) suppressed by rate limiting");
+	}
+}
+
+
+bool log_rate_limiter::acquire(log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction, std::uint64_t &p_num_suppressed)
+{
+	p_num_suppressed = 0;
+
+	std::int64_t emission_interval = rate_limit_emission_interval.load(std::memory_order_relaxed);
+	if (emission_interval == 0)
+		return true;
+
+	std::int64_t burst_window = rate_limit_burst_window.load(std::memory_order_relaxed);
+	std::int64_t now = std::chrono::duration_cast < std::chrono::nanoseconds > (std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	// Each message moves the theoretical arrival time ahead by one emission
+	// interval. If it gets too far ahead of the current time, the bucket is
+	// empty, and the message is dropped.
+	std::int64_t arrival_time = m_theoretical_arrival_time.load(std::memory_order_relaxed);
+	while (true)
+	{
+		std::int64_t new_arrival_time = std::max(arrival_time, now) + emission_interval;
+		if ((new_arrival_time - now) > burst_window)
+		{
+			m_num_suppressed.fetch_add(1, std::memory_order_relaxed);
+			if (!m_registered.load(std::memory_order_relaxed))
+				register_call_site(p_log_level, p_srcfile, p_srcline, p_srcfunction);
+			return false;
+		}
+
+		if (m_theoretical_arrival_time.compare_exchange_weak(arrival_time, new_arrival_time, std::memory_order_relaxed))
+			break;
+	}
+
+	if (m_num_suppressed.load(std::memory_order_relaxed) != 0)
+		p_num_suppressed = m_num_suppressed.exchange(0, std::memory_order_relaxed);
+
+	return true;
+}
+
+
+void log_rate_limiter::register_call_site(log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction)
+{
+	if (m_registered.exchange(true))
+		return;
+
+	m_log_level = p_log_level;
+	m_srcfile = p_srcfile;
+	m_srcline = p_srcline;
+	m_srcfunction = p_srcfunction;
+
+	m_next = rate_limited_call_sites.load(std::memory_order_relaxed);
+	while (!rate_limited_call_sites.compare_exchange_weak(m_next, this, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+}
+
+
 } // namespace ironseed end
@@ -12,6 +12,8 @@
 #ifndef NXPLAY_LOG_HPP
 #define NXPLAY_LOG_HPP
 
+#include <atomic>
+#include <cstdint>
 #include <sstream>
 #include <string>
 #include <functional>
@@ -88,6 +90,164 @@ void set_min_log_level(log_levels const p_min_log_level);
 log_levels get_min_log_level();
 
 
+/// Log context for messages that belong to one pipeline.
+/**
+ * Each pipeline owns a log context. The context has an ID, which is used to
+ * tag messages, and an optional minimum log level, which overrides the global
+ * one for the messages of that pipeline. This makes it possible to enable
+ * trace logging for one misbehaving pipeline without enabling it for all of
+ * them.
+ *
+ * Messages are associated with a context by a log_context_scope that is
+ * active in the logging thread. Log write functions can retrieve the scope
+ * with get_current_log_context_scope().
+ */
+class log_context
+{
+public:
+	log_context();
+
+	/// Returns the ID of this context. IDs are unique and never 0.
+	std::uint32_t get_id() const;
+
+	/// Sets a minimum log level for this context, overriding the global one.
+	void set_min_log_level(log_levels const p_min_log_level);
+	/// Removes the context's minimum log level; the global one is used again.
+	void unset_min_log_level();
+	/// Returns true if messages with the given level are logged in this context.
+	/**
+	 * This is a single atomic load (plus the global level lookup if the
+	 * context has no minimum log level of its own).
+	 */
+	bool is_log_level_enabled(log_levels const p_log_level) const;
+
+	/// Sets the token that messages are tagged with if their scope has no token of its own.
+	void set_current_token(std::uint64_t const p_token);
+	/// Returns the token set by set_current_token().
+	std::uint64_t get_current_token() const;
+
+private:
+	log_context(log_context const &) = delete;
+	log_context& operator = (log_context const &) = delete;
+
+	std::uint32_t const m_id;
+	// Minimum log level, or -1 if the global level is used
+	std::atomic < int > m_min_log_level;
+	std::atomic < std::uint64_t > m_current_token;
+};
+
+
+/// RAII class that associates log messages of the current thread with a log context.
+/**
+ * Scopes can be nested; the innermost scope is the active one. Scopes are
+ * typically placed at pipeline entry points: API functions, GLib callbacks,
+ * and GStreamer streaming thread callbacks.
+ */
+class log_context_scope
+{
+public:
+	/// Sets up a scope whose messages are tagged with the context's current token.
+	explicit log_context_scope(log_context const &p_context);
+	/// Sets up a scope whose messages are tagged with the given token.
+	log_context_scope(log_context const &p_context, std::uint64_t const p_token);
+	~log_context_scope();
+
+	log_context const & get_context() const;
+	/// Returns the token messages in this scope are tagged with.
+	std::uint64_t get_token() const;
+
+private:
+	log_context_scope(log_context_scope const &) = delete;
+	log_context_scope& operator = (log_context_scope const &) = delete;
+
+	log_context const &m_context;
+	bool m_has_token;
+	std::uint64_t m_token;
+	log_context_scope const *m_previous_scope;
+};
+
+
+/// Returns the innermost log context scope of the current thread, or nullptr if there is none.
+log_context_scope const * get_current_log_context_scope();
+
+/// Returns true if messages with the given level are logged in the current thread.
+/**
+ * If a log context scope is active, the context's minimum log level is used,
+ * otherwise the global one.
+ */
+bool is_log_level_enabled(log_levels const p_log_level);
+
+
+
+/// Enables per-call-site rate limiting of log messages.
+/**
+ * Each NXPLAY_LOG_MSG call site gets its own token bucket. A call site can
+ * log up to p_burst_size messages at once, and then p_messages_per_second
+ * messages per second. Excess messages are dropped before they are even
+ * formatted. The number of dropped messages is appended to the next message
+ * that gets through, and can also be logged with log_suppressed_message_summaries().
+ *
+ * Rate limiting is disabled by default.
+ *
+ * @param p_messages_per_second Sustained rate of messages per call site; must be greater than 0
+ * @param p_burst_size Number of messages a call site can log in a burst; must be at least 1
+ */
+void set_log_rate_limit(double const p_messages_per_second, unsigned int const p_burst_size);
+/// Disables per-call-site rate limiting of log messages.
+void disable_log_rate_limit();
+/// Logs a summary for each call site that dropped messages since its last logged message.
+/**
+ * This is useful for getting the counts of call sites that stopped flooding
+ * the log, and therefore never logged another message that would carry the
+ * count. The summaries are logged with the levels of their call sites.
+ */
+void log_suppressed_message_summaries();
+
+
+/// Per-call-site rate limiting state. For internal use by the NXPLAY_LOG_MSG macro.
+/**
+ * Instances are function-local statics, one per macro expansion. The
+ * constructor is constexpr, so they are initialized statically, without
+ * a thread-safe initialization guard.
+ */
+class log_rate_limiter
+{
+public:
+	constexpr log_rate_limiter()
+		: m_theoretical_arrival_time(0)
+		, m_num_suppressed(0)
+		, m_registered(false)
+		, m_next(nullptr)
+		, m_log_level(log_level_trace)
+		, m_srcfile(nullptr)
+		, m_srcline(0)
+		, m_srcfunction(nullptr)
+	{
+	}
+
+	/// Returns true if a message may be logged; if so, p_num_suppressed is set to the number of messages dropped before.
+	bool acquire(log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction, std::uint64_t &p_num_suppressed);
+
+private:
+	friend void log_suppressed_message_summaries();
+
+	void register_call_site(log_levels const p_log_level, char const *p_srcfile, int const p_srcline, char const *p_srcfunction);
+
+	// Token bucket, implemented as a "generic cell rate algorithm":
+	// instead of a token count, the time when the bucket would be full
+	// again is stored, so one atomic value is enough
+	std::atomic < std::int64_t > m_theoretical_arrival_time;
+	std::atomic < std::uint64_t > m_num_suppressed;
+
+	// Call sites are added to a global list the first time they drop a message
+	std::atomic < bool > m_registered;
+	log_rate_limiter *m_next;
+	log_levels m_log_level;
+	char const *m_srcfile;
+	int m_srcline;
+	char const *m_srcfunction;
+};
+
 
 /**
  * Convenience macro for logging.
@@ -96,15 +256,24 @@ log_levels get_min_log_level();
  * uses __FILE__, __LINE__ and __func__ macros to determine source file name,
  * line number, and function name. It also makes it possible to use an
  * iostream-like like directly. Example: NXPLAY_LOG_MSG(debug, "test " << value);
+ * If rate limiting is enabled (see set_log_rate_limit()), each expansion of
+ * this macro is limited separately.
  */
 #define NXPLAY_LOG_MSG(LEVEL, MSG) \
 	do \
 	{ \
-		if (( ::nxplay::log_level_##LEVEL) >= ::nxplay::get_min_log_level()) \
+		if (::nxplay::is_log_level_enabled(::nxplay::log_level_##LEVEL)) \
 		{ \
-			std::stringstream nxplay_log_msg_internal_sstr_813585712987; \
-			nxplay_log_msg_internal_sstr_813585712987 << MSG; \
-			::nxplay::log_message(::nxplay::log_level_##LEVEL, __FILE__, __LINE__, __func__, nxplay_log_msg_internal_sstr_813585712987.str()); \
+			static ::nxplay::log_rate_limiter nxplay_log_msg_internal_limiter_813585712987; \
+			std::uint64_t nxplay_log_msg_internal_num_suppressed_813585712987; \
+			if (nxplay_log_msg_internal_limiter_813585712987.acquire(::nxplay::log_level_##LEVEL, __FILE__, __LINE__, __func__, nxplay_log_msg_internal_num_suppressed_813585712987)) \
+			{ \
+				std::stringstream nxplay_log_msg_internal_sstr_813585712987; \
+				nxplay_log_msg_internal_sstr_813585712987 << MSG; \
+				if (nxplay_log_msg_internal_num_suppressed_813585712987 != 0) \
+					nxplay_log_msg_internal_sstr_813585712987 << " (" << nxplay_log_msg_internal_num_suppressed_813585712987 << " similar message(s) suppressed)"; \
+				::nxplay::log_message(::nxplay::log_level_##LEVEL, __FILE__, __LINE__, __func__, nxplay_log_msg_internal_sstr_813585712987.str()); \
+			} \
 		} \
 	} \
 	while (false)
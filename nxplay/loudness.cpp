@@ -0,0 +1,352 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "loudness.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+// Sub blocks are 100 ms long. Gating blocks (400 ms, 75% overlap) and
+// short-term blocks (3 s, for the loudness range) are computed out of them.
+std::size_t const num_sub_blocks_per_gating_block = 4;
+std::size_t const num_sub_blocks_per_short_term_block = 30;
+
+// True peak oversampling (4x, as recommended by BS.1770-4 for 48 kHz)
+std::size_t const oversampling_factor = 4;
+std::size_t const num_taps_per_phase = 12;
+
+
+double energy_to_loudness(double const p_energy)
+{
+	return -0.691 + 10.0 * std::log10(p_energy);
+}
+
+
+double loudness_to_energy(double const p_loudness)
+{
+	return std::pow(10.0, (p_loudness + 0.691) / 10.0);
+}
+
+
+// Computes the mean energy of all blocks above the given threshold energy.
+// Returns 0 if no block is above the threshold.
+double gated_mean_energy(std::vector < double > const &p_energies, double const p_threshold_energy)
+{
+	double sum = 0.0;
+	std::size_t count = 0;
+	for (double energy : p_energies)
+	{
+		if (energy > p_threshold_energy)
+		{
+			sum += energy;
+			++count;
+		}
+	}
+
+	return (count > 0) ? (sum / count) : 0.0;
+}
+
+
+double sinc(double const p_x)
+{
+	return (p_x == 0.0) ? 1.0 : (std::sin(M_PI * p_x) / (M_PI * p_x));
+}
+
+
+} // unnamed namespace end
+
+
+loudness_meter::loudness_meter(guint const p_rate, guint const p_channels)
+	: m_rate(0)
+	, m_sub_block_length(0)
+	, m_sub_block_frames(0)
+	, m_num_sub_blocks(0)
+	, m_sample_peak(0.0)
+	, m_true_peak(0.0)
+	, m_num_frames(0)
+	, m_duration(0.0)
+{
+	// Set up the polyphase interpolation filter for true peak measurement.
+	// The prototype is a Blackman windowed sinc lowpass with the cutoff at
+	// the original Nyquist frequency. The coefficients are stored per phase,
+	// in reverse order, so each output sample is the dot product of one
+	// phase's coefficients and the contiguous sample history.
+	std::size_t num_taps = oversampling_factor * num_taps_per_phase;
+	std::vector < double > prototype(num_taps);
+	double sum = 0.0;
+	for (std::size_t i = 0; i < num_taps; ++i)
+	{
+		double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * (i + 0.5) / num_taps) + 0.08 * std::cos(4.0 * M_PI * (i + 0.5) / num_taps);
+		prototype[i] = sinc((double(i) - (num_taps - 1) / 2.0) / oversampling_factor) * window;
+		sum += prototype[i];
+	}
+
+	m_oversampling_coefficients.resize(num_taps);
+	for (std::size_t phase = 0; phase < oversampling_factor; ++phase)
+	{
+		for (std::size_t tap = 0; tap < num_taps_per_phase; ++tap)
+		{
+			// Scale so each phase has (approximately) unity DC gain
+			m_oversampling_coefficients[phase * num_taps_per_phase + (num_taps_per_phase - 1 - tap)] = float(prototype[phase + tap * oversampling_factor] * oversampling_factor / sum);
+		}
+	}
+
+	set_format(p_rate, p_channels);
+}
+
+
+void loudness_meter::set_format(guint const p_rate, guint const p_channels)
+{
+	m_rate = p_rate;
+
+	// K-weighting filter coefficients (BS.1770 stage 1: high shelving filter,
+	// stage 2: RLB highpass filter), computed for the given sample rate
+	{
+		double f0 = 1681.974450955533;
+		double gain = 3.999843853973347;
+		double q = 0.7071752369554196;
+		double k = std::tan(M_PI * f0 / p_rate);
+		double vh = std::pow(10.0, gain / 20.0);
+		double vb = std::pow(vh, 0.4996667741545416);
+		double a0 = 1.0 + k / q + k * k;
+		m_shelving_filter.m_b0 = (vh + vb * k / q + k * k) / a0;
+		m_shelving_filter.m_b1 = 2.0 * (k * k - vh) / a0;
+		m_shelving_filter.m_b2 = (vh - vb * k / q + k * k) / a0;
+		m_shelving_filter.m_a1 = 2.0 * (k * k - 1.0) / a0;
+		m_shelving_filter.m_a2 = (1.0 - k / q + k * k) / a0;
+	}
+	{
+		double f0 = 38.13547087602444;
+		double q = 0.5003270373238773;
+		double k = std::tan(M_PI * f0 / p_rate);
+		double a0 = 1.0 + k / q + k * k;
+		m_highpass_filter.m_b0 = 1.0;
+		m_highpass_filter.m_b1 = -2.0;
+		m_highpass_filter.m_b2 = 1.0;
+		m_highpass_filter.m_a1 = 2.0 * (k * k - 1.0) / a0;
+		m_highpass_filter.m_a2 = (1.0 - k / q + k * k) / a0;
+	}
+
+	m_channels.resize(p_channels);
+	for (guint i = 0; i < p_channels; ++i)
+	{
+		channel_state &channel = m_channels[i];
+
+		if ((p_channels == 5) && (i >= 3))
+			channel.m_weight = 1.41;
+		else if ((p_channels >= 6) && (i == 3))
+			channel.m_weight = 0.0;
+		else if ((p_channels >= 6) && ((i == 4) || (i == 5)))
+			channel.m_weight = 1.41;
+		else
+			channel.m_weight = 1.0;
+
+		std::fill(channel.m_z, channel.m_z + 4, 0.0);
+		channel.m_sub_block_sum = 0.0;
+		channel.m_history.assign(num_taps_per_phase * 2, 0.0f);
+		channel.m_history_pos = 0;
+	}
+
+	// Blocks do not span format changes
+	m_sub_block_length = std::max(p_rate / 10, guint(1));
+	m_sub_block_frames = 0;
+	m_sub_block_energies.assign(num_sub_blocks_per_short_term_block, 0.0);
+	m_num_sub_blocks = 0;
+}
+
+
+void loudness_meter::add_frames(float const *p_samples, std::size_t const p_num_frames)
+{
+	std::size_t num_channels = m_channels.size();
+	biquad const &sf = m_shelving_filter;
+	biquad const &hf = m_highpass_filter;
+	float const *coefficients = &m_oversampling_coefficients[0];
+
+	for (std::size_t frame = 0; frame < p_num_frames; ++frame)
+	{
+		for (std::size_t i = 0; i < num_channels; ++i)
+		{
+			channel_state &channel = m_channels[i];
+			float sample = p_samples[frame * num_channels + i];
+
+			// Sample peak
+			m_sample_peak = std::max(m_sample_peak, double(std::fabs(sample)));
+
+			// True peak; the inner loops are plain dot products over
+			// contiguous ranges, which the compiler can vectorize
+			channel.m_history[channel.m_history_pos] = sample;
+			channel.m_history[channel.m_history_pos + num_taps_per_phase] = sample;
+			channel.m_history_pos = (channel.m_history_pos + 1) % num_taps_per_phase;
+			float const *history = &(channel.m_history[channel.m_history_pos]);
+			for (std::size_t phase = 0; phase < oversampling_factor; ++phase)
+			{
+				float const *phase_coefficients = coefficients + phase * num_taps_per_phase;
+				float value = 0.0f;
+				for (std::size_t tap = 0; tap < num_taps_per_phase; ++tap)
+					value += phase_coefficients[tap] * history[tap];
+				m_true_peak = std::max(m_true_peak, double(std::fabs(value)));
+			}
+
+			// K-weighting (two cascaded biquads, direct form II transposed)
+			double x = sample;
+			double y = sf.m_b0 * x + channel.m_z[0];
+			channel.m_z[0] = sf.m_b1 * x - sf.m_a1 * y + channel.m_z[1];
+			channel.m_z[1] = sf.m_b2 * x - sf.m_a2 * y;
+			x = y;
+			y = hf.m_b0 * x + channel.m_z[2];
+			channel.m_z[2] = hf.m_b1 * x - hf.m_a1 * y + channel.m_z[3];
+			channel.m_z[3] = hf.m_b2 * x - hf.m_a2 * y;
+
+			channel.m_sub_block_sum += y * y;
+		}
+
+		if (++m_sub_block_frames == m_sub_block_length)
+			finish_sub_block();
+	}
+
+	m_num_frames += p_num_frames;
+	m_duration += double(p_num_frames) / m_rate;
+}
+
+
+double loudness_meter::get_integrated_loudness() const
+{
+	return compute_integrated_loudness(m_gating_block_energies);
+}
+
+
+double loudness_meter::get_loudness_range() const
+{
+	return compute_loudness_range(m_short_term_energies);
+}
+
+
+double loudness_meter::get_sample_peak() const
+{
+	return m_sample_peak;
+}
+
+
+double loudness_meter::get_true_peak() const
+{
+	// The true peak can never be lower than the sample peak
+	return std::max(m_true_peak, m_sample_peak);
+}
+
+
+guint64 loudness_meter::get_num_frames() const
+{
+	return m_num_frames;
+}
+
+
+double loudness_meter::get_duration() const
+{
+	return m_duration;
+}
+
+
+std::vector < double > const & loudness_meter::get_gating_block_energies() const
+{
+	return m_gating_block_energies;
+}
+
+
+std::vector < double > const & loudness_meter::get_short_term_energies() const
+{
+	return m_short_term_energies;
+}
+
+
+double loudness_meter::compute_integrated_loudness(std::vector < double > const &p_gating_block_energies)
+{
+	// Absolute gate at -70 LUFS, then relative gate at -10 LU
+	// below the loudness of the absolute-gated blocks
+	double absolute_threshold = loudness_to_energy(-70.0);
+	double mean_energy = gated_mean_energy(p_gating_block_energies, absolute_threshold);
+	if (mean_energy == 0.0)
+		return -HUGE_VAL;
+
+	double relative_threshold = std::max(loudness_to_energy(energy_to_loudness(mean_energy) - 10.0), absolute_threshold);
+	mean_energy = gated_mean_energy(p_gating_block_energies, relative_threshold);
+	if (mean_energy == 0.0)
+		return -HUGE_VAL;
+
+	return energy_to_loudness(mean_energy);
+}
+
+
+double loudness_meter::compute_loudness_range(std::vector < double > const &p_short_term_energies)
+{
+	// EBU Tech 3342: absolute gate at -70 LUFS, relative gate at -20 LU,
+	// range is the difference between the 10th and 95th percentiles
+	double absolute_threshold = loudness_to_energy(-70.0);
+	double mean_energy = gated_mean_energy(p_short_term_energies, absolute_threshold);
+	if (mean_energy == 0.0)
+		return 0.0;
+
+	double relative_threshold = std::max(loudness_to_energy(energy_to_loudness(mean_energy) - 20.0), absolute_threshold);
+
+	std::vector < double > loudness_values;
+	for (double energy : p_short_term_energies)
+	{
+		if (energy > relative_threshold)
+			loudness_values.push_back(energy_to_loudness(energy));
+	}
+
+	if (loudness_values.empty())
+		return 0.0;
+
+	std::sort(loudness_values.begin(), loudness_values.end());
+	std::size_t last = loudness_values.size() - 1;
+	double low = loudness_values[std::size_t(std::round(last * 0.10))];
+	double high = loudness_values[std::size_t(std::round(last * 0.95))];
+
+	return high - low;
+}
+
+
+void loudness_meter::finish_sub_block()
+{
+	double energy = 0.0;
+	for (auto &channel : m_channels)
+	{
+		energy += channel.m_weight * channel.m_sub_block_sum;
+		channel.m_sub_block_sum = 0.0;
+	}
+	energy /= m_sub_block_length;
+
+	m_sub_block_energies[m_num_sub_blocks % num_sub_blocks_per_short_term_block] = energy;
+	++m_num_sub_blocks;
+	m_sub_block_frames = 0;
+
+	auto mean_of_last = [&](std::size_t const p_count)
+	{
+		double sum = 0.0;
+		for (std::size_t i = 0; i < p_count; ++i)
+			sum += m_sub_block_energies[(m_num_sub_blocks - 1 - i) % num_sub_blocks_per_short_term_block];
+		return sum / p_count;
+	};
+
+	if (m_num_sub_blocks >= num_sub_blocks_per_gating_block)
+		m_gating_block_energies.push_back(mean_of_last(num_sub_blocks_per_gating_block));
+	if (m_num_sub_blocks >= num_sub_blocks_per_short_term_block)
+		m_short_term_energies.push_back(mean_of_last(num_sub_blocks_per_short_term_block));
+}
+
+
+} // namespace nxplay end
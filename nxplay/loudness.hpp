@@ -0,0 +1,132 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_LOUDNESS_HPP
+#define NXPLAY_LOUDNESS_HPP
+
+#include <cstddef>
+#include <vector>
+#include <gst/gst.h>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Loudness meter according to ITU-R BS.1770-4 and EBU R128 / EBU Tech 3342.
+/**
+ * Samples are fed incrementally with add_frames(). The meter computes the
+ * gated integrated loudness, the loudness range (LRA), the sample peak, and
+ * the true peak (using 4x oversampling).
+ *
+ * Channel weighting follows BS.1770: the first three channels (left, right,
+ * center) are weighted with 1.0. With 5 channels, channels 3 and 4 are
+ * treated as surround channels (weight 1.41). With 6 or more channels, the
+ * standard 5.1 order is assumed: channel 3 is the LFE channel and is skipped,
+ * channels 4 and 5 are surround channels. Other channels are weighted with 1.0.
+ *
+ * Loudness values are in LUFS, ranges in LU. If there is not enough audible
+ * material for measuring loudness, the loudness functions return -HUGE_VAL.
+ */
+class loudness_meter
+{
+public:
+	/// Creates a meter for the given format.
+	explicit loudness_meter(guint const p_rate, guint const p_channels);
+
+	/// Changes the format of subsequently added samples.
+	/**
+	 * Accumulated measurements are kept; only the filter states and the
+	 * partially filled blocks are reset. This is useful for media that
+	 * change their format midstream.
+	 */
+	void set_format(guint const p_rate, guint const p_channels);
+
+	/// Analyzes the given 32-bit float interleaved samples.
+	void add_frames(float const *p_samples, std::size_t const p_num_frames);
+
+	/// Returns the gated integrated loudness, in LUFS.
+	double get_integrated_loudness() const;
+	/// Returns the loudness range, in LU.
+	double get_loudness_range() const;
+	/// Returns the highest absolute sample value (1.0 = full scale).
+	double get_sample_peak() const;
+	/// Returns the highest absolute value of the 4x oversampled signal (1.0 = full scale).
+	double get_true_peak() const;
+	/// Returns the number of analyzed frames.
+	guint64 get_num_frames() const;
+	/// Returns the duration of the analyzed audio, in seconds.
+	double get_duration() const;
+
+	/// Returns the mean square energies of all 400 ms gating blocks.
+	/**
+	 * The energies of several meters can be combined to compute the
+	 * loudness of an album with compute_integrated_loudness().
+	 */
+	std::vector < double > const & get_gating_block_energies() const;
+	/// Returns the mean square energies of all 3 s short-term blocks.
+	/**
+	 * The energies of several meters can be combined to compute the
+	 * loudness range of an album with compute_loudness_range().
+	 */
+	std::vector < double > const & get_short_term_energies() const;
+
+	/// Computes the gated integrated loudness out of gating block energies.
+	static double compute_integrated_loudness(std::vector < double > const &p_gating_block_energies);
+	/// Computes the loudness range out of short-term block energies.
+	static double compute_loudness_range(std::vector < double > const &p_short_term_energies);
+
+private:
+	struct biquad
+	{
+		double m_b0, m_b1, m_b2, m_a1, m_a2;
+	};
+
+	struct channel_state
+	{
+		double m_weight;
+		// Direct form II transposed states of the two K-weighting biquads
+		double m_z[4];
+		double m_sub_block_sum;
+		// Last input samples for true peak interpolation; each sample is
+		// stored twice (at index i and i + number of taps per phase),
+		// so the most recent samples are always available as one
+		// contiguous range
+		std::vector < float > m_history;
+		std::size_t m_history_pos;
+	};
+
+	void finish_sub_block();
+
+	guint m_rate;
+	std::vector < channel_state > m_channels;
+	biquad m_shelving_filter, m_highpass_filter;
+	std::vector < float > m_oversampling_coefficients;
+
+	std::size_t m_sub_block_length, m_sub_block_frames;
+	// Energies of the last 30 sub blocks (100 ms each); ring buffer
+	std::vector < double > m_sub_block_energies;
+	std::size_t m_num_sub_blocks;
+
+	std::vector < double > m_gating_block_energies;
+	std::vector < double > m_short_term_energies;
+
+	double m_sample_peak, m_true_peak;
+	guint64 m_num_frames;
+	double m_duration;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
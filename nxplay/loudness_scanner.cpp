@@ -0,0 +1,440 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include "log.hpp"
+#include "loudness.hpp"
+#include "loudness_scanner.hpp"
+#include "offline_decoder.hpp"
+#include "parallel_jobs.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+double const replaygain_reference_loudness = -18.0;
+
+char const result_file_magic[4] = { 'N', 'X', 'L', 'R' };
+guint32 const result_file_version = 1;
+std::size_t const result_file_header_size = 16;
+std::size_t const result_file_entry_size = 48;
+guint32 const result_flag_valid = 0x1;
+
+
+double loudness_to_gain(double const p_loudness)
+{
+	return std::isfinite(p_loudness) ? (replaygain_reference_loudness - p_loudness) : 0.0;
+}
+
+
+template < typename T >
+void write_value(std::vector < guint8 > &p_data, std::size_t const p_offset, T const p_value)
+{
+	std::memcpy(&p_data[p_offset], &p_value, sizeof(T));
+}
+
+
+template < typename T >
+T read_value(guint8 const *p_data, std::size_t const p_offset)
+{
+	T value;
+	std::memcpy(&value, p_data + p_offset, sizeof(T));
+	return value;
+}
+
+
+// Per-job analysis state; the meters are kept until all jobs are done,
+// since album values need the blocks of all tracks of the album
+struct job_state
+{
+	std::unique_ptr < loudness_meter > m_meter;
+	decoded_format m_format;
+	bool m_success;
+};
+
+
+} // unnamed namespace end
+
+
+loudness_scan_job::loudness_scan_job()
+{
+}
+
+
+loudness_scan_job::loudness_scan_job(std::string const &p_uri, std::string const &p_album_id)
+	: m_uri(p_uri)
+	, m_album_id(p_album_id)
+{
+}
+
+
+loudness_result::loudness_result()
+	: m_is_valid(false)
+	, m_duration(0.0)
+	, m_integrated_loudness(-HUGE_VAL)
+	, m_loudness_range(0.0)
+	, m_sample_peak(0.0)
+	, m_true_peak(0.0)
+	, m_track_gain(0.0)
+	, m_album_integrated_loudness(-HUGE_VAL)
+	, m_album_true_peak(0.0)
+	, m_album_gain(0.0)
+{
+}
+
+
+loudness_scan_stats::loudness_scan_stats()
+	: m_num_media(0)
+	, m_num_failed_media(0)
+	, m_num_threads(0)
+	, m_audio_duration(0.0)
+	, m_wall_time(0)
+{
+}
+
+
+double loudness_scan_stats::get_media_per_second() const
+{
+	double seconds = std::chrono::duration_cast < std::chrono::duration < double > > (m_wall_time).count();
+	return (seconds > 0.0) ? (m_num_media / seconds) : 0.0;
+}
+
+
+double loudness_scan_stats::get_audio_hours_per_second() const
+{
+	double seconds = std::chrono::duration_cast < std::chrono::duration < double > > (m_wall_time).count();
+	return (seconds > 0.0) ? (m_audio_duration / 3600.0 / seconds) : 0.0;
+}
+
+
+std::vector < loudness_result > scan_loudness(std::vector < loudness_scan_job > const &p_jobs, unsigned int const p_num_threads, loudness_scan_stats *p_stats)
+{
+	auto start_time = std::chrono::steady_clock::now();
+
+	std::vector < job_state > job_states(p_jobs.size());
+
+	unsigned int num_threads = run_parallel_jobs(p_jobs.size(), p_num_threads, [&](std::size_t const p_index)
+	{
+		job_state &state = job_states[p_index];
+		state.m_success = decode_media_offline(p_jobs[p_index].m_uri, [&](decoded_format const &p_format, float const *p_samples, std::size_t const p_num_frames)
+		{
+			if (!state.m_meter)
+			{
+				state.m_meter.reset(new loudness_meter(p_format.m_rate, p_format.m_channels));
+				state.m_format = p_format;
+			}
+			else if ((p_format.m_rate != state.m_format.m_rate) || (p_format.m_channels != state.m_format.m_channels))
+			{
+				NXPLAY_LOG_MSG(debug, "format of media with URI " << p_jobs[p_index].m_uri << " changed midstream");
+				state.m_meter->set_format(p_format.m_rate, p_format.m_channels);
+				state.m_format = p_format;
+			}
+
+			state.m_meter->add_frames(p_samples, p_num_frames);
+			return true;
+		});
+
+		if (!state.m_success || !state.m_meter)
+		{
+			NXPLAY_LOG_MSG(warning, "could not analyze loudness of media with URI " << p_jobs[p_index].m_uri);
+			state.m_success = false;
+		}
+	});
+
+	// Compute track values, and collect the blocks of each album
+	struct album_data
+	{
+		album_data() : m_true_peak(0.0) {}
+		std::vector < double > m_gating_block_energies;
+		double m_true_peak;
+	};
+	std::map < std::string, album_data > albums;
+
+	std::vector < loudness_result > results(p_jobs.size());
+	loudness_scan_stats stats;
+	for (std::size_t i = 0; i < p_jobs.size(); ++i)
+	{
+		loudness_result &result = results[i];
+		job_state const &state = job_states[i];
+
+		result.m_uri = p_jobs[i].m_uri;
+		result.m_album_id = p_jobs[i].m_album_id;
+
+		++stats.m_num_media;
+		if (!state.m_success)
+		{
+			++stats.m_num_failed_media;
+			continue;
+		}
+
+		loudness_meter const &meter = *(state.m_meter);
+
+		result.m_is_valid = true;
+		result.m_duration = meter.get_duration();
+		result.m_integrated_loudness = meter.get_integrated_loudness();
+		result.m_loudness_range = meter.get_loudness_range();
+		result.m_sample_peak = meter.get_sample_peak();
+		result.m_true_peak = meter.get_true_peak();
+		result.m_track_gain = loudness_to_gain(result.m_integrated_loudness);
+
+		stats.m_audio_duration += result.m_duration;
+
+		if (!result.m_album_id.empty())
+		{
+			album_data &album = albums[result.m_album_id];
+			auto const &energies = meter.get_gating_block_energies();
+			album.m_gating_block_energies.insert(album.m_gating_block_energies.end(), energies.begin(), energies.end());
+			album.m_true_peak = std::max(album.m_true_peak, result.m_true_peak);
+		}
+	}
+
+	// Compute album values
+	for (auto &result : results)
+	{
+		if (!result.m_is_valid)
+			continue;
+
+		if (result.m_album_id.empty())
+		{
+			result.m_album_integrated_loudness = result.m_integrated_loudness;
+			result.m_album_true_peak = result.m_true_peak;
+		}
+		else
+		{
+			album_data const &album = albums[result.m_album_id];
+			result.m_album_integrated_loudness = loudness_meter::compute_integrated_loudness(album.m_gating_block_energies);
+			result.m_album_true_peak = album.m_true_peak;
+		}
+
+		result.m_album_gain = loudness_to_gain(result.m_album_integrated_loudness);
+	}
+
+	stats.m_num_threads = num_threads;
+	stats.m_wall_time = std::chrono::steady_clock::now() - start_time;
+
+	NXPLAY_LOG_MSG(info, "analyzed loudness of " << stats.m_num_media << " media (" << stats.m_num_failed_media << " failed) with " << num_threads << " threads: " << stats.get_media_per_second() << " media/s, " << stats.get_audio_hours_per_second() << " hours of audio/s");
+
+	if (p_stats != nullptr)
+		*p_stats = stats;
+
+	return results;
+}
+
+
+bool write_loudness_result_file(std::string const &p_filename, std::vector < loudness_result > const &p_results)
+{
+	// Sort by URI, to allow for binary search lookups
+	std::vector < loudness_result const * > sorted_results;
+	for (auto const &result : p_results)
+		sorted_results.push_back(&result);
+	std::sort(sorted_results.begin(), sorted_results.end(), [](loudness_result const *p_first, loudness_result const *p_second)
+	{
+		return p_first->m_uri < p_second->m_uri;
+	});
+
+	std::size_t string_table_offset = result_file_header_size + sorted_results.size() * result_file_entry_size;
+	std::vector < guint8 > data(string_table_offset, 0);
+	std::string string_table;
+
+	std::memcpy(&data[0], result_file_magic, sizeof(result_file_magic));
+	write_value < guint32 > (data, 4, result_file_version);
+	write_value < guint32 > (data, 8, guint32(sorted_results.size()));
+	write_value < guint32 > (data, 12, guint32(string_table_offset));
+
+	for (std::size_t i = 0; i < sorted_results.size(); ++i)
+	{
+		loudness_result const &result = *(sorted_results[i]);
+		std::size_t offset = result_file_header_size + i * result_file_entry_size;
+
+		write_value < guint32 > (data, offset + 0, guint32(string_table.size()));
+		write_value < guint32 > (data, offset + 4, guint32(result.m_uri.size()));
+		string_table += result.m_uri;
+		write_value < guint32 > (data, offset + 8, guint32(string_table.size()));
+		write_value < guint32 > (data, offset + 12, guint32(result.m_album_id.size()));
+		string_table += result.m_album_id;
+
+		write_value < float > (data, offset + 16, float(result.m_duration));
+		write_value < float > (data, offset + 20, float(result.m_integrated_loudness));
+		write_value < float > (data, offset + 24, float(result.m_loudness_range));
+		write_value < float > (data, offset + 28, float(result.m_sample_peak));
+		write_value < float > (data, offset + 32, float(result.m_true_peak));
+		write_value < float > (data, offset + 36, float(result.m_album_integrated_loudness));
+		write_value < float > (data, offset + 40, float(result.m_album_true_peak));
+		write_value < guint32 > (data, offset + 44, result.m_is_valid ? result_flag_valid : 0);
+	}
+
+	std::ofstream file(p_filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		NXPLAY_LOG_MSG(error, "could not open loudness result file " << p_filename << " for writing");
+		return false;
+	}
+
+	file.write(reinterpret_cast < char const * > (&data[0]), data.size());
+	file.write(string_table.data(), string_table.size());
+
+	if (!file)
+	{
+		NXPLAY_LOG_MSG(error, "could not write loudness result file " << p_filename);
+		return false;
+	}
+
+	return true;
+}
+
+
+loudness_result_file::loudness_result_file()
+	: m_mapped_file(nullptr)
+	, m_data(nullptr)
+	, m_size(0)
+	, m_num_results(0)
+{
+}
+
+
+loudness_result_file::~loudness_result_file()
+{
+	close();
+}
+
+
+bool loudness_result_file::open(std::string const &p_filename)
+{
+	close();
+
+	GError *error = nullptr;
+	m_mapped_file = g_mapped_file_new(p_filename.c_str(), FALSE, &error);
+	if (m_mapped_file == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not open loudness result file " << p_filename << ": " << error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	m_data = reinterpret_cast < guint8 const * > (g_mapped_file_get_contents(m_mapped_file));
+	m_size = g_mapped_file_get_length(m_mapped_file);
+
+	if ((m_size < result_file_header_size) || (std::memcmp(m_data, result_file_magic, sizeof(result_file_magic)) != 0) || (read_value < guint32 > (m_data, 4) != result_file_version))
+	{
+		NXPLAY_LOG_MSG(error, "file " << p_filename << " is not a valid loudness result file");
+		close();
+		return false;
+	}
+
+	m_num_results = read_value < guint32 > (m_data, 8);
+	if ((read_value < guint32 > (m_data, 12) != (result_file_header_size + m_num_results * result_file_entry_size)) || (m_size < (result_file_header_size + m_num_results * result_file_entry_size)))
+	{
+		NXPLAY_LOG_MSG(error, "loudness result file " << p_filename << " is truncated or corrupted");
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+
+void loudness_result_file::close()
+{
+	if (m_mapped_file != nullptr)
+	{
+		g_mapped_file_unref(m_mapped_file);
+		m_mapped_file = nullptr;
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_num_results = 0;
+}
+
+
+bool loudness_result_file::is_open() const
+{
+	return m_mapped_file != nullptr;
+}
+
+
+std::size_t loudness_result_file::get_num_results() const
+{
+	return m_num_results;
+}
+
+
+loudness_result loudness_result_file::get_result(std::size_t const p_index) const
+{
+	loudness_result result;
+	if (p_index >= m_num_results)
+		return result;
+
+	std::size_t offset = result_file_header_size + p_index * result_file_entry_size;
+	std::size_t string_table_offset = read_value < guint32 > (m_data, 12);
+	std::size_t album_id_offset = string_table_offset + read_value < guint32 > (m_data, offset + 8);
+	std::size_t album_id_length = read_value < guint32 > (m_data, offset + 12);
+
+	result.m_uri = get_uri(p_index);
+	if ((album_id_offset + album_id_length) <= m_size)
+		result.m_album_id.assign(reinterpret_cast < char const * > (m_data + album_id_offset), album_id_length);
+
+	result.m_duration = read_value < float > (m_data, offset + 16);
+	result.m_integrated_loudness = read_value < float > (m_data, offset + 20);
+	result.m_loudness_range = read_value < float > (m_data, offset + 24);
+	result.m_sample_peak = read_value < float > (m_data, offset + 28);
+	result.m_true_peak = read_value < float > (m_data, offset + 32);
+	result.m_album_integrated_loudness = read_value < float > (m_data, offset + 36);
+	result.m_album_true_peak = read_value < float > (m_data, offset + 40);
+	result.m_is_valid = (read_value < guint32 > (m_data, offset + 44) & result_flag_valid) != 0;
+	result.m_track_gain = loudness_to_gain(result.m_integrated_loudness);
+	result.m_album_gain = loudness_to_gain(result.m_album_integrated_loudness);
+
+	return result;
+}
+
+
+boost::optional < loudness_result > loudness_result_file::find(std::string const &p_uri) const
+{
+	std::size_t low = 0, high = m_num_results;
+	while (low < high)
+	{
+		std::size_t middle = low + (high - low) / 2;
+		int cmp = get_uri(middle).compare(p_uri);
+		if (cmp == 0)
+			return get_result(middle);
+		else if (cmp < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return boost::none;
+}
+
+
+std::string loudness_result_file::get_uri(std::size_t const p_index) const
+{
+	std::size_t offset = result_file_header_size + p_index * result_file_entry_size;
+	std::size_t uri_offset = read_value < guint32 > (m_data, 12) + read_value < guint32 > (m_data, offset + 0);
+	std::size_t uri_length = read_value < guint32 > (m_data, offset + 4);
+
+	if ((uri_offset + uri_length) > m_size)
+		return std::string();
+
+	return std::string(reinterpret_cast < char const * > (m_data + uri_offset), uri_length);
+}
+
+
+} // namespace nxplay end
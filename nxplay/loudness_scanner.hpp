@@ -0,0 +1,155 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_LOUDNESS_SCANNER_HPP
+#define NXPLAY_LOUDNESS_SCANNER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+#include <gst/gst.h>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// One media to be analyzed by scan_loudness().
+struct loudness_scan_job
+{
+	loudness_scan_job();
+	loudness_scan_job(std::string const &p_uri, std::string const &p_album_id = "");
+
+	std::string m_uri;
+	/// Media with the same nonempty album ID are considered to belong to the same album
+	std::string m_album_id;
+};
+
+
+/// Loudness analysis results for one media.
+/**
+ * Loudness values are in LUFS, ranges and gains in LU (= dB), peaks are linear
+ * (1.0 = full scale). The gains are ReplayGain 2.0 gains, that is, the gains
+ * needed to reach a loudness of -18 LUFS.
+ */
+struct loudness_result
+{
+	loudness_result();
+
+	std::string m_uri;
+	std::string m_album_id;
+	/// false if the media could not be decoded; all other values are invalid then
+	bool m_is_valid;
+	double m_duration;
+	double m_integrated_loudness;
+	double m_loudness_range;
+	double m_sample_peak;
+	double m_true_peak;
+	double m_track_gain;
+	/// Album values; if the media does not belong to an album, these are equal to the track values
+	double m_album_integrated_loudness;
+	double m_album_true_peak;
+	double m_album_gain;
+};
+
+
+/// Statistics about a scan_loudness() run.
+struct loudness_scan_stats
+{
+	loudness_scan_stats();
+
+	std::size_t m_num_media;
+	std::size_t m_num_failed_media;
+	unsigned int m_num_threads;
+	/// Total duration of the analyzed audio, in seconds
+	double m_audio_duration;
+	std::chrono::steady_clock::duration m_wall_time;
+
+	/// Returns the throughput in media per second.
+	double get_media_per_second() const;
+	/// Returns the throughput in hours of audio per second.
+	double get_audio_hours_per_second() const;
+};
+
+
+/// Analyzes the loudness of many media in parallel.
+/**
+ * The media are decoded with decode_media_offline() (without clock sync, so as
+ * fast as possible), and analyzed with loudness_meter. The jobs are distributed
+ * over a pool of worker threads with run_parallel_jobs(). Album values are
+ * computed once all tracks are analyzed, by gating over the merged blocks of
+ * all tracks of the album.
+ *
+ * GStreamer must have been initialized before calling this function.
+ *
+ * @param p_jobs Media to analyze
+ * @param p_num_threads Number of worker threads; 0 means one thread per CPU core
+ * @param p_stats If non-null, throughput statistics are written to it
+ * @return Results, in the same order as p_jobs
+ */
+std::vector < loudness_result > scan_loudness(std::vector < loudness_scan_job > const &p_jobs, unsigned int const p_num_threads = 0, loudness_scan_stats *p_stats = nullptr);
+
+
+/// Writes loudness results to a compact binary file.
+/**
+ * The file consists of a header, a table with fixed-size entries sorted by URI,
+ * and a string table. Values are stored as 32-bit floats in host byte order.
+ * Lookups by URI are done with binary search over the mapped file; see
+ * loudness_result_file.
+ *
+ * @return true if writing succeeded
+ */
+bool write_loudness_result_file(std::string const &p_filename, std::vector < loudness_result > const &p_results);
+
+
+/// Read-only access to files written by write_loudness_result_file().
+/**
+ * The file is memory-mapped, so opening it is cheap, and only the parts that
+ * are accessed are actually read.
+ */
+class loudness_result_file
+{
+public:
+	loudness_result_file();
+	~loudness_result_file();
+
+	/// Opens and validates the given file. Any previously opened file is closed.
+	bool open(std::string const &p_filename);
+	void close();
+	bool is_open() const;
+
+	/// Returns the number of results in the file.
+	std::size_t get_num_results() const;
+	/// Returns the result with the given index (results are sorted by URI).
+	loudness_result get_result(std::size_t const p_index) const;
+	/// Looks up the result for the given URI.
+	boost::optional < loudness_result > find(std::string const &p_uri) const;
+
+private:
+	loudness_result_file(loudness_result_file const &) = delete;
+	loudness_result_file& operator = (loudness_result_file const &) = delete;
+
+	std::string get_uri(std::size_t const p_index) const;
+
+	GMappedFile *m_mapped_file;
+	guint8 const *m_data;
+	std::size_t m_size;
+	std::size_t m_num_results;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -8,6 +8,9 @@
  */
 
 #include <assert.h>
+#include <algorithm>
+#include <gst/audio/audio.h>
+#include "alloc_tracking.hpp"
 #include "log.hpp"
 #include "main_pipeline.hpp"
 #include "scope_guard.hpp"
@@ -23,12 +26,17 @@ namespace
 
 
 char const *stream_eos_msg_name = "nxplay-stream-eos";
+char const *aligned_tags_msg_name = "nxplay-aligned-tags";
 char const *element_shutdown_marker = "nxplay-element-shutdown";
 guint64 const buffer_estimation_duration_default = GST_SECOND * 200;
 guint64 const buffer_timeout_default = GST_SECOND * 200;
 guint const buffer_size_limit_default = 1024 * 1024 * 2;
 guint const buffer_low_threshold_default = 10;
 guint const buffer_high_threshold_default = 99;
+// Weight of new samples in the buffer health model's smoothed rates
+double const buffer_health_smoothing = 0.3;
+// Enough for a current and a next stream
+std::size_t const max_pooled_streams = 2;
 
 
 GstFormat pos_unit_to_format(position_units const p_unit)
@@ -51,6 +59,19 @@ char const * yesno(bool const p_value)
 }
 
 
+char const * command_type_name(main_pipeline::command_types const p_type)
+{
+	switch (p_type)
+	{
+		case main_pipeline::command_type_play: return "play";
+		case main_pipeline::command_type_pause: return "pause";
+		case main_pipeline::command_type_resume: return "resume";
+		case main_pipeline::command_type_stop: return "stop";
+		default: return "<invalid>";
+	}
+}
+
+
 char const * pos_unit_description(position_units const p_unit)
 {
 	switch (p_unit)
@@ -129,21 +150,73 @@ bool is_object_marked_as_shutting_down(GObject *p_object)
 }
 
 
+// Finds the first element with the given property. p_element itself is
+// checked first; if it is a bin, its children are checked recursively.
+// The returned element is ref'd (or nullptr if no such element was found).
+GstElement* find_element_with_property(GstElement *p_element, char const *p_property)
+{
+	if (g_object_class_find_property(G_OBJECT_GET_CLASS(p_element), p_property) != nullptr)
+		return GST_ELEMENT(gst_object_ref(GST_OBJECT(p_element)));
+
+	if (!GST_IS_BIN(p_element))
+		return nullptr;
+
+	GstElement *found = nullptr;
+	GstIterator *iter = gst_bin_iterate_recurse(GST_BIN(p_element));
+	GValue item = G_VALUE_INIT;
+	bool done = false;
+
+	while (!done)
+	{
+		switch (gst_iterator_next(iter, &item))
+		{
+			case GST_ITERATOR_OK:
+			{
+				GObject *obj = G_OBJECT(g_value_get_object(&item));
+				if (g_object_class_find_property(G_OBJECT_GET_CLASS(obj), p_property) != nullptr)
+				{
+					found = GST_ELEMENT(gst_object_ref(GST_OBJECT(obj)));
+					done = true;
+				}
+				g_value_reset(&item);
+				break;
+			}
+
+			case GST_ITERATOR_RESYNC:
+				gst_iterator_resync(iter);
+				break;
+
+			case GST_ITERATOR_ERROR:
+			case GST_ITERATOR_DONE:
+				done = true;
+				break;
+		}
+	}
+
+	g_value_unset(&item);
+	gst_iterator_free(iter);
+
+	return found;
+}
+
+
 } // unnamed namespace end
 
 
 
-main_pipeline::stream::stream(main_pipeline &p_pipeline, guint64 const p_token, media &&p_media, GstBin *p_container_bin, GstElement *p_concat_elem, playback_properties const &p_properties)
+main_pipeline::stream::stream(main_pipeline &p_pipeline, guint64 const p_token, media &&p_media, GstBin *p_container_bin, GstElement *p_concat_elem, playback_properties const &p_properties, std::size_t const p_uri_index, GstPad *p_concat_sinkpad)
 	: m_pipeline(p_pipeline)
 	, m_token(p_token)
 	, m_media(std::move(p_media))
 	, m_playback_properties(p_properties)
+	, m_uri_index(p_uri_index)
 	, m_uridecodebin_elem(nullptr)
 	, m_identity_elem(nullptr)
 	, m_concat_elem(p_concat_elem)
 	, m_queue_elem(nullptr)
 	, m_identity_srcpad(nullptr)
 	, m_concat_sinkpad(nullptr)
+	, m_concat_sinkpad_handed_over(false)
 	, m_container_bin(p_container_bin)
 	, m_is_buffering(false)
 	, m_is_live(false)
@@ -156,10 +229,27 @@ main_pipeline::stream::stream(main_pipeline &p_pipeline, guint64 const p_token,
 	, m_buffer_size_limit(buffer_size_limit_default)
 	, m_effective_buffer_size_limit(0)
 	, m_buffering_timeout_enabled(true)
+	, m_buffer_budget_client([this]() { m_pipeline.schedule_buffer_budget_update(); })
+	, m_buffer_priority(buffer_priority_next_paused)
+	, m_ingress_client(ingress_class_next)
+	, m_ingress_bytes(0)
+	, m_ingress_finished(false)
+	, m_last_ingress_bytes(0)
+	, m_last_buffer_level(0)
+	, m_has_buffer_health(false)
+	, m_ingress_rate(0.0)
+	, m_consumption_rate(0.0)
+	, m_is_proactively_buffering(false)
+	, m_is_fast_started(false)
+	, m_stall_check_bytes(0)
+	, m_last_ingress_progress(std::chrono::steady_clock::now())
+	, m_tag_probe_id(0)
+	, m_eos_probe_id(0)
 {
 	assert(m_container_bin != nullptr);
+	assert(m_uri_index <= m_media.get_mirror_uris().size());
 
-	NXPLAY_LOG_MSG(debug, "constructing stream " << guintptr(this) << " with media URI " << m_media.get_uri());
+	NXPLAY_LOG_MSG(debug, "constructing stream " << guintptr(this) << " with media URI " << get_uri());
 
 	auto elems_guard = make_scope_guard([&]()
 	{
@@ -175,28 +265,61 @@ main_pipeline::stream::stream(main_pipeline &p_pipeline, guint64 const p_token,
 	// can be linked immediately, and uridecodebin and identity is
 	// linked later, when uridecodebin has loaded and produces srcpads
 
-	if ((m_uridecodebin_elem = gst_element_factory_make("uridecodebin", nullptr)) == nullptr)
+	if (!(m_pipeline.m_stream_element_pool.empty()))
 	{
-		NXPLAY_LOG_MSG(error, "could not create uridecodebin element");
-		return;
+		// Reuse the elements of a previously discarded stream
+		// (see the destructor). The pool holds references to them,
+		// which are passed on to the container bin.
+		pooled_stream_elements elements = m_pipeline.m_stream_element_pool.back();
+		m_pipeline.m_stream_element_pool.pop_back();
+
+		m_uridecodebin_elem = elements.m_uridecodebin_elem;
+		m_identity_elem = elements.m_identity_elem;
+		gst_bin_add_many(m_container_bin, m_uridecodebin_elem, m_identity_elem, nullptr);
+		gst_object_unref(GST_OBJECT(m_uridecodebin_elem));
+		gst_object_unref(GST_OBJECT(m_identity_elem));
+
+		// The destructor locked their states
+		gst_element_set_locked_state(m_uridecodebin_elem, FALSE);
+		gst_element_set_locked_state(m_identity_elem, FALSE);
+
+		NXPLAY_LOG_MSG(debug, "reusing pooled stream elements; " << m_pipeline.m_stream_element_pool.size() << " left in the pool");
 	}
-
-	if ((m_identity_elem = gst_element_factory_make("identity", nullptr)) == nullptr)
+	else
 	{
-		NXPLAY_LOG_MSG(error, "could not create identity element");
-		return;
-	}
+		if ((m_uridecodebin_elem = gst_element_factory_make("uridecodebin", nullptr)) == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create uridecodebin element");
+			return;
+		}
+
+		if ((m_identity_elem = gst_element_factory_make("identity", nullptr)) == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create identity element");
+			return;
+		}
 
-	gst_bin_add_many(m_container_bin, m_uridecodebin_elem, m_identity_elem, nullptr);
+		gst_bin_add_many(m_container_bin, m_uridecodebin_elem, m_identity_elem, nullptr);
+	}
 
-	// Link identity and concat
+	// Link identity and concat. A stream that takes over from another
+	// one uses that stream's concat sinkpad, to keep its position
+	// among the concat sinkpads.
 	m_identity_srcpad = gst_element_get_static_pad(m_identity_elem, "src");
-	GstPadTemplate *concat_sinkpad_template = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(m_concat_elem), "sink_%u");
-	m_concat_sinkpad = gst_element_request_pad(m_concat_elem, concat_sinkpad_template, nullptr, nullptr);
+	if (p_concat_sinkpad != nullptr)
+	{
+		m_concat_sinkpad = GST_PAD(gst_object_ref(GST_OBJECT(p_concat_sinkpad)));
+	}
+	else
+	{
+		GstPadTemplate *concat_sinkpad_template = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(m_concat_elem), "sink_%u");
+		m_concat_sinkpad = gst_element_request_pad(m_concat_elem, concat_sinkpad_template, nullptr, nullptr);
+	}
 	gst_pad_link(m_identity_srcpad, m_concat_sinkpad);
 
-	// Install srcpad probe to intercept bitrate tags
-	gst_pad_add_probe(
+	// Install srcpad probe to intercept bitrate tags (the probe
+	// removes itself once the bitrate is known)
+	m_tag_probe_id = gst_pad_add_probe(
 		m_identity_srcpad,
 		GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
 		static_tag_probe,
@@ -204,20 +327,31 @@ main_pipeline::stream::stream(main_pipeline &p_pipeline, guint64 const p_token,
 		nullptr
 	);
 
+	// Add an EOS probe, necessary for the gapless switching between next and current streams
+	m_eos_probe_id = gst_pad_add_probe(
+		m_identity_srcpad,
+		GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+		static_stream_eos_probe,
+		gpointer(&m_pipeline),
+		nullptr
+	);
+
 	// "async-handling" has to be set to TRUE to ensure no internal async state changes
 	// "escape" from the uridecobin and affect the rest of the pipeline (otherwise, the
 	// pipeline may be set to PAUSED state, which affects gapless playback)
-	g_object_set(G_OBJECT(m_uridecodebin_elem), "uri", m_media.get_uri().c_str(), "async-handling", gboolean(TRUE), NULL);
+	g_object_set(G_OBJECT(m_uridecodebin_elem), "uri", get_uri().c_str(), "async-handling", gboolean(TRUE), NULL);
 	g_signal_connect(G_OBJECT(m_uridecodebin_elem), "pad-added", G_CALLBACK(static_new_pad_callback), gpointer(this));
 	g_signal_connect(G_OBJECT(m_uridecodebin_elem), "element-added", G_CALLBACK(static_element_added_callback), gpointer(this));
+	g_signal_connect(G_OBJECT(m_uridecodebin_elem), "source-setup", G_CALLBACK(static_source_setup_callback), gpointer(this));
 
-	// Configure buffering values
+	// Configure buffering values; the limits are updated once all values are set
 
-	set_buffer_estimation_duration(p_properties.m_buffer_estimation_duration);
-	set_buffer_timeout(p_properties.m_buffer_timeout);
-	set_buffer_size_limit(p_properties.m_buffer_size);
+	set_buffer_estimation_duration(p_properties.m_buffer_estimation_duration, false);
+	set_buffer_timeout(p_properties.m_buffer_timeout, false);
+	set_buffer_size_limit(p_properties.m_buffer_size, false);
 
-	set_buffer_thresholds(p_properties.m_low_buffer_threshold, p_properties.m_high_buffer_threshold);
+	set_buffer_thresholds(p_properties.m_low_buffer_threshold, p_properties.m_high_buffer_threshold, false);
+	update_buffer_limits();
 
 	// Do not sync states with parent here just yet, since the static_new_pad_callback
 	// does checks to see if this is the current media. Let the caller assign this new
@@ -289,7 +423,10 @@ main_pipeline::stream::~stream()
 	// even if the elements' are currently set to PLAYING.
 	// Releasing *below* the state switch to NULL would potentially cause
 	// deadlocks.
-	if (m_concat_sinkpad != nullptr)
+	// A handed over sinkpad is not released, since another stream takes
+	// it over. The caller of hand_over_concat_sinkpad() is responsible for
+	// waking up the streaming threads then (by flushing the sinkpad).
+	if ((m_concat_sinkpad != nullptr) && !m_concat_sinkpad_handed_over)
 		gst_element_release_request_pad(m_concat_elem, m_concat_sinkpad);
 
 	// The states of the elements are locked before the element states
@@ -304,6 +441,26 @@ main_pipeline::stream::~stream()
 	gst_element_set_state(m_uridecodebin_elem, GST_STATE_NULL);
 	gst_element_set_state(m_identity_elem, GST_STATE_NULL);
 
+	// With soft stops, park the elements in the pool, so the next stream
+	// does not have to create them again. In the NULL state, uridecodebin
+	// has already removed the source and decoder elements it created for
+	// this stream, so only the signal handlers and the identity srcpad
+	// probes still refer to this stream. (The streaming threads are gone
+	// at this point, so m_tag_probe_id is up to date.)
+	bool park_elements = m_pipeline.m_soft_stop_enabled && (m_pipeline.m_stream_element_pool.size() < max_pooled_streams);
+	if (park_elements)
+	{
+		g_signal_handlers_disconnect_by_data(G_OBJECT(m_uridecodebin_elem), gpointer(this));
+		if (m_tag_probe_id != 0)
+			gst_pad_remove_probe(m_identity_srcpad, m_tag_probe_id);
+		if (m_eos_probe_id != 0)
+			gst_pad_remove_probe(m_identity_srcpad, m_eos_probe_id);
+
+		// Keep the elements alive once they are removed from the pipeline
+		gst_object_ref(GST_OBJECT(m_uridecodebin_elem));
+		gst_object_ref(GST_OBJECT(m_identity_elem));
+	}
+
 	// Unlink identity and concat
 	if (m_concat_sinkpad != nullptr)
 	{
@@ -319,6 +476,15 @@ main_pipeline::stream::~stream()
 	// No need to unref these elements, since gst_bin_remove() does it automatically
 	gst_bin_remove_many(m_container_bin, m_uridecodebin_elem, m_identity_elem, NULL);
 
+	if (park_elements)
+	{
+		pooled_stream_elements elements;
+		elements.m_uridecodebin_elem = m_uridecodebin_elem;
+		elements.m_identity_elem = m_identity_elem;
+		m_pipeline.m_stream_element_pool.push_back(elements);
+		NXPLAY_LOG_MSG(debug, "parked elements of stream " << guintptr(this) << " in the pool");
+	}
+
 	NXPLAY_LOG_MSG(debug, "stream " << guintptr(this) << " destroyed");
 }
 
@@ -336,6 +502,14 @@ GstPad* main_pipeline::stream::get_srcpad()
 }
 
 
+GstPad* main_pipeline::stream::hand_over_concat_sinkpad()
+{
+	assert(m_concat_sinkpad != nullptr);
+	m_concat_sinkpad_handed_over = true;
+	return GST_PAD(gst_object_ref(GST_OBJECT(m_concat_sinkpad)));
+}
+
+
 guint64 main_pipeline::stream::get_token() const
 {
 	return m_token;
@@ -354,38 +528,54 @@ playback_properties const & main_pipeline::stream::get_playback_properties() con
 }
 
 
+std::size_t main_pipeline::stream::get_uri_index() const
+{
+	return m_uri_index;
+}
+
+
+std::string const & main_pipeline::stream::get_uri() const
+{
+	return (m_uri_index == 0) ? m_media.get_uri() : m_media.get_mirror_uris()[m_uri_index - 1];
+}
+
+
 bool main_pipeline::stream::contains_object(GstObject *p_object)
 {
 	return gst_object_has_as_ancestor(p_object, GST_OBJECT(m_uridecodebin_elem));
 }
 
 
-void main_pipeline::stream::set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration)
+void main_pipeline::stream::set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration, bool const p_update_limits)
 {
 	m_buffer_estimation_duration = p_new_duration ? *p_new_duration : buffer_estimation_duration_default;
-	update_buffer_limits();
+	if (p_update_limits)
+		update_buffer_limits();
 }
 
 
-void main_pipeline::stream::set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout)
+void main_pipeline::stream::set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout, bool const p_update_limits)
 {
 	m_buffer_timeout = p_new_timeout ? *p_new_timeout : buffer_timeout_default;
-	update_buffer_limits();
+	if (p_update_limits)
+		update_buffer_limits();
 }
 
 
-void main_pipeline::stream::set_buffer_size_limit(boost::optional < guint > const &p_new_size)
+void main_pipeline::stream::set_buffer_size_limit(boost::optional < guint > const &p_new_size, bool const p_update_limits)
 {
 	m_buffer_size_limit = p_new_size ? *p_new_size : buffer_size_limit_default;
-	update_buffer_limits();
+	if (p_update_limits)
+		update_buffer_limits();
 }
 
 
-void main_pipeline::stream::set_buffer_thresholds(boost::optional < guint > const &p_low_threshold, boost::optional < guint > const &p_high_threshold)
+void main_pipeline::stream::set_buffer_thresholds(boost::optional < guint > const &p_low_threshold, boost::optional < guint > const &p_high_threshold, bool const p_update_limits)
 {
 	m_low_buffer_threshold = p_low_threshold ? *p_low_threshold : buffer_low_threshold_default;
 	m_high_buffer_threshold = p_high_threshold ? *p_high_threshold : buffer_high_threshold_default;
-	update_buffer_limits();
+	if (p_update_limits)
+		update_buffer_limits();
 }
 
 
@@ -411,6 +601,8 @@ guint main_pipeline::stream::get_effective_buffer_size_limit() const
 void main_pipeline::stream::set_buffering(bool const p_flag)
 {
 	m_is_buffering = p_flag;
+	if (!p_flag)
+		m_is_proactively_buffering = false;
 }
 
 
@@ -420,6 +612,18 @@ bool main_pipeline::stream::is_buffering() const
 }
 
 
+guint main_pipeline::stream::get_low_buffer_threshold() const
+{
+	return m_low_buffer_threshold;
+}
+
+
+guint main_pipeline::stream::get_high_buffer_threshold() const
+{
+	return m_high_buffer_threshold;
+}
+
+
 bool main_pipeline::stream::is_live() const
 {
 	return m_is_live;
@@ -472,7 +676,7 @@ void main_pipeline::stream::enable_buffering_timeout(bool const p_do_enable)
 void main_pipeline::stream::block_buffering(bool const p_do_block)
 {
 	{
-		std::unique_lock < std::mutex > (m_block_mutex);
+		std::unique_lock < std::mutex > lock(m_block_mutex);
 		if (m_buffering_is_blocked != p_do_block)
 		{
 			NXPLAY_LOG_MSG(debug, (p_do_block ? "blocking" : "unblocking") << " the buffering of the stream with URI " << m_media.get_uri());
@@ -484,9 +688,173 @@ void main_pipeline::stream::block_buffering(bool const p_do_block)
 }
 
 
+void main_pipeline::stream::set_buffer_priority(buffer_priorities const p_priority)
+{
+	if (m_buffer_priority == p_priority)
+		return;
+
+	m_buffer_priority = p_priority;
+	update_buffer_limits();
+
+	// Only the current stream of a playing pipeline gets the
+	// highest ingress class, since only its data is heard soon
+	m_ingress_client.set_class((p_priority == buffer_priority_current_playing) ? ingress_class_current : ingress_class_next);
+}
+
+
+void main_pipeline::stream::apply_buffer_budget()
+{
+	update_buffer_limits();
+}
+
+
+main_pipeline::buffer_health const & main_pipeline::stream::update_buffer_health(bool const p_is_consuming)
+{
+	auto level = get_current_buffer_level();
+	if (!level)
+		return m_buffer_health;
+
+	auto now = std::chrono::steady_clock::now();
+	guint64 ingress_bytes = m_ingress_bytes;
+
+	if (m_has_buffer_health)
+	{
+		double elapsed = std::chrono::duration < double > (now - m_last_health_update).count();
+		if (elapsed > 0.0)
+		{
+			double ingress = double(ingress_bytes - m_last_ingress_bytes);
+			double ingress_rate = ingress / elapsed;
+			m_ingress_rate += (ingress_rate - m_ingress_rate) * buffer_health_smoothing;
+
+			// Whatever entered the buffer and is no longer in
+			// there was consumed by the playback. Only measure
+			// this while playing, since otherwise nothing is
+			// consumed, and the rate would drop to zero.
+			if (p_is_consuming)
+			{
+				double consumed = ingress + double(m_last_buffer_level) - double(*level);
+				double consumption_rate = std::max(consumed, 0.0) / elapsed;
+				if (m_consumption_rate == 0.0)
+					m_consumption_rate = consumption_rate;
+				else
+					m_consumption_rate += (consumption_rate - m_consumption_rate) * buffer_health_smoothing;
+			}
+		}
+	}
+
+	m_has_buffer_health = true;
+	m_last_health_update = now;
+	m_last_ingress_bytes = ingress_bytes;
+	m_last_buffer_level = *level;
+
+	// The bitrate from the tags is more reliable than the measured
+	// consumption, which fluctuates with the decoder's read pattern
+	guint64 byte_rate = (m_bitrate != 0) ? guint64(m_bitrate / 8) : guint64(m_consumption_rate);
+
+	buffer_health &health = m_buffer_health;
+	health.m_level = *level;
+	health.m_ingress_rate = guint64(m_ingress_rate);
+	health.m_consumption_rate = byte_rate;
+	health.m_total_ingress_bytes = ingress_bytes;
+	health.m_ingress_finished = m_ingress_finished;
+
+	if (byte_rate != 0)
+		health.m_buffered_duration = gst_util_uint64_scale(*level, GST_SECOND, byte_rate);
+	else
+		health.m_buffered_duration = boost::none;
+
+	// An underrun can only happen if data is consumed faster than it
+	// arrives. Once all data was received, the buffer draining is
+	// expected, and not a sign of trouble.
+	if (p_is_consuming && !(health.m_ingress_finished) && (byte_rate > health.m_ingress_rate))
+		health.m_time_to_underrun = gst_util_uint64_scale(*level, GST_SECOND, byte_rate - health.m_ingress_rate);
+	else
+		health.m_time_to_underrun = boost::none;
+
+	return health;
+}
+
+
+main_pipeline::buffer_health const & main_pipeline::stream::get_buffer_health() const
+{
+	return m_buffer_health;
+}
+
+
+bool main_pipeline::stream::has_buffer_health() const
+{
+	return m_has_buffer_health;
+}
+
+
+void main_pipeline::stream::set_proactively_buffering(bool const p_flag)
+{
+	m_is_proactively_buffering = p_flag;
+	m_is_buffering = p_flag;
+}
+
+
+bool main_pipeline::stream::is_proactively_buffering() const
+{
+	return m_is_proactively_buffering;
+}
+
+
+void main_pipeline::stream::set_fast_started(bool const p_flag)
+{
+	m_is_fast_started = p_flag;
+	if (p_flag)
+		m_is_buffering = false;
+}
+
+
+bool main_pipeline::stream::is_fast_started() const
+{
+	return m_is_fast_started;
+}
+
+
+bool main_pipeline::stream::check_for_ingress_stall(guint64 const p_stall_timeout)
+{
+	auto now = std::chrono::steady_clock::now();
+	guint64 ingress_bytes = m_ingress_bytes;
+	auto level = get_current_buffer_level();
+
+	// Data is only expected if the stream has a buffer, the source did
+	// not finish yet, and the buffer has room left. The last 10% are
+	// excluded, since the queue may consider itself full slightly
+	// before reaching the exact limit.
+	bool expects_data = level && !m_ingress_finished && (*level < (m_effective_buffer_size_limit - m_effective_buffer_size_limit / 10));
+
+	if (!expects_data || (ingress_bytes != m_stall_check_bytes))
+	{
+		m_stall_check_bytes = ingress_bytes;
+		m_last_ingress_progress = now;
+		return false;
+	}
+
+	if (std::chrono::duration_cast < std::chrono::nanoseconds > (now - m_last_ingress_progress).count() < gint64(p_stall_timeout))
+		return false;
+
+	// Restart the measurement, so that a stall is
+	// reported again if it continues for too long
+	m_last_ingress_progress = now;
+	return true;
+}
+
+
+void main_pipeline::stream::set_source_reconnect_settings(boost::optional < source_reconnect_settings > const &p_settings)
+{
+	m_source_reconnect_settings = p_settings;
+}
+
+
 void main_pipeline::stream::static_new_pad_callback(GstElement *, GstPad *p_pad, gpointer p_data)
 {
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::stream::static_new_pad_callback");
+
 	stream *self = static_cast < stream* > (p_data);
+	log_context_scope log_scope(self->m_pipeline.m_log_context, self->m_token);
 
 	// Make sure this callback does not run at the same time as the destructor
 	std::unique_lock < std::mutex > lock(self->m_shutdown_mutex);
@@ -550,7 +918,10 @@ void main_pipeline::stream::static_new_pad_callback(GstElement *, GstPad *p_pad,
 
 void main_pipeline::stream::static_element_added_callback(GstElement *, GstElement *p_element, gpointer p_data)
 {
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::stream::static_element_added_callback");
+
 	stream *self = static_cast < stream* > (p_data);
+	log_context_scope log_scope(self->m_pipeline.m_log_context, self->m_token);
 
 	gchar *name_cstr = gst_element_get_name(p_element);
 	bool is_queue = g_str_has_prefix(name_cstr, "queue");
@@ -560,6 +931,17 @@ void main_pipeline::stream::static_element_added_callback(GstElement *, GstEleme
 		NXPLAY_LOG_MSG(debug, "found queue element \"" << name_cstr << "\"");
 		self->m_queue_elem = p_element;
 
+		// Count the bytes entering the queue for the buffer health model
+		GstPad *sinkpad = gst_element_get_static_pad(p_element, "sink");
+		gst_pad_add_probe(
+			sinkpad,
+			GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+			static_ingress_probe,
+			gpointer(self),
+			nullptr
+		);
+		gst_object_unref(GST_OBJECT(sinkpad));
+
 		// Queue is now available; update buffer limits to make sure the queue
 		// is configured with the computed limit values
 		self->update_buffer_limits();
@@ -569,9 +951,47 @@ void main_pipeline::stream::static_element_added_callback(GstElement *, GstEleme
 }
 
 
+void main_pipeline::stream::static_source_setup_callback(GstElement *, GstElement *p_source, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::stream::static_source_setup_callback");
+
+	stream *self = static_cast < stream* > (p_data);
+	log_context_scope log_scope(self->m_pipeline.m_log_context, self->m_token);
+
+	if (!(self->m_source_reconnect_settings))
+		return;
+
+	source_reconnect_settings const &settings = *(self->m_source_reconnect_settings);
+
+	// Sources like souphttpsrc can detect stalled connections and reconnect
+	// on their own, continuing with a range request at the byte where the
+	// connection was lost. This is seamless for the rest of the stream, so
+	// it is preferred over restarting the stream. The property types are
+	// checked, since other sources use the same names for other purposes.
+	GParamSpec *timeout_spec = g_object_class_find_property(G_OBJECT_GET_CLASS(p_source), "timeout");
+	GParamSpec *retries_spec = g_object_class_find_property(G_OBJECT_GET_CLASS(p_source), "retries");
+
+	if ((timeout_spec != nullptr) && (timeout_spec->value_type == G_TYPE_UINT))
+	{
+		guint timeout_in_seconds = std::max(guint((settings.m_stall_timeout + GST_SECOND - 1) / GST_SECOND), 1u);
+		NXPLAY_LOG_MSG(debug, "setting source timeout to " << timeout_in_seconds << " second(s)");
+		g_object_set(G_OBJECT(p_source), "timeout", timeout_in_seconds, nullptr);
+	}
+
+	if ((retries_spec != nullptr) && (retries_spec->value_type == G_TYPE_INT))
+	{
+		NXPLAY_LOG_MSG(debug, "setting source retries to " << settings.m_max_reconnects);
+		g_object_set(G_OBJECT(p_source), "retries", gint(settings.m_max_reconnects), nullptr);
+	}
+}
+
+
 GstPadProbeReturn main_pipeline::stream::static_tag_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
 {
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::stream::static_tag_probe");
+
 	stream *self = static_cast < stream* > (p_data);
+	log_context_scope log_scope(self->m_pipeline.m_log_context, self->m_token);
 
 	if (G_UNLIKELY((p_info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) == 0))
 		return GST_PAD_PROBE_OK;
@@ -596,6 +1016,11 @@ GstPadProbeReturn main_pipeline::stream::static_tag_probe(GstPad *, GstPadProbeI
 					// Bitrate found; update buffer limits, since now it can
 					// actually estimate a size limit out of duration & bitrate
 					self->update_buffer_limits();
+
+					// The bitrate is all this probe is looking for, so there
+					// is no need to inspect any more events in this stream
+					self->m_tag_probe_id = 0;
+					return GST_PAD_PROBE_REMOVE;
 				}
 			}
 
@@ -612,7 +1037,10 @@ GstPadProbeReturn main_pipeline::stream::static_tag_probe(GstPad *, GstPadProbeI
 
 GstPadProbeReturn main_pipeline::stream::static_buffering_block_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
 {
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::stream::static_buffering_block_probe");
+
 	stream *self = static_cast < stream* > (p_data);
+	log_context_scope log_scope(self->m_pipeline.m_log_context, self->m_token);
 
 	if (G_UNLIKELY((p_info->type & GST_PAD_PROBE_TYPE_BUFFER) == 0))
 		return GST_PAD_PROBE_OK;
@@ -633,6 +1061,52 @@ GstPadProbeReturn main_pipeline::stream::static_buffering_block_probe(GstPad *,
 }
 
 
+GstPadProbeReturn main_pipeline::stream::static_ingress_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::stream::static_ingress_probe");
+
+	stream *self = static_cast < stream* > (p_data);
+	log_context_scope log_scope(self->m_pipeline.m_log_context, self->m_token);
+
+	if ((p_info->type & GST_PAD_PROBE_TYPE_BUFFER) != 0)
+	{
+		gsize size = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(p_info));
+		self->m_ingress_bytes += size;
+		// This blocks the source's streaming thread if the
+		// stream exceeds its share of the global ingress rate
+		self->m_ingress_client.throttle(size, p_pad);
+	}
+	else if ((p_info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) != 0)
+	{
+		GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(p_info);
+		guint64 size = 0;
+		for (guint i = 0; i < gst_buffer_list_length(list); ++i)
+			size += gst_buffer_get_size(gst_buffer_list_get(list, i));
+		self->m_ingress_bytes += size;
+		self->m_ingress_client.throttle(size, p_pad);
+	}
+	else
+	{
+		switch (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(p_info)))
+		{
+			case GST_EVENT_EOS:
+				self->m_ingress_finished = true;
+				break;
+
+			// After seeking, the source delivers data again
+			case GST_EVENT_FLUSH_STOP:
+				self->m_ingress_finished = false;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
 void main_pipeline::stream::update_buffer_limits()
 {
 	guint64 calc_size_limit = 0;
@@ -647,6 +1121,16 @@ void main_pipeline::stream::update_buffer_limits()
 
 	m_effective_buffer_size_limit = (calc_size_limit == 0) ? m_buffer_size_limit : std::min(m_buffer_size_limit, guint(calc_size_limit));
 
+	// Request this size from the global buffer budget. If the budget is
+	// tight, fewer bytes than requested may be granted.
+	m_buffer_budget_client.set_request(m_effective_buffer_size_limit, m_buffer_priority);
+	guint granted_size = m_buffer_budget_client.get_granted();
+	if (granted_size < m_effective_buffer_size_limit)
+	{
+		NXPLAY_LOG_MSG(debug, "global buffer budget limits stream buffer size to " << granted_size << " bytes instead of " << m_effective_buffer_size_limit << " bytes");
+		m_effective_buffer_size_limit = granted_size;
+	}
+
 	NXPLAY_LOG_MSG(debug, "setting stream buffer size limit to " << m_effective_buffer_size_limit << " bytes");
 
 	g_object_set(
@@ -677,52 +1161,247 @@ void main_pipeline::stream::update_buffer_limits()
 
 
 
-main_pipeline::main_pipeline(callbacks const &p_callbacks, GstClockTime const p_needs_next_media_time, guint const p_update_interval, bool const p_postpone_all_tags, processing_objects const &p_processing_objects)
-	: m_state(state_idle)
-	, m_duration_in_nanoseconds(-1)
-	, m_duration_in_bytes(-1)
-	, m_block_abouttoend_notifications(false)
-	, m_force_next_duration_update(true)
-	, m_stream_eos_seen(false)
-	, m_postpone_all_tags(p_postpone_all_tags)
-	, m_timeout_source(nullptr)
-	, m_needs_next_media_time(p_needs_next_media_time)
-	, m_update_interval(p_update_interval)
-	, m_current_gstreamer_state(GST_STATE_NULL)
-	, m_pending_gstreamer_state(GST_STATE_VOID_PENDING)
-	, m_pipeline_elem(nullptr)
-	, m_concat_elem(nullptr)
-	, m_audiosink_elem(nullptr)
-	, m_bus(nullptr)
-	, m_watch_source(nullptr)
-	, m_next_token(0)
-	, m_thread_loop(nullptr)
-	, m_thread_loop_context(nullptr)
-	, m_callbacks(p_callbacks)
-	, m_processing_objects(p_processing_objects)
+main_pipeline::stream_memory_usage::stream_memory_usage()
+	: m_compressed_buffer(0)
+	, m_compressed_buffer_limit(0)
+	, m_tags(0)
 {
-	// By default, add the bitrate tags to the list of
-	// forcibly postponed ones, since these can be frequently
-	// updated sometimes
-	m_tags_to_always_postpone.insert(GST_TAG_MINIMUM_BITRATE);
-	m_tags_to_always_postpone.insert(GST_TAG_MAXIMUM_BITRATE);
-	m_tags_to_always_postpone.insert(GST_TAG_BITRATE);
+}
 
-	// Start the GLib mainloop thread
-	start_thread();
+
+main_pipeline::memory_usage::memory_usage()
+	: m_output_buffer(0)
+	, m_total(0)
+{
 }
 
 
-main_pipeline::~main_pipeline()
+main_pipeline::event_savings::event_savings()
+	: m_skipped_tag_messages(0)
+	, m_skipped_buffer_level_queries(0)
+	, m_skipped_position_queries(0)
+	, m_skipped_duration_queries(0)
 {
-	// Stop playback immediately and cancel transitioning states
-	// by shutting down the pipeline right now
-	{
-		// Lock the loop mutex to ensure the pipeline isn't
-		// shut down during a bus watch or playback timeout
-		// callback call
-		std::unique_lock < std::mutex > lock(m_loop_mutex);
+}
+
+
+main_pipeline::fast_start_settings::fast_start_settings()
+	: m_min_buffered_duration(GST_SECOND * 2)
+	, m_safety_margin(125)
+{
+}
+
+
+main_pipeline::next_stream_throttling::next_stream_throttling()
+	: m_pause_below(GST_SECOND * 5)
+	, m_resume_above(GST_SECOND * 15)
+{
+}
+
+
+main_pipeline::ingress_throughput::ingress_throughput()
+	: m_next_stream_throttled(false)
+	, m_num_next_stream_throttles(0)
+{
+}
+
+
+main_pipeline::startup_policy_stats::startup_policy_stats()
+	: m_num_starts(0)
+	, m_last_time_to_first_audio(0)
+	, m_total_time_to_first_audio(0)
+	, m_num_rebuffers(0)
+{
+}
+
+
+main_pipeline::mirror_failover_stats::mirror_failover_stats()
+	: m_num_stalls(0)
+	, m_num_failovers(0)
+	, m_last_failover_time(0)
+	, m_total_failover_time(0)
+{
+}
+
+
+main_pipeline::source_reconnect_settings::source_reconnect_settings()
+	: m_stall_timeout(GST_SECOND * 5)
+	, m_max_reconnects(3)
+{
+}
+
+
+main_pipeline::source_reconnect_stats::source_reconnect_stats()
+	: m_num_reconnects(0)
+	, m_num_recoveries(0)
+	, m_num_failures(0)
+	, m_last_recovery_time(0)
+	, m_total_recovery_time(0)
+{
+}
+
+
+main_pipeline::command_batch::command_batch()
+	: m_token(0)
+	, m_play_now(false)
+	, m_stop(false)
+{
+}
+
+
+void main_pipeline::command_batch::set_buffer_size_limit(boost::optional < guint > const &p_new_size)
+{
+	m_buffer_size_limit = p_new_size;
+}
+
+
+void main_pipeline::command_batch::set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration)
+{
+	m_buffer_estimation_duration = p_new_duration;
+}
+
+
+void main_pipeline::command_batch::set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout)
+{
+	m_buffer_timeout = p_new_timeout;
+}
+
+
+void main_pipeline::command_batch::set_buffer_thresholds(boost::optional < guint > const &p_new_low_threshold, boost::optional < guint > const &p_new_high_threshold)
+{
+	m_low_buffer_threshold = p_new_low_threshold;
+	m_high_buffer_threshold = p_new_high_threshold;
+}
+
+
+void main_pipeline::command_batch::play_media(guint64 const p_token, media const &p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	play_media(p_token, media(p_media), p_play_now, p_properties);
+}
+
+
+void main_pipeline::command_batch::play_media(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	m_token = p_token;
+	m_media = std::move(p_media);
+	m_play_now = p_play_now;
+	m_playback_properties = p_properties;
+	m_stop = false;
+}
+
+
+void main_pipeline::command_batch::set_current_position(gint64 const p_new_position, position_units const p_unit)
+{
+	m_position = std::make_pair(p_new_position, p_unit);
+}
+
+
+void main_pipeline::command_batch::set_paused(bool const p_paused)
+{
+	m_paused = p_paused;
+}
+
+
+void main_pipeline::command_batch::stop()
+{
+	m_media = media();
+	m_stop = true;
+}
+
+
+main_pipeline::command_latency_stats::command_latency_stats()
+	: m_num_commands(0)
+	, m_last_latency(0)
+	, m_min_latency(0)
+	, m_max_latency(0)
+	, m_total_latency(0)
+{
+}
+
+
+main_pipeline::buffer_health::buffer_health()
+	: m_level(0)
+	, m_ingress_rate(0)
+	, m_consumption_rate(0)
+	, m_total_ingress_bytes(0)
+	, m_ingress_finished(false)
+{
+}
+
+
+
+main_pipeline::main_pipeline(callbacks const &p_callbacks, GstClockTime const p_needs_next_media_time, guint const p_update_interval, bool const p_postpone_all_tags, processing_objects const &p_processing_objects)
+	: m_buffer_budget_update_pending(false)
+	, m_state(state_idle)
+	, m_duration_in_nanoseconds(-1)
+	, m_duration_in_bytes(-1)
+	, m_block_abouttoend_notifications(false)
+	, m_force_next_duration_update(true)
+	, m_stream_eos_seen(false)
+	, m_soft_stop_enabled(false)
+	, m_float32_processing(false)
+	, m_output_chain_dirty(false)
+	, m_next_stream_throttled(false)
+	, m_num_next_stream_throttles(0)
+	, m_startup_pending(false)
+	, m_startup_was_fast(false)
+	, m_current_startup_stats(nullptr)
+	, m_pending_stream_restart(stream_restart_none)
+	, m_stream_restart_seeking(false)
+	, m_num_consecutive_reconnects(0)
+	, m_dither_method(dither_tpdf)
+	, m_noise_shaping_method(noise_shaping_none)
+	, m_postpone_all_tags(p_postpone_all_tags)
+	, m_playback_aligned_tags(false)
+	, m_aligned_tag_probe_id(0)
+	, m_aligned_tag_timeout_source(nullptr)
+	, m_aligned_tag_running_time(GST_CLOCK_TIME_NONE)
+	, m_event_subscriptions(event_all)
+	, m_timeout_source(nullptr)
+	, m_needs_next_media_time(p_needs_next_media_time)
+	, m_update_interval(p_update_interval)
+	, m_current_gstreamer_state(GST_STATE_NULL)
+	, m_pending_gstreamer_state(GST_STATE_VOID_PENDING)
+	, m_pipeline_elem(nullptr)
+	, m_concat_elem(nullptr)
+	, m_audiosink_elem(nullptr)
+	, m_output_audioconvert_elem(nullptr)
+	, m_bus(nullptr)
+	, m_watch_source(nullptr)
+	, m_next_token(0)
+	, m_thread_loop(nullptr)
+	, m_thread_loop_context(nullptr)
+	, m_callbacks(p_callbacks)
+	, m_processing_objects(p_processing_objects)
+{
+	// By default, add the bitrate tags to the list of
+	// forcibly postponed ones, since these can be frequently
+	// updated sometimes
+	m_tags_to_always_postpone.insert(GST_TAG_MINIMUM_BITRATE);
+	m_tags_to_always_postpone.insert(GST_TAG_MAXIMUM_BITRATE);
+	m_tags_to_always_postpone.insert(GST_TAG_BITRATE);
+
+	gst_segment_init(&m_aligned_tag_segment, GST_FORMAT_TIME);
+
+	// Start the GLib mainloop thread
+	start_thread();
+}
+
+
+main_pipeline::~main_pipeline()
+{
+	log_context_scope log_scope(m_log_context);
+
+	// Stop playback immediately and cancel transitioning states
+	// by shutting down the pipeline right now
+	{
+		// Lock the loop mutex to ensure the pipeline isn't
+		// shut down during a bus watch or playback timeout
+		// callback call
+		std::unique_lock < std::mutex > lock(m_loop_mutex);
 		shutdown_pipeline_nolock();
+		// Do not leave anyone waiting for a command forever
+		resolve_async_command_nolock(command_failed);
 	}
 
 	// Now stop the thread with the GLib mainloop
@@ -732,6 +1411,7 @@ main_pipeline::~main_pipeline()
 
 void main_pipeline::set_buffer_size_limit(boost::optional < guint > const &p_new_size)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 	if (m_current_stream)
 		m_current_stream->set_buffer_size_limit(p_new_size);
@@ -740,6 +1420,7 @@ void main_pipeline::set_buffer_size_limit(boost::optional < guint > const &p_new
 
 void main_pipeline::set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 	if (m_current_stream)
 		m_current_stream->set_buffer_estimation_duration(p_new_duration);
@@ -748,6 +1429,7 @@ void main_pipeline::set_buffer_estimation_duration(boost::optional < guint64 > c
 
 void main_pipeline::set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 	if (m_current_stream)
 		m_current_stream->set_buffer_timeout(p_new_timeout);
@@ -756,848 +1438,2587 @@ void main_pipeline::set_buffer_timeout(boost::optional < guint64 > const &p_new_
 
 void main_pipeline::set_buffer_thresholds(boost::optional < guint > const &p_new_low_threshold, boost::optional < guint > const &p_new_high_threshold)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 	if (m_current_stream)
 		m_current_stream->set_buffer_thresholds(p_new_low_threshold, p_new_high_threshold);
 }
 
 
-bool main_pipeline::play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+void main_pipeline::set_soft_stop_enabled(bool const p_enabled)
 {
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	return play_media_nolock(p_token, std::move(p_media), p_play_now, p_properties);
+	m_soft_stop_enabled = p_enabled;
+	if (!p_enabled)
+		clear_stream_element_pool_nolock();
 }
 
 
-guint64 main_pipeline::get_new_token()
+main_pipeline::command_latency_stats main_pipeline::get_command_latency_stats(command_types const p_type) const
 {
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	return m_next_token++; // Generate unique tokens by using a monotonically increasing counter
+	return m_command_latency_stats[p_type];
 }
 
 
-void main_pipeline::stop()
+void main_pipeline::reset_command_latency_stats()
 {
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	stop_nolock();
+	for (auto &stats : m_command_latency_stats)
+		stats = command_latency_stats();
 }
 
 
-void main_pipeline::set_paused(bool const p_paused)
+void main_pipeline::set_float32_processing(bool const p_enabled)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	set_paused_nolock(p_paused);
+
+	if (m_float32_processing == p_enabled)
+		return;
+
+	m_float32_processing = p_enabled;
+	m_output_chain_dirty = true;
 }
 
 
-bool main_pipeline::is_transitioning() const
+void main_pipeline::set_output_quantization(dither_methods const p_dither_method, noise_shaping_methods const p_noise_shaping_method)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	return is_transitioning_nolock();
+
+	m_dither_method = p_dither_method;
+	m_noise_shaping_method = p_noise_shaping_method;
+
+	apply_output_quantization_nolock();
 }
 
 
-states main_pipeline::get_current_state() const
+main_pipeline::memory_usage main_pipeline::get_memory_usage() const
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	return m_state;
+
+	memory_usage usage;
+
+	auto get_stream_usage = [](stream const &p_stream)
+	{
+		stream_memory_usage stream_usage;
+		auto level = p_stream.get_current_buffer_level();
+		stream_usage.m_compressed_buffer = level ? *level : 0;
+		stream_usage.m_compressed_buffer_limit = p_stream.get_effective_buffer_size_limit();
+		return stream_usage;
+	};
+
+	if (m_current_stream)
+	{
+		usage.m_current_stream = get_stream_usage(*m_current_stream);
+		// The aggregated and postponed tag lists always
+		// belong to the current stream
+		usage.m_current_stream->m_tags = estimate_memory_usage(m_aggregated_tag_list) + estimate_memory_usage(m_postponed_tags_list);
+		for (auto const &pending_tags : m_pending_aligned_tags)
+			usage.m_current_stream->m_tags += estimate_memory_usage(pending_tags.second);
+		usage.m_total += usage.m_current_stream->m_compressed_buffer + usage.m_current_stream->m_tags;
+	}
+
+	if (m_next_stream)
+	{
+		usage.m_next_stream = get_stream_usage(*m_next_stream);
+		usage.m_total += usage.m_next_stream->m_compressed_buffer + usage.m_next_stream->m_tags;
+	}
+
+	usage.m_output_buffer = estimate_output_buffer_size_nolock();
+	usage.m_total += usage.m_output_buffer;
+
+	return usage;
 }
 
 
-void main_pipeline::set_current_position(gint64 const p_new_position, position_units const p_unit)
+bool main_pipeline::play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
-	set_current_position_nolock(p_new_position, p_unit);
+	if (p_play_now || (m_state == state_idle))
+	{
+		resolve_async_command_nolock(command_superseded);
+		mark_command_start_nolock(command_type_play);
+	}
+	return play_media_nolock(p_token, std::move(p_media), p_play_now, p_properties);
 }
 
 
-gint64 main_pipeline::get_current_position(position_units const p_unit) const
+void main_pipeline::set_event_subscriptions(unsigned int const p_mask)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	if ((m_pipeline_elem == nullptr) || (m_state == state_idle))
-		return -1;
+	unsigned int newly_subscribed = p_mask & ~m_event_subscriptions;
+	m_event_subscriptions = p_mask;
 
-        gint64 position;
-        gboolean success = gst_element_query_position(GST_ELEMENT(m_pipeline_elem), pos_unit_to_format(p_unit), &position);
-        return success ? position : -1;
+	NXPLAY_LOG_MSG(debug, "event subscriptions set to 0x" << std::hex << p_mask << std::dec);
+
+	// Tag messages were ignored while tags were unsubscribed, so the
+	// aggregated tags are stale; clear them to make the next update complete
+	if ((newly_subscribed & event_tags) != 0)
+		m_aggregated_tag_list = tag_list();
+
+	// Durations were not queried while unsubscribed; catch up right away
+	if (((newly_subscribed & (event_duration | event_media_about_to_end)) != 0) && (m_pipeline_elem != nullptr) && (m_current_stream != nullptr))
+	{
+		m_force_next_duration_update = true;
+		update_durations_nolock();
+	}
 }
 
 
-gint64 main_pipeline::get_duration(position_units const p_unit) const
+unsigned int main_pipeline::get_event_subscriptions() const
 {
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_event_subscriptions;
+}
 
-	switch (p_unit)
+
+main_pipeline::event_savings main_pipeline::get_event_savings() const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_event_savings;
+}
+
+
+void main_pipeline::set_playback_aligned_tags(bool const p_enabled)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if (m_playback_aligned_tags == p_enabled)
+		return;
+
+	m_playback_aligned_tags = p_enabled;
+
+	// If there is no pipeline yet, the probe is
+	// installed once the pipeline is initialized
+	if (m_audiosink_elem == nullptr)
+		return;
+
+	if (p_enabled)
 	{
-		case position_unit_nanoseconds: return m_duration_in_nanoseconds;
-		case position_unit_bytes:     return m_duration_in_bytes;
-		default: assert(0);
+		install_aligned_tag_probe_nolock();
+	}
+	else
+	{
+		remove_aligned_tag_probe_nolock();
+		clear_aligned_tags_nolock();
 	}
-
-	// not supposed to be reached due to the assert above; just shuts up the compiler
-	return -1;
 }
 
 
+boost::optional < main_pipeline::buffer_health > main_pipeline::get_buffer_health() const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if (!m_current_stream || !(m_current_stream->has_buffer_health()))
+		return boost::none;
+	else
+		return m_current_stream->get_buffer_health();
+}
+
 
-void main_pipeline::force_postpone_tag(std::string const &p_tag, bool const p_postpone)
+void main_pipeline::set_proactive_buffering(boost::optional < guint64 > const &p_min_time_to_underrun)
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	auto iter = m_tags_to_always_postpone.find(p_tag);
-	if (p_postpone && (iter == m_tags_to_always_postpone.end()))
-		m_tags_to_always_postpone.insert(p_tag);
-	else if (!p_postpone && (iter != m_tags_to_always_postpone.end()))
-		m_tags_to_always_postpone.erase(iter);
+	m_proactive_buffering_threshold = p_min_time_to_underrun;
+
+	// End any ongoing proactive buffering if it was disabled
+	if (!p_min_time_to_underrun && m_current_stream && m_current_stream->is_proactively_buffering())
+		set_proactively_buffering_nolock(false);
 }
 
 
-bool main_pipeline::is_transitioning_nolock() const
+void main_pipeline::set_fast_start(boost::optional < fast_start_settings > const &p_settings)
 {
-	switch (m_state)
-	{
-		case state_starting:
-		case state_stopping:
-		case state_seeking:
-		case state_buffering:
-			return true;
-		default:
-			return (m_pending_gstreamer_state != GST_STATE_VOID_PENDING);
-	}
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	m_fast_start_settings = p_settings;
 }
 
 
-bool main_pipeline::set_gstreamer_state_nolock(GstState const p_new_gstreamer_state)
+main_pipeline::startup_stats main_pipeline::get_startup_stats() const
 {
-	// Catch redundant state changes
-	if (m_current_gstreamer_state == p_new_gstreamer_state)
-		return true;
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_startup_stats;
+}
 
-	NXPLAY_LOG_MSG(
-		debug,
-		"switching state of GStreamer pipeline from " <<
-		gst_element_state_get_name(m_current_gstreamer_state) <<
-		" to "
-		<< gst_element_state_get_name(p_new_gstreamer_state)
-	);
 
-	GstStateChangeReturn ret = gst_element_set_state(GST_ELEMENT(m_pipeline_elem), p_new_gstreamer_state);
-	NXPLAY_LOG_MSG(debug, "return value after starting state change: " << gst_element_state_change_return_get_name(ret));
+void main_pipeline::set_next_stream_throttling(boost::optional < next_stream_throttling > const &p_throttling)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	switch (ret)
+	m_next_stream_throttling = p_throttling;
+
+	if (!p_throttling && m_next_stream_throttled)
 	{
-		case GST_STATE_CHANGE_FAILURE:
-			NXPLAY_LOG_MSG(error, "switching GStreamer pipeline state to " << gst_element_state_get_name(p_new_gstreamer_state) << " failed");
-			return false;
-		default:
-			return true;
+		m_next_stream_throttled = false;
+		update_next_stream_blocking_nolock();
 	}
 }
 
 
-void main_pipeline::handle_postponed_task_nolock()
+main_pipeline::ingress_throughput main_pipeline::get_ingress_throughput() const
 {
-	postponed_task::types type = m_postponed_task.m_type;
-	m_postponed_task.m_type = postponed_task::type_none;
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	switch (type)
-	{
-		case postponed_task::type_play:
-			NXPLAY_LOG_MSG(debug, "handling postponed play_media task");
-			play_media_nolock(m_postponed_task.m_token, std::move(m_postponed_task.m_media), true, m_postponed_task.m_playback_properties);
-			break;
+	ingress_throughput throughput;
+	if (m_current_stream && m_current_stream->has_buffer_health())
+		throughput.m_current_stream = m_current_stream->get_buffer_health().m_ingress_rate;
+	if (m_next_stream && m_next_stream->has_buffer_health())
+		throughput.m_next_stream = m_next_stream->get_buffer_health().m_ingress_rate;
+	throughput.m_next_stream_throttled = m_next_stream_throttled;
+	throughput.m_num_next_stream_throttles = m_num_next_stream_throttles;
 
-		case postponed_task::type_stop:
-			NXPLAY_LOG_MSG(debug, "handling postponed stop task");
-			stop_nolock();
-			break;
+	return throughput;
+}
 
-		case postponed_task::type_pause:
-			NXPLAY_LOG_MSG(debug, "handling postponed pause task");
-			set_paused_nolock(m_postponed_task.m_paused);
-			break;
 
-		case postponed_task::type_set_position:
-			NXPLAY_LOG_MSG(debug, "handling postponed set_position task");
-			set_current_position_nolock(m_postponed_task.m_position, m_postponed_task.m_position_format);
-			break;
+void main_pipeline::set_mirror_failover(boost::optional < guint64 > const &p_stall_timeout)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-		case postponed_task::type_set_state:
-			NXPLAY_LOG_MSG(debug, "handling postponed set_state task");
-			gst_element_set_state(m_pipeline_elem, m_postponed_task.m_gstreamer_state);
-			break;
+	m_stall_timeout = p_stall_timeout;
 
-		default:
-			break;
-	}
+	// Stall detection is driven by the periodic updates,
+	// which otherwise do not run during startup
+	if (p_stall_timeout && (m_state == state_starting))
+		setup_timeouts_nolock();
 }
 
 
-main_pipeline::stream_sptr main_pipeline::setup_stream_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties)
+main_pipeline::mirror_failover_stats main_pipeline::get_mirror_failover_stats() const
 {
-	stream_sptr new_stream(new stream(
-		*this,
-		p_token,
-		std::move(p_media),
-		GST_BIN(m_pipeline_elem),
-		m_concat_elem,
-		p_properties
-	));
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_mirror_failover_stats;
+}
 
-	// Add an EOS probe, necessary for the gapless switching between next and current streams
-	gst_pad_add_probe(
-		new_stream->get_srcpad(),
-		GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
-		static_stream_eos_probe,
-		gpointer(this),
-		nullptr
-	);
 
-	return new_stream;
+void main_pipeline::set_source_reconnect(boost::optional < source_reconnect_settings > const &p_settings)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	m_source_reconnect_settings = p_settings;
+
+	// Sources that already exist keep their configuration;
+	// this only affects the reconnects by the pipeline
+	if (m_current_stream)
+		m_current_stream->set_source_reconnect_settings(p_settings);
+	if (m_next_stream)
+		m_next_stream->set_source_reconnect_settings(p_settings);
 }
 
 
-GstPadProbeReturn main_pipeline::static_stream_eos_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
+main_pipeline::source_reconnect_stats main_pipeline::get_source_reconnect_stats() const
 {
-	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_source_reconnect_stats;
+}
 
-	if ((p_info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) == 0)
-		return GST_PAD_PROBE_OK;
 
-	GstEvent *event = gst_pad_probe_info_get_event(p_info);
-	switch (GST_EVENT_TYPE(event))
-	{
-		case GST_EVENT_EOS:
-		{
-			NXPLAY_LOG_MSG(debug, "EOS event observed at stream srcpad");
+log_context & main_pipeline::get_log_context()
+{
+	return m_log_context;
+}
 
-			std::unique_lock < std::mutex > lock(self->m_stream_mutex);
 
-			// m_current_stream and m_next_token are no longer up to date.
-			// Raise the flag to ensure the next make_next_stream_current_nolock()
-			// call updates these two values properly.
-			self->m_stream_eos_seen = true;
+guint64 main_pipeline::get_new_token()
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_next_token++; // Generate unique tokens by using a monotonically increasing counter
+}
 
-			// Post a custom message to the bus to trigger a bus watch
-			// call as soon as possible.
-			gst_bus_post(
-				self->m_bus,
-				gst_message_new_application(
-					GST_OBJECT(self->m_pipeline_elem),
-					gst_structure_new_empty(stream_eos_msg_name)
-				)
-			);
 
-			break;
-		}
+void main_pipeline::stop()
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	resolve_async_command_nolock(command_superseded);
+	mark_command_start_nolock(command_type_stop);
+	stop_nolock();
+}
 
-		default:
-			break;
-	}
 
-	return GST_PAD_PROBE_OK;
+void main_pipeline::set_paused(bool const p_paused)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	resolve_async_command_nolock(command_superseded);
+	mark_command_start_nolock(p_paused ? command_type_pause : command_type_resume);
+	set_paused_nolock(p_paused);
 }
 
 
-bool main_pipeline::initialize_pipeline_nolock()
+bool main_pipeline::is_transitioning() const
 {
-	// Construct the pipeline
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return is_transitioning_nolock();
+}
 
-	GstElement *audioconvert_elem = nullptr;
-	GstElement *audioresample_elem = nullptr;
 
-	if (m_pipeline_elem != nullptr)
-		shutdown_pipeline_nolock();
+states main_pipeline::get_current_state() const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_state;
+}
 
-	auto pipeline_guard = make_scope_guard([&]()
-	{
-		checked_unref(m_pipeline_elem);
-	});
-	auto elems_guard = make_scope_guard([&]()
-	{
-		checked_unref(m_concat_elem);
-		checked_unref(audioconvert_elem);
-		checked_unref(m_audiosink_elem);
-	});
 
-	m_pipeline_elem = gst_pipeline_new(nullptr);
-	if (m_pipeline_elem == nullptr)
-	{
-		NXPLAY_LOG_MSG(error, "could not create pipeline element");
-		return false;
-	}
+void main_pipeline::set_current_position(gint64 const p_new_position, position_units const p_unit)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	resolve_async_command_nolock(command_superseded);
+	set_current_position_nolock(p_new_position, p_unit);
+}
 
-	m_concat_elem = gst_element_factory_make("concat", "concat");
-	if (m_concat_elem == nullptr)
-	{
-		NXPLAY_LOG_MSG(error, "could not create concat element");
-		return false;
-	}
 
-	audioconvert_elem = gst_element_factory_make("audioconvert", "audioconvert");
-	if (audioconvert_elem == nullptr)
-	{
-		NXPLAY_LOG_MSG(error, "could not create audioconvert element");
-		return false;
-	}
+main_pipeline::command_future main_pipeline::play_media_async(guint64 const p_token, media const &p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	return play_media_async(p_token, media(p_media), p_play_now, p_properties);
+}
 
-	audioresample_elem = gst_element_factory_make("audioresample", "audioresample");
-	if (audioresample_elem == nullptr)
-	{
-		NXPLAY_LOG_MSG(error, "could not create audioresample element");
-		return false;
-	}
 
-	m_audiosink_elem = gst_element_factory_make("autoaudiosink", "audiosink");
-	if (m_audiosink_elem == nullptr)
+main_pipeline::command_future main_pipeline::play_media_async(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if (!plays_media_now_nolock(p_token, p_play_now))
 	{
-		NXPLAY_LOG_MSG(error, "could not create audiosink element");
-		return false;
+		// Scheduling the next media is done right away; there
+		// is no state to wait for. Use a temporary command
+		// without touching the pending one.
+		command_result result;
+		result.m_outcome = play_media_nolock(p_token, std::move(p_media), false, p_properties) ? command_completed : command_failed;
+		result.m_state = m_state;
+		result.m_latency = std::chrono::microseconds(0);
+
+		std::promise < command_result > promise;
+		promise.set_value(result);
+		return promise.get_future();
 	}
 
-	g_object_set(G_OBJECT(audioresample_elem), "quality", 0, nullptr);
+	mark_command_start_nolock(command_type_play);
+	// The pipeline might already be playing, so the command
+	// only completes after it went through state_starting
+	command_future future = begin_async_command_nolock(p_properties.m_start_paused ? state_paused : state_playing, state_starting);
 
-	for (auto obj : m_processing_objects)
-	{
-		if (!(obj->setup()))
-		{
-			NXPLAY_LOG_MSG(error, "error while setting up processing object");
-			return false;
-		}
+	if (!play_media_nolock(p_token, std::move(p_media), true, p_properties))
+		resolve_async_command_nolock(command_failed);
 
-		g_assert(obj->get_gst_element() != nullptr);
+	return future;
+}
 
-		gst_bin_add(GST_BIN(m_pipeline_elem), obj->get_gst_element());
-	}
 
-	gst_bin_add_many(GST_BIN(m_pipeline_elem), m_concat_elem, audioconvert_elem, audioresample_elem, m_audiosink_elem, nullptr);
-	// no need to guard the elements anymore, since the pipeline
-	// now manages their lifetime
-	elems_guard.unguard();
+main_pipeline::command_future main_pipeline::set_paused_async(bool const p_paused)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	// Link all of the elements together
-	if (m_processing_objects.empty())
-	{
-		gst_element_link_many(m_concat_elem, audioconvert_elem, audioresample_elem, m_audiosink_elem, nullptr);
-	}
-	else
-	{
-		gst_element_link(m_concat_elem, m_processing_objects.front()->get_gst_element());
+	mark_command_start_nolock(p_paused ? command_type_pause : command_type_resume);
+	// The target state is set by set_paused_nolock() once
+	// it carries out the command, which might be postponed
+	command_future future = begin_async_command_nolock(boost::none);
 
-		for (auto iter = m_processing_objects.begin() + 1; iter != m_processing_objects.end(); ++iter)
-			gst_element_link((*(iter - 1))->get_gst_element(), (*iter)->get_gst_element());
+	if (!set_paused_nolock(p_paused))
+		resolve_async_command_nolock(command_failed);
 
-		gst_element_link_many(m_processing_objects.back()->get_gst_element(), audioconvert_elem, audioresample_elem, m_audiosink_elem, nullptr);
-	}
+	return future;
+}
 
-	// Setup the pipeline bus
-	m_bus = gst_pipeline_get_bus(GST_PIPELINE(m_pipeline_elem));
-	// Set up the sync handler
-	gst_bus_set_sync_handler(m_bus, static_bus_sync_handler, gpointer(this), nullptr);
-	// Set up the bus watch
-	// NOT done by calling gst_bus_add_watch(), since we need to explicitely
-	// connect the bus watch to the m_thread_loop_context
-	m_watch_source = gst_bus_create_watch(m_bus);
-	g_source_set_callback(m_watch_source, (GSourceFunc)static_bus_watch, gpointer(this), nullptr);
-	g_source_attach(m_watch_source, m_thread_loop_context);
 
-	pipeline_guard.unguard();
+main_pipeline::command_future main_pipeline::set_current_position_async(gint64 const p_new_position, position_units const p_unit)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	// Announce the idle state
-	set_state_nolock(state_idle);
+	// The target state depends on the state the seek starts from, so it
+	// is set by set_current_position_nolock() once it carries out the
+	// command. The seek might be postponed (for example during startup,
+	// or while a seek is still in progress), and then that state is not
+	// known yet.
+	command_future future = begin_async_command_nolock(boost::none);
 
-	NXPLAY_LOG_MSG(debug, "pipeline initialized");
+	if (!set_current_position_nolock(p_new_position, p_unit))
+		resolve_async_command_nolock(command_failed);
 
-	return true;
+	return future;
 }
 
 
-void main_pipeline::shutdown_pipeline_nolock(bool const p_set_state)
+bool main_pipeline::execute_batch(command_batch p_batch)
 {
-	// Catch redundant calls
-	if (m_pipeline_elem == nullptr)
-		return;
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
-	// Stop any periodic update timeouts
-	shutdown_timeouts_nolock();
+	bool has_media = is_valid(p_batch.m_media);
+	bool plays_now = has_media && plays_media_now_nolock(p_batch.m_token, p_batch.m_play_now);
 
-	// Cancel any postponed tasks
-	m_postponed_task.m_type = postponed_task::type_none;
+	if (p_batch.m_stop)
+	{
+		// Nothing else in the batch matters once the pipeline stops
+		resolve_async_command_nolock(command_superseded);
+		mark_command_start_nolock(command_type_stop);
+		stop_nolock();
+		return true;
+	}
 
-	// Set the pipeline to idle state immediately
-	// Pass on p_set_state to let the function announce the idle state
-	// if p_set_state is true
-	// The handle_postponed_task_nolock() call inside this function
-	// will never be ran, since postponed tasks are canceled earlier
-	set_pipeline_to_idle_nolock(p_set_state);
+	if (plays_now)
+	{
+		// The new stream replaces the current one, so the settings
+		// meant for the current stream are applied to the new one
+		// instead, right when it is set up
+		playback_properties properties = p_batch.m_playback_properties;
+
+		if (p_batch.m_buffer_size_limit)
+			properties.m_buffer_size = *(p_batch.m_buffer_size_limit);
+		if (p_batch.m_buffer_estimation_duration)
+			properties.m_buffer_estimation_duration = *(p_batch.m_buffer_estimation_duration);
+		if (p_batch.m_buffer_timeout)
+			properties.m_buffer_timeout = *(p_batch.m_buffer_timeout);
+		if (p_batch.m_low_buffer_threshold)
+		{
+			properties.m_low_buffer_threshold = *(p_batch.m_low_buffer_threshold);
+			properties.m_high_buffer_threshold = *(p_batch.m_high_buffer_threshold);
+		}
+		if (p_batch.m_position)
+		{
+			properties.m_start_at_position = p_batch.m_position->first;
+			properties.m_start_at_position_unit = p_batch.m_position->second;
+		}
+		if (p_batch.m_paused)
+			properties.m_start_paused = *(p_batch.m_paused);
 
-	// Shut down the bus
-	g_source_destroy(m_watch_source);
-	g_source_unref(m_watch_source);
-	gst_object_unref(GST_OBJECT(m_bus));
+		resolve_async_command_nolock(command_superseded);
+		mark_command_start_nolock(command_type_play);
+		return play_media_nolock(p_batch.m_token, std::move(p_batch.m_media), true, properties);
+	}
 
-	for (auto obj : m_processing_objects)
+	bool ok = true;
+
+	if (m_current_stream)
 	{
-		gst_bin_remove(GST_BIN(m_pipeline_elem), obj->get_gst_element());
-		obj->teardown();
+		stream &current_stream = *m_current_stream;
+		bool buffer_settings_changed = false;
+
+		if (p_batch.m_buffer_size_limit)
+		{
+			current_stream.set_buffer_size_limit(*(p_batch.m_buffer_size_limit), false);
+			buffer_settings_changed = true;
+		}
+		if (p_batch.m_buffer_estimation_duration)
+		{
+			current_stream.set_buffer_estimation_duration(*(p_batch.m_buffer_estimation_duration), false);
+			buffer_settings_changed = true;
+		}
+		if (p_batch.m_buffer_timeout)
+		{
+			current_stream.set_buffer_timeout(*(p_batch.m_buffer_timeout), false);
+			buffer_settings_changed = true;
+		}
+		if (p_batch.m_low_buffer_threshold)
+		{
+			current_stream.set_buffer_thresholds(*(p_batch.m_low_buffer_threshold), *(p_batch.m_high_buffer_threshold), false);
+			buffer_settings_changed = true;
+		}
+
+		if (buffer_settings_changed)
+			current_stream.update_buffer_limits();
 	}
 
-	// Cleanup and unref the pipeline
-	gst_bin_remove_many(GST_BIN(m_pipeline_elem), m_concat_elem, m_audiosink_elem, nullptr);
-	gst_object_unref(GST_OBJECT(m_pipeline_elem));
+	if (p_batch.m_position)
+	{
+		resolve_async_command_nolock(command_superseded);
+		ok = set_current_position_nolock(p_batch.m_position->first, p_batch.m_position->second) && ok;
+	}
 
-	m_pipeline_elem = nullptr;
-	m_concat_elem = nullptr;
-	m_audiosink_elem = nullptr;
+	if (p_batch.m_paused)
+	{
+		resolve_async_command_nolock(command_superseded);
+		mark_command_start_nolock(*(p_batch.m_paused) ? command_type_pause : command_type_resume);
+		ok = set_paused_nolock(*(p_batch.m_paused)) && ok;
+	}
 
-	NXPLAY_LOG_MSG(debug, "pipeline shut down");
+	if (has_media)
+		ok = play_media_nolock(p_batch.m_token, std::move(p_batch.m_media), false, p_batch.m_playback_properties) && ok;
+
+	return ok;
 }
 
 
-bool main_pipeline::reinitialize_pipeline_nolock()
+main_pipeline::command_future main_pipeline::stop_async()
 {
-	// Reinitialize by shutting down and initializing again
-	// Suppress the idle state notification, since it makes
-	// no sense to do so when shutting down the pipeline here
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	mark_command_start_nolock(command_type_stop);
+	command_future future = begin_async_command_nolock(state_idle);
+
+	stop_nolock();
+
+	// Stopping an idle pipeline does not change the state
+	if (m_state == state_idle)
+		resolve_async_command_nolock(command_completed);
+
+	return future;
+}
+
+
+gint64 main_pipeline::get_current_position(position_units const p_unit) const
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if ((m_pipeline_elem == nullptr) || (m_state == state_idle))
+		return -1;
+
+        gint64 position;
+        gboolean success = gst_element_query_position(GST_ELEMENT(m_pipeline_elem), pos_unit_to_format(p_unit), &position);
+        return success ? position : -1;
+}
+
+
+gint64 main_pipeline::get_duration(position_units const p_unit) const
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	switch (p_unit)
+	{
+		case position_unit_nanoseconds: return m_duration_in_nanoseconds;
+		case position_unit_bytes:     return m_duration_in_bytes;
+		default: assert(0);
+	}
+
+	// not supposed to be reached due to the assert above; just shuts up the compiler
+	return -1;
+}
+
+
+
+void main_pipeline::force_postpone_tag(std::string const &p_tag, bool const p_postpone)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	auto iter = m_tags_to_always_postpone.find(p_tag);
+	if (p_postpone && (iter == m_tags_to_always_postpone.end()))
+		m_tags_to_always_postpone.insert(p_tag);
+	else if (!p_postpone && (iter != m_tags_to_always_postpone.end()))
+		m_tags_to_always_postpone.erase(iter);
+}
+
+
+bool main_pipeline::prewarm()
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if ((m_state != state_idle) || is_transitioning_nolock())
+		return true;
+
+	// Build the pipeline if it does not exist yet, or
+	// if its output chain settings are outdated
+	if (((m_pipeline_elem == nullptr) || m_output_chain_dirty) && !reinitialize_pipeline_nolock())
+		return false;
+
+	if (m_current_gstreamer_state == GST_STATE_READY)
+		return true;
+
+	// The sink opens the output device when switching to READY.
+	// This state change is always synchronous.
+	if (gst_element_set_state(GST_ELEMENT(m_pipeline_elem), GST_STATE_READY) == GST_STATE_CHANGE_FAILURE)
+	{
+		NXPLAY_LOG_MSG(error, "could not switch GStreamer pipeline to READY for prewarming");
+		return false;
+	}
+
+	m_current_gstreamer_state = GST_STATE_READY;
+	NXPLAY_LOG_MSG(debug, "pipeline prewarmed");
+
+	return true;
+}
+
+
+bool main_pipeline::is_transitioning_nolock() const
+{
+	switch (m_state)
+	{
+		case state_starting:
+		case state_stopping:
+		case state_seeking:
+		case state_buffering:
+			return true;
+		default:
+			return (m_pending_gstreamer_state != GST_STATE_VOID_PENDING);
+	}
+}
+
+
+bool main_pipeline::set_gstreamer_state_nolock(GstState const p_new_gstreamer_state)
+{
+	// Catch redundant state changes
+	if (m_current_gstreamer_state == p_new_gstreamer_state)
+		return true;
+
+	NXPLAY_LOG_MSG(
+		debug,
+		"switching state of GStreamer pipeline from " <<
+		gst_element_state_get_name(m_current_gstreamer_state) <<
+		" to "
+		<< gst_element_state_get_name(p_new_gstreamer_state)
+	);
+
+	GstStateChangeReturn ret = gst_element_set_state(GST_ELEMENT(m_pipeline_elem), p_new_gstreamer_state);
+	NXPLAY_LOG_MSG(debug, "return value after starting state change: " << gst_element_state_change_return_get_name(ret));
+
+	switch (ret)
+	{
+		case GST_STATE_CHANGE_FAILURE:
+			NXPLAY_LOG_MSG(error, "switching GStreamer pipeline state to " << gst_element_state_get_name(p_new_gstreamer_state) << " failed");
+			return false;
+		default:
+			return true;
+	}
+}
+
+
+void main_pipeline::handle_postponed_task_nolock()
+{
+	postponed_task::types type = m_postponed_task.m_type;
+	m_postponed_task.m_type = postponed_task::type_none;
+
+	switch (type)
+	{
+		case postponed_task::type_play:
+			NXPLAY_LOG_MSG(debug, "handling postponed play_media task");
+			play_media_nolock(m_postponed_task.m_token, std::move(m_postponed_task.m_media), true, m_postponed_task.m_playback_properties);
+			break;
+
+		case postponed_task::type_stop:
+			NXPLAY_LOG_MSG(debug, "handling postponed stop task");
+			stop_nolock();
+			break;
+
+		case postponed_task::type_pause:
+			NXPLAY_LOG_MSG(debug, "handling postponed pause task");
+			if (!set_paused_nolock(m_postponed_task.m_paused))
+				fail_postponed_async_command_nolock();
+			break;
+
+		case postponed_task::type_set_position:
+			NXPLAY_LOG_MSG(debug, "handling postponed set_position task");
+			if (!set_current_position_nolock(m_postponed_task.m_position, m_postponed_task.m_position_format))
+				fail_postponed_async_command_nolock();
+			break;
+
+		case postponed_task::type_set_state:
+			NXPLAY_LOG_MSG(debug, "handling postponed set_state task");
+			gst_element_set_state(m_pipeline_elem, m_postponed_task.m_gstreamer_state);
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+main_pipeline::stream_sptr main_pipeline::setup_stream_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties, std::size_t const p_uri_index, GstPad *p_concat_sinkpad)
+{
+	stream_sptr new_stream(new stream(
+		*this,
+		p_token,
+		std::move(p_media),
+		GST_BIN(m_pipeline_elem),
+		m_concat_elem,
+		p_properties,
+		p_uri_index,
+		p_concat_sinkpad
+	));
+
+	// Must be set before the states are synced, since
+	// that is when uridecodebin creates the source
+	new_stream->set_source_reconnect_settings(m_source_reconnect_settings);
+
+	return new_stream;
+}
+
+
+void main_pipeline::clear_stream_element_pool_nolock()
+{
+	for (auto &elements : m_stream_element_pool)
+	{
+		gst_object_unref(GST_OBJECT(elements.m_uridecodebin_elem));
+		gst_object_unref(GST_OBJECT(elements.m_identity_elem));
+	}
+
+	m_stream_element_pool.clear();
+}
+
+
+GstPadProbeReturn main_pipeline::static_stream_eos_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::static_stream_eos_probe");
+
+	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
+
+	if ((p_info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) == 0)
+		return GST_PAD_PROBE_OK;
+
+	GstEvent *event = gst_pad_probe_info_get_event(p_info);
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_EOS:
+		{
+			NXPLAY_LOG_MSG(debug, "EOS event observed at stream srcpad");
+
+			std::unique_lock < std::mutex > lock(self->m_stream_mutex);
+
+			// m_current_stream and m_next_token are no longer up to date.
+			// Raise the flag to ensure the next make_next_stream_current_nolock()
+			// call updates these two values properly.
+			self->m_stream_eos_seen = true;
+
+			// Post a custom message to the bus to trigger a bus watch
+			// call as soon as possible.
+			gst_bus_post(
+				self->m_bus,
+				gst_message_new_application(
+					GST_OBJECT(self->m_pipeline_elem),
+					gst_structure_new_empty(stream_eos_msg_name)
+				)
+			);
+
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+bool main_pipeline::initialize_pipeline_nolock()
+{
+	// Construct the pipeline
+
+	GstElement *audioconvert_elem = nullptr;
+	GstElement *audioresample_elem = nullptr;
+	GstElement *f32_audioconvert_elem = nullptr;
+	GstElement *f32_capsfilter_elem = nullptr;
+
+	if (m_pipeline_elem != nullptr)
+		shutdown_pipeline_nolock();
+
+	auto pipeline_guard = make_scope_guard([&]()
+	{
+		checked_unref(m_pipeline_elem);
+	});
+	auto elems_guard = make_scope_guard([&]()
+	{
+		checked_unref(m_concat_elem);
+		checked_unref(audioconvert_elem);
+		checked_unref(m_audiosink_elem);
+		checked_unref(f32_audioconvert_elem);
+		checked_unref(f32_capsfilter_elem);
+	});
+
+	m_pipeline_elem = gst_pipeline_new(nullptr);
+	if (m_pipeline_elem == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not create pipeline element");
+		return false;
+	}
+
+	m_concat_elem = gst_element_factory_make("concat", "concat");
+	if (m_concat_elem == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not create concat element");
+		return false;
+	}
+
+	audioconvert_elem = gst_element_factory_make("audioconvert", "audioconvert");
+	if (audioconvert_elem == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not create audioconvert element");
+		return false;
+	}
+
+	audioresample_elem = gst_element_factory_make("audioresample", "audioresample");
+	if (audioresample_elem == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not create audioresample element");
+		return false;
+	}
+
+	m_audiosink_elem = gst_element_factory_make("autoaudiosink", "audiosink");
+	if (m_audiosink_elem == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not create audiosink element");
+		return false;
+	}
+
+	if (m_float32_processing)
+	{
+		f32_audioconvert_elem = gst_element_factory_make("audioconvert", "f32_audioconvert");
+		if (f32_audioconvert_elem == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create float32 audioconvert element");
+			return false;
+		}
+
+		f32_capsfilter_elem = gst_element_factory_make("capsfilter", "f32_capsfilter");
+		if (f32_capsfilter_elem == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create float32 capsfilter element");
+			return false;
+		}
+
+		// Only pin format and layout; rate and channel count stay
+		// as they are, so they pass through unchanged
+		GstCaps *f32_caps = gst_caps_new_simple(
+			"audio/x-raw",
+			"format", G_TYPE_STRING, GST_AUDIO_NE(F32),
+			"layout", G_TYPE_STRING, "interleaved",
+			nullptr
+		);
+		g_object_set(G_OBJECT(f32_capsfilter_elem), "caps", f32_caps, nullptr);
+		gst_caps_unref(f32_caps);
+	}
+
+	g_object_set(G_OBJECT(audioresample_elem), "quality", 0, nullptr);
+
+	for (auto obj : m_processing_objects)
+	{
+		obj->set_float32_pinned(m_float32_processing);
+
+		if (!(obj->setup()))
+		{
+			NXPLAY_LOG_MSG(error, "error while setting up processing object");
+			return false;
+		}
+
+		g_assert(obj->get_gst_element() != nullptr);
+
+		if (m_float32_processing && (obj->get_native_format() != processing_format_f32))
+			NXPLAY_LOG_MSG(debug, "processing object " << GST_ELEMENT_NAME(obj->get_gst_element()) << " does not declare float32 as its native format; it may convert samples internally");
+
+		gst_bin_add(GST_BIN(m_pipeline_elem), obj->get_gst_element());
+	}
+
+	gst_bin_add_many(GST_BIN(m_pipeline_elem), m_concat_elem, audioconvert_elem, audioresample_elem, m_audiosink_elem, nullptr);
+	if (m_float32_processing)
+		gst_bin_add_many(GST_BIN(m_pipeline_elem), f32_audioconvert_elem, f32_capsfilter_elem, nullptr);
+	// no need to guard the elements anymore, since the pipeline
+	// now manages their lifetime
+	elems_guard.unguard();
+
+	// Link all of the elements together
+	// Default mode:
+	//   concat ! [processing objects] ! audioconvert ! audioresample ! sink
+	// Float32 processing mode (resampling happens in float32, and the only
+	// conversion after the processing objects is the one at the very end):
+	//   concat ! audioconvert ! capsfilter ! [processing objects] ! audioresample ! audioconvert ! sink
+	std::vector < GstElement* > chain;
+	chain.push_back(m_concat_elem);
+	if (m_float32_processing)
+	{
+		chain.push_back(f32_audioconvert_elem);
+		chain.push_back(f32_capsfilter_elem);
+	}
+	for (auto obj : m_processing_objects)
+		chain.push_back(obj->get_gst_element());
+	if (m_float32_processing)
+	{
+		chain.push_back(audioresample_elem);
+		chain.push_back(audioconvert_elem);
+	}
+	else
+	{
+		chain.push_back(audioconvert_elem);
+		chain.push_back(audioresample_elem);
+	}
+	chain.push_back(m_audiosink_elem);
+
+	for (auto iter = chain.begin() + 1; iter != chain.end(); ++iter)
+		gst_element_link(*(iter - 1), *iter);
+
+	m_output_chain_dirty = false;
+
+	m_output_audioconvert_elem = audioconvert_elem;
+	apply_output_quantization_nolock();
+
+	// Setup the pipeline bus
+	m_bus = gst_pipeline_get_bus(GST_PIPELINE(m_pipeline_elem));
+	// Set up the sync handler
+	gst_bus_set_sync_handler(m_bus, static_bus_sync_handler, gpointer(this), nullptr);
+	// Set up the bus watch
+	// NOT done by calling gst_bus_add_watch(), since we need to explicitely
+	// connect the bus watch to the m_thread_loop_context
+	m_watch_source = gst_bus_create_watch(m_bus);
+	// Bus watch sources invoke their callback as a GstBusFunc, so static_bus_watch
+	// has the right signature; g_source_set_callback() just takes it as a generic
+	// GSourceFunc. The detour through void(*)(void) is the conversion GLib itself
+	// uses for this (see G_SOURCE_FUNC), and does not trigger -Wcast-function-type.
+	g_source_set_callback(m_watch_source, GSourceFunc(reinterpret_cast < void (*)(void) > (static_bus_watch)), gpointer(this), nullptr);
+	g_source_attach(m_watch_source, m_thread_loop_context);
+
+	pipeline_guard.unguard();
+
+	if (m_playback_aligned_tags)
+		install_aligned_tag_probe_nolock();
+
+	// Announce the idle state
+	set_state_nolock(state_idle);
+
+	NXPLAY_LOG_MSG(debug, "pipeline initialized");
+
+	return true;
+}
+
+
+void main_pipeline::shutdown_pipeline_nolock(bool const p_set_state)
+{
+	// Catch redundant calls
+	if (m_pipeline_elem == nullptr)
+		return;
+
+	// Stop any periodic update timeouts
+	shutdown_timeouts_nolock();
+
+	// Cancel any postponed tasks
+	m_postponed_task.m_type = postponed_task::type_none;
+
+	// Set the pipeline to idle state immediately
+	// Pass on p_set_state to let the function announce the idle state
+	// if p_set_state is true
+	// The handle_postponed_task_nolock() call inside this function
+	// will never be ran, since postponed tasks are canceled earlier
+	set_pipeline_to_idle_nolock(p_set_state);
+
+	// The streams discarded above may have parked their elements
+	clear_stream_element_pool_nolock();
+
+	// Shut down the bus
+	g_source_destroy(m_watch_source);
+	g_source_unref(m_watch_source);
+	gst_object_unref(GST_OBJECT(m_bus));
+
+	for (auto obj : m_processing_objects)
+	{
+		gst_bin_remove(GST_BIN(m_pipeline_elem), obj->get_gst_element());
+		obj->teardown();
+	}
+
+	// Cleanup and unref the pipeline
+	gst_bin_remove_many(GST_BIN(m_pipeline_elem), m_concat_elem, m_audiosink_elem, nullptr);
+	gst_object_unref(GST_OBJECT(m_pipeline_elem));
+
+	m_pipeline_elem = nullptr;
+	m_concat_elem = nullptr;
+	m_audiosink_elem = nullptr;
+	m_output_audioconvert_elem = nullptr;
+	// The aligned tag probe is gone along with the sink
+	m_aligned_tag_probe_id = 0;
+
+	NXPLAY_LOG_MSG(debug, "pipeline shut down");
+}
+
+
+bool main_pipeline::reinitialize_pipeline_nolock()
+{
+	// Reinitialize by shutting down and initializing again
+	// Suppress the idle state notification, since it makes
+	// no sense to do so when shutting down the pipeline here
 	shutdown_pipeline_nolock(false);
 	return initialize_pipeline_nolock();
 }
 
 
-void main_pipeline::set_pipeline_to_idle_nolock(bool const p_set_state)
+bool main_pipeline::prepare_pipeline_nolock()
+{
+	// Build the pipeline from scratch if it does not exist yet
+	// (or if it was shut down earlier)
+	if (m_pipeline_elem == nullptr)
+		return initialize_pipeline_nolock();
+
+	// Settings changed that affect the structure of the output chain,
+	// so it cannot be reused
+	if (m_output_chain_dirty)
+	{
+		NXPLAY_LOG_MSG(debug, "output chain settings changed; rebuilding pipeline");
+		return reinitialize_pipeline_nolock();
+	}
+
+	// Otherwise, reuse the existing output chain, and just get rid of the
+	// old streams. This avoids recreating and relinking concat, the
+	// converters, the processing objects, and the sink. Any postponed
+	// task is canceled, just like a reinitialization would do. If the
+	// output is already open (because the pipeline was prewarmed),
+	// keep it open.
+	shutdown_timeouts_nolock();
+	m_postponed_task.m_type = postponed_task::type_none;
+	set_pipeline_to_idle_nolock(true, m_soft_stop_enabled || (m_current_gstreamer_state == GST_STATE_READY));
+
+	return true;
+}
+
+
+void main_pipeline::set_pipeline_to_idle_nolock(bool const p_set_state, bool const p_keep_output_open)
+{
+	NXPLAY_LOG_MSG(trace, "setting pipeline to idle" << (p_keep_output_open ? " (keeping output open)" : ""));
+
+	// Unblock buffering in the streams. This must happen before the pipeline is set to NULL,
+	// otherwise a deadlock occurs.
+	if (m_current_stream)
+		m_current_stream->block_buffering(false);	
+	if (m_next_stream)
+		m_next_stream->block_buffering(false);	
+
+	// Set the pipeline to NULL, or to READY if the output shall be kept open.
+	// Both are always synchronous state changes.
+	GstState idle_gstreamer_state = p_keep_output_open ? GST_STATE_READY : GST_STATE_NULL;
+	GstStateChangeReturn ret = gst_element_set_state(GST_ELEMENT(m_pipeline_elem), idle_gstreamer_state);
+	g_assert(ret != GST_STATE_CHANGE_ASYNC); // If this is ASYNC, something in GStreamer went seriously wrong
+
+	// The pipeline only flushes its bus when switching to NULL. In the READY
+	// case, flush it manually, otherwise stale messages from the previous
+	// playback would reach the bus watch later.
+	if (p_keep_output_open)
+	{
+		gst_bus_set_flushing(m_bus, TRUE);
+		gst_bus_set_flushing(m_bus, FALSE);
+	}
+
+	// Discard any current, next, or old streams
+	m_current_stream.reset();
+	m_next_stream.reset();
+	m_log_context.set_current_token(0);
+
+	if (p_set_state)
+		set_state_nolock(state_idle);
+
+	NXPLAY_LOG_MSG(trace, "pipeline is idle");
+
+	set_initial_state_values_nolock();
+	m_current_gstreamer_state = idle_gstreamer_state;
+
+	// Reached idle state; now handle any postponed task
+	handle_postponed_task_nolock();
+}
+
+
+void main_pipeline::set_initial_state_values_nolock()
+{
+	m_current_gstreamer_state = GST_STATE_NULL;
+	m_pending_gstreamer_state = GST_STATE_VOID_PENDING;
+	m_duration_in_nanoseconds = -1;
+	m_duration_in_bytes = -1;
+	m_block_abouttoend_notifications = false;
+	m_force_next_duration_update = true;
+	m_stream_eos_seen = false;
+	m_aggregated_tag_list = tag_list();
+	m_postponed_tags_list = tag_list();
+	clear_aligned_tags_nolock();
+	m_startup_pending = false;
+	m_current_startup_stats = nullptr;
+	m_next_stream_throttled = false;
+	m_pending_stream_restart = stream_restart_none;
+	m_stream_restart_position = boost::none;
+	m_stream_restart_seeking = false;
+}
+
+
+bool main_pipeline::postpone_tags_nolock(tag_list &p_new_tags)
+{
+	if (m_postpone_all_tags)
+	{
+		// Just add all of the tags to the list of postponed tags
+		m_postponed_tags_list.insert(p_new_tags, GST_TAG_MERGE_REPLACE);
+		return false;
+	}
+
+	bool tags_left = false;
+
+	// Go over all tags in the p_new_tags list, remove those which are
+	// in the m_tags_to_always_postpone set, and place these in the
+	// m_postponed_tags_list. Iterate backwards, since removing a tag
+	// shifts the indices of the ones after it.
+	for (gint num = gst_tag_list_n_tags(p_new_tags.get_tag_list()) - 1; num >= 0; --num)
+	{
+		std::string name(gst_tag_list_nth_tag_name(p_new_tags.get_tag_list(), num));
+
+		if (m_tags_to_always_postpone.find(name) == m_tags_to_always_postpone.end())
+		{
+			// This is one tag that is *not* in the set of
+			// tags to always remove, meaning at least this
+			// tag will remain in p_new_tags. Therefore, there
+			// is something to report to the new_tags_callback.
+			// => set tags_left to true.
+			tags_left = true;
+			continue;
+		}
+
+		// At this point, it is clear that this tag is one of the
+		// ones included in m_tags_to_always_postpone. Therefore,
+		// this tag must be postponed.
+
+		// If this value is already present in m_postponed_tags_list,
+		// remove it first.
+		if (has_value(m_postponed_tags_list, name))
+			gst_tag_list_remove_tag(m_postponed_tags_list.get_tag_list(), name.c_str());
+
+		// Append each value for this tag to the m_postponed_tags_list
+		for (guint index = 0; index < get_num_values_for_tag(p_new_tags, name); ++index)
+		{
+			GValue const *value = get_raw_value(p_new_tags, name, index);
+			add_raw_value(m_postponed_tags_list, value, name, GST_TAG_MERGE_APPEND);
+		}
+
+		// Finally, remove this tag from p_new_tags
+		gst_tag_list_remove_tag(p_new_tags.get_tag_list(), name.c_str());
+	}
+
+	return tags_left;
+}
+
+
+GstPadProbeReturn main_pipeline::static_aligned_tag_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::static_aligned_tag_probe");
+
+	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+
+	if ((p_info->type & GST_PAD_PROBE_TYPE_BUFFER) != 0)
+	{
+		// Keep track of the running time of the end of the most recent
+		// buffer. Tags which arrive after this buffer become audible
+		// once playback reaches this point.
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(p_info);
+		if (GST_BUFFER_PTS_IS_VALID(buffer))
+		{
+			GstClockTime end = GST_BUFFER_PTS(buffer);
+			if (GST_BUFFER_DURATION_IS_VALID(buffer))
+				end += GST_BUFFER_DURATION(buffer);
+			self->m_aligned_tag_running_time = gst_segment_to_running_time(&(self->m_aligned_tag_segment), GST_FORMAT_TIME, end);
+		}
+
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(p_info);
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_SEGMENT:
+		{
+			GstSegment const *segment;
+			gst_event_parse_segment(event, &segment);
+			gst_segment_copy_into(segment, &(self->m_aligned_tag_segment));
+			// Tags arriving before the first buffer belong to the segment start
+			self->m_aligned_tag_running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME, segment->start);
+			break;
+		}
+
+		case GST_EVENT_FLUSH_STOP:
+			self->m_aligned_tag_running_time = GST_CLOCK_TIME_NONE;
+			break;
+
+		case GST_EVENT_TAG:
+		{
+			// Pass the tags on to the bus watch, which schedules them
+			GstTagList *raw_tag_list;
+			gst_event_parse_tag(event, &raw_tag_list);
+			gst_bus_post(
+				self->m_bus,
+				gst_message_new_application(
+					GST_OBJECT(self->m_pipeline_elem),
+					gst_structure_new(
+						aligned_tags_msg_name,
+						"running-time", G_TYPE_UINT64, guint64(self->m_aligned_tag_running_time),
+						"tags", GST_TYPE_TAG_LIST, raw_tag_list,
+						nullptr
+					)
+				)
+			);
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+gboolean main_pipeline::static_aligned_tag_timeout_cb(gpointer p_data)
+{
+	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
+
+	std::unique_lock < std::mutex > lock(self->m_loop_mutex);
+
+	// This source only runs once; deliver_due_aligned_tags_nolock()
+	// sets up a new one if more tags are pending
+	g_source_unref(self->m_aligned_tag_timeout_source);
+	self->m_aligned_tag_timeout_source = nullptr;
+
+	self->make_next_stream_current_nolock();
+	self->deliver_due_aligned_tags_nolock();
+
+	return G_SOURCE_REMOVE;
+}
+
+
+void main_pipeline::install_aligned_tag_probe_nolock()
+{
+	if (m_aligned_tag_probe_id != 0)
+		return;
+
+	GstPad *sinkpad = gst_element_get_static_pad(m_audiosink_elem, "sink");
+
+	// Pick up the current segment in case this is
+	// enabled in the middle of the playback
+	gst_segment_init(&m_aligned_tag_segment, GST_FORMAT_TIME);
+	m_aligned_tag_running_time = GST_CLOCK_TIME_NONE;
+	GstEvent *segment_event = gst_pad_get_sticky_event(sinkpad, GST_EVENT_SEGMENT, 0);
+	if (segment_event != nullptr)
+	{
+		GstSegment const *segment;
+		gst_event_parse_segment(segment_event, &segment);
+		gst_segment_copy_into(segment, &m_aligned_tag_segment);
+		gst_event_unref(segment_event);
+	}
+
+	m_aligned_tag_probe_id = gst_pad_add_probe(
+		sinkpad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+		static_aligned_tag_probe,
+		gpointer(this),
+		nullptr
+	);
+
+	gst_object_unref(GST_OBJECT(sinkpad));
+}
+
+
+void main_pipeline::remove_aligned_tag_probe_nolock()
+{
+	if (m_aligned_tag_probe_id == 0)
+		return;
+
+	GstPad *sinkpad = gst_element_get_static_pad(m_audiosink_elem, "sink");
+	gst_pad_remove_probe(sinkpad, m_aligned_tag_probe_id);
+	gst_object_unref(GST_OBJECT(sinkpad));
+
+	m_aligned_tag_probe_id = 0;
+}
+
+
+void main_pipeline::handle_aligned_tags_message_nolock(GstMessage *p_msg)
+{
+	// The message might have been posted before aligned
+	// tags were disabled; drop it in that case
+	if (!m_playback_aligned_tags || !m_callbacks.m_new_tags_callback)
+		return;
+
+	if (!is_subscribed_nolock(event_tags))
+	{
+		++m_event_savings.m_skipped_tag_messages;
+		return;
+	}
+
+	GstStructure const *s = gst_message_get_structure(p_msg);
+	guint64 running_time = GST_CLOCK_TIME_NONE;
+	GstTagList *raw_tag_list = nullptr;
+	gst_structure_get_uint64(s, "running-time", &running_time);
+	if (!gst_structure_get(s, "tags", GST_TYPE_TAG_LIST, &raw_tag_list, nullptr) || (raw_tag_list == nullptr))
+		return;
+
+	NXPLAY_LOG_MSG(debug, "tags reached the sink at running time " << running_time << " ns");
+
+	// Tags arrive in running time order, so appending keeps the queue sorted
+	m_pending_aligned_tags.emplace_back(running_time, tag_list(raw_tag_list));
+
+	if (m_aligned_tag_timeout_source == nullptr)
+		deliver_due_aligned_tags_nolock();
+}
+
+
+void main_pipeline::deliver_due_aligned_tags_nolock()
+{
+	if (m_pending_aligned_tags.empty() || (m_pipeline_elem == nullptr))
+		return;
+
+	// Data with running time X is heard at running time X + latency
+	GstClockTime latency = 0;
+	GstQuery *query = gst_query_new_latency();
+	if (gst_element_query(m_pipeline_elem, query))
+		gst_query_parse_latency(query, nullptr, &latency, nullptr);
+	gst_query_unref(query);
+
+	GstClockTime now = get_current_running_time_nolock();
+
+	// Merge all tags that are due now into one list. Tags without a valid
+	// running time (for example, those that arrive before any segment)
+	// are due right away.
+	tag_list due_tags;
+	bool tags_due = false;
+	while (!m_pending_aligned_tags.empty())
+	{
+		aligned_tags &front = m_pending_aligned_tags.front();
+		if (GST_CLOCK_TIME_IS_VALID(front.first) && (!GST_CLOCK_TIME_IS_VALID(now) || ((front.first + latency) > now)))
+			break;
+
+		due_tags.insert(front.second, GST_TAG_MERGE_REPLACE);
+		tags_due = true;
+		m_pending_aligned_tags.pop_front();
+	}
+
+	if (tags_due && (m_current_stream != nullptr))
+	{
+		tag_list new_tags = calculate_new_tags(m_aggregated_tag_list, due_tags);
+		if (!new_tags.is_empty())
+		{
+			m_aggregated_tag_list.insert(new_tags, GST_TAG_MERGE_REPLACE);
+
+			if (postpone_tags_nolock(new_tags))
+			{
+				// Report the entire aggregated list, so the application
+				// gets a consistent snapshot, minus the postponed tags
+				tag_list snapshot(m_aggregated_tag_list);
+				for (auto const &name : m_tags_to_always_postpone)
+					gst_tag_list_remove_tag(snapshot.get_tag_list(), name.c_str());
+				m_callbacks.m_new_tags_callback(m_current_stream->get_media(), m_current_stream->get_token(), std::move(snapshot));
+			}
+		}
+	}
+
+	if (m_pending_aligned_tags.empty())
+		return;
+
+	// Wake up when the next tags are due. If the running time cannot be
+	// determined right now (because the pipeline is not playing yet),
+	// check again later. While paused, the running time does not advance,
+	// so the timer fires early, and is then just set up again.
+	GstClockTime next_running_time = m_pending_aligned_tags.front().first + latency;
+	guint delay_in_ms = GST_CLOCK_TIME_IS_VALID(now) ? guint((next_running_time - now) / GST_MSECOND) : m_update_interval;
+	delay_in_ms = std::max(delay_in_ms, guint(10));
+
+	m_aligned_tag_timeout_source = g_timeout_source_new(delay_in_ms);
+	g_source_set_callback(m_aligned_tag_timeout_source, static_aligned_tag_timeout_cb, gpointer(this), nullptr);
+	g_source_attach(m_aligned_tag_timeout_source, m_thread_loop_context);
+}
+
+
+void main_pipeline::clear_aligned_tags_nolock()
+{
+	m_pending_aligned_tags.clear();
+
+	if (m_aligned_tag_timeout_source != nullptr)
+	{
+		g_source_destroy(m_aligned_tag_timeout_source);
+		g_source_unref(m_aligned_tag_timeout_source);
+		m_aligned_tag_timeout_source = nullptr;
+	}
+}
+
+
+GstClockTime main_pipeline::get_current_running_time_nolock() const
+{
+	// This is the same calculation GStreamer elements do internally:
+	// while playing, the running time is the clock time minus the base
+	// time; while paused, it is the running time at which pausing occurred.
+	switch (m_current_gstreamer_state)
+	{
+		case GST_STATE_PLAYING:
+		{
+			GstClock *clock = gst_element_get_clock(m_pipeline_elem);
+			if (clock == nullptr)
+				return GST_CLOCK_TIME_NONE;
+
+			GstClockTime clock_time = gst_clock_get_time(clock);
+			GstClockTime base_time = gst_element_get_base_time(m_pipeline_elem);
+			gst_object_unref(GST_OBJECT(clock));
+
+			return (clock_time >= base_time) ? (clock_time - base_time) : 0;
+		}
+
+		case GST_STATE_PAUSED:
+			return gst_element_get_start_time(m_pipeline_elem);
+
+		default:
+			return GST_CLOCK_TIME_NONE;
+	}
+}
+
+
+void main_pipeline::mark_command_start_nolock(command_types const p_type)
+{
+	m_pending_command = p_type;
+	m_command_start_time = std::chrono::steady_clock::now();
+}
+
+
+void main_pipeline::record_command_latency_nolock()
+{
+	if (!m_pending_command)
+		return;
+
+	// Only check for the state the command results in. Playing passes
+	// through the idle state when the previous streams are discarded,
+	// so idle must not end play commands.
+	bool reached = false;
+	switch (*m_pending_command)
+	{
+		case command_type_play: reached = (m_state == state_playing) || (m_state == state_paused); break;
+		case command_type_pause: reached = (m_state == state_paused); break;
+		case command_type_resume: reached = (m_state == state_playing); break;
+		case command_type_stop: reached = (m_state == state_idle); break;
+		default: break;
+	}
+
+	if (!reached)
+		return;
+
+	auto latency = std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now() - m_command_start_time);
+	NXPLAY_LOG_MSG(debug, command_type_name(*m_pending_command) << " command reached state " << get_state_name(m_state) << " after " << latency.count() << " us");
+
+	command_latency_stats &stats = m_command_latency_stats[*m_pending_command];
+	stats.m_min_latency = (stats.m_num_commands == 0) ? latency : std::min(stats.m_min_latency, latency);
+	stats.m_max_latency = std::max(stats.m_max_latency, latency);
+	stats.m_last_latency = latency;
+	stats.m_total_latency += latency;
+	++stats.m_num_commands;
+
+	m_pending_command = boost::none;
+}
+
+
+main_pipeline::command_future main_pipeline::begin_async_command_nolock(boost::optional < states > const &p_target_state, boost::optional < states > const &p_via_state)
+{
+	resolve_async_command_nolock(command_superseded);
+
+	m_async_command.reset(new async_command);
+	m_async_command->m_start_time = std::chrono::steady_clock::now();
+	m_async_command->m_target_state = p_target_state;
+	m_async_command->m_via_state = p_via_state;
+
+	return m_async_command->m_promise.get_future();
+}
+
+
+void main_pipeline::resolve_async_command_nolock(command_outcomes const p_outcome)
+{
+	if (!m_async_command)
+		return;
+
+	command_result result;
+	result.m_outcome = p_outcome;
+	result.m_state = m_state;
+	result.m_latency = std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now() - m_async_command->m_start_time);
+
+	NXPLAY_LOG_MSG(trace, "asynchronous command with target state " << (m_async_command->m_target_state ? get_state_name(*(m_async_command->m_target_state)) : std::string("<not set>")) << " ended in state " << get_state_name(m_state) << " after " << result.m_latency.count() << " us");
+
+	// Reset the pending command before making the future ready, since
+	// a waiting thread might immediately issue the next command
+	std::unique_ptr < async_command > command = std::move(m_async_command);
+	command->m_promise.set_value(result);
+}
+
+
+void main_pipeline::set_async_command_target_nolock(states const p_target_state, boost::optional < states > const &p_via_state)
+{
+	if (!m_async_command || m_async_command->m_target_state)
+		return;
+
+	m_async_command->m_target_state = p_target_state;
+	m_async_command->m_via_state = p_via_state;
+
+	// The pipeline might be in the target state already
+	update_async_command_nolock();
+}
+
+
+void main_pipeline::fail_postponed_async_command_nolock()
+{
+	// A pending command without a target state is the one
+	// whose postponed task could not be carried out
+	if (m_async_command && !(m_async_command->m_target_state))
+		resolve_async_command_nolock(command_failed);
+}
+
+
+void main_pipeline::update_async_command_nolock()
+{
+	if (!m_async_command)
+		return;
+
+	if (!(m_async_command->m_target_state))
+	{
+		// The command is postponed; if the pipeline
+		// stops meanwhile, it is not carried out anymore
+		if (m_state == state_idle)
+			resolve_async_command_nolock(command_failed);
+		return;
+	}
+
+	if (m_async_command->m_via_state)
+	{
+		// Ignore any state before the via state, like the idle state
+		// that is set while old streams are discarded during play_media()
+		if (m_state == *(m_async_command->m_via_state))
+			m_async_command->m_via_state = boost::none;
+		return;
+	}
+
+	if (m_state == *(m_async_command->m_target_state))
+		resolve_async_command_nolock(command_completed);
+	else if (m_state == state_idle)
+		resolve_async_command_nolock(command_failed);
+}
+
+
+void main_pipeline::set_state_nolock(states const p_new_state)
+{
+	states old_state = m_state;
+	m_state = p_new_state;
+	NXPLAY_LOG_MSG(trace, "state change: old: " << get_state_name(old_state) << " new: " << get_state_name(m_state));
+	record_command_latency_nolock();
+	update_async_command_nolock();
+	update_buffer_priorities_nolock();
+	if (m_callbacks.m_state_changed_callback)
+		m_callbacks.m_state_changed_callback(old_state, p_new_state);
+}
+
+
+bool main_pipeline::plays_media_now_nolock(guint64 const p_token, bool const p_play_now) const
+{
+	// Try to play media right now if either one of these apply:
+	// 1. Pipeline is in the idle state
+	// 2. p_play_now is true (= caller explicitely wants to play media right now)
+	// 3. p_token is the same as the token of the current stream
+	return (m_state == state_idle) || p_play_now || (m_current_stream && m_current_stream->get_token() == p_token);
+}
+
+
+bool main_pipeline::play_media_nolock(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	if (plays_media_now_nolock(p_token, p_play_now))
+	{
+		if (!is_valid(p_media))
+		{
+			NXPLAY_LOG_MSG(error, "cannot play invalid media");
+			return false;
+		}
+
+		NXPLAY_LOG_MSG(debug, "playing media with URI " << p_media.get_uri() << " now with token " << p_token);
+
+		// Postpone call if transitioning
+		if (is_transitioning_nolock())
+		{
+			m_postponed_task.m_type = postponed_task::type_play;
+			m_postponed_task.m_media = std::move(p_media);
+			m_postponed_task.m_token = p_token;
+			m_postponed_task.m_playback_properties = p_properties;
+			return true;
+		}
+
+		auto startup_begin = std::chrono::steady_clock::now();
+
+		if (!start_current_stream_nolock(p_token, std::move(p_media), p_properties, 0))
+			return false;
+
+		m_num_consecutive_reconnects = 0;
+
+		m_startup_pending = true;
+		m_startup_was_fast = false;
+		m_startup_begin = startup_begin;
+		m_current_startup_stats = nullptr;
+	}
+	else
+	{
+		NXPLAY_LOG_MSG(debug, "queuing media with URI " << p_media.get_uri() << " as next media with token " << p_token);
+		// Discard any previously set next media
+		m_next_stream.reset();
+		if (is_valid(p_media))
+		{
+			// Create stream for the new next media
+			m_next_stream = setup_stream_nolock(p_token, std::move(p_media), p_properties);
+			// And sync states with parent, since the new stream
+			// is now assigned to m_current_stream
+			m_next_stream->sync_states();
+			// Don't set a buffering timeout for the next stream. Let it instead
+			// buffer until its maximum number of bytes are reached. Since the
+			// next stream won't be playing until the current one is done, it is
+			// OK to let it buffer even if does so for a long time. If this next
+			// stream becomes the current one, a buffering timeout *will* be set.
+			m_next_stream->enable_buffering_timeout(false);
+			update_buffer_priorities_nolock();
+			// Do not let the new next stream compete with
+			// the current one if that one is low on data
+			update_next_stream_blocking_nolock();
+		}
+		else
+		{
+			NXPLAY_LOG_MSG(error, "cannot schedule invalid media as next one");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool main_pipeline::start_current_stream_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties, std::size_t const p_uri_index)
+{
+	// Clear any leftover old streams, or set up the pipeline
+	// if it does not exist yet
+	if (!prepare_pipeline_nolock())
+	{
+		NXPLAY_LOG_MSG(error, "(re)initializing pipeline failed - aborting play attempt");
+		return false;
+	}
+
+	// Cleanup any previously set next media
+	m_next_stream.reset();
+
+	// Switch to the starting state
+	set_state_nolock(state_starting);
+
+	m_next_stream_throttled = false;
+
+	// Create stream for the new current media
+	m_current_stream = setup_stream_nolock(p_token, std::move(p_media), p_properties, p_uri_index);
+	m_log_context.set_current_token(p_token);
+	// And sync states with parent, since the new stream
+	// is now assigned to m_current_stream
+	m_current_stream->sync_states();
+	update_buffer_priorities_nolock();
+
+	// Switch pipeline to PAUSED. The bus watch callback then takes care
+	// of continuing the state changes to state_playing.
+	if (!set_gstreamer_state_nolock(GST_STATE_PAUSED))
+	{
+		// GStreamer state change failed. This is considered a nonrecoverable
+		// error in GStreamer, since it leaves the pipeline in an undefined
+		// state. Reinitialize the pipeline in that case, and report failure.
+		// Do *not* try to replay the media again, since the state change
+		// failure might be caused by the very media.
+		NXPLAY_LOG_MSG(error, "could not switch GStreamer pipeline to PAUSED ; reinitializing pipeline");
+		reinitialize_pipeline_nolock();
+		return false;
+	}
+
+	// Stall detection is driven by the periodic updates,
+	// so these must run during startup as well
+	if (m_stall_timeout)
+		setup_timeouts_nolock();
+
+	return true;
+}
+
+
+bool main_pipeline::set_paused_nolock(bool const p_paused)
+{
+	// Do nothing if either one of these hold true:
+	// 1. Pipeline is not present
+	// 2. State is idle
+	// 3. p_paused is true and pipeline is already paused
+	// 4. p_paused is false and pipeline is already playing
+	// 5. No current stream is present
+	// 6. Current stream is live or live status is not known
+	// Cases 3 and 4 are not failures, since the pipeline
+	// already is in the requested state.
+	// If the pipeline is transitioning, the call is postponed
+	// before checking cases 3 and 4, since the GStreamer state
+	// says nothing about the final state then (during startup
+	// for example, the GStreamer state is PAUSED, but the
+	// pipeline is going to play).
+
+	if ((m_pipeline_elem == nullptr) ||
+	    (m_state == state_idle) ||
+	    (m_current_stream == nullptr)
+	)
+		return false;
+
+	// Pipeline is transitioning, or the current stream is being
+	// restarted; postpone the call
+	if (is_transitioning_nolock() || (m_pending_stream_restart != stream_restart_none))
+	{
+		NXPLAY_LOG_MSG(info, "pipeline currently transitioning -> postponing pause task");
+		m_postponed_task.m_type = postponed_task::type_pause;
+		m_postponed_task.m_paused = p_paused;
+		return true;
+	}
+
+	states target_state = p_paused ? state_paused : state_playing;
+
+	if ((p_paused && (m_current_gstreamer_state == GST_STATE_PAUSED)) ||
+	    (!p_paused && (m_pending_gstreamer_state == GST_STATE_PLAYING))
+	)
+	{
+		set_async_command_target_nolock(target_state);
+		return true;
+	}
+
+	if (m_current_stream->is_live())
+	{
+		// This case might be less obvious, so log it
+		// Live pipelines cannot be paused
+		NXPLAY_LOG_MSG(info, "current stream is live, cannot pause");
+		return false;
+	}
+
+	if (!(m_current_stream->is_live_status_known()))
+	{
+		// To be on the safe side, don't pause if the live
+		// status isn't known, in case it later turns out
+		// to be live
+		NXPLAY_LOG_MSG(info, "current stream's live status is not known yet, cannot pause");
+		return false;
+	}
+
+	set_async_command_target_nolock(target_state);
+	return set_gstreamer_state_nolock(p_paused ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+}
+
+
+bool main_pipeline::set_current_position_nolock(gint64 const p_new_position, position_units const p_unit)
 {
-	NXPLAY_LOG_MSG(trace, "setting pipeline to idle");
+	if ((m_pipeline_elem == nullptr) || (m_state == state_idle) || (m_current_stream == nullptr))
+		return false;
 
-	// Unblock buffering in the streams. This must happen before the pipeline is set to NULL,
-	// otherwise a deadlock occurs.
-	if (m_current_stream)
-		m_current_stream->block_buffering(false);	
-	if (m_next_stream)
-		m_next_stream->block_buffering(false);	
+	if (!(m_current_stream->is_seekable()))
+	{
+		NXPLAY_LOG_MSG(info, "current stream is not seekable, cannot seek");
+		return false;
+	}
 
-	// Set the pipeline to NULL. This is always a synchronous state change.
-	GstStateChangeReturn ret = gst_element_set_state(GST_ELEMENT(m_pipeline_elem), GST_STATE_NULL);
-	g_assert(ret != GST_STATE_CHANGE_ASYNC); // If this is ASYNC, something in GStreamer went seriously wrong
+	// Pipeline is transitioning, or the current stream is being
+	// restarted; postpone the call
+	if (is_transitioning_nolock() || (m_pending_stream_restart != stream_restart_none))
+	{
+		NXPLAY_LOG_MSG(info, "streamer currently transitioning -> postponing set_current_position call");
+		m_postponed_task.m_type = postponed_task::type_set_position;
+		m_postponed_task.m_position = p_new_position;
+		m_postponed_task.m_position_format = p_unit;
+		return true;
+	}
 
-	// Discard any current, next, or old streams
+	// Only actually seek if the current state is paused or playing
+	if ((m_state != state_paused) && (m_state != state_playing))
+		return false;
+
+	NXPLAY_LOG_MSG(debug, "set_current_position() called, unit " << pos_unit_description(p_unit) << "; switching to seeking state");
+
+	// save current paused status, since it needs to be
+	// temporarily modified for seeking
+	m_seeking_data.m_was_paused = (m_state == state_paused);
+	m_seeking_data.m_seek_to_position = p_new_position;
+	m_seeking_data.m_seek_format = pos_unit_to_format(p_unit);
+
+	// After seeking, the pipeline returns to the state it is in now
+	set_async_command_target_nolock(m_seeking_data.m_was_paused ? state_paused : state_playing, state_seeking);
+
+	// Pending aligned tags refer to running times
+	// from before the seek, which are reset by it
+	clear_aligned_tags_nolock();
+
+	set_state_nolock(state_seeking);
+
+	if (m_seeking_data.m_was_paused)
+	{
+		// If the pipeline is already paused, then seeking can be
+		// finished right now. This also sets the state back to
+		// paused or playing, depending on what it was before.
+		finish_seeking_nolock(true);
+	}
+	else
+	{
+		// Need to switch to PAUSED before actually seeking.
+		// The bus watch will see the state change, also see that
+		// the pipeline state is state_seeking. This will cause it
+		// to call finish_seeking_nolock().
+		set_gstreamer_state_nolock(GST_STATE_PAUSED);
+	}
+
+	return true;
+}
+
+
+void main_pipeline::stop_nolock()
+{
+	if ((m_pipeline_elem == nullptr) || (m_state == state_stopping) || (m_state == state_idle))
+		return;
+
+	if (is_transitioning_nolock())
+	{
+		// Pipeline is transitioning; postpone the call
+		m_postponed_task.m_type = postponed_task::type_stop;
+		m_postponed_task.m_media = media();
+	}
+	else
+	{
+		// We can stop right now
+		// Stopping means the streams are torn down. The output chain is
+		// kept, so the next play_media() call does not have to rebuild it.
+		// With soft stops, the output chain is kept in READY as well, to
+		// keep the output device open.
+		shutdown_timeouts_nolock();
+		set_pipeline_to_idle_nolock(true, m_soft_stop_enabled);
+	}
+}
+
+
+gint64 main_pipeline::query_duration_nolock(position_units const p_unit) const
+{	
+	if ((m_pipeline_elem == nullptr) || (m_state == state_idle))
+		return -1;
+
+	gint64 duration;
+	gboolean success = gst_element_query_duration(GST_ELEMENT(m_pipeline_elem), pos_unit_to_format(p_unit), &duration);
+	return success ? duration : gint64(-1);
+}
+
+
+void main_pipeline::update_durations_nolock()
+{
+	// Durations are needed for duration updates, and for determining
+	// when the media is about to end; if neither is subscribed, skip
+	// the queries (m_force_next_duration_update stays set, so the next
+	// update after subscribing again notifies in any case)
+	if (!is_subscribed_nolock(event_duration) && !is_subscribed_nolock(event_media_about_to_end))
+	{
+		if (m_callbacks.m_duration_updated_callback || m_callbacks.m_media_about_to_end_callback)
+			m_event_savings.m_skipped_duration_queries += 2;
+		return;
+	}
+
+	// Always check durations in both bytes and nanoseconds, but only
+	// notify if the duration actually changed (or if an update is forced
+	// by m_force_next_duration_update)
+
+	gint64 new_duration_in_nanoseconds = query_duration_nolock(position_unit_nanoseconds);
+	gint64 new_duration_in_bytes       = query_duration_nolock(position_unit_bytes);
+
+	bool duration_in_nanoseconds_updated = m_force_next_duration_update || (new_duration_in_nanoseconds != m_duration_in_nanoseconds);
+	bool duration_in_bytes_updated       = m_force_next_duration_update || (new_duration_in_bytes != m_duration_in_bytes);
+
+	NXPLAY_LOG_MSG(
+		debug,
+		"duration updated: " <<
+		"  timestamp: " << yesno(duration_in_nanoseconds_updated) <<
+		"  bytes: " << yesno(duration_in_bytes_updated) <<
+		"    current durations: " <<
+		"  timestamp: " << new_duration_in_nanoseconds <<
+		"  bytes: " << new_duration_in_bytes
+	);
+
+	// The durations are stored even if duration updates are not subscribed,
+	// since the media_about_to_end check needs them as well
+	if (duration_in_nanoseconds_updated)
+		m_duration_in_nanoseconds = new_duration_in_nanoseconds;
+	if (duration_in_bytes_updated)
+		m_duration_in_bytes = new_duration_in_bytes;
+
+	/* do duration updates if there is a current stream and a callback */
+	if (m_callbacks.m_duration_updated_callback && is_subscribed_nolock(event_duration) && (m_current_stream != nullptr))
+	{
+		if (duration_in_nanoseconds_updated)
+			m_callbacks.m_duration_updated_callback(m_current_stream->get_media(), m_current_stream->get_token(), new_duration_in_nanoseconds, position_unit_nanoseconds);
+		if (duration_in_bytes_updated)
+			m_callbacks.m_duration_updated_callback(m_current_stream->get_media(), m_current_stream->get_token(), new_duration_in_bytes, position_unit_bytes);
+	}
+
+	// Forced updates are supposed to be a one-shot action; reset the flag
+	m_force_next_duration_update = false;
+}
+
+
+bool main_pipeline::finish_seeking_nolock(bool const p_set_state_after_seeking)
+{
+	// This finishes the seeking process that was started by a
+	// set_current_position() call.
+
+	bool ret = true;
+
+	// Perform the actual seek
+	bool succeeded = gst_element_seek(
+		GST_ELEMENT(m_pipeline_elem),
+		1.0,
+		m_seeking_data.m_seek_format,
+		GstSeekFlags(GST_SEEK_FLAG_FLUSH),
+		GST_SEEK_TYPE_SET, m_seeking_data.m_seek_to_position,
+		GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+
+	if (!succeeded)
+	{
+		ret = false;
+		NXPLAY_LOG_MSG(error, "seeking failed");
+
+		// Do not exit early; if p_set_state_after_seeking is true,
+		// then the pipeline needs to be switched back to the previous state,
+		// otherwise the pipeline remains stuck in the seeking state forever
+	}
+
+	m_seeking_data.m_seek_to_position = GST_CLOCK_TIME_NONE;
+
+	if (p_set_state_after_seeking)
+	{
+		if (m_seeking_data.m_was_paused)
+		{
+			// If the pipeline was already paused when the seeking
+			// process started, then the GStreamer state does not
+			// have to be changed, since it is already PAUSED
+			NXPLAY_LOG_MSG(debug, "seeking finished; switching back to state paused");
+			set_state_nolock(state_paused);
+
+			// Handle any tasks that were postponed during the seeking state
+			handle_postponed_task_nolock();
+		}
+		else
+		{
+			NXPLAY_LOG_MSG(debug, "seeking finished; witching to PLAYING now");
+			set_gstreamer_state_nolock(GST_STATE_PLAYING);
+			// the bus watch will handle the pipeline state_seeking -> state_playing change
+		}
+	}
+
+	return ret;
+}
+
+
+void main_pipeline::make_next_stream_current_nolock()
+{
+	// Lock the stream mutex to ensure this function does not
+	// collide with static_stream_eos_probe
+	std::unique_lock < std::mutex > lock(m_stream_mutex);
+
+	if (!m_stream_eos_seen)
+		return;
+
+	// If m_stream_eos_seen is true, then the stream EOS probe has
+	// seen an EOS coming from the concat's srcpad, which means the
+	// current stream has ended. Therefore, promote the next stream
+	// to become the current one, since concat is playing this one
+	// now. (And set m_next_stream to null, since there is no next
+	// stream anymore unless the user later calls play_media() with
+	// p_play_now set to false.)
 	m_current_stream.reset();
+	m_current_stream = m_next_stream;
 	m_next_stream.reset();
+	m_log_context.set_current_token(m_current_stream ? m_current_stream->get_token() : 0);
+	// The new current stream was not started by play_media()
+	m_current_startup_stats = nullptr;
+	// Throttling was in favor of the previous current stream
+	m_next_stream_throttled = false;
+	// The promoted stream may still be blocked from back when it was
+	// the next stream (because of throttling, or because the previous
+	// current stream was buffering). Nothing competes with it anymore,
+	// and it has to deliver data right away, so lift the block.
+	if (m_current_stream)
+		m_current_stream->block_buffering(false);
 
-	if (p_set_state)
-		set_state_nolock(state_idle);
+	// m_current_stream and m_next_stream are updated and in
+	// sync with the situation over at the concat element now
+	m_stream_eos_seen = false;
 
-	NXPLAY_LOG_MSG(trace, "pipeline is idle");
+	// The former next stream is now the current one, so it
+	// gets precedence when the global buffer budget is tight
+	update_buffer_priorities_nolock();
+}
 
-	set_initial_state_values_nolock();
 
-	// Reached idle state; now handle any postponed task
-	handle_postponed_task_nolock();
+void main_pipeline::schedule_buffer_budget_update()
+{
+	// This is called by the buffer budget governor, possibly from another
+	// pipeline's thread, and with the governor's mutex locked. Do not lock
+	// the loop mutex here (this would invert the lock order); instead,
+	// attach an idle source to the mainloop, and apply the new budget there.
+	// Streams only exist while the mainloop thread runs, so
+	// m_thread_loop_context is valid here.
+
+	if (m_buffer_budget_update_pending.exchange(true))
+		return;
+
+	GSource *idle_source = g_idle_source_new();
+	g_source_set_callback(idle_source, static_buffer_budget_update_cb, gpointer(this), nullptr);
+	g_source_attach(idle_source, m_thread_loop_context);
+	g_source_unref(idle_source);
 }
 
 
-void main_pipeline::set_initial_state_values_nolock()
+void main_pipeline::update_buffer_priorities_nolock()
 {
-	m_current_gstreamer_state = GST_STATE_NULL;
-	m_pending_gstreamer_state = GST_STATE_VOID_PENDING;
-	m_duration_in_nanoseconds = -1;
-	m_duration_in_bytes = -1;
-	m_block_abouttoend_notifications = false;
-	m_force_next_duration_update = true;
-	m_stream_eos_seen = false;
-	m_aggregated_tag_list = tag_list();
-	m_postponed_tags_list = tag_list();
+	bool is_playing = (m_state == state_playing) || (m_state == state_buffering) || (m_state == state_starting) || (m_state == state_seeking);
+
+	if (m_current_stream)
+		m_current_stream->set_buffer_priority(is_playing ? buffer_priority_current_playing : buffer_priority_current_paused);
+	if (m_next_stream)
+		m_next_stream->set_buffer_priority(is_playing ? buffer_priority_next_playing : buffer_priority_next_paused);
 }
 
 
-void main_pipeline::set_state_nolock(states const p_new_state)
+gboolean main_pipeline::static_buffer_budget_update_cb(gpointer p_data)
 {
-	states old_state = m_state;
-	m_state = p_new_state;
-	NXPLAY_LOG_MSG(trace, "state change: old: " << get_state_name(old_state) << " new: " << get_state_name(m_state));
-	if (m_callbacks.m_state_changed_callback)
-		m_callbacks.m_state_changed_callback(old_state, p_new_state);
+	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
+
+	std::unique_lock < std::mutex > lock(self->m_loop_mutex);
+
+	self->m_buffer_budget_update_pending = false;
+
+	if (self->m_current_stream)
+		self->m_current_stream->apply_buffer_budget();
+	if (self->m_next_stream)
+		self->m_next_stream->apply_buffer_budget();
+
+	return G_SOURCE_REMOVE;
 }
 
 
-bool main_pipeline::play_media_nolock(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+void main_pipeline::recheck_buffering_state_nolock()
 {
-	// Try to play media right now if either one of these apply:
-	// 1. Pipeline is in the idle state
-	// 2. p_play_now is true (= caller explicitely wants to play media right now)
-	// 3. p_token is the same as the token of the current stream
-	if ((m_state == state_idle) || p_play_now || (m_current_stream && m_current_stream->get_token() == p_token))
+	assert(m_current_stream);
+
+	// Recheck if the buffering states changed, and if so, update
+	// the relevant states and values. If however the current media
+	// is a live stream, do not pause (live sources must not pause).
+	// Also, if the live status isn't known, don't pause, in case
+	// the media later turns out to be live.
+
+	if (m_current_stream->is_buffering() && !(m_current_stream->is_live()) && m_current_stream->is_live_status_known() && (m_state == state_playing))
 	{
-		if (!is_valid(p_media))
-		{
-			NXPLAY_LOG_MSG(error, "cannot play invalid media");
-			return false;
-		}
+		// The current stream is now buffering, but the pipeline is playing.
+		// Switch pipeline state to buffering and the GStreamer state to
+		// PAUSED. The former is useful for UIs to indicate buffering.
+		// The latter is needed to give the current stream time to fill its
+		// buffer(s).
 
-		NXPLAY_LOG_MSG(debug, "playing media with URI " << p_media.get_uri() << " now with token " << p_token);
+		NXPLAY_LOG_MSG(debug, "current stream's buffering flag enabled; switching to PAUSED and setting pipeline state to buffering");
+		if (m_current_startup_stats != nullptr)
+			++(m_current_startup_stats->m_num_rebuffers);
+		set_state_nolock(state_buffering);
+		set_gstreamer_state_nolock(GST_STATE_PAUSED);
+	}
+	else if (!(m_current_stream->is_buffering()) && (m_state == state_buffering) && !is_restarted_stream_prerolling_nolock())
+	{
+		// The current stream is no longer buffering, but the pipeline is
+		// still in the buffering state. The GStreamer state is PAUSED
+		// when this place is reached. Switch the GStreamer state back to
+		// PLAYING. The code in the bus watch callback will then see
+		// that the current pipeline state is state_buffering and the new
+		// GStreamer state is PLAYING, and as result, switch the pipeline
+		// state to state_playing.
+
+		NXPLAY_LOG_MSG(debug, "current stream's buffering flag disabled; switching back to PLAYING");
+		set_gstreamer_state_nolock(GST_STATE_PLAYING);
+	}
+}
 
-		// Postpone call if transitioning
-		if (is_transitioning_nolock())
-		{
-			m_postponed_task.m_type = postponed_task::type_play;
-			m_postponed_task.m_media = std::move(p_media);
-			m_postponed_task.m_token = p_token;
-			m_postponed_task.m_playback_properties = p_properties;
-			return true;
-		}
 
-		// Clear any leftover old pipeline
-		if (!reinitialize_pipeline_nolock())
+void main_pipeline::update_buffer_health_nolock()
+{
+	if (m_current_stream)
+	{
+		buffer_health const &health = m_current_stream->update_buffer_health(m_state == state_playing);
+
+		if (m_current_stream->has_buffer_health())
 		{
-			NXPLAY_LOG_MSG(error, "(re)initializing pipeline failed - aborting play attempt");
-			return false;
-		}
+			if (m_callbacks.m_buffer_health_callback && is_subscribed_nolock(event_buffer_health))
+				m_callbacks.m_buffer_health_callback(m_current_stream->get_media(), m_current_stream->get_token(), true, health);
 
-		// Cleanup any previously set next media
-		m_next_stream.reset();
+			if (m_current_stream->is_proactively_buffering())
+			{
+				// Proactive buffering was started by the pipeline, not by
+				// the queue, so the queue does not post a buffering message
+				// once it is filled. Check the level here instead.
+				guint limit = m_current_stream->get_effective_buffer_size_limit();
+				guint high_level = guint(guint64(limit) * m_current_stream->get_high_buffer_threshold() / 100);
+				unsigned int percentage = (high_level == 0) ? 100 : unsigned(std::min(guint64(health.m_level) * 100 / high_level, guint64(100)));
 
-		// Switch to the starting state
-		set_state_nolock(state_starting);
+				if (m_callbacks.m_buffering_updated_callback)
+					m_callbacks.m_buffering_updated_callback(m_current_stream->get_media(), m_current_stream->get_token(), true, percentage, health.m_level, limit);
 
-		// Create stream for the new current media
-		m_current_stream = setup_stream_nolock(p_token, std::move(p_media), p_properties);
-		// And sync states with parent, since the new stream
-		// is now assigned to m_current_stream
-		m_current_stream->sync_states();
+				if ((percentage >= 100) || health.m_ingress_finished)
+				{
+					NXPLAY_LOG_MSG(debug, "current stream's buffer recovered; ending proactive buffering");
+					set_proactively_buffering_nolock(false);
+				}
+			}
+			else if (
+				m_proactive_buffering_threshold && health.m_time_to_underrun &&
+				(*(health.m_time_to_underrun) < *m_proactive_buffering_threshold) &&
+				(m_state == state_playing) && !(m_current_stream->is_buffering()) &&
+				!(m_current_stream->is_live()) && m_current_stream->is_live_status_known()
+			)
+			{
+				NXPLAY_LOG_MSG(debug, "buffer underrun predicted in " << *(health.m_time_to_underrun) << " ns; starting proactive buffering");
+				set_proactively_buffering_nolock(true);
+			}
+			else if (m_startup_pending && (m_state == state_buffering) && m_current_stream->is_buffering() && is_fast_start_possible_nolock(health))
+			{
+				NXPLAY_LOG_MSG(debug, "buffered " << *(health.m_buffered_duration) << " ns, ingress rate " << health.m_ingress_rate << " B/s, consumption rate " << health.m_consumption_rate << " B/s; fast start");
 
-		// Switch pipeline to PAUSED. The bus watch callback then takes care
-		// of continuing the state changes to state_playing.
-		if (!set_gstreamer_state_nolock(GST_STATE_PAUSED))
-		{
-			// GStreamer state change failed. This is considered a nonrecoverable
-			// error in GStreamer, since it leaves the pipeline in an undefined
-			// state. Reinitialize the pipeline in that case, and report failure.
-			// Do *not* try to replay the media again, since the state change
-			// failure might be caused by the very media.
-			NXPLAY_LOG_MSG(error, "could not switch GStreamer pipeline to PAUSED ; reinitializing pipeline");
-			reinitialize_pipeline_nolock();
-			return false;
+				m_startup_was_fast = true;
+				m_current_stream->set_fast_started(true);
+				update_next_stream_blocking_nolock();
+				recheck_buffering_state_nolock();
+			}
 		}
 	}
-	else
+
+	if (m_current_stream && m_current_stream->has_buffer_health() && m_next_stream_throttling)
+		update_next_stream_throttling_nolock(m_current_stream->get_buffer_health());
+
+	if (m_next_stream)
 	{
-		NXPLAY_LOG_MSG(debug, "queuing media with URI " << p_media.get_uri() << " as next media with token " << p_token);
-		// Discard any previously set next media
-		m_next_stream.reset();
-		if (is_valid(p_media))
-		{
-			// Create stream for the new next media
-			m_next_stream = setup_stream_nolock(p_token, std::move(p_media), p_properties);
-			// And sync states with parent, since the new stream
-			// is now assigned to m_current_stream
-			m_next_stream->sync_states();
-			// Don't set a buffering timeout for the next stream. Let it instead
-			// buffer until its maximum number of bytes are reached. Since the
-			// next stream won't be playing until the current one is done, it is
-			// OK to let it buffer even if does so for a long time. If this next
-			// stream becomes the current one, a buffering timeout *will* be set.
-			m_next_stream->enable_buffering_timeout(false);
-		}
-		else
-		{
-			NXPLAY_LOG_MSG(error, "cannot schedule invalid media as next one");
-			return false;
-		}
+		buffer_health const &health = m_next_stream->update_buffer_health(false);
+		if (m_next_stream->has_buffer_health() && m_callbacks.m_buffer_health_callback && is_subscribed_nolock(event_buffer_health))
+			m_callbacks.m_buffer_health_callback(m_next_stream->get_media(), m_next_stream->get_token(), false, health);
 	}
-
-	return true;
 }
 
 
-void main_pipeline::set_paused_nolock(bool const p_paused)
+bool main_pipeline::is_fast_start_possible_nolock(buffer_health const &p_health) const
 {
-	// Do nothing if either one of these hold true:
-	// 1. Pipeline is not present
-	// 2. State is idle
-	// 3. p_paused is true and pipeline is already paused
-	// 4. p_paused is false and pipeline is already playing
-	// 5. No current stream is present
-	// 6. Current stream is live or live status is not known
+	if (!m_fast_start_settings)
+		return false;
 
-	if ((m_pipeline_elem == nullptr) ||
-	    (m_state == state_idle) ||
-	    (p_paused && (m_current_gstreamer_state == GST_STATE_PAUSED)) ||
-	    (!p_paused && (m_pending_gstreamer_state == GST_STATE_PLAYING)) ||
-	    (m_current_stream == nullptr)
-	)
-		return;
+	if (!(p_health.m_buffered_duration) || (*(p_health.m_buffered_duration) < m_fast_start_settings->m_min_buffered_duration))
+		return false;
 
-	if (m_current_stream->is_live())
-	{
-		// This case might be less obvious, so log it
-		// Live pipelines cannot be paused
-		NXPLAY_LOG_MSG(info, "current stream is live, cannot pause");
-		return;
-	}
+	// If everything is received already, nothing can run out
+	if (p_health.m_ingress_finished)
+		return true;
 
-	if (!(m_current_stream->is_live_status_known()))
-	{
-		// To be on the safe side, don't pause if the live
-		// status isn't known, in case it later turns out
-		// to be live
-		NXPLAY_LOG_MSG(info, "current stream's live status is not known yet, cannot pause");
-		return;
-	}
+	// Without a known consumption rate, there is nothing to compare against
+	if (p_health.m_consumption_rate == 0)
+		return false;
 
-	// Pipeline is transitioning; postpone the call
-	if (is_transitioning_nolock())
-	{
-		NXPLAY_LOG_MSG(info, "pipeline currently transitioning -> postponing pause task");
-		m_postponed_task.m_type = postponed_task::type_pause;
-		m_postponed_task.m_paused = p_paused;
+	return (p_health.m_ingress_rate * 100) >= (p_health.m_consumption_rate * m_fast_start_settings->m_safety_margin);
+}
+
+
+void main_pipeline::finish_startup_nolock()
+{
+	if (!m_startup_pending)
 		return;
-	}
 
-	set_gstreamer_state_nolock(p_paused ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+	m_startup_pending = false;
+
+	auto latency = std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now() - m_startup_begin);
+
+	startup_policy_stats &stats = m_startup_was_fast ? m_startup_stats.m_fast_starts : m_startup_stats.m_threshold_starts;
+	stats.m_last_time_to_first_audio = latency;
+	stats.m_total_time_to_first_audio += latency;
+	++stats.m_num_starts;
+	m_current_startup_stats = &stats;
+
+	NXPLAY_LOG_MSG(debug, "time to first audio: " << latency.count() << " us (" << (m_startup_was_fast ? "fast start" : "threshold start") << ")");
 }
 
 
-void main_pipeline::set_current_position_nolock(gint64 const p_new_position, position_units const p_unit)
+void main_pipeline::check_for_ingress_stall_nolock()
 {
-	if ((m_pipeline_elem == nullptr) || (m_state == state_idle) || (m_current_stream == nullptr))
+	if (!m_stall_timeout || !m_current_stream || (m_pending_stream_restart != stream_restart_none))
 		return;
 
-	if (!(m_current_stream->is_seekable()))
-	{
-		NXPLAY_LOG_MSG(info, "current stream is not seekable, cannot seek");
+	if (!(m_current_stream->check_for_ingress_stall(*m_stall_timeout)))
 		return;
-	}
 
-	// Pipeline is transitioning; postpone the call
-	if (is_transitioning_nolock())
-	{
-		NXPLAY_LOG_MSG(info, "streamer currently transitioning -> postponing set_current_position call");
-		m_postponed_task.m_type = postponed_task::type_set_position;
-		m_postponed_task.m_position = p_new_position;
-		m_postponed_task.m_position_format = p_unit;
-		return;
-	}
+	++m_mirror_failover_stats.m_num_stalls;
 
-	// Only actually seek if the current state is paused or playing
-	if ((m_state != state_paused) && (m_state != state_playing))
-		return;
+	bool mirror_left = (m_current_stream->get_uri_index() < m_current_stream->get_media().get_mirror_uris().size());
 
-	NXPLAY_LOG_MSG(debug, "set_current_position() called, unit " << pos_unit_description(p_unit) << "; switching to seeking state");
+	if (!mirror_left)
+		NXPLAY_LOG_MSG(warning, "ingress of media with URI " << m_current_stream->get_uri() << " stalled, and no mirror is left to switch to");
+	else if (!fail_over_to_next_mirror_nolock())
+		NXPLAY_LOG_MSG(warning, "ingress of media with URI " << m_current_stream->get_uri() << " stalled, but the stream cannot be restarted with a mirror right now");
+}
 
-	// save current paused status, since it needs to be
-	// temporarily modified for seeking
-	m_seeking_data.m_was_paused = (m_state == state_paused);
-	m_seeking_data.m_seek_to_position = p_new_position;
-	m_seeking_data.m_seek_format = pos_unit_to_format(p_unit);
 
-	set_state_nolock(state_seeking);
+bool main_pipeline::fail_over_to_next_mirror_nolock()
+{
+	assert(m_current_stream);
 
-	if (m_seeking_data.m_was_paused)
+	media const &cur_media = m_current_stream->get_media();
+	std::size_t uri_index = m_current_stream->get_uri_index() + 1;
+	if (uri_index > cur_media.get_mirror_uris().size())
+		return false;
+
+	NXPLAY_LOG_MSG(info, "switching from URI " << m_current_stream->get_uri() << " to mirror URI " << cur_media.get_mirror_uris()[uri_index - 1]);
+
+	if (!restart_current_stream_nolock(uri_index, stream_restart_failover))
+		return false;
+
+	// The mirror gets its own reconnect attempts
+	m_num_consecutive_reconnects = 0;
+	++m_mirror_failover_stats.m_num_failovers;
+
+	return true;
+}
+
+
+bool main_pipeline::reconnect_current_stream_nolock(GstMessage *p_error_msg)
+{
+	if (!m_source_reconnect_settings || !m_current_stream)
+		return false;
+
+	switch (m_state)
 	{
-		// If the pipeline is already paused, then seeking can be
-		// finished right now. This also sets the state back to
-		// paused or playing, depending on what it was before.
-		finish_seeking_nolock(true);
+		case state_starting:
+		case state_playing:
+		case state_buffering:
+		case state_paused:
+			break;
+		default:
+			return false;
 	}
-	else
+
+	// Only errors of the current stream's source elements are of interest;
+	// anything else is not caused by the connection
+	if (!(m_current_stream->contains_object(GST_MESSAGE_SRC(p_error_msg))))
+		return false;
+
+	GError *error = nullptr;
+	gst_message_parse_error(p_error_msg, &error, nullptr);
+	bool is_resource_error = (error->domain == GST_RESOURCE_ERROR);
+	// Reconnecting does not help if the resource does not exist
+	// or access is denied; a mirror might still work though
+	bool can_reconnect = is_resource_error && (error->code != GST_RESOURCE_ERROR_NOT_FOUND) && (error->code != GST_RESOURCE_ERROR_NOT_AUTHORIZED);
+	g_error_free(error);
+
+	if (!is_resource_error)
+		return false;
+
+	if (can_reconnect && (m_num_consecutive_reconnects < m_source_reconnect_settings->m_max_reconnects))
 	{
-		// Need to switch to PAUSED before actually seeking.
-		// The bus watch will see the state change, also see that
-		// the pipeline state is state_seeking. This will cause it
-		// to call finish_seeking_nolock().
-		set_gstreamer_state_nolock(GST_STATE_PAUSED);
+		NXPLAY_LOG_MSG(info, "source of media with URI " << m_current_stream->get_uri() << " failed; reconnecting (attempt " << (m_num_consecutive_reconnects + 1) << " of " << m_source_reconnect_settings->m_max_reconnects << ")");
+
+		if (restart_current_stream_nolock(m_current_stream->get_uri_index(), stream_restart_reconnect))
+		{
+			++m_num_consecutive_reconnects;
+			++m_source_reconnect_stats.m_num_reconnects;
+			return true;
+		}
+
+		// The stream cannot be swapped in place right now (for example
+		// because a postponed play or stop task replaces it anyway, or
+		// because it already reached its end); the error is then handled
+		// like any other, which reinitializes the pipeline
+		NXPLAY_LOG_MSG(info, "cannot reconnect media with URI " << m_current_stream->get_uri() << " in place right now");
 	}
+	else if (m_stall_timeout && fail_over_to_next_mirror_nolock())
+		return true;
+
+	++m_source_reconnect_stats.m_num_failures;
+	return false;
 }
 
 
-void main_pipeline::stop_nolock()
+bool main_pipeline::restart_current_stream_nolock(std::size_t const p_uri_index, stream_restart_reasons const p_reason)
 {
-	if ((m_pipeline_elem == nullptr) || (m_state == state_stopping) || (m_state == state_idle))
-		return;
+	assert(m_current_stream);
+
+	// A postponed play or stop task replaces the current stream anyway;
+	// postponed pause, seek and state requests are handled once the
+	// restart is finished
+	if ((m_postponed_task.m_type == postponed_task::type_play) || (m_postponed_task.m_type == postponed_task::type_stop))
+		return false;
+
+	switch (m_state)
+	{
+		case state_starting:
+		case state_playing:
+		case state_buffering:
+		case state_paused:
+			break;
+		default:
+			return false;
+	}
+
+	// If the current stream already ended, concat moved on to the
+	// next stream's sinkpad, so there is nothing left to restart
+	{
+		std::unique_lock < std::mutex > lock(m_stream_mutex);
+		if (m_stream_eos_seen)
+			return false;
+	}
 
-	if (is_transitioning_nolock())
+	auto restart_begin = std::chrono::steady_clock::now();
+
+	// Continue where the old stream left off. Streams that cannot seek
+	// (live streams for example) just continue with what the new source
+	// delivers. If the restart happens during startup, the new stream
+	// applies the start position from the playback properties just
+	// like the old one would have. If the previous restart did not get
+	// to seek yet (because its stream failed as well), its position
+	// and begin time still apply.
+	boost::optional < gint64 > resume_position;
+	if ((m_pending_stream_restart != stream_restart_none) && m_stream_restart_position)
 	{
-		// Pipeline is transitioning; postpone the call
-		m_postponed_task.m_type = postponed_task::type_stop;
-		m_postponed_task.m_media = media();
+		resume_position = m_stream_restart_position;
+		restart_begin = m_stream_restart_begin;
 	}
-	else
+	else if (m_state != state_starting)
 	{
-		// We can stop right now
-		// Stopping means the pipeline is torn down
-		shutdown_pipeline_nolock(true);
+		gint64 position;
+		if (m_current_stream->is_seekable() && gst_element_query_position(GST_ELEMENT(m_pipeline_elem), GST_FORMAT_TIME, &position) && (position > 0))
+			resume_position = position;
 	}
-}
 
+	guint64 token = m_current_stream->get_token();
+	media restarted_media = m_current_stream->get_media();
+	playback_properties properties = m_current_stream->get_playback_properties();
+
+	// Only the stream is replaced. The state, tags, duration, the next
+	// stream, and the output chain stay as they are. The new stream takes
+	// over the old stream's concat sinkpad, so concat still plays the
+	// next stream after it.
+	//
+	// The old stream's streaming thread may be blocked downstream (for
+	// example in the sink while it is prerolled), and then the old stream
+	// could not be shut down. Flushing wakes it up, and discards the old
+	// stream's data in the output chain. The flush makes the pipeline
+	// preroll again, which is picked up by continue_stream_restart_nolock().
+	m_current_stream->block_buffering(false);
+	GstPad *concat_sinkpad = m_current_stream->hand_over_concat_sinkpad();
+	gst_pad_send_event(concat_sinkpad, gst_event_new_flush_start());
+	m_current_stream.reset();
+	// Reset the running time, just like a flushing seek does, since the
+	// new stream's timestamps start from the beginning again
+	gst_pad_send_event(concat_sinkpad, gst_event_new_flush_stop(TRUE));
 
-gint64 main_pipeline::query_duration_nolock(position_units const p_unit) const
-{	
-	if ((m_pipeline_elem == nullptr) || (m_state == state_idle))
-		return -1;
+	m_current_stream = setup_stream_nolock(token, std::move(restarted_media), properties, p_uri_index, concat_sinkpad);
+	gst_object_unref(GST_OBJECT(concat_sinkpad));
+	m_current_stream->sync_states();
+	update_buffer_priorities_nolock();
+	update_next_stream_blocking_nolock();
 
-	gint64 duration;
-	gboolean success = gst_element_query_duration(GST_ELEMENT(m_pipeline_elem), pos_unit_to_format(p_unit), &duration);
-	return success ? duration : gint64(-1);
+	m_pending_stream_restart = p_reason;
+	m_stream_restart_begin = restart_begin;
+	m_stream_restart_position = resume_position;
+	m_stream_restart_seeking = false;
+
+	return true;
 }
 
 
-void main_pipeline::update_durations_nolock()
+void main_pipeline::continue_stream_restart_nolock()
 {
-	// Always check durations in both bytes and nanoseconds, but only
-	// notify if the duration actually changed (or if an update is forced
-	// by m_force_next_duration_update)
+	// Called when the pipeline prerolled after the flush in
+	// restart_current_stream_nolock(), or after the seek below
 
-	gint64 new_duration_in_nanoseconds = query_duration_nolock(position_unit_nanoseconds);
-	gint64 new_duration_in_bytes       = query_duration_nolock(position_unit_bytes);
+	if (m_stream_restart_position)
+	{
+		gint64 position = *m_stream_restart_position;
+		m_stream_restart_position = boost::none;
 
-	bool duration_in_nanoseconds_updated = m_force_next_duration_update || (new_duration_in_nanoseconds != m_duration_in_nanoseconds);
-	bool duration_in_bytes_updated       = m_force_next_duration_update || (new_duration_in_bytes != m_duration_in_bytes);
+		if (m_current_stream->is_seekable())
+		{
+			NXPLAY_LOG_MSG(debug, "restarted stream prerolled; seeking to position " << position << " ns, where the old stream left off");
 
-	NXPLAY_LOG_MSG(
-		debug,
-		"duration updated: " <<
-		"  timestamp: " << yesno(duration_in_nanoseconds_updated) <<
-		"  bytes: " << yesno(duration_in_bytes_updated) <<
-		"    current durations: " <<
-		"  timestamp: " << new_duration_in_nanoseconds <<
-		"  bytes: " << new_duration_in_bytes
-	);
+			bool succeeded = gst_element_seek(
+				GST_ELEMENT(m_pipeline_elem),
+				1.0,
+				GST_FORMAT_TIME,
+				GstSeekFlags(GST_SEEK_FLAG_FLUSH),
+				GST_SEEK_TYPE_SET, position,
+				GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
 
-	/* do duration updates if there is a current stream and a callback */
-	if (m_callbacks.m_duration_updated_callback && (m_current_stream != nullptr))
-	{
-		if (duration_in_nanoseconds_updated)
-		{
-			m_duration_in_nanoseconds = new_duration_in_nanoseconds;
-			m_callbacks.m_duration_updated_callback(m_current_stream->get_media(), m_current_stream->get_token(), new_duration_in_nanoseconds, position_unit_nanoseconds);
-		}
+			if (succeeded)
+			{
+				// The flushing seek makes the pipeline preroll once more
+				m_stream_restart_seeking = true;
+				return;
+			}
 
-		if (duration_in_bytes_updated)
-		{
-			m_duration_in_bytes = new_duration_in_bytes;
-			m_callbacks.m_duration_updated_callback(m_current_stream->get_media(), m_current_stream->get_token(), new_duration_in_bytes, position_unit_bytes);
+			NXPLAY_LOG_MSG(warning, "seeking in the restarted stream failed; continuing from its beginning");
 		}
+		else
+			NXPLAY_LOG_MSG(info, "restarted stream is not seekable; continuing from its beginning");
 	}
 
-	// Forced updates are supposed to be a one-shot action; reset the flag
-	m_force_next_duration_update = false;
+	m_stream_restart_seeking = false;
+
+	switch (m_state)
+	{
+		case state_paused:
+			// The pipeline stays in PAUSED, so the restart is done now
+			finish_stream_restart_nolock();
+			handle_postponed_task_nolock();
+			break;
+
+		case state_buffering:
+			// The buffering state changes are suspended while the restarted
+			// stream prerolls (see recheck_buffering_state_nolock()), so
+			// catch up now. Once the pipeline is PLAYING again, the
+			// restart finishes.
+			recheck_buffering_state_nolock();
+			break;
+
+		default:
+			// When playing, the pipeline returns to PLAYING on its own after
+			// prerolling, and the state change handler finishes the restart.
+			// During startup, the startup code does that.
+			break;
+	}
 }
 
 
-bool main_pipeline::finish_seeking_nolock(bool const p_set_state_after_seeking)
+bool main_pipeline::is_restarted_stream_prerolling_nolock() const
 {
-	// This finishes the seeking process that was started by a
-	// set_current_position() call.
+	return m_stream_restart_position || m_stream_restart_seeking;
+}
 
-	bool ret = true;
 
-	// Perform the actual seek
-	bool succeeded = gst_element_seek(
-		GST_ELEMENT(m_pipeline_elem),
-		1.0,
-		m_seeking_data.m_seek_format,
-		GstSeekFlags(GST_SEEK_FLAG_FLUSH),
-		GST_SEEK_TYPE_SET, m_seeking_data.m_seek_to_position,
-		GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+void main_pipeline::finish_stream_restart_nolock()
+{
+	if (m_pending_stream_restart == stream_restart_none)
+		return;
 
-	if (!succeeded)
+	auto latency = std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now() - m_stream_restart_begin);
+
+	switch (m_pending_stream_restart)
 	{
-		ret = false;
-		NXPLAY_LOG_MSG(error, "seeking failed");
+		case stream_restart_failover:
+			m_mirror_failover_stats.m_last_failover_time = latency;
+			m_mirror_failover_stats.m_total_failover_time += latency;
+			NXPLAY_LOG_MSG(debug, "mirror failover took " << latency.count() << " us");
+			break;
 
-		// Do not exit early; if p_set_state_after_seeking is true,
-		// then the pipeline needs to be switched back to the previous state,
-		// otherwise the pipeline remains stuck in the seeking state forever
+		case stream_restart_reconnect:
+			m_source_reconnect_stats.m_last_recovery_time = latency;
+			m_source_reconnect_stats.m_total_recovery_time += latency;
+			++m_source_reconnect_stats.m_num_recoveries;
+			NXPLAY_LOG_MSG(debug, "recovered from source failure in " << latency.count() << " us");
+			break;
+
+		default:
+			break;
 	}
 
-	m_seeking_data.m_seek_to_position = GST_CLOCK_TIME_NONE;
+	// The source works again, so it gets the full
+	// number of reconnects the next time it fails
+	m_num_consecutive_reconnects = 0;
+	m_pending_stream_restart = stream_restart_none;
+}
 
-	if (p_set_state_after_seeking)
-	{
-		if (m_seeking_data.m_was_paused)
-		{
-			// If the pipeline was already paused when the seeking
-			// process started, then the GStreamer state does not
-			// have to be changed, since it is already PAUSED
-			NXPLAY_LOG_MSG(debug, "seeking finished; switching back to state paused");
-			set_state_nolock(state_paused);
 
-			// Handle any tasks that were postponed during the seeking state
-			handle_postponed_task_nolock();
-		}
-		else
+void main_pipeline::set_proactively_buffering_nolock(bool const p_flag)
+{
+	assert(m_current_stream);
+
+	m_current_stream->set_proactively_buffering(p_flag);
+
+	// Same as with regular buffering; the next stream
+	// must not compete with the current one
+	update_next_stream_blocking_nolock();
+
+	recheck_buffering_state_nolock();
+}
+
+
+void main_pipeline::update_next_stream_throttling_nolock(buffer_health const &p_current_health)
+{
+	// Nothing left to protect once the current stream received everything
+	if (p_current_health.m_ingress_finished)
+	{
+		if (m_next_stream_throttled)
 		{
-			NXPLAY_LOG_MSG(debug, "seeking finished; witching to PLAYING now");
-			set_gstreamer_state_nolock(GST_STATE_PLAYING);
-			// the bus watch will handle the pipeline state_seeking -> state_playing change
+			NXPLAY_LOG_MSG(debug, "current stream received all of its data; resuming next stream ingress");
+			m_next_stream_throttled = false;
+			update_next_stream_blocking_nolock();
 		}
+		return;
 	}
 
-	return ret;
+	// Without a bitrate, the buffered duration is unknown; keep the current throttling state
+	if (!(p_current_health.m_buffered_duration))
+		return;
+
+	guint64 buffered_duration = *(p_current_health.m_buffered_duration);
+	guint64 time_to_underrun = p_current_health.m_time_to_underrun.get_value_or(G_MAXUINT64);
+	guint64 health = std::min(buffered_duration, time_to_underrun);
+
+	if (!m_next_stream_throttled && (health < m_next_stream_throttling->m_pause_below))
+	{
+		NXPLAY_LOG_MSG(debug, "current stream's buffer health is low (" << health << " ns); pausing next stream ingress");
+		m_next_stream_throttled = true;
+		++m_num_next_stream_throttles;
+		update_next_stream_blocking_nolock();
+	}
+	else if (m_next_stream_throttled && (health >= m_next_stream_throttling->m_resume_above))
+	{
+		NXPLAY_LOG_MSG(debug, "current stream's buffer health recovered (" << health << " ns); resuming next stream ingress");
+		m_next_stream_throttled = false;
+		update_next_stream_blocking_nolock();
+	}
 }
 
 
-void main_pipeline::make_next_stream_current_nolock()
+void main_pipeline::update_next_stream_blocking_nolock()
 {
-	// Lock the stream mutex to ensure this function does not
-	// collide with static_stream_eos_probe
-	std::unique_lock < std::mutex > lock(m_stream_mutex);
-
-	if (!m_stream_eos_seen)
+	if (!m_next_stream)
 		return;
 
-	// If m_stream_eos_seen is true, then the stream EOS probe has
-	// seen an EOS coming from the concat's srcpad, which means the
-	// current stream has ended. Therefore, promote the next stream
-	// to become the current one, since concat is playing this one
-	// now. (And set m_next_stream to null, since there is no next
-	// stream anymore unless the user later calls play_media() with
-	// p_play_now set to false.)
-	m_current_stream.reset();
-	m_current_stream = m_next_stream;
-	m_next_stream.reset();
-
-	// m_current_stream and m_next_stream are updated and in
-	// sync with the situation over at the concat element now
-	m_stream_eos_seen = false;
+	// The next stream must not compete with the current one for
+	// bandwidth if the current one is buffering or low on data
+	bool block = m_next_stream_throttled || (m_current_stream && m_current_stream->is_buffering());
+	m_next_stream->block_buffering(block);
 }
 
 
-void main_pipeline::recheck_buffering_state_nolock()
+bool main_pipeline::is_subscribed_nolock(event_types const p_event_type) const
 {
-	assert(m_current_stream);
+	return (m_event_subscriptions & p_event_type) != 0;
+}
 
-	// Recheck if the buffering states changed, and if so, update
-	// the relevant states and values. If however the current media
-	// is a live stream, do not pause (live sources must not pause).
-	// Also, if the live status isn't known, don't pause, in case
-	// the media later turns out to be live.
 
-	if (m_current_stream->is_buffering() && !(m_current_stream->is_live()) && m_current_stream->is_live_status_known() && (m_state == state_playing))
-	{
-		// The current stream is now buffering, but the pipeline is playing.
-		// Switch pipeline state to buffering and the GStreamer state to
-		// PAUSED. The former is useful for UIs to indicate buffering.
-		// The latter is needed to give the current stream time to fill its
-		// buffer(s).
+void main_pipeline::apply_output_quantization_nolock()
+{
+	if (m_output_audioconvert_elem == nullptr)
+		return;
 
-		NXPLAY_LOG_MSG(debug, "current stream's buffering flag enabled; switching to PAUSED and setting pipeline state to buffering");
-		set_state_nolock(state_buffering);
-		set_gstreamer_state_nolock(GST_STATE_PAUSED);
-	}
-	else if (!(m_current_stream->is_buffering()) && (m_state == state_buffering))
+	GstAudioDitherMethod dither_method = GST_AUDIO_DITHER_TPDF;
+	switch (m_dither_method)
 	{
-		// The current stream is no longer buffering, but the pipeline is
-		// still in the buffering state. The GStreamer state is PAUSED
-		// when this place is reached. Switch the GStreamer state back to
-		// PLAYING. The code in the bus watch callback will then see
-		// that the current pipeline state is state_buffering and the new
-		// GStreamer state is PLAYING, and as result, switch the pipeline
-		// state to state_playing.
+		case dither_none: dither_method = GST_AUDIO_DITHER_NONE; break;
+		case dither_rpdf: dither_method = GST_AUDIO_DITHER_RPDF; break;
+		case dither_tpdf: dither_method = GST_AUDIO_DITHER_TPDF; break;
+		case dither_tpdf_hf: dither_method = GST_AUDIO_DITHER_TPDF_HF; break;
+	}
 
-		NXPLAY_LOG_MSG(debug, "current stream's buffering flag disabled; switching back to PLAYING");
-		set_gstreamer_state_nolock(GST_STATE_PLAYING);
+	GstAudioNoiseShapingMethod noise_shaping_method = GST_AUDIO_NOISE_SHAPING_NONE;
+	switch (m_noise_shaping_method)
+	{
+		case noise_shaping_none: noise_shaping_method = GST_AUDIO_NOISE_SHAPING_NONE; break;
+		case noise_shaping_error_feedback: noise_shaping_method = GST_AUDIO_NOISE_SHAPING_ERROR_FEEDBACK; break;
+		case noise_shaping_simple: noise_shaping_method = GST_AUDIO_NOISE_SHAPING_SIMPLE; break;
+		case noise_shaping_medium: noise_shaping_method = GST_AUDIO_NOISE_SHAPING_MEDIUM; break;
+		case noise_shaping_high: noise_shaping_method = GST_AUDIO_NOISE_SHAPING_HIGH; break;
 	}
+
+	g_object_set(
+		G_OBJECT(m_output_audioconvert_elem),
+		"dithering", dither_method,
+		"noise-shaping", noise_shaping_method,
+		nullptr
+	);
 }
 
 
@@ -1608,12 +4029,47 @@ void main_pipeline::create_dot_pipeline_dump_nolock(std::string const &p_extra_n
 }
 
 
+guint64 main_pipeline::estimate_output_buffer_size_nolock() const
+{
+	if ((m_audiosink_elem == nullptr) || (m_current_gstreamer_state < GST_STATE_PAUSED))
+		return 0;
+
+	// Audio sinks store decoded data in a ringbuffer whose size is defined by the
+	// "buffer-time" property (in microseconds). autoaudiosink is a bin, so look
+	// for the actual sink inside it.
+	GstElement *sink = find_element_with_property(m_audiosink_elem, "buffer-time");
+	if (sink == nullptr)
+		return 0;
+
+	gint64 buffer_time = 0;
+	g_object_get(G_OBJECT(sink), "buffer-time", &buffer_time, nullptr);
+	gst_object_unref(GST_OBJECT(sink));
+
+	guint64 size = 0;
+	GstPad *sinkpad = gst_element_get_static_pad(m_audiosink_elem, "sink");
+	GstCaps *caps = gst_pad_get_current_caps(sinkpad);
+	if (caps != nullptr)
+	{
+		GstAudioInfo info;
+		if (gst_audio_info_from_caps(&info, caps) && (buffer_time > 0))
+			size = gst_util_uint64_scale_int(buffer_time, GST_AUDIO_INFO_RATE(&info) * GST_AUDIO_INFO_BPF(&info), G_USEC_PER_SEC);
+		gst_caps_unref(caps);
+	}
+	gst_object_unref(GST_OBJECT(sinkpad));
+
+	return size;
+}
+
+
 
 gboolean main_pipeline::static_timeout_cb(gpointer p_data)
 {
+	NXPLAY_ALLOC_SCOPE("main_pipeline::static_timeout_cb");
+
 	// The timeout callback is called by the main_pipeline's internal GLib mainloop.
 
 	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
 
 	// Lock is *not* held when this callback is invoked, since the
 	// GLib mainloop is what calls it (and the lock is not held
@@ -1628,7 +4084,7 @@ gboolean main_pipeline::static_timeout_cb(gpointer p_data)
 
 	// Pass on any postponed tags now to the m_new_tags_callback
 	// (if there are any)
-	if (self->m_callbacks.m_new_tags_callback && (self->m_current_stream != nullptr) && !(self->m_postponed_tags_list.is_empty()))
+	if (self->m_callbacks.m_new_tags_callback && self->is_subscribed_nolock(event_tags) && (self->m_current_stream != nullptr) && !(self->m_postponed_tags_list.is_empty()))
 		self->m_callbacks.m_new_tags_callback(self->m_current_stream->get_media(), self->m_current_stream->get_token(), std::move(self->m_postponed_tags_list));
 	// Reset the postponed tasks even if no callback is set,
 	// to make sure this list does not accumulate and grow
@@ -1638,7 +4094,9 @@ gboolean main_pipeline::static_timeout_cb(gpointer p_data)
 	// stream, and there is a position_updated, buffer_level, or media_about_to_end callback.
 	if ((self->m_pipeline_elem != nullptr) && (self->m_state == state_playing) && (self->m_current_stream != nullptr) && (self->m_callbacks.m_position_updated_callback || self->m_callbacks.m_buffer_level_callback || self->m_callbacks.m_media_about_to_end_callback))
 	{
-		if (self->m_callbacks.m_buffer_level_callback)
+		if (self->m_callbacks.m_buffer_level_callback && !self->is_subscribed_nolock(event_buffer_level))
+			++self->m_event_savings.m_skipped_buffer_level_queries;
+		else if (self->m_callbacks.m_buffer_level_callback)
 		{
 			auto cur_level = self->m_current_stream->get_current_buffer_level();
 			if (cur_level)
@@ -1652,21 +4110,27 @@ gboolean main_pipeline::static_timeout_cb(gpointer p_data)
 			}
 		}
 
-		if (self->m_callbacks.m_position_updated_callback || self->m_callbacks.m_media_about_to_end_callback)
+		// The position is needed for position updates, and for checking if
+		// the media is about to end (unless that was already notified)
+		bool notify_position = self->m_callbacks.m_position_updated_callback && self->is_subscribed_nolock(event_position);
+		bool check_about_to_end = self->m_callbacks.m_media_about_to_end_callback && self->is_subscribed_nolock(event_media_about_to_end) && !(self->m_block_abouttoend_notifications);
+
+		if ((self->m_callbacks.m_position_updated_callback || self->m_callbacks.m_media_about_to_end_callback) && !notify_position && !check_about_to_end)
+			++self->m_event_savings.m_skipped_position_queries;
+		else if (notify_position || check_about_to_end)
 		{
 			// TODO: also do BYTES queries?
 			gint64 position;
 			if (gst_element_query_position(GST_ELEMENT(self->m_pipeline_elem), GST_FORMAT_TIME, &position))
 			{
 				// Notify about the new position if the callback is set
-				if (self->m_callbacks.m_position_updated_callback)
+				if (notify_position)
 					self->m_callbacks.m_position_updated_callback(self->m_current_stream->get_media(), self->m_current_stream->get_token(), position, position_unit_nanoseconds);
 
 				// If the current position is close enough to the duration,
 				// and if a media_about_to_end callback is set, and if the callback
 				// hasn't been called before for this media, notify
-				if (!(self->m_block_abouttoend_notifications) &&
-				    self->m_callbacks.m_media_about_to_end_callback &&
+				if (check_about_to_end &&
 				    self->m_current_stream && (self->m_duration_in_nanoseconds != -1) &&
 				    (GST_CLOCK_DIFF(position, self->m_duration_in_nanoseconds) < gint64(self->m_needs_next_media_time))
 				)
@@ -1681,6 +4145,12 @@ gboolean main_pipeline::static_timeout_cb(gpointer p_data)
 		}
 	}
 
+	if ((self->m_pipeline_elem != nullptr) && ((self->m_state == state_playing) || (self->m_state == state_buffering)))
+		self->update_buffer_health_nolock();
+
+	if ((self->m_pipeline_elem != nullptr) && ((self->m_state == state_starting) || (self->m_state == state_playing) || (self->m_state == state_buffering)))
+		self->check_for_ingress_stall_nolock();
+
 	return G_SOURCE_CONTINUE;
 }
 
@@ -1721,6 +4191,8 @@ void main_pipeline::shutdown_timeouts_nolock()
 
 GstBusSyncReply main_pipeline::static_bus_sync_handler(GstBus *, GstMessage *p_msg, gpointer)
 {
+	NXPLAY_STREAMING_ALLOC_SCOPE("main_pipeline::static_bus_sync_handler");
+
 	switch (GST_MESSAGE_TYPE(p_msg))
 	{
 		case GST_MESSAGE_ERROR:
@@ -1752,9 +4224,12 @@ GstBusSyncReply main_pipeline::static_bus_sync_handler(GstBus *, GstMessage *p_m
 
 gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p_data)
 {
+	NXPLAY_ALLOC_SCOPE("main_pipeline::static_bus_watch");
+
 	// The bus watch is called by the main_pipeline's internal GLib mainloop.
 
 	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
 
 	std::unique_lock < std::mutex > lock(self->m_loop_mutex);
 
@@ -1770,6 +4245,8 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 		{
 			if (gst_message_has_name(p_msg, stream_eos_msg_name))
 				NXPLAY_LOG_MSG(trace, "received message from stream EOS probe");
+			else if (gst_message_has_name(p_msg, aligned_tags_msg_name))
+				self->handle_aligned_tags_message_nolock(p_msg);
 
 			break;
 		}
@@ -1780,28 +4257,42 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 
 			NXPLAY_LOG_MSG(debug, "stream start reported by " << GST_MESSAGE_SRC_NAME(p_msg));
 
-			// Fresh new media started, so clear this flag, since otherwise,
-			// media-about-to-end callback calls would not ever happen for the new media
-			self->m_block_abouttoend_notifications = false;
+			// A restarted stream (a mirror that took over from a stalled
+			// stream, or a reconnect) continues the same media, so its
+			// tags and duration are still valid, and the tags it posts
+			// are compared against them
+			bool is_restarted_stream = (self->m_pending_stream_restart != stream_restart_none);
 
-			// Clear aggregated tag list, since it contains
-			// stale tags from the previous stream
-			self->m_aggregated_tag_list = tag_list();
-			// Clear postponed tags, since they belong to the
-			// previous stream
-			self->m_postponed_tags_list = tag_list();
+			if (!is_restarted_stream)
+			{
+				// Fresh new media started, so clear this flag, since otherwise,
+				// media-about-to-end callback calls would not ever happen for the new media
+				self->m_block_abouttoend_notifications = false;
+
+				// Clear aggregated tag list, since it contains
+				// stale tags from the previous stream
+				self->m_aggregated_tag_list = tag_list();
+				// Clear postponed tags, since they belong to the
+				// previous stream
+				self->m_postponed_tags_list = tag_list();
+				// Same with pending aligned tags; any tags of this new
+				// stream are posted after this message
+				self->clear_aligned_tags_nolock();
+			}
 
 			if (self->m_current_stream)
 			{
 				// Update durations. With some media, it is necessary
 				// to do this here. Force it in case no further
 				// duration updates will ever happen.
-				self->m_force_next_duration_update = true;
+				if (!is_restarted_stream)
+					self->m_force_next_duration_update = true;
 				self->update_durations_nolock();
 
 				NXPLAY_LOG_MSG(debug, "media with URI " << self->m_current_stream->get_media().get_uri() << " started to play");
 
-				if (self->m_callbacks.m_media_started_callback)
+				// The media of a restarted stream already started
+				if (self->m_callbacks.m_media_started_callback && !is_restarted_stream)
 					self->m_callbacks.m_media_started_callback(self->m_current_stream->get_media(), self->m_current_stream->get_token());
 
 				if (!(self->m_current_stream->is_live_status_known()))
@@ -1951,6 +4442,13 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 
 									NXPLAY_LOG_MSG(debug, "pipeline reaches the PAUSED state, and current stream is supposed to start in paused state");
 									self->set_state_nolock(state_paused);
+									// The time to first audio would then depend
+									// on when playback is unpaused, so skip it
+									self->m_startup_pending = false;
+									self->finish_stream_restart_nolock();
+
+									// Handle any tasks that were postponed during startup
+									self->handle_postponed_task_nolock();
 								}
 								else
 								{
@@ -1963,6 +4461,9 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 									{
 										NXPLAY_LOG_MSG(debug, "current stream is still buffering during startup; switching pipeline to buffering state");
 										self->set_state_nolock(state_buffering);
+										// Keep the buffer health model updated; the
+										// fast start policy depends on it
+										enable_timeouts = true;
 									}
 									else
 									{
@@ -1977,7 +4478,12 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 
 						case GST_STATE_PLAYING:
 							enable_timeouts = true;
+							self->finish_startup_nolock();
+							self->finish_stream_restart_nolock();
 							self->set_state_nolock(state_playing);
+
+							// Handle any tasks that were postponed during startup
+							self->handle_postponed_task_nolock();
 							break;
 
 						default:
@@ -2005,6 +4511,8 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 							// We are playing again. Re-enable timeouts.
 							enable_timeouts = true;
 							NXPLAY_LOG_MSG(debug, "seeking finished, and switching back to the PLAYING GStreamer state completed; setting pipeline state to playing");
+							self->finish_startup_nolock();
+							self->finish_stream_restart_nolock();
 							self->set_state_nolock(state_playing);
 
 							// Handle any tasks that were postponed during seeking
@@ -2030,8 +4538,16 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 							// It is safe to assume that switching to playing is correct here, since
 							// recheck_buffering_state_nolock() does not switch to state_buffering while
 							// the pipeline is paused.
-							if (self->m_current_stream && !(self->m_current_stream->is_buffering()))
+							// A restarted stream that is still prerolling is not ready for playing yet;
+							// continue_stream_restart_nolock() takes care of this case later.
+							if (self->m_current_stream && !(self->m_current_stream->is_buffering()) && !(self->is_restarted_stream_prerolling_nolock()))
 								self->set_gstreamer_state_nolock(GST_STATE_PLAYING);
+							else
+							{
+								// Keep the buffer health updates going while buffering.
+								// These are also what ends proactive buffering.
+								enable_timeouts = true;
+							}
 							break;
 
 						case GST_STATE_PLAYING:
@@ -2039,6 +4555,8 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 							enable_timeouts = true;
 							NXPLAY_LOG_MSG(debug, "reached PLAYING GStreamer state after buffering finished; switching back to playing state");
 
+							self->finish_startup_nolock();
+							self->finish_stream_restart_nolock();
 							self->set_state_nolock(state_playing);
 
 							// Handle any tasks that were postponed during seeking
@@ -2056,6 +4574,23 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 				case state_playing:
 				case state_paused:
 				{
+					// Restarting the current stream flushes the output, so the
+					// pipeline prerolls again, and then returns to PLAYING on its
+					// own if it was playing before. These GStreamer state changes
+					// do not change the pipeline state.
+					if (self->m_pending_stream_restart != stream_restart_none)
+					{
+						enable_timeouts = (self->m_state == state_playing);
+
+						if ((new_gstreamer_state == GST_STATE_PLAYING) && !(self->is_restarted_stream_prerolling_nolock()))
+						{
+							self->finish_stream_restart_nolock();
+							self->handle_postponed_task_nolock();
+						}
+
+						break;
+					}
+
 					// If either pipeline is in paused state and the new GStreamer
 					// state is PLAYING or vice versa, update the pipeline state.
 					// After the update, handle postponed tasks.
@@ -2090,6 +4625,10 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 					break;
 			}
 
+			// Stall detection needs the periodic updates during startup as well
+			if ((self->m_state == state_starting) && self->m_stall_timeout)
+				enable_timeouts = true;
+
 			// Update the timeout status after handling the state change
 			// This makes sure the timeout source performs periodic updates
 			// only if appropriate (= if state is playing)
@@ -2101,9 +4640,29 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 			break;
 		}
 
+		case GST_MESSAGE_ASYNC_DONE:
+		{
+			// The pipeline finished prerolling. During a stream restart,
+			// this means the new stream's data reached the sink.
+			if ((GST_MESSAGE_SRC(p_msg) == GST_OBJECT_CAST(self->m_pipeline_elem)) && (self->m_pending_stream_restart != stream_restart_none) && self->m_current_stream)
+				self->continue_stream_restart_nolock();
+
+			break;
+		}
+
 		case GST_MESSAGE_TAG:
 		{
-			if (self->m_callbacks.m_new_tags_callback)
+			if (self->m_playback_aligned_tags)
+			{
+				// Tags are picked up by the aligned tag probe at the
+				// sink instead; see set_playback_aligned_tags()
+			}
+			else if (self->m_callbacks.m_new_tags_callback && !self->is_subscribed_nolock(event_tags))
+			{
+				// Tags are not wanted right now, so skip parsing and diffing
+				++self->m_event_savings.m_skipped_tag_messages;
+			}
+			else if (self->m_callbacks.m_new_tags_callback)
 			{
 				NXPLAY_LOG_MSG(debug, "new tags reported by " << GST_MESSAGE_SRC_NAME(p_msg));
 
@@ -2118,58 +4677,9 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 					// to be able to calculate new tags next time
 					self->m_aggregated_tag_list.insert(new_tags, GST_TAG_MERGE_REPLACE);
 
-					if (self->m_postpone_all_tags)
-					{
-						// Just add all of the tags to the list of postponed tags
-						self->m_postponed_tags_list.insert(new_tags, GST_TAG_MERGE_REPLACE);
-					}
-					else
-					{
-						bool tags_left = false;
-
-						// Go over all tags in the new_tags list, remove those which are
-						// in the m_tags_to_always_postpone set, and place these in the
-						// m_postponed_tags_list.
-						for (gint num = 0; num < gst_tag_list_n_tags(new_tags.get_tag_list()); ++num)
-						{
-							std::string name(gst_tag_list_nth_tag_name(new_tags.get_tag_list(), num));
-
-							if (self->m_tags_to_always_postpone.find(std::string(name)) == self->m_tags_to_always_postpone.end())
-							{
-								// This is one tag that is *not* in the set of
-								// tags to always remove, meaning at least this
-								// tag will remain in new_tags. Therefore, there
-								// is something to report to the new_tags_callback.
-								// => set tags_left to true.
-								tags_left = true;
-								continue;
-							}
-
-							// At this point, it is clear that this tag is one of the
-							// ones included in m_tags_to_always_postpone. Therefore,
-							// this tag must be postponed.
-
-							// If this value is already present in m_postponed_tags_list,
-							// remove it first.
-							if (has_value(self->m_postponed_tags_list, name))
-								gst_tag_list_remove_tag(self->m_postponed_tags_list.get_tag_list(), name.c_str());
-
-							// Append each value for this tag to the m_postponed_tags_list
-							for (guint index = 0; index < get_num_values_for_tag(new_tags, name); ++index)
-							{
-								GValue const *value = get_raw_value(new_tags, name, index);
-								add_raw_value(self->m_postponed_tags_list, value, name, GST_TAG_MERGE_APPEND);
-							}
-
-							// Finally, remove this tag from new_tags
-							gst_tag_list_remove_tag(new_tags.get_tag_list(), name.c_str());
-						}
-
-						// Report new_tags to the callback unless the loop above
-						// removed all values
-						if (tags_left)
-							self->m_callbacks.m_new_tags_callback(self->m_current_stream->get_media(), self->m_current_stream->get_token(), std::move(new_tags));
-					}
+					// Report new_tags to the callback unless all of them were postponed
+					if (self->postpone_tags_nolock(new_tags))
+						self->m_callbacks.m_new_tags_callback(self->m_current_stream->get_media(), self->m_current_stream->get_token(), std::move(new_tags));
 				}
 			}
 
@@ -2194,7 +4704,25 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 
 		case GST_MESSAGE_ERROR:
 		{
+			// The sync handler drops errors of streams that are being shut
+			// down, but errors posted shortly before the shutdown may
+			// still be queued. These are meaningless as well.
+			if (is_object_marked_as_shutting_down(G_OBJECT(GST_MESSAGE_SRC(p_msg))))
+			{
+				NXPLAY_LOG_MSG(debug, "ignoring error message from stream object " << GST_MESSAGE_SRC_NAME(p_msg) << " that was shut down");
+				break;
+			}
+
 			std::string text = message_to_str(p_msg, GST_LEVEL_ERROR);
+
+			// Source failures may be transient network problems
+			if (self->reconnect_current_stream_nolock(p_msg))
+			{
+				if (self->m_callbacks.m_warning_callback)
+					self->m_callbacks.m_warning_callback(text);
+				break;
+			}
+
 			if (self->m_callbacks.m_error_callback)
 				self->m_callbacks.m_error_callback(text);
 
@@ -2237,12 +4765,30 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 				char const *label = is_current ? "current" : "next";
 				bool changed = false;
 
+				// After a fast start, the queue is still in the buffering cycle
+				// that began at startup, and keeps posting levels below 100%
+				// while it fills up. These are expected. Only if the level falls
+				// below the low threshold does the stream need to buffer again.
+				// (The queue's percentage is relative to the high threshold.)
+				bool ignore_level = false;
+				if (stream_->is_fast_started())
+				{
+					if (percent >= 100)
+						stream_->set_fast_started(false);
+					else
+						ignore_level = (guint(percent) * stream_->get_high_buffer_threshold() / 100) >= stream_->get_low_buffer_threshold();
+				}
+
 				// Use a low/high watermark approach. If the stream isn't buffering,
 				// and the buffer fill level falls below 100%, enable buffering.
 				// If the stream is buffering, and the fill level reaches 100%
 				// (= stream is fully filled), disable buffering.
 
-				if (percent < 100)
+				if (ignore_level)
+				{
+					NXPLAY_LOG_MSG(trace, label << " stream was fast started, and its buffer fill level is above the low threshold; not buffering");
+				}
+				else if (percent < 100)
 				{
 					if (!(stream_->is_buffering()))
 					{
@@ -2292,7 +4838,7 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 						else
 							NXPLAY_LOG_MSG(debug, "current stream no longer needs to buffer; unblock buffering in the next stream");
 
-						self->m_next_stream->block_buffering(stream_->is_buffering());
+						self->update_next_stream_blocking_nolock();
 					}
 
 					self->recheck_buffering_state_nolock();
@@ -2366,6 +4912,7 @@ gboolean main_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p
 
 void main_pipeline::thread_main()
 {
+	log_context_scope log_scope(m_log_context);
 	std::unique_lock < std::mutex > lock(m_loop_mutex);
 
 	// Setup an explciit loop context. This is necessary to avoid collisions
@@ -2449,6 +4996,7 @@ gboolean main_pipeline::static_loop_start_cb(gpointer p_data)
 	// When this place is reached, the mainloop actually started
 
 	main_pipeline *self = static_cast < main_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
 
 	{
 		std::unique_lock < std::mutex > lock(self->m_loop_mutex);
@@ -12,15 +12,23 @@
 #ifndef NXPLAY_MAIN_PIPELINE_HPP
 #define NXPLAY_MAIN_PIPELINE_HPP
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
+#include <future>
 #include <memory>
 #include <set>
 #include <mutex>
 #include <thread>
+#include <utility>
 #include <vector>
 #include <condition_variable>
 #include <boost/optional.hpp>
 #include "pipeline.hpp"
+#include "buffer_budget.hpp"
+#include "ingress_scheduler.hpp"
+#include "log.hpp"
 #include "tag_list.hpp"
 #include "processing_object.hpp"
 
@@ -251,6 +259,22 @@ public:
 	 */
 	typedef std::function < void(media const &p_current_media, guint64 const p_token) > media_about_to_end_callback;
 
+	struct buffer_health;
+	/// Notifies about the health of a stream's buffer.
+	/**
+	 * This is called in the same intervals as the position updates, for the
+	 * current and the next stream, as long as they have a buffer (which is
+	 * the case with network streams, but not with local files). It is also
+	 * called while the pipeline is in the state_buffering state.
+	 *
+	 * @param p_media Const reference to the media this information is about
+	 * @param p_token Associated playback token (see pipeline::play_media() )
+	 * @param p_is_current_media true if p_media is the current media, false
+	 *        otherwise
+	 * @param p_health The stream's current buffer health
+	 */
+	typedef std::function < void(media const &p_media, guint64 const p_token, bool const p_is_current_media, buffer_health const &p_health) > buffer_health_callback;
+
 	/// Structure containing all of the callbacks.
 	/**
 	 * All callbacks are optional. If a callback is not defined, it will not be called.
@@ -271,10 +295,339 @@ public:
 		is_live_callback            m_is_live_callback;
 		position_updated_callback   m_position_updated_callback;
 		media_about_to_end_callback m_media_about_to_end_callback;
+		buffer_health_callback      m_buffer_health_callback;
 	};
 
 	typedef std::vector < processing_object* > processing_objects;
 
+	/// Memory usage of one stream, in bytes.
+	struct stream_memory_usage
+	{
+		/// Compressed data currently held in the stream's buffer (the queue2 element
+		/// inside uridecodebin). 0 if the stream does not use a buffer.
+		guint m_compressed_buffer;
+		/// Current size limit of the stream's buffer.
+		guint m_compressed_buffer_limit;
+		/// Estimated size of the tags that are kept for this stream (see
+		/// estimate_memory_usage() ). This includes cached cover art images.
+		gsize m_tags;
+
+		stream_memory_usage();
+	};
+
+	/// Memory usage of the whole pipeline, in bytes.
+	/**
+	 * These values are computed from existing queue levels, tag lists, and the sink's
+	 * configuration, so retrieving them is cheap. The fixed overhead of the GStreamer
+	 * elements themselves is not included.
+	 */
+	struct memory_usage
+	{
+		/// Memory usage of the current stream, or boost::none if there is no current stream.
+		boost::optional < stream_memory_usage > m_current_stream;
+		/// Memory usage of the next stream, or boost::none if there is no next stream.
+		boost::optional < stream_memory_usage > m_next_stream;
+		/// Decoded data buffered in the output chain (estimated out of the audio sink's
+		/// buffer time and the negotiated format). 0 if no format is negotiated yet.
+		guint64 m_output_buffer;
+		/// Sum of all of the values above.
+		guint64 m_total;
+
+		memory_usage();
+	};
+
+	/// Event types that can be subscribed to; see set_event_subscriptions().
+	enum event_types
+	{
+		/// new_tags_callback calls (tag messages are not parsed and diffed)
+		event_tags               = (1 << 0),
+		/// buffer_level_callback calls (the queue level is not read)
+		event_buffer_level       = (1 << 1),
+		/// position_updated_callback calls (no position queries unless needed for event_media_about_to_end)
+		event_position           = (1 << 2),
+		/// duration_updated_callback calls (no duration queries unless needed for event_media_about_to_end)
+		event_duration           = (1 << 3),
+		/// media_about_to_end_callback calls
+		event_media_about_to_end = (1 << 4),
+		/// buffer_health_callback calls (the health model itself is still updated)
+		event_buffer_health      = (1 << 5),
+
+		event_all = event_tags | event_buffer_level | event_position | event_duration | event_media_about_to_end | event_buffer_health
+	};
+
+	/// Counts of the work that was skipped because an event type was unsubscribed.
+	/**
+	 * Work is only counted as skipped if the corresponding callback is set,
+	 * since without the callback, the work would not have been done anyway.
+	 */
+	struct event_savings
+	{
+		/// Tag messages that were neither parsed nor diffed against the aggregated tags
+		guint64 m_skipped_tag_messages;
+		/// Buffer level reads that were skipped
+		guint64 m_skipped_buffer_level_queries;
+		/// Position queries that were skipped
+		guint64 m_skipped_position_queries;
+		/// Duration queries that were skipped
+		guint64 m_skipped_duration_queries;
+
+		event_savings();
+	};
+
+	/// Health of a stream's buffer, in the time domain.
+	/**
+	 * The buffer level alone does not say how long playback can continue.
+	 * This model measures how many bytes per second flow into the buffer
+	 * (ingress) and how many the playback takes out of it (consumption).
+	 * Out of these, it estimates how many nanoseconds of playback the buffer
+	 * holds, and, if ingress is slower than consumption, when the buffer
+	 * will run empty. The rates are smoothed, so short bursts do not cause
+	 * the values to jump around.
+	 */
+	struct buffer_health
+	{
+		/// Current fill level of the buffer, in bytes
+		guint m_level;
+		/// Playback duration the buffered data corresponds to, in nanoseconds, or
+		/// boost::none if the bitrate is not known yet
+		boost::optional < guint64 > m_buffered_duration;
+		/// Rate at which data enters the buffer, in bytes per second
+		guint64 m_ingress_rate;
+		/// Rate at which playback takes data out of the buffer, in bytes per second;
+		/// 0 until it could be measured or derived from the bitrate
+		guint64 m_consumption_rate;
+		/// Predicted time until the buffer runs empty, in nanoseconds, or boost::none
+		/// if no underrun is predicted (because the stream is not playing, ingress
+		/// keeps up with consumption, or all of the data was already received)
+		boost::optional < guint64 > m_time_to_underrun;
+		/// Number of bytes that entered the buffer since the stream was set up
+		guint64 m_total_ingress_bytes;
+		/// true if the source delivered all of its data
+		bool m_ingress_finished;
+
+		buffer_health();
+	};
+
+	/// Settings for the fast start policy; see set_fast_start().
+	struct fast_start_settings
+	{
+		/// Minimum playback duration that must be buffered before starting, in
+		/// nanoseconds; the default is 2 seconds
+		guint64 m_min_buffered_duration;
+		/// The ingress rate must be at least this many percent of the consumption
+		/// rate; the default is 125
+		guint m_safety_margin;
+
+		fast_start_settings();
+	};
+
+	/// Settings for throttling the next stream; see set_next_stream_throttling().
+	/**
+	 * The two thresholds form a hysteresis, which prevents rapid toggling
+	 * when the current stream's buffer hovers around one threshold.
+	 */
+	struct next_stream_throttling
+	{
+		/// Pause the next stream's ingress once the current stream's buffered
+		/// duration or time to underrun falls below this, in nanoseconds; the
+		/// default is 5 seconds
+		guint64 m_pause_below;
+		/// Resume the next stream's ingress once the current stream's buffered
+		/// duration is at least this, and no underrun is predicted within this
+		/// time, in nanoseconds; the default is 15 seconds
+		guint64 m_resume_above;
+
+		next_stream_throttling();
+	};
+
+	/// Ingress throughput of the streams.
+	struct ingress_throughput
+	{
+		/// Ingress rate of the current stream in bytes per second, or
+		/// boost::none if there is no current stream with a buffer
+		boost::optional < guint64 > m_current_stream;
+		/// Ingress rate of the next stream in bytes per second, or
+		/// boost::none if there is no next stream with a buffer
+		boost::optional < guint64 > m_next_stream;
+		/// true if the next stream's ingress is currently paused in favor of the current stream
+		bool m_next_stream_throttled;
+		/// Number of times the next stream's ingress was paused in favor of the current stream
+		unsigned int m_num_next_stream_throttles;
+
+		ingress_throughput();
+	};
+
+	/// Startup statistics of one startup policy.
+	struct startup_policy_stats
+	{
+		/// Number of times playback was started with this policy
+		unsigned int m_num_starts;
+		/// Time from the play_media() call until the pipeline reached the
+		/// PLAYING GStreamer state, for the most recent start
+		std::chrono::microseconds m_last_time_to_first_audio;
+		/// Sum of all times to first audio; divide by m_num_starts to get the mean
+		std::chrono::microseconds m_total_time_to_first_audio;
+		/// Number of times playback of media started with this policy had to
+		/// be interrupted for buffering; divide by m_num_starts to get the rebuffer rate
+		unsigned int m_num_rebuffers;
+
+		startup_policy_stats();
+	};
+
+	/// Startup statistics, separated by the policy that started the playback.
+	/**
+	 * Media that starts gaplessly after the previous one is not counted
+	 * as a start, since it does not go through the startup buffering.
+	 */
+	struct startup_stats
+	{
+		/// Starts that waited until the high buffer threshold was reached
+		startup_policy_stats m_threshold_starts;
+		/// Starts that began playback early thanks to the fast start policy
+		startup_policy_stats m_fast_starts;
+	};
+
+	/// Kinds of commands whose latencies are measured; see get_command_latency_stats().
+	enum command_types
+	{
+		command_type_play = 0,
+		command_type_pause,
+		command_type_resume,
+		command_type_stop,
+
+		num_command_types
+	};
+
+	/// Latency statistics of one kind of command.
+	struct command_latency_stats
+	{
+		/// Number of commands which reached their resulting state
+		unsigned int m_num_commands;
+		/// Latency of the most recent command
+		std::chrono::microseconds m_last_latency;
+		/// Lowest and highest latencies so far
+		std::chrono::microseconds m_min_latency, m_max_latency;
+		/// Sum of all latencies; divide by m_num_commands to get the mean
+		std::chrono::microseconds m_total_latency;
+
+		command_latency_stats();
+	};
+
+	/// Statistics about ingress stalls and mirror failovers; see set_mirror_failover().
+	struct mirror_failover_stats
+	{
+		/// Number of detected ingress stalls of the current stream
+		unsigned int m_num_stalls;
+		/// Number of times the current stream switched to a mirror URI
+		unsigned int m_num_failovers;
+		/// Time from the detection of the stall until the mirror was playing
+		/// (or paused, if the pipeline was paused), for the most recent failover
+		std::chrono::microseconds m_last_failover_time;
+		/// Sum of all failover times; divide by m_num_failovers to get the mean
+		std::chrono::microseconds m_total_failover_time;
+
+		mirror_failover_stats();
+	};
+
+	/// Settings for reconnecting failed sources; see set_source_reconnect().
+	struct source_reconnect_settings
+	{
+		/// Time without any incoming data after which a source gives up on its
+		/// connection, in nanoseconds; the default is 5 seconds
+		guint64 m_stall_timeout;
+		/// Maximum number of reconnects in a row; the default is 3
+		guint m_max_reconnects;
+
+		source_reconnect_settings();
+	};
+
+	/// Statistics about source reconnects; see set_source_reconnect().
+	struct source_reconnect_stats
+	{
+		/// Number of times the current stream was reconnected after its source failed
+		unsigned int m_num_reconnects;
+		/// Number of reconnects after which the stream played again
+		unsigned int m_num_recoveries;
+		/// Number of source failures which were reported as errors, because
+		/// reconnecting failed too often or was not possible
+		unsigned int m_num_failures;
+		/// Time from the source failure until the reconnected stream was playing
+		/// (or paused, if the pipeline was paused), for the most recent reconnect
+		std::chrono::microseconds m_last_recovery_time;
+		/// Sum of all recovery times; divide by m_num_recoveries to get the mean
+		std::chrono::microseconds m_total_recovery_time;
+
+		source_reconnect_stats();
+	};
+
+	/// Ways an asynchronous command can end; see command_result.
+	enum command_outcomes
+	{
+		/// The pipeline reached the command's target state
+		command_completed,
+		/// Another command was issued before this one completed
+		command_superseded,
+		/// The command was not carried out, or playback ended
+		/// (for example because of an error) before the command completed
+		command_failed
+	};
+
+	/// Result of an asynchronous command.
+	struct command_result
+	{
+		/// How the command ended
+		command_outcomes m_outcome;
+		/// State of the pipeline when the command ended
+		states m_state;
+		/// Time from the command call until it ended
+		std::chrono::microseconds m_latency;
+	};
+
+	/// Future which is made ready once an asynchronous command ends.
+	typedef std::future < command_result > command_future;
+
+	/// Set of commands which are applied together; see execute_batch().
+	/**
+	 * The functions have the same meaning as the main_pipeline functions of
+	 * the same name. If a function is called more than once, the last call
+	 * wins. stop() and play_media() cancel each other out; if the batch
+	 * stops the pipeline, its other commands are discarded.
+	 */
+	class command_batch
+	{
+	public:
+		command_batch();
+
+		void set_buffer_size_limit(boost::optional < guint > const &p_new_size);
+		void set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration);
+		void set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout);
+		void set_buffer_thresholds(boost::optional < guint > const &p_new_low_threshold, boost::optional < guint > const &p_new_high_threshold);
+
+		void play_media(guint64 const p_token, media const &p_media, bool const p_play_now, playback_properties const &p_properties = playback_properties());
+		void play_media(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties = playback_properties());
+		void set_current_position(gint64 const p_new_position, position_units const p_unit = position_unit_nanoseconds);
+		void set_paused(bool const p_paused);
+		void stop();
+
+	private:
+		friend class main_pipeline;
+
+		// The outer optionals are empty if the batch does not change the value
+		boost::optional < boost::optional < guint > > m_buffer_size_limit;
+		boost::optional < boost::optional < guint64 > > m_buffer_estimation_duration;
+		boost::optional < boost::optional < guint64 > > m_buffer_timeout;
+		boost::optional < boost::optional < guint > > m_low_buffer_threshold, m_high_buffer_threshold;
+
+		guint64 m_token;
+		media m_media;
+		bool m_play_now;
+		playback_properties m_playback_properties;
+
+		boost::optional < std::pair < gint64, position_units > > m_position;
+		boost::optional < bool > m_paused;
+		bool m_stop;
+	};
+
 	/// Constructor. Sets up the callbacks and initializes the pipeline.
 	/**
 	 * After the constructor finishes, the pipeline is in the idle state.
@@ -340,6 +693,379 @@ public:
 	 */
 	virtual void set_buffer_thresholds(boost::optional < guint > const &p_new_low_threshold, boost::optional < guint > const &p_new_high_threshold);
 
+	/// Enables/disables soft stops.
+	/**
+	 * stop() always keeps the output chain (concat, converters, processing objects,
+	 * audio sink) around, and only discards the streams, so a subsequent play_media()
+	 * call does not have to rebuild and relink these elements. In addition, if soft
+	 * stops are enabled, the output chain is kept in the READY GStreamer state
+	 * instead of the NULL one. This keeps the output device open, which makes
+	 * starting playback after a stop considerably faster with some sinks. The
+	 * downside is that the device remains occupied while the pipeline is idle.
+	 *
+	 * Soft stops also keep a small pool of stream elements. The uridecodebin
+	 * and identity elements of discarded streams are reset and parked in the
+	 * pool instead of being destroyed, and the next streams reuse them with
+	 * their new URIs. Disabling soft stops empties the pool.
+	 *
+	 * Soft stops are disabled by default. Changes take effect with the next
+	 * stop() or play_media() call. Use get_command_latency_stats() to see
+	 * how much they speed up the commands.
+	 *
+	 * @param p_enabled true if soft stops shall be used
+	 */
+	void set_soft_stop_enabled(bool const p_enabled);
+
+	/// Returns the latency statistics of a kind of command.
+	/**
+	 * The latency is the time from the command call until the pipeline reaches
+	 * the resulting state: state_playing or state_paused after play, pause, and
+	 * resume commands, state_idle after stop commands. Commands which are
+	 * superseded by another command before that are not counted.
+	 *
+	 * Playing media only counts as a play command if the media is played
+	 * right away. Batches (see execute_batch()) count as the commands they
+	 * contain, and asynchronous commands count as their synchronous variants.
+	 */
+	command_latency_stats get_command_latency_stats(command_types const p_type) const;
+	/// Resets the latency statistics of all kinds of commands.
+	void reset_command_latency_stats();
+
+	/// Dither methods for the final quantization to the sink's sample format.
+	enum dither_methods
+	{
+		/// No dithering (plain truncation/rounding)
+		dither_none,
+		/// Rectangular probability density function dither
+		dither_rpdf,
+		/// Triangular probability density function dither (the default)
+		dither_tpdf,
+		/// High frequency triangular probability density function dither
+		dither_tpdf_hf
+	};
+
+	/// Noise shaping methods for the final quantization to the sink's sample format.
+	enum noise_shaping_methods
+	{
+		/// No noise shaping (the default)
+		noise_shaping_none,
+		/// Error feedback
+		noise_shaping_error_feedback,
+		/// Simple 2-pole noise shaping
+		noise_shaping_simple,
+		/// Medium 5-pole noise shaping
+		noise_shaping_medium,
+		/// High 8-pole noise shaping
+		noise_shaping_high
+	};
+
+	/// Configures how samples are quantized when the sink requires an integer format.
+	/**
+	 * The final audioconvert element in front of the sink quantizes samples to the
+	 * sink's format (for example S16 or S24). Dithering and noise shaping are done
+	 * in the same pass as this format conversion, with vectorized code paths where
+	 * GStreamer provides them, so there is no additional processing stage. If the
+	 * sink accepts the samples without quantization (for example F32), these settings
+	 * have no effect.
+	 *
+	 * The settings are applied when the output format is negotiated, that is, the
+	 * next time playback is started.
+	 *
+	 * @param p_dither_method Dither method to use
+	 * @param p_noise_shaping_method Noise shaping method to use
+	 */
+	void set_output_quantization(dither_methods const p_dither_method, noise_shaping_methods const p_noise_shaping_method);
+
+	/// Enables/disables float32 processing mode.
+	/**
+	 * By default, processing objects get samples in whatever format the decoder
+	 * produces, and may convert them internally (soft_volume_control for example
+	 * contains an audioconvert element). Together with the audioconvert element in
+	 * front of the sink, this can cause several integer<->float conversions per
+	 * buffer.
+	 *
+	 * In float32 processing mode, the decoded samples are converted to 32-bit float
+	 * interleaved right after the concat element, and this format is pinned
+	 * through all processing objects (see processing_object::is_float32_pinned()).
+	 * Resampling is then done in float32 as well, and the only other conversion is
+	 * the one to the sink's format, at the very end of the chain.
+	 *
+	 * Disabled by default. Since this changes the structure of the output chain,
+	 * the change takes effect with the next play_media() call that starts playback
+	 * right now.
+	 *
+	 * @param p_enabled true if float32 processing mode shall be used
+	 */
+	void set_float32_processing(bool const p_enabled);
+
+	/// Returns the current memory usage of the pipeline.
+	/**
+	 * See the memory_usage documentation for details.
+	 */
+	memory_usage get_memory_usage() const;
+
+	/// Sets which events the application is interested in.
+	/**
+	 * Callbacks for event types that are not in the mask are not called, and
+	 * more importantly, the work that produces these events is not done at all.
+	 * This is useful when callbacks are configured, but the application only
+	 * needs some of them at times (for example, positions only while a UI is
+	 * visible). The mask can be changed at any time.
+	 *
+	 * When event_tags is subscribed again, the next tag update contains all
+	 * tags, not just the ones that changed. When event_duration is subscribed
+	 * again, the durations are updated right away.
+	 *
+	 * By default, all event types are subscribed.
+	 *
+	 * @param p_mask Bitwise OR combination of event_types values
+	 */
+	void set_event_subscriptions(unsigned int const p_mask);
+	/// Returns the current event subscription mask.
+	unsigned int get_event_subscriptions() const;
+	/// Returns how much work was skipped so far thanks to the event subscription mask.
+	event_savings get_event_savings() const;
+
+	/// Enables/disables delivery of tags aligned to the playback.
+	/**
+	 * Normally, new tags are reported as soon as GStreamer posts them. With
+	 * buffered streams (like HTTP radio streams with ICY metadata), this can
+	 * be many seconds before the audio the tags belong to is actually heard.
+	 *
+	 * If enabled, tags are instead picked up when they reach the audio sink,
+	 * together with the running time of the audio that precedes them. They
+	 * are then reported once the playback reaches this running time (taking
+	 * the pipeline latency into account). Tags that become due at the same
+	 * time are merged, and the new_tags_callback receives the full aggregated
+	 * tag list of the current media, not just the tags that changed. This way,
+	 * applications always see a consistent snapshot. The forcibly postponed
+	 * tags (see force_postpone_tag()) and the postpone-all-tags setting
+	 * are not used in this mode.
+	 *
+	 * Only one timer is active at any time, for the tags that are due next,
+	 * so the scheduling costs stay low even with many pending tag updates.
+	 *
+	 * By default, this is disabled.
+	 */
+	void set_playback_aligned_tags(bool const p_enabled);
+
+	/// Returns the buffer health of the current stream.
+	/**
+	 * The health is updated in the same intervals as the position updates.
+	 *
+	 * @return Buffer health, or boost::none if there is no current stream,
+	 *         or if it has no buffer
+	 */
+	boost::optional < buffer_health > get_buffer_health() const;
+
+	/// Enables/disables proactive buffering.
+	/**
+	 * Normally, the pipeline switches to the state_buffering state only once
+	 * the buffer level falls below the low threshold. With proactive
+	 * buffering, it does so as soon as the buffer health model predicts
+	 * an underrun within the given time, which gives the buffer more time
+	 * to recover, and avoids running completely dry. Proactive buffering
+	 * ends once the buffer level reaches the high threshold again. Live
+	 * streams are never paused for buffering, proactively or otherwise.
+	 *
+	 * By default, proactive buffering is disabled.
+	 *
+	 * @param p_min_time_to_underrun Start buffering if an underrun is predicted
+	 *        to happen in less than this many nanoseconds; boost::none disables
+	 *        proactive buffering
+	 */
+	void set_proactive_buffering(boost::optional < guint64 > const &p_min_time_to_underrun);
+
+	/// Enables/disables the fast start policy.
+	/**
+	 * Normally, playback of new media starts once the buffer is filled up
+	 * to the high threshold. On fast networks, this delays the start for
+	 * no real benefit. With fast start, playback starts as soon as a minimum
+	 * duration is buffered, and the buffer health model shows that data
+	 * arrives faster than the playback consumes it (with a safety margin),
+	 * so no underrun is to be expected. The buffer then keeps filling up in
+	 * the background. During that time, the stream only switches to
+	 * buffering again if its level falls below the low threshold.
+	 *
+	 * The consumption rate is derived from the bitrate tags. If the media
+	 * does not report a bitrate, the regular threshold policy is used.
+	 *
+	 * The time to first audio and the rebuffers are recorded for both policies;
+	 * see get_startup_stats(). By default, fast start is disabled.
+	 *
+	 * @param p_settings Fast start settings, or boost::none to disable fast start
+	 */
+	void set_fast_start(boost::optional < fast_start_settings > const &p_settings);
+
+	/// Returns the startup statistics.
+	startup_stats get_startup_stats() const;
+
+	/// Enables/disables throttling of the next stream.
+	/**
+	 * While the current stream plays, the next stream already fills its
+	 * buffer, and competes with the current stream for the same network
+	 * link. On slow links, this can make the current stream rebuffer. With
+	 * throttling enabled, the next stream's ingress is paused whenever the
+	 * buffer health of the current stream falls below a threshold, and
+	 * resumed once it recovered. (The next stream's ingress is always paused
+	 * while the current stream is buffering, throttling or not.) Once the
+	 * current stream received all of its data, the next stream is never
+	 * throttled.
+	 *
+	 * The ingress rates of both streams can be retrieved with
+	 * get_ingress_throughput(), and are also reported by the
+	 * buffer_health_callback. By default, throttling is disabled.
+	 *
+	 * @param p_throttling Throttling settings, or boost::none to disable throttling
+	 */
+	void set_next_stream_throttling(boost::optional < next_stream_throttling > const &p_throttling);
+
+	/// Returns the ingress throughput of the current and next streams.
+	ingress_throughput get_ingress_throughput() const;
+
+	/// Enables/disables the failover to mirror URIs.
+	/**
+	 * If the server of the current media stops delivering data, the buffer
+	 * drains, and playback eventually stops until the server resumes or the
+	 * connection times out, which can take minutes. With failover enabled,
+	 * the pipeline watches how much data enters the current stream's buffer.
+	 * If nothing arrives for the given stall timeout even though the buffer
+	 * has room and the source did not finish yet, the stream is switched
+	 * to the next mirror URI of its media (see media::set_mirror_uris()).
+	 *
+	 * Only the stream's source and decoder are replaced; the pipeline state,
+	 * the tags, the duration, and the output chain stay intact. Pause and
+	 * seek requests made during the switch are carried out once the mirror
+	 * plays. Playback continues at the position where the stalled
+	 * stream left off, provided that the media is seekable. A next media
+	 * that was already scheduled stays scheduled, and no media_started_callback
+	 * call is made for the mirror. Once all mirrors were tried, stalls are
+	 * handled by the regular buffering.
+	 *
+	 * Stalls and failover times can be retrieved with get_mirror_failover_stats().
+	 * By default, failover is disabled.
+	 *
+	 * @param p_stall_timeout Time without any incoming data after which the
+	 *        ingress is considered stalled, in nanoseconds, or boost::none to
+	 *        disable failover
+	 */
+	void set_mirror_failover(boost::optional < guint64 > const &p_stall_timeout);
+
+	/// Returns the stall and mirror failover statistics.
+	mirror_failover_stats get_mirror_failover_stats() const;
+
+	/// Enables/disables reconnecting failed sources.
+	/**
+	 * Normally, when a source loses its connection, it posts an error,
+	 * the error_callback is invoked, and the pipeline is reinitialized,
+	 * losing the playback position. With reconnecting enabled, this is
+	 * handled in two stages:
+	 *
+	 * First, sources which can reconnect on their own (like the HTTP source)
+	 * are configured to give up on a connection that did not deliver any data
+	 * within the stall timeout, and to then reconnect, continuing with a range
+	 * request at the byte where the connection was lost. The data is spliced
+	 * into the existing decoding chain, so playback is not interrupted at all
+	 * if the buffer holds enough data.
+	 *
+	 * Second, if the source still fails, the current stream is set up again
+	 * with the same URI, the same way as a stream is switched to a mirror
+	 * (see set_mirror_failover()), and continues at the position where the failed stream
+	 * left off (provided that the media is seekable). This happens at most
+	 * m_max_reconnects times in a row. Then, if mirror failover is enabled
+	 * (see set_mirror_failover()), the next mirror URI is tried. Otherwise,
+	 * the error is reported as usual. Sources which failed because the
+	 * resource does not exist or access was denied are not reconnected.
+	 *
+	 * Reconnected failures are passed to the warning_callback instead of
+	 * the error_callback. No media_started_callback call is made for the
+	 * reconnected stream. Reconnects and recovery times can be retrieved
+	 * with get_source_reconnect_stats(). By default, reconnecting is disabled.
+	 *
+	 * @param p_settings Reconnect settings, or boost::none to disable reconnecting
+	 */
+	void set_source_reconnect(boost::optional < source_reconnect_settings > const &p_settings);
+
+	/// Returns the source reconnect statistics.
+	source_reconnect_stats get_source_reconnect_stats() const;
+
+	/// Asynchronous variant of play_media().
+	/**
+	 * The asynchronous commands behave just like their regular counterparts,
+	 * but also return a future, which is made ready once the command ended.
+	 * This happens when the pipeline reaches the command's target state,
+	 * when another command (asynchronous or not) is issued before that, or
+	 * when the command could not be carried out. The result also contains
+	 * the command's latency. Only one command can be pending at a time;
+	 * issuing a new one supersedes the pending one.
+	 *
+	 * The target state of play_media_async() is state_playing, or state_paused
+	 * if the playback properties say that the media shall start paused. If the
+	 * media is scheduled as the next media instead of being played right away,
+	 * the future is ready immediately.
+	 *
+	 * Futures are made ready by the pipeline's internal thread, and in some
+	 * cases by the calling thread. Do not wait for them inside callbacks,
+	 * since the callbacks run in the internal thread, and would then wait
+	 * for themselves.
+	 */
+	command_future play_media_async(guint64 const p_token, media const &p_media, bool const p_play_now, playback_properties const &p_properties = playback_properties());
+	/// Asynchronous variant of play_media(). See the other overload for details.
+	command_future play_media_async(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties = playback_properties());
+	/// Asynchronous variant of set_paused(); the target state is state_paused or state_playing.
+	/**
+	 * If the pipeline is transitioning (during startup or buffering for example),
+	 * the command is carried out once the transition is done, and the future is
+	 * made ready after that.
+	 */
+	command_future set_paused_async(bool const p_paused);
+	/// Asynchronous variant of set_current_position().
+	/**
+	 * The target state is the state the pipeline returns to after seeking,
+	 * that is, state_paused if the seek starts while the pipeline is paused,
+	 * and state_playing otherwise. If the seek is postponed because the pipeline
+	 * is transitioning (during startup or another seek for example), this refers
+	 * to the state the pipeline is in once the seek is actually carried out.
+	 */
+	command_future set_current_position_async(gint64 const p_new_position, position_units const p_unit = position_unit_nanoseconds);
+	/// Asynchronous variant of stop(); the target state is state_idle.
+	command_future stop_async();
+
+	/// Applies a batch of commands at once.
+	/**
+	 * Setting up playback often takes several calls, like configuring the
+	 * buffer, playing the media, and seeking to a start position. Issuing
+	 * them one by one reconfigures the pipeline after each call, and lets
+	 * other threads observe (and interfere with) the intermediate states.
+	 * A batch is instead applied as a whole, and merges redundant work:
+	 *
+	 * If the batch plays media right away, the buffer settings, position,
+	 * and paused state are folded into the playback properties of that media,
+	 * so its stream is set up with them from the start. There is no extra
+	 * seek, and no separate pause. Otherwise, the buffer settings are applied
+	 * to the current stream with one buffer reconfiguration, then seeking and
+	 * pausing happen as usual, and finally, the media (if any) is scheduled
+	 * as the next media.
+	 *
+	 * As with the individual commands, a pending asynchronous command is
+	 * superseded if the batch plays media right away, seeks, pauses, or stops.
+	 *
+	 * @param p_batch Batch to apply
+	 * @return true if all commands in the batch were carried out (or
+	 *         postponed until the current transition is done)
+	 */
+	bool execute_batch(command_batch p_batch);
+
+	/// Returns the pipeline's log context.
+	/**
+	 * All messages logged by this pipeline (from API calls, the main loop thread,
+	 * and the GStreamer streaming threads) are tagged with the context's ID and
+	 * the token of the media they refer to. The context's minimum log level can
+	 * be set to make this pipeline's logging more or less verbose than that of
+	 * other pipelines, without affecting them.
+	 */
+	log_context & get_log_context();
+
 	virtual guint64 get_new_token() override;
 	virtual void stop() override;
 
@@ -356,6 +1082,13 @@ public:
 
 	virtual void force_postpone_tag(std::string const &p_tag, bool const p_postpone) override;
 
+	/// Builds the GStreamer pipeline if necessary, and opens the audio output.
+	/**
+	 * The pipeline is then kept in the READY state, so the next play_media()
+	 * call only needs to set up the stream.
+	 */
+	virtual bool prewarm() override;
+
 
 protected:
 	virtual bool play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties) override;
@@ -366,6 +1099,13 @@ private:
 	// (they may still lock the stream mutex)
 
 
+	// logging
+
+	// Declared first, so it outlives all other members, since
+	// their destruction can still log messages in its scope
+	log_context m_log_context;
+
+
 	// miscellaneous
 
 	bool is_transitioning_nolock() const;
@@ -411,27 +1151,42 @@ private:
 	class stream
 	{
 	public:
-		explicit stream(main_pipeline &p_pipeline, guint64 const p_token, media &&p_media, GstBin *p_container_bin, GstElement *p_concat_elem, playback_properties const &p_properties);
+		// If p_concat_sinkpad is non-null, the stream links to this concat
+		// sinkpad instead of requesting a new one (see hand_over_concat_sinkpad())
+		explicit stream(main_pipeline &p_pipeline, guint64 const p_token, media &&p_media, GstBin *p_container_bin, GstElement *p_concat_elem, playback_properties const &p_properties, std::size_t const p_uri_index, GstPad *p_concat_sinkpad = nullptr);
 		~stream();
 
 		void sync_states();
 
 		GstPad* get_srcpad();
+		// Returns a new reference to the concat sinkpad, and makes sure the
+		// destructor does not release it, so another stream can take over
+		// this stream's place in the concat element
+		GstPad* hand_over_concat_sinkpad();
 		guint64 get_token() const;
 		media const & get_media() const;
 		playback_properties const & get_playback_properties() const;
+		// 0 = main URI of the media, 1 = first mirror URI etc.
+		std::size_t get_uri_index() const;
+		std::string const & get_uri() const;
 
 		bool contains_object(GstObject *p_object);
 
-		void set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration);
-		void set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout);
-		void set_buffer_size_limit(boost::optional < guint > const &p_new_size);
+		// Setters with p_update_limits set to false only store the new
+		// value, so that several changes can be applied by one
+		// update_buffer_limits() call
+		void set_buffer_estimation_duration(boost::optional < guint64 > const &p_new_duration, bool const p_update_limits = true);
+		void set_buffer_timeout(boost::optional < guint64 > const &p_new_timeout, bool const p_update_limits = true);
+		void set_buffer_size_limit(boost::optional < guint > const &p_new_size, bool const p_update_limits = true);
 
-		void set_buffer_thresholds(boost::optional < guint > const &p_low_threshold, boost::optional < guint > const &p_high_threshold);
+		void set_buffer_thresholds(boost::optional < guint > const &p_low_threshold, boost::optional < guint > const &p_high_threshold, bool const p_update_limits = true);
+		void update_buffer_limits();
 
 		boost::optional < guint > get_current_buffer_level() const;
 
 		guint get_effective_buffer_size_limit() const;
+		guint get_low_buffer_threshold() const;
+		guint get_high_buffer_threshold() const;
 
 		void set_buffering(bool const p_flag);
 		bool is_buffering() const;
@@ -445,20 +1200,35 @@ private:
 		void enable_buffering_timeout(bool const p_do_enable);
 		void block_buffering(bool const p_do_block);
 
+		void set_buffer_priority(buffer_priorities const p_priority);
+		void apply_buffer_budget();
+
+		buffer_health const & update_buffer_health(bool const p_is_consuming);
+		buffer_health const & get_buffer_health() const;
+		bool has_buffer_health() const;
+		void set_proactively_buffering(bool const p_flag);
+		bool is_proactively_buffering() const;
+		void set_fast_started(bool const p_flag);
+		bool is_fast_started() const;
+		bool check_for_ingress_stall(guint64 const p_stall_timeout);
+		void set_source_reconnect_settings(boost::optional < source_reconnect_settings > const &p_settings);
+
 	private:
 		static void static_new_pad_callback(GstElement *p_uridecodebin, GstPad *p_pad, gpointer p_data);
 		static void static_element_added_callback(GstElement *p_uridecodebin, GstElement *p_element, gpointer p_data);
+		static void static_source_setup_callback(GstElement *p_uridecodebin, GstElement *p_source, gpointer p_data);
 		static GstPadProbeReturn static_tag_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
 		static GstPadProbeReturn static_buffering_block_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
-
-		void update_buffer_limits();
+		static GstPadProbeReturn static_ingress_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
 
 		main_pipeline &m_pipeline;
 		guint64 m_token;
 		media m_media;
 		playback_properties m_playback_properties;
+		std::size_t m_uri_index;
 		GstElement *m_uridecodebin_elem, *m_identity_elem, *m_concat_elem, *m_queue_elem;
 		GstPad *m_identity_srcpad, *m_concat_sinkpad;
+		bool m_concat_sinkpad_handed_over;
 		GstBin *m_container_bin;
 		bool m_is_buffering;
 		bool m_is_live;
@@ -478,6 +1248,40 @@ private:
 
 		guint m_low_buffer_threshold, m_high_buffer_threshold;
 
+		// Share of the global buffer budget (see buffer_budget.hpp)
+		buffer_budget_client m_buffer_budget_client;
+		buffer_priorities m_buffer_priority;
+
+		// Share of the global ingress rate (see ingress_scheduler.hpp)
+		ingress_client m_ingress_client;
+
+		// Buffer health model. The ingress counters are updated by the
+		// queue's streaming thread, everything else by the mainloop thread.
+		std::atomic < guint64 > m_ingress_bytes;
+		std::atomic < bool > m_ingress_finished;
+		guint64 m_last_ingress_bytes;
+		guint m_last_buffer_level;
+		std::chrono::steady_clock::time_point m_last_health_update;
+		bool m_has_buffer_health;
+		double m_ingress_rate, m_consumption_rate;
+		buffer_health m_buffer_health;
+		bool m_is_proactively_buffering;
+		// Set after a fast start, until the queue
+		// reports that it is filled completely
+		bool m_is_fast_started;
+
+		// Stall detection. Only accessed by the mainloop thread.
+		guint64 m_stall_check_bytes;
+		std::chrono::steady_clock::time_point m_last_ingress_progress;
+
+		// Applied to the source once uridecodebin created it
+		boost::optional < source_reconnect_settings > m_source_reconnect_settings;
+
+		// Probes at the identity srcpad; they have to be removed
+		// before the elements are parked in the stream element pool.
+		// m_tag_probe_id is 0 once the tag probe removed itself.
+		gulong m_tag_probe_id, m_eos_probe_id;
+
 		// Used in the static_new_pad_callback and in the destructor,
 		// to prevent both from running at the same time (this is a corner
 		// case when the stream is destroyed even before the decodebin
@@ -487,11 +1291,35 @@ private:
 
 	typedef std::shared_ptr < stream > stream_sptr;
 
-	stream_sptr setup_stream_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties);
+	stream_sptr setup_stream_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties, std::size_t const p_uri_index = 0, GstPad *p_concat_sinkpad = nullptr);
 	static GstPadProbeReturn static_stream_eos_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
 
 	stream_sptr m_current_stream, m_next_stream;
 
+	// Stream element pool. With soft stops, the uridecodebin and identity
+	// elements of discarded streams are parked here instead of being
+	// destroyed, and new streams reuse them. The pool holds one
+	// reference to each element.
+	struct pooled_stream_elements
+	{
+		GstElement *m_uridecodebin_elem, *m_identity_elem;
+	};
+
+	void clear_stream_element_pool_nolock();
+
+	std::vector < pooled_stream_elements > m_stream_element_pool;
+
+
+	// global buffer budget
+
+	void schedule_buffer_budget_update();
+	void update_buffer_priorities_nolock();
+	static gboolean static_buffer_budget_update_cb(gpointer p_data);
+
+	// Set when an update is already scheduled, to avoid piling up
+	// idle sources if the budget is redistributed several times in a row
+	std::atomic < bool > m_buffer_budget_update_pending;
+
 
 	// pipeline state & management
 
@@ -502,22 +1330,54 @@ private:
 		GstFormat m_seek_format;
 	};
 
+	enum stream_restart_reasons
+	{
+		stream_restart_none,
+		stream_restart_failover,
+		stream_restart_reconnect
+	};
+
 	bool initialize_pipeline_nolock();
 	void shutdown_pipeline_nolock(bool const p_set_state = true);
 	bool reinitialize_pipeline_nolock();
-	void set_pipeline_to_idle_nolock(bool const p_set_state);
+	bool prepare_pipeline_nolock();
+	void set_pipeline_to_idle_nolock(bool const p_set_state, bool const p_keep_output_open = false);
+	void mark_command_start_nolock(command_types const p_type);
+	void record_command_latency_nolock();
+	command_future begin_async_command_nolock(boost::optional < states > const &p_target_state, boost::optional < states > const &p_via_state = boost::none);
+	void set_async_command_target_nolock(states const p_target_state, boost::optional < states > const &p_via_state = boost::none);
+	void fail_postponed_async_command_nolock();
+	void resolve_async_command_nolock(command_outcomes const p_outcome);
+	void update_async_command_nolock();
 	void set_initial_state_values_nolock();
 	void set_state_nolock(states const p_new_state);
 	bool play_media_nolock(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties);
-	void set_paused_nolock(bool const p_paused);
-	void set_current_position_nolock(gint64 const p_new_position, position_units const p_unit);
+	bool plays_media_now_nolock(guint64 const p_token, bool const p_play_now) const;
+	bool start_current_stream_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties, std::size_t const p_uri_index);
+	bool set_paused_nolock(bool const p_paused);
+	bool set_current_position_nolock(gint64 const p_new_position, position_units const p_unit);
 	void stop_nolock();
 	gint64 query_duration_nolock(position_units const p_unit) const;
 	void update_durations_nolock();
 	bool finish_seeking_nolock(bool const p_set_state_after_seeking);
 	void make_next_stream_current_nolock();
 	void recheck_buffering_state_nolock();
+	void update_buffer_health_nolock();
+	void set_proactively_buffering_nolock(bool const p_flag);
+	bool is_fast_start_possible_nolock(buffer_health const &p_health) const;
+	void update_next_stream_throttling_nolock(buffer_health const &p_current_health);
+	void update_next_stream_blocking_nolock();
+	void finish_startup_nolock();
+	void check_for_ingress_stall_nolock();
+	bool fail_over_to_next_mirror_nolock();
+	bool reconnect_current_stream_nolock(GstMessage *p_error_msg);
+	bool restart_current_stream_nolock(std::size_t const p_uri_index, stream_restart_reasons const p_reason);
+	void continue_stream_restart_nolock();
+	bool is_restarted_stream_prerolling_nolock() const;
+	void finish_stream_restart_nolock();
 	void create_dot_pipeline_dump_nolock(std::string const &p_extra_name);
+	void apply_output_quantization_nolock();
+	guint64 estimate_output_buffer_size_nolock() const;
 
 	seeking_data m_seeking_data;
 	states m_state;
@@ -525,6 +1385,63 @@ private:
 	bool m_block_abouttoend_notifications;
 	bool m_force_next_duration_update;
 	bool m_stream_eos_seen;
+	bool m_soft_stop_enabled;
+	bool m_float32_processing;
+	// Set if settings changed that require the output chain to be rebuilt
+	bool m_output_chain_dirty;
+	boost::optional < guint64 > m_proactive_buffering_threshold;
+	boost::optional < fast_start_settings > m_fast_start_settings;
+	boost::optional < next_stream_throttling > m_next_stream_throttling;
+	bool m_next_stream_throttled;
+	unsigned int m_num_next_stream_throttles;
+
+	// Startup measurements. m_current_startup_stats refers to the
+	// statistics of the policy that started the current stream, and
+	// is null if the current stream was not started by play_media().
+	bool m_startup_pending, m_startup_was_fast;
+	std::chrono::steady_clock::time_point m_startup_begin;
+	startup_stats m_startup_stats;
+	startup_policy_stats *m_current_startup_stats;
+
+	// Mirror failover and source reconnects. Both replace the current
+	// stream with a new one in place (the state and the output chain are
+	// not touched). m_pending_stream_restart is set from the restart until
+	// the restarted stream is playing (or paused). m_stream_restart_position
+	// is where the new stream shall continue; it is seeked to once the
+	// new stream prerolled, and m_stream_restart_seeking is set until
+	// the pipeline prerolled again after that seek.
+	boost::optional < guint64 > m_stall_timeout;
+	boost::optional < source_reconnect_settings > m_source_reconnect_settings;
+	stream_restart_reasons m_pending_stream_restart;
+	std::chrono::steady_clock::time_point m_stream_restart_begin;
+	boost::optional < gint64 > m_stream_restart_position;
+	bool m_stream_restart_seeking;
+	unsigned int m_num_consecutive_reconnects;
+	mirror_failover_stats m_mirror_failover_stats;
+	source_reconnect_stats m_source_reconnect_stats;
+	dither_methods m_dither_method;
+	noise_shaping_methods m_noise_shaping_method;
+
+	// Used for measuring how long it takes from a play/pause/stop
+	// command until the pipeline reaches the resulting state
+	boost::optional < command_types > m_pending_command;
+	std::chrono::steady_clock::time_point m_command_start_time;
+	command_latency_stats m_command_latency_stats[num_command_types];
+
+	// The pending asynchronous command, if any
+	struct async_command
+	{
+		std::promise < command_result > m_promise;
+		std::chrono::steady_clock::time_point m_start_time;
+		// Not set until the command is carried out if the target state
+		// depends on the state the command starts from, and the command
+		// might be postponed (see set_async_command_target_nolock())
+		boost::optional < states > m_target_state;
+		// If set, the pipeline has to pass this state first, since
+		// it might currently be in the target state already
+		boost::optional < states > m_via_state;
+	};
+	std::unique_ptr < async_command > m_async_command;
 
 
 	// tags management
@@ -535,6 +1452,42 @@ private:
 	tag_list m_postponed_tags_list;
 	bool m_postpone_all_tags;
 
+	// Moves the tags that must be postponed from p_new_tags to
+	// m_postponed_tags_list; returns true if tags are left to report
+	bool postpone_tags_nolock(tag_list &p_new_tags);
+
+
+	// playback aligned tags
+
+	static GstPadProbeReturn static_aligned_tag_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
+	static gboolean static_aligned_tag_timeout_cb(gpointer p_data);
+	void install_aligned_tag_probe_nolock();
+	void remove_aligned_tag_probe_nolock();
+	void handle_aligned_tags_message_nolock(GstMessage *p_msg);
+	void deliver_due_aligned_tags_nolock();
+	void clear_aligned_tags_nolock();
+	GstClockTime get_current_running_time_nolock() const;
+
+	typedef std::pair < GstClockTime, tag_list > aligned_tags;
+
+	bool m_playback_aligned_tags;
+	gulong m_aligned_tag_probe_id;
+	// Tags which reached the sink, in running time order, and
+	// the timer for the ones that are due next
+	std::deque < aligned_tags > m_pending_aligned_tags;
+	GSource *m_aligned_tag_timeout_source;
+	// Only accessed by the sink's streaming thread
+	GstSegment m_aligned_tag_segment;
+	GstClockTime m_aligned_tag_running_time;
+
+
+	// event subscriptions
+
+	bool is_subscribed_nolock(event_types const p_event_type) const;
+
+	unsigned int m_event_subscriptions;
+	event_savings m_event_savings;
+
 
 	// playback timer
 
@@ -554,6 +1507,8 @@ private:
 
 	GstState m_current_gstreamer_state, m_pending_gstreamer_state;
 	GstElement *m_pipeline_elem, *m_concat_elem, *m_audiosink_elem;
+	// The audioconvert element in front of the sink (owned by the pipeline)
+	GstElement *m_output_audioconvert_elem;
 	GstBus *m_bus;
 	GSource *m_watch_source;
 
@@ -23,6 +23,7 @@ media::media()
 
 media::media(media const &p_other)
 	: m_uri(p_other.m_uri)
+	, m_mirror_uris(p_other.m_mirror_uris)
 	, m_payload(p_other.m_payload)
 {
 }
@@ -30,6 +31,7 @@ media::media(media const &p_other)
 
 media::media(media && p_other)
 	: m_uri(std::move(p_other.m_uri))
+	, m_mirror_uris(std::move(p_other.m_mirror_uris))
 	, m_payload(std::move(p_other.m_payload))
 {
 }
@@ -58,6 +60,7 @@ media::media(std::string const &p_uri, boost::any &&p_payload)
 media& media::operator = (media const &p_other)
 {
 	m_uri = p_other.m_uri;
+	m_mirror_uris = p_other.m_mirror_uris;
 	m_payload = p_other.m_payload;
 	return *this;
 }
@@ -66,6 +69,7 @@ media& media::operator = (media const &p_other)
 media& media::operator = (media &&p_other)
 {
 	m_uri = std::move(p_other.m_uri);
+	m_mirror_uris = std::move(p_other.m_mirror_uris);
 	m_payload = std::move(p_other.m_payload);
 	return *this;
 }
@@ -83,6 +87,18 @@ boost::any& media::get_payload() const
 }
 
 
+void media::set_mirror_uris(std::vector < std::string > p_mirror_uris)
+{
+	m_mirror_uris = std::move(p_mirror_uris);
+}
+
+
+std::vector < std::string > const & media::get_mirror_uris() const
+{
+	return m_mirror_uris;
+}
+
+
 bool is_valid(media const &p_media)
 {
 	return !(p_media.get_uri().empty());
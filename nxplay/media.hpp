@@ -16,6 +16,7 @@
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 #include <boost/any.hpp>
 
 
@@ -40,6 +41,11 @@ namespace nxplay
  *
  * A media instance can be invalid. This is the case when the URI string is
  * empty. is_valid() checks for that.
+ *
+ * Optionally, the media can list mirror URIs, which refer to the same
+ * content on other servers. Pipelines can switch to these if the
+ * server behind the main URI stops delivering data (see
+ * main_pipeline::set_mirror_failover()).
  */
 class media
 {
@@ -75,8 +81,14 @@ public:
 	 */
 	boost::any& get_payload() const;
 
+	/// Sets the mirror URIs, in the order they shall be tried.
+	void set_mirror_uris(std::vector < std::string > p_mirror_uris);
+	/// Retrieves the mirror URIs. The main URI is not part of this list.
+	std::vector < std::string > const & get_mirror_uris() const;
+
 private:
 	std::string m_uri;
+	std::vector < std::string > m_mirror_uris;
 	mutable boost::any m_payload;
 };
 
@@ -0,0 +1,250 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <atomic>
+#include <gst/audio/audio.h>
+#include "alloc_tracking.hpp"
+#include "ingress_scheduler.hpp"
+#include "log.hpp"
+#include "offline_decoder.hpp"
+#include "scope_guard.hpp"
+#include "utility.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+struct decoder_context
+{
+	decoder_context(decoded_samples_callback const &p_callback)
+		: m_callback(p_callback)
+		, m_convert_elem(nullptr)
+		, m_caps(nullptr)
+		, m_aborted(false)
+		, m_ingress_client(ingress_class_probe)
+	{
+		m_format.m_rate = 0;
+		m_format.m_channels = 0;
+	}
+
+	decoded_samples_callback const &m_callback;
+	GstElement *m_convert_elem;
+	GstCaps *m_caps;
+	decoded_format m_format;
+	std::atomic < bool > m_aborted;
+	ingress_client m_ingress_client;
+};
+
+
+void static_new_pad_callback(GstElement *, GstPad *p_pad, gpointer p_data)
+{
+	decoder_context *ctx = static_cast < decoder_context* > (p_data);
+
+	GstCaps *caps = gst_pad_query_caps(p_pad, nullptr);
+	GstStructure *s = gst_caps_get_structure(caps, 0);
+	bool match = g_strrstr(gst_structure_get_name(s), "audio");
+	gst_caps_unref(caps);
+	if (!match)
+		return;
+
+	// Only link the first audio pad
+	GstPad *sinkpad = gst_element_get_static_pad(ctx->m_convert_elem, "sink");
+	if (!GST_PAD_IS_LINKED(sinkpad))
+		gst_pad_link(p_pad, sinkpad);
+	gst_object_unref(GST_OBJECT(sinkpad));
+}
+
+
+GstPadProbeReturn static_ingress_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("offline_decoder::static_ingress_probe");
+
+	decoder_context *ctx = static_cast < decoder_context* > (p_data);
+	ctx->m_ingress_client.throttle(gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(p_info)), p_pad);
+	return GST_PAD_PROBE_OK;
+}
+
+
+void static_element_added_callback(GstElement *, GstElement *p_element, gpointer p_data)
+{
+	// uridecodebin only adds a queue for network sources. Local files
+	// are not subject to ingress scheduling, so they can be ignored.
+	gchar *name_cstr = gst_element_get_name(p_element);
+	if (g_str_has_prefix(name_cstr, "queue"))
+	{
+		GstPad *sinkpad = gst_element_get_static_pad(p_element, "sink");
+		gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_BUFFER, static_ingress_probe, p_data, nullptr);
+		gst_object_unref(GST_OBJECT(sinkpad));
+	}
+	g_free(name_cstr);
+}
+
+
+void static_handoff_callback(GstElement *, GstBuffer *p_buffer, GstPad *p_pad, gpointer p_data)
+{
+	decoder_context *ctx = static_cast < decoder_context* > (p_data);
+
+	if (ctx->m_aborted)
+		return;
+
+	// Update the format if the caps changed
+	GstCaps *caps = gst_pad_get_current_caps(p_pad);
+	if (caps == nullptr)
+		return;
+	if ((ctx->m_caps == nullptr) || !gst_caps_is_equal(caps, ctx->m_caps))
+	{
+		GstAudioInfo info;
+		if (!gst_audio_info_from_caps(&info, caps))
+		{
+			NXPLAY_LOG_MSG(error, "could not parse caps of decoded samples");
+			gst_caps_unref(caps);
+			ctx->m_aborted = true;
+			return;
+		}
+
+		ctx->m_format.m_rate = GST_AUDIO_INFO_RATE(&info);
+		ctx->m_format.m_channels = GST_AUDIO_INFO_CHANNELS(&info);
+
+		if (ctx->m_caps != nullptr)
+			gst_caps_unref(ctx->m_caps);
+		ctx->m_caps = caps;
+	}
+	else
+		gst_caps_unref(caps);
+
+	GstMapInfo map_info;
+	if (!gst_buffer_map(p_buffer, &map_info, GST_MAP_READ))
+		return;
+
+	std::size_t num_frames = map_info.size / (sizeof(float) * ctx->m_format.m_channels);
+	if (!(ctx->m_callback(ctx->m_format, reinterpret_cast < float const * > (map_info.data), num_frames)))
+		ctx->m_aborted = true;
+
+	gst_buffer_unmap(p_buffer, &map_info);
+}
+
+
+} // unnamed namespace end
+
+
+bool decode_media_offline(std::string const &p_uri, decoded_samples_callback const &p_callback, guint const p_rate, guint const p_channels)
+{
+	GstElement *pipeline_elem = nullptr;
+	GstElement *uridecodebin_elem = nullptr, *audioresample_elem = nullptr, *capsfilter_elem = nullptr, *fakesink_elem = nullptr;
+	decoder_context ctx(p_callback);
+
+	auto elems_guard = make_scope_guard([&]()
+	{
+		checked_unref(uridecodebin_elem);
+		checked_unref(ctx.m_convert_elem);
+		checked_unref(audioresample_elem);
+		checked_unref(capsfilter_elem);
+		checked_unref(fakesink_elem);
+	});
+
+	if (((pipeline_elem = gst_pipeline_new(nullptr)) == nullptr)
+	 || ((uridecodebin_elem = gst_element_factory_make("uridecodebin", nullptr)) == nullptr)
+	 || ((ctx.m_convert_elem = gst_element_factory_make("audioconvert", nullptr)) == nullptr)
+	 || ((audioresample_elem = gst_element_factory_make("audioresample", nullptr)) == nullptr)
+	 || ((capsfilter_elem = gst_element_factory_make("capsfilter", nullptr)) == nullptr)
+	 || ((fakesink_elem = gst_element_factory_make("fakesink", nullptr)) == nullptr))
+	{
+		NXPLAY_LOG_MSG(error, "could not create offline decoder elements");
+		checked_unref(pipeline_elem);
+		return false;
+	}
+
+	// Set up the caps for 32-bit float interleaved samples, and
+	// optionally a fixed rate and channel count
+	GstCaps *caps = gst_caps_new_simple(
+		"audio/x-raw",
+		"format", G_TYPE_STRING, GST_AUDIO_NE(F32),
+		"layout", G_TYPE_STRING, "interleaved",
+		nullptr
+	);
+	if (p_rate != 0)
+		gst_caps_set_simple(caps, "rate", G_TYPE_INT, gint(p_rate), nullptr);
+	if (p_channels != 0)
+		gst_caps_set_simple(caps, "channels", G_TYPE_INT, gint(p_channels), nullptr);
+	g_object_set(G_OBJECT(capsfilter_elem), "caps", caps, nullptr);
+	gst_caps_unref(caps);
+
+	g_object_set(G_OBJECT(uridecodebin_elem), "uri", p_uri.c_str(), nullptr);
+	// sync=FALSE to decode as fast as possible
+	g_object_set(G_OBJECT(fakesink_elem), "sync", gboolean(FALSE), "signal-handoffs", gboolean(TRUE), nullptr);
+
+	gst_bin_add_many(GST_BIN(pipeline_elem), uridecodebin_elem, ctx.m_convert_elem, audioresample_elem, capsfilter_elem, fakesink_elem, nullptr);
+	elems_guard.unguard();
+
+	auto pipeline_guard = make_scope_guard([&]()
+	{
+		gst_element_set_state(pipeline_elem, GST_STATE_NULL);
+		checked_unref(pipeline_elem);
+		if (ctx.m_caps != nullptr)
+			gst_caps_unref(ctx.m_caps);
+	});
+
+	gst_element_link_many(ctx.m_convert_elem, audioresample_elem, capsfilter_elem, fakesink_elem, nullptr);
+
+	g_signal_connect(G_OBJECT(uridecodebin_elem), "pad-added", G_CALLBACK(static_new_pad_callback), gpointer(&ctx));
+	g_signal_connect(G_OBJECT(uridecodebin_elem), "element-added", G_CALLBACK(static_element_added_callback), gpointer(&ctx));
+	g_signal_connect(G_OBJECT(fakesink_elem), "handoff", G_CALLBACK(static_handoff_callback), gpointer(&ctx));
+
+	if (gst_element_set_state(pipeline_elem, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		NXPLAY_LOG_MSG(error, "could not start decoding media with URI " << p_uri);
+		return false;
+	}
+
+	// Poll the bus instead of running a mainloop. The timeout is used
+	// for checking periodically if the callback aborted decoding.
+	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline_elem));
+	bool success = false;
+	while (true)
+	{
+		if (ctx.m_aborted)
+		{
+			NXPLAY_LOG_MSG(debug, "decoding media with URI " << p_uri << " aborted");
+			break;
+		}
+
+		GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_MSECOND * 100, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+		if (msg == nullptr)
+			continue;
+
+		bool is_eos = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+
+		if (!is_eos)
+		{
+			GError *error = nullptr;
+			gchar *debug_info = nullptr;
+			gst_message_parse_error(msg, &error, &debug_info);
+			NXPLAY_LOG_MSG(error, "error while decoding media with URI " << p_uri << ": " << error->message << " (debug info: " << (debug_info != nullptr ? debug_info : "<none>") << ")");
+			g_error_free(error);
+			g_free(debug_info);
+		}
+
+		gst_message_unref(msg);
+
+		success = is_eos;
+		break;
+	}
+
+	gst_object_unref(GST_OBJECT(bus));
+
+	return success;
+}
+
+
+} // namespace nxplay end
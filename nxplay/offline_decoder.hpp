@@ -0,0 +1,74 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_OFFLINE_DECODER_HPP
+#define NXPLAY_OFFLINE_DECODER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <gst/gst.h>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Format of the samples delivered by decode_media_offline().
+struct decoded_format
+{
+	guint m_rate;
+	guint m_channels;
+};
+
+
+/// Callback for decoded samples.
+/**
+ * @param p_format Format of the samples; can change between calls if the
+ *        media changes its format midstream and no fixed format was requested
+ * @param p_samples Pointer to 32-bit float interleaved samples
+ * @param p_num_frames Number of frames p_samples points to (one frame contains
+ *        one sample per channel)
+ * @return true if decoding shall continue, false if it shall be aborted
+ */
+typedef std::function < bool(decoded_format const &p_format, float const *p_samples, std::size_t const p_num_frames) > decoded_samples_callback;
+
+
+/// Decodes media to 32-bit float interleaved samples as fast as possible.
+/**
+ * This is meant for offline analysis (loudness scanning, fingerprinting etc.),
+ * not for playback. The samples are not synchronized against a clock, and the
+ * function blocks until decoding is complete. It does not need a GLib mainloop;
+ * the pipeline's bus is polled directly instead. This makes it possible to
+ * decode several media in parallel, one per thread.
+ *
+ * Data read from the network counts as ingress_class_probe traffic in the
+ * global ingress scheduling (see ingress_scheduler.hpp), so it does not
+ * starve the streams that are being played.
+ *
+ * GStreamer must have been initialized before calling this function.
+ *
+ * @param p_uri URI of the media to decode
+ * @param p_callback Callback to invoke for each block of decoded samples; it is
+ *        called from a GStreamer streaming thread
+ * @param p_rate If nonzero, the samples are resampled to this rate
+ * @param p_channels If nonzero, the samples are up/downmixed to this number of channels
+ * @return true if decoding finished successfully, false if an error occurred or
+ *         the callback aborted decoding
+ */
+bool decode_media_offline(std::string const &p_uri, decoded_samples_callback const &p_callback, guint const p_rate = 0, guint const p_channels = 0);
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "parallel_jobs.hpp"
+
+
+namespace nxplay
+{
+
+
+unsigned int run_parallel_jobs(std::size_t const p_num_jobs, unsigned int const p_num_threads, job_function const &p_job_function)
+{
+	unsigned int num_threads = p_num_threads;
+	if (num_threads == 0)
+		num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	num_threads = unsigned(std::min(std::size_t(num_threads), std::max(p_num_jobs, std::size_t(1))));
+
+	std::atomic < std::size_t > next_job_index(0);
+
+	auto worker = [&]()
+	{
+		while (true)
+		{
+			std::size_t index = next_job_index.fetch_add(1);
+			if (index >= p_num_jobs)
+				break;
+
+			p_job_function(index);
+		}
+	};
+
+	std::vector < std::thread > threads;
+	for (unsigned int i = 0; i < num_threads; ++i)
+		threads.emplace_back(worker);
+	for (auto &thread : threads)
+		thread.join();
+
+	return num_threads;
+}
+
+
+} // namespace nxplay end
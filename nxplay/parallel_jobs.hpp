@@ -0,0 +1,47 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_PARALLEL_JOBS_HPP
+#define NXPLAY_PARALLEL_JOBS_HPP
+
+#include <cstddef>
+#include <functional>
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Function that processes the job with the given index.
+typedef std::function < void(std::size_t const p_job_index) > job_function;
+
+
+/// Runs jobs on a pool of worker threads, and waits until all of them are done.
+/**
+ * Each worker fetches the next unprocessed job index from a shared atomic
+ * counter as soon as it finished its previous job. Workers therefore never
+ * idle while jobs are left, even if job durations vary greatly (which is
+ * typical when processing media of different lengths).
+ *
+ * @param p_num_jobs Number of jobs; the job function is called with indices
+ *        0 to p_num_jobs-1, once per index
+ * @param p_num_threads Number of worker threads; 0 means one thread per CPU core
+ * @param p_job_function Function to call for each job; called from the worker threads
+ * @return Number of worker threads that were used
+ */
+unsigned int run_parallel_jobs(std::size_t const p_num_jobs, unsigned int const p_num_threads, job_function const &p_job_function);
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -70,6 +70,12 @@ pipeline::~pipeline()
 }
 
 
+bool pipeline::prewarm()
+{
+	return true;
+}
+
+
 bool pipeline::play_media(guint64 const p_token, media const &p_media, bool const p_play_now, playback_properties const &p_properties)
 {
 	media temp_media(p_media); // create temporary copy which will be moved by the derived class
@@ -212,8 +212,8 @@ struct playback_properties
  * stated otherwise.
  *
  * In most cases, the derived main_pipeline class will be used. The pipeline base class
- * is useful as a building block to a "selector" however which can switch between
- * pipelines. This is planned for future nxplay versions.
+ * is also the building block for pipeline_selector, which switches between pipelines
+ * depending on the media to play.
  *
  * Unless documented otherwise, pipeline reinitializations always cancel any internal
  * postponed tasks.
@@ -379,6 +379,17 @@ public:
 	 */
 	virtual void force_postpone_tag(std::string const &p_tag, bool const p_postpone) = 0;
 
+	/// Prepares an idle pipeline so that subsequent playback starts faster.
+	/**
+	 * Implementations can use this to build their internal GStreamer pipelines
+	 * and open output devices ahead of time. This is only done in the idle
+	 * state; in other states, the call is ignored. The default implementation
+	 * does nothing.
+	 *
+	 * @return false if preparing the pipeline failed, true otherwise
+	 */
+	virtual bool prewarm();
+
 
 protected:
 	// Derived classes only need to overload this one, and can leave the two play_media() functions alone
@@ -0,0 +1,243 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include "log.hpp"
+#include "pipeline_selector.hpp"
+
+
+namespace nxplay
+{
+
+
+pipeline_selector::switch_stats::switch_stats()
+	: m_num_switches(0)
+	, m_last_latency(0)
+	, m_min_latency(0)
+	, m_max_latency(0)
+	, m_total_latency(0)
+{
+}
+
+
+pipeline_selector::pipeline_selector(bool const p_prewarm)
+	: m_prewarm(p_prewarm)
+	, m_active_entry(nullptr)
+	, m_next_token(0)
+	, m_pending_next_token(0)
+{
+}
+
+
+void pipeline_selector::add_pipeline(pipeline &p_pipeline, media_predicate const &p_predicate, std::string const &p_name)
+{
+	// m_active_entry points into m_entries, so keep it valid
+	// in case the vector reallocates
+	std::ptrdiff_t active_index = (m_active_entry != nullptr) ? (m_active_entry - &m_entries[0]) : -1;
+
+	entry new_entry;
+	new_entry.m_pipeline = &p_pipeline;
+	new_entry.m_predicate = p_predicate;
+	new_entry.m_name = p_name;
+	m_entries.push_back(std::move(new_entry));
+
+	if (active_index >= 0)
+		m_active_entry = &m_entries[active_index];
+
+	if (m_prewarm && !p_pipeline.prewarm())
+		NXPLAY_LOG_MSG(warning, "could not prewarm pipeline \"" << p_name << "\"");
+}
+
+
+pipeline* pipeline_selector::get_active_pipeline()
+{
+	return (m_active_entry != nullptr) ? m_active_entry->m_pipeline : nullptr;
+}
+
+
+bool pipeline_selector::play_pending_next_media()
+{
+	if (!is_valid(m_pending_next_media))
+		return false;
+
+	media next_media = std::move(m_pending_next_media);
+	m_pending_next_media = media();
+
+	return play_media_impl(m_pending_next_token, std::move(next_media), true, m_pending_next_properties);
+}
+
+
+pipeline_selector::switch_stats const & pipeline_selector::get_switch_stats() const
+{
+	return m_switch_stats;
+}
+
+
+void pipeline_selector::stop()
+{
+	m_pending_next_media = media();
+	if (m_active_entry != nullptr)
+		m_active_entry->m_pipeline->stop();
+}
+
+
+guint64 pipeline_selector::get_new_token()
+{
+	return m_next_token++;
+}
+
+
+void pipeline_selector::set_paused(bool const p_paused)
+{
+	if (m_active_entry != nullptr)
+		m_active_entry->m_pipeline->set_paused(p_paused);
+}
+
+
+bool pipeline_selector::is_transitioning() const
+{
+	return (m_active_entry != nullptr) && m_active_entry->m_pipeline->is_transitioning();
+}
+
+
+states pipeline_selector::get_current_state() const
+{
+	return (m_active_entry != nullptr) ? m_active_entry->m_pipeline->get_current_state() : state_idle;
+}
+
+
+void pipeline_selector::set_current_position(gint64 const p_new_position, position_units const p_unit)
+{
+	if (m_active_entry != nullptr)
+		m_active_entry->m_pipeline->set_current_position(p_new_position, p_unit);
+}
+
+
+gint64 pipeline_selector::get_current_position(position_units const p_unit) const
+{
+	return (m_active_entry != nullptr) ? m_active_entry->m_pipeline->get_current_position(p_unit) : -1;
+}
+
+
+gint64 pipeline_selector::get_duration(position_units const p_unit) const
+{
+	return (m_active_entry != nullptr) ? m_active_entry->m_pipeline->get_duration(p_unit) : -1;
+}
+
+
+void pipeline_selector::force_postpone_tag(std::string const &p_tag, bool const p_postpone)
+{
+	for (auto &e : m_entries)
+		e.m_pipeline->force_postpone_tag(p_tag, p_postpone);
+}
+
+
+bool pipeline_selector::prewarm()
+{
+	bool ok = true;
+
+	for (auto &e : m_entries)
+	{
+		if ((&e != m_active_entry) && !(e.m_pipeline->prewarm()))
+		{
+			NXPLAY_LOG_MSG(warning, "could not prewarm pipeline \"" << e.m_name << "\"");
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+
+bool pipeline_selector::play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	if (!is_valid(p_media))
+	{
+		NXPLAY_LOG_MSG(error, "cannot play invalid media");
+		return false;
+	}
+
+	entry *target_entry = find_entry(p_media);
+	if (target_entry == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "no pipeline can play media with URI " << p_media.get_uri());
+		return false;
+	}
+
+	bool active_is_idle = (m_active_entry == nullptr) || (m_active_entry->m_pipeline->get_current_state() == state_idle);
+
+	// The active pipeline decides on its own if the media is played
+	// now or becomes its next media
+	if (target_entry == m_active_entry)
+	{
+		m_pending_next_media = media();
+		return target_entry->m_pipeline->play_media(p_token, std::move(p_media), p_play_now, p_properties);
+	}
+
+	// Next media that belongs to another pipeline cannot be played
+	// gaplessly, so keep it until play_pending_next_media() is called
+	if (!p_play_now && !active_is_idle)
+	{
+		NXPLAY_LOG_MSG(debug, "media with URI " << p_media.get_uri() << " needs pipeline \"" << target_entry->m_name << "\"; keeping it as pending next media");
+		m_pending_next_media = std::move(p_media);
+		m_pending_next_token = p_token;
+		m_pending_next_properties = p_properties;
+		return true;
+	}
+
+	// Switch to the target pipeline
+	m_pending_next_media = media();
+
+	auto switch_start_time = std::chrono::steady_clock::now();
+
+	entry *previous_entry = m_active_entry;
+	if (previous_entry != nullptr)
+		previous_entry->m_pipeline->stop();
+
+	m_active_entry = target_entry;
+	bool ret = target_entry->m_pipeline->play_media(p_token, std::move(p_media), true, p_properties);
+
+	auto latency = std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now() - switch_start_time);
+
+	// Only count actual switches; the very first play request is not one
+	if (previous_entry != nullptr)
+	{
+		switch_stats &stats = m_switch_stats;
+		stats.m_min_latency = (stats.m_num_switches == 0) ? latency : std::min(stats.m_min_latency, latency);
+		stats.m_max_latency = std::max(stats.m_max_latency, latency);
+		stats.m_last_latency = latency;
+		stats.m_total_latency += latency;
+		++stats.m_num_switches;
+
+		NXPLAY_LOG_MSG(debug, "switched from pipeline \"" << previous_entry->m_name << "\" to \"" << target_entry->m_name << "\" in " << latency.count() << " us");
+
+		// Prewarm the previous pipeline again, so the
+		// next switch back to it is fast as well
+		if (m_prewarm && !(previous_entry->m_pipeline->prewarm()))
+			NXPLAY_LOG_MSG(warning, "could not prewarm pipeline \"" << previous_entry->m_name << "\"");
+	}
+
+	return ret;
+}
+
+
+pipeline_selector::entry* pipeline_selector::find_entry(media const &p_media)
+{
+	for (auto &e : m_entries)
+	{
+		if (!(e.m_predicate) || e.m_predicate(p_media))
+			return &e;
+	}
+
+	return nullptr;
+}
+
+
+} // namespace nxplay end
@@ -0,0 +1,171 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_PIPELINE_SELECTOR_HPP
+#define NXPLAY_PIPELINE_SELECTOR_HPP
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "media.hpp"
+#include "pipeline.hpp"
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// Pipeline which forwards calls to one of several other pipelines, depending on the media.
+/**
+ * Each pipeline added to the selector comes with a predicate which decides
+ * what media the pipeline is responsible for (for example, one pipeline for
+ * local files and HTTP streams with gapless playback, one for live receivers,
+ * and one configured for low latency). play_media() picks the first pipeline
+ * whose predicate accepts the media. All other calls are forwarded to the
+ * currently active pipeline.
+ *
+ * The idle pipelines are kept prewarmed (see pipeline::prewarm()). Switching
+ * to another pipeline therefore does not tear down and rebuild anything; the
+ * previously active pipeline is stopped, the new one starts playing, and the
+ * stopped pipeline is prewarmed again for the next switch. The time these
+ * switches take is recorded, and can be retrieved with get_switch_stats().
+ *
+ * The selector does not own the pipelines; they must outlive it. Callbacks
+ * of the pipelines are not affected by the selector, so applications
+ * install them on the individual pipelines as usual.
+ *
+ * Next media is forwarded to the active pipeline if it is responsible for
+ * it, which retains gapless playback. If another pipeline is responsible,
+ * gapless playback is not possible. The media is then kept as pending
+ * next media, and play_pending_next_media() must be called once the
+ * active pipeline reached its end of stream. Note that this must not be
+ * done from within a pipeline callback, since pipeline functions cannot
+ * be called from within their own callbacks.
+ *
+ * Like the pipelines themselves, the selector is not thread safe.
+ */
+class pipeline_selector
+	: public pipeline
+{
+public:
+	/// Predicate for deciding if a pipeline is responsible for given media.
+	typedef std::function < bool(media const &p_media) > media_predicate;
+
+	/// Latency statistics of pipeline switches.
+	/**
+	 * The latency covers stopping the previously active pipeline and
+	 * issuing the play request to the new one. It does not include the
+	 * new pipeline's prerolling, since that is the same with or without
+	 * a switch.
+	 */
+	struct switch_stats
+	{
+		/// Number of switches between pipelines
+		unsigned int m_num_switches;
+		/// Latency of the most recent switch
+		std::chrono::microseconds m_last_latency;
+		/// Lowest switch latency
+		std::chrono::microseconds m_min_latency;
+		/// Highest switch latency
+		std::chrono::microseconds m_max_latency;
+		/// Sum of all switch latencies; divide by m_num_switches to get the mean
+		std::chrono::microseconds m_total_latency;
+
+		switch_stats();
+	};
+
+	/// Constructor.
+	/**
+	 * @param p_prewarm If true, idle pipelines are prewarmed
+	 */
+	explicit pipeline_selector(bool const p_prewarm = true);
+
+	/// Adds a pipeline to the selector.
+	/**
+	 * Pipelines are checked in the order they were added. A pipeline with
+	 * an empty predicate accepts all media, so it is useful as a fallback
+	 * at the end. If prewarming is enabled, the pipeline is prewarmed here.
+	 *
+	 * @param p_pipeline Pipeline to add; must outlive the selector
+	 * @param p_predicate Predicate which decides what media p_pipeline plays
+	 * @param p_name Name of the pipeline, used for logging
+	 */
+	void add_pipeline(pipeline &p_pipeline, media_predicate const &p_predicate, std::string const &p_name);
+
+	/// Returns the currently active pipeline, or nullptr if no media was played yet.
+	pipeline* get_active_pipeline();
+
+	/// Plays the pending next media (if there is any) with its pipeline.
+	/**
+	 * See the pipeline_selector description for details.
+	 *
+	 * @return true if there was pending next media and it started to play
+	 */
+	bool play_pending_next_media();
+
+	/// Returns the latency statistics of pipeline switches.
+	switch_stats const & get_switch_stats() const;
+
+	virtual void stop() override;
+
+	virtual guint64 get_new_token() override;
+
+	virtual void set_paused(bool const p_paused) override;
+
+	virtual bool is_transitioning() const override;
+
+	virtual states get_current_state() const override;
+
+	virtual void set_current_position(gint64 const p_new_position, position_units const p_unit = position_unit_nanoseconds) override;
+	virtual gint64 get_current_position(position_units const p_unit = position_unit_nanoseconds) const override;
+
+	virtual gint64 get_duration(position_units const p_unit = position_unit_nanoseconds) const override;
+
+	/// Forwards the call to all pipelines.
+	virtual void force_postpone_tag(std::string const &p_tag, bool const p_postpone) override;
+
+	/// Prewarms all pipelines except the active one.
+	virtual bool prewarm() override;
+
+
+protected:
+	virtual bool play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties) override;
+
+
+private:
+	struct entry
+	{
+		pipeline *m_pipeline;
+		media_predicate m_predicate;
+		std::string m_name;
+	};
+
+	entry* find_entry(media const &p_media);
+
+	bool const m_prewarm;
+	std::vector < entry > m_entries;
+	entry *m_active_entry;
+	guint64 m_next_token;
+
+	media m_pending_next_media;
+	guint64 m_pending_next_token;
+	playback_properties m_pending_next_properties;
+
+	switch_stats m_switch_stats;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
@@ -14,6 +14,12 @@ namespace nxplay
 {
 
 
+processing_object::processing_object()
+	: m_float32_pinned(false)
+{
+}
+
+
 processing_object::~processing_object()
 {
 }
@@ -30,4 +36,22 @@ void processing_object::teardown()
 }
 
 
+processing_formats processing_object::get_native_format() const
+{
+	return processing_format_any;
+}
+
+
+void processing_object::set_float32_pinned(bool const p_pinned)
+{
+	m_float32_pinned = p_pinned;
+}
+
+
+bool processing_object::is_float32_pinned() const
+{
+	return m_float32_pinned;
+}
+
+
 } // namespace nxplay end
@@ -20,6 +20,16 @@ namespace nxplay
 {
 
 
+/// Sample formats processing objects can declare as their native format.
+enum processing_formats
+{
+	/// The object accepts any format (it contains its own converter, or is format agnostic)
+	processing_format_any,
+	/// The object processes 32-bit floating point interleaved samples natively
+	processing_format_f32
+};
+
+
 /// Class for processing media data; placed right before a suitable output sink.
 /**
  * This is useful for processing data right before it is presented. Examples
@@ -36,10 +46,17 @@ namespace nxplay
  * The reason for this is that this element is inserted in the pipeline's bin with
  * the gst_bin_add() call, and this call sink-refs the element (also, the inserted
  * elements are later unref'd when the pipeline element is destroyed).
+ *
+ * If the pipeline runs in float32 processing mode, the samples are converted
+ * to 32-bit float interleaved once, before the first processing object, and
+ * the format is pinned. In that case, is_float32_pinned() returns true during
+ * setup(), and objects must not insert their own converters, since these
+ * would be redundant.
  */
 class processing_object
 {
 public:
+	processing_object();
 	virtual ~processing_object();
 
 	/// Sets up the object's states (called during pipeline initialization).
@@ -68,6 +85,20 @@ public:
 	 * @return A GStreamer element, or nullptr is something went wrong
 	 */
 	virtual GstElement* get_gst_element() = 0;
+
+	/// Returns the sample format this object processes natively.
+	/**
+	 * Default implementation returns processing_format_any.
+	 */
+	virtual processing_formats get_native_format() const;
+
+	/// Pins/unpins the sample format to 32-bit float interleaved (called by the pipeline before setup()).
+	void set_float32_pinned(bool const p_pinned);
+	/// Returns true if the sample format is pinned to 32-bit float interleaved.
+	bool is_float32_pinned() const;
+
+private:
+	bool m_float32_pinned;
 };
 
 
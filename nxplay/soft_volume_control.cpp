@@ -53,7 +53,9 @@ bool soft_volume_control::setup()
 		return false;
 	}
 
-	if ((audioconvert = gst_element_factory_make("audioconvert", "processing_obj_audioconvert_elem")) == nullptr)
+	// The audioconvert element is only necessary if the incoming format
+	// is not pinned to float32 already
+	if (!is_float32_pinned() && ((audioconvert = gst_element_factory_make("audioconvert", "processing_obj_audioconvert_elem")) == nullptr))
 	{
 		NXPLAY_LOG_MSG(error, "could not create audioconvert element");
 		return false;
@@ -65,8 +67,13 @@ bool soft_volume_control::setup()
 		return false;
 	}
 
-	gst_bin_add_many(GST_BIN(m_bin), audioconvert, m_volume_elem, nullptr);
-	gst_element_link(audioconvert, m_volume_elem);
+	if (audioconvert != nullptr)
+	{
+		gst_bin_add_many(GST_BIN(m_bin), audioconvert, m_volume_elem, nullptr);
+		gst_element_link(audioconvert, m_volume_elem);
+	}
+	else
+		gst_bin_add(GST_BIN(m_bin), m_volume_elem);
 
 	elems_guard.unguard();
 
@@ -77,7 +84,7 @@ bool soft_volume_control::setup()
 		nullptr
 	);
 
-	GstPad *sinkpad = gst_element_get_static_pad(audioconvert, "sink");
+	GstPad *sinkpad = gst_element_get_static_pad((audioconvert != nullptr) ? audioconvert : m_volume_elem, "sink");
 	GstPad *srcpad = gst_element_get_static_pad(m_volume_elem, "src");
 	gst_element_add_pad(m_bin, gst_ghost_pad_new("sink", sinkpad));
 	gst_element_add_pad(m_bin, gst_ghost_pad_new("src", srcpad));
@@ -103,6 +110,12 @@ GstElement* soft_volume_control::get_gst_element()
 }
 
 
+processing_formats soft_volume_control::get_native_format() const
+{
+	return processing_format_f32;
+}
+
+
 void soft_volume_control::set_volume(double const p_new_volume)
 {
 	m_volume = p_new_volume;
@@ -25,6 +25,9 @@ namespace nxplay
 /**
  * Implements software volume control by using the GStreamer volume object.
  * The volume object is created in setup() and unref'd in teardown().
+ * The volume element processes 32-bit float samples natively, so if the
+ * format is pinned to float32, no audioconvert element is placed in front
+ * of it.
  */
 class soft_volume_control
 	: public processing_object
@@ -37,6 +40,7 @@ public:
 	virtual void teardown() override;
 
 	virtual GstElement* get_gst_element() override;
+	virtual processing_formats get_native_format() const override;
 
 	/// Sets the current volume, with the given format.
 	/**
@@ -0,0 +1,370 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <gst/audio/audio.h>
+#include "alloc_tracking.hpp"
+#include "log.hpp"
+#include "scope_guard.hpp"
+#include "spectrum_analyzer.hpp"
+#include "utility.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+std::size_t const new_frame_flag = 4;
+std::size_t const index_mask = 3;
+
+// Equivalent noise bandwidth of the Hann window, in bins. A sine spreads
+// its energy over this many bins, so the band sums are divided by it to
+// make a full scale sine show up as 0 dB.
+float const hann_noise_bandwidth = 1.5f;
+
+
+} // unnamed namespace end
+
+
+spectrum_frame::spectrum_frame()
+	: m_timestamp(GST_CLOCK_TIME_NONE)
+	, m_sequence_number(0)
+{
+}
+
+
+spectrum_analyzer::spectrum_analyzer(std::size_t const p_fft_size, std::size_t const p_hop_size)
+	: m_bin(nullptr)
+	, m_configuration_changed(true)
+	, m_fft(p_fft_size)
+	, m_hop_size(p_hop_size)
+	, m_samples(p_fft_size)
+	, m_power(m_fft.get_num_bins())
+	, m_num_samples(0)
+	, m_rate(0)
+	, m_num_channels(0)
+	, m_sequence_number(0)
+	, m_back_index(0)
+	, m_front_index(2)
+	, m_middle_index(1)
+{
+	assert((p_hop_size > 0) && (p_hop_size <= p_fft_size));
+
+	m_configuration.m_num_bands = 32;
+	m_configuration.m_min_frequency = 40.0f;
+	m_configuration.m_max_frequency = 16000.0f;
+	m_active_configuration = m_configuration;
+}
+
+
+spectrum_analyzer::~spectrum_analyzer()
+{
+	teardown();
+}
+
+
+bool spectrum_analyzer::setup()
+{
+	GstElement *audioconvert = nullptr, *capsfilter = nullptr, *identity = nullptr;
+
+	assert(m_bin == nullptr);
+
+	auto elems_guard = make_scope_guard([&]()
+	{
+		checked_unref(m_bin);
+		checked_unref(audioconvert);
+		checked_unref(capsfilter);
+		checked_unref(identity);
+	});
+
+	if ((m_bin = gst_bin_new("processing_obj_spectrum_bin")) == nullptr)
+	{
+		NXPLAY_LOG_MSG(error, "could not create spectrum analyzer bin");
+		return false;
+	}
+
+	GstElement *first_elem, *last_elem;
+
+	if (is_float32_pinned())
+	{
+		// The format is already float32, so just pass the data through
+		// and analyze it on the way
+		if ((identity = gst_element_factory_make("identity", "processing_obj_spectrum_identity_elem")) == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create identity element");
+			return false;
+		}
+
+		gst_bin_add(GST_BIN(m_bin), identity);
+		first_elem = last_elem = identity;
+	}
+	else
+	{
+		if ((audioconvert = gst_element_factory_make("audioconvert", "processing_obj_spectrum_audioconvert_elem")) == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create audioconvert element");
+			return false;
+		}
+
+		if ((capsfilter = gst_element_factory_make("capsfilter", "processing_obj_spectrum_capsfilter_elem")) == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create capsfilter element");
+			return false;
+		}
+
+		GstCaps *f32_caps = gst_caps_new_simple(
+			"audio/x-raw",
+			"format", G_TYPE_STRING, GST_AUDIO_NE(F32),
+			"layout", G_TYPE_STRING, "interleaved",
+			nullptr
+		);
+		g_object_set(G_OBJECT(capsfilter), "caps", f32_caps, nullptr);
+		gst_caps_unref(f32_caps);
+
+		gst_bin_add_many(GST_BIN(m_bin), audioconvert, capsfilter, nullptr);
+		gst_element_link(audioconvert, capsfilter);
+		first_elem = audioconvert;
+		last_elem = capsfilter;
+	}
+
+	elems_guard.unguard();
+
+	m_num_samples = 0;
+	m_rate = 0;
+	m_num_channels = 0;
+
+	GstPad *sinkpad = gst_element_get_static_pad(first_elem, "sink");
+	GstPad *srcpad = gst_element_get_static_pad(last_elem, "src");
+	gst_pad_add_probe(
+		srcpad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+		static_analysis_probe,
+		gpointer(this),
+		nullptr
+	);
+	gst_element_add_pad(m_bin, gst_ghost_pad_new("sink", sinkpad));
+	gst_element_add_pad(m_bin, gst_ghost_pad_new("src", srcpad));
+	gst_object_unref(GST_OBJECT(sinkpad));
+	gst_object_unref(GST_OBJECT(srcpad));
+
+	gst_object_ref_sink(GST_OBJECT(m_bin));
+
+	return true;
+}
+
+
+void spectrum_analyzer::teardown()
+{
+	checked_unref(m_bin);
+}
+
+
+GstElement* spectrum_analyzer::get_gst_element()
+{
+	return m_bin;
+}
+
+
+processing_formats spectrum_analyzer::get_native_format() const
+{
+	return processing_format_f32;
+}
+
+
+void spectrum_analyzer::set_bands(std::size_t const p_num_bands, float const p_min_frequency, float const p_max_frequency)
+{
+	assert(p_num_bands >= 1);
+	assert((p_min_frequency > 0.0f) && (p_min_frequency < p_max_frequency));
+
+	std::unique_lock < std::mutex > lock(m_configuration_mutex);
+	m_configuration.m_num_bands = p_num_bands;
+	m_configuration.m_min_frequency = p_min_frequency;
+	m_configuration.m_max_frequency = p_max_frequency;
+	m_configuration_changed = true;
+}
+
+
+spectrum_frame const & spectrum_analyzer::read_spectrum(bool *p_is_new)
+{
+	bool is_new = false;
+
+	// Only swap if the writer published a frame since the last
+	// read; otherwise, the reader would get an older frame back
+	if ((m_middle_index.load(std::memory_order_acquire) & new_frame_flag) != 0)
+	{
+		m_front_index = m_middle_index.exchange(m_front_index, std::memory_order_acq_rel) & index_mask;
+		is_new = true;
+	}
+
+	if (p_is_new != nullptr)
+		*p_is_new = is_new;
+
+	return m_frames[m_front_index];
+}
+
+
+GstPadProbeReturn spectrum_analyzer::static_analysis_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("spectrum_analyzer::static_analysis_probe");
+
+	spectrum_analyzer *self = static_cast < spectrum_analyzer* > (p_data);
+
+	if ((p_info->type & GST_PAD_PROBE_TYPE_BUFFER) != 0)
+	{
+		self->analyze_buffer(GST_PAD_PROBE_INFO_BUFFER(p_info));
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(p_info);
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_CAPS:
+		{
+			GstCaps *caps;
+			GstAudioInfo audio_info;
+			gst_event_parse_caps(event, &caps);
+
+			if (gst_audio_info_from_caps(&audio_info, caps))
+			{
+				self->m_rate = GST_AUDIO_INFO_RATE(&audio_info);
+				self->m_num_channels = GST_AUDIO_INFO_CHANNELS(&audio_info);
+				self->update_band_ranges(self->m_active_configuration);
+			}
+			else
+			{
+				self->m_rate = 0;
+				self->m_num_channels = 0;
+			}
+
+			self->m_num_samples = 0;
+			break;
+		}
+
+		case GST_EVENT_FLUSH_STOP:
+			self->m_num_samples = 0;
+			break;
+
+		default:
+			break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void spectrum_analyzer::update_band_ranges(band_configuration const &p_configuration)
+{
+	m_active_configuration = p_configuration;
+
+	if (m_rate == 0)
+		return;
+
+	std::size_t num_bands = p_configuration.m_num_bands;
+	std::size_t num_bins = m_fft.get_num_bins();
+	float bin_width = float(m_rate) / m_fft.get_size();
+	float frequency_ratio = p_configuration.m_max_frequency / p_configuration.m_min_frequency;
+
+	// Each band covers the bin range [begin, end). Bands that are narrower
+	// than a bin still get one bin, so they never stay empty.
+	m_band_bin_ranges.resize(num_bands * 2);
+	for (std::size_t band = 0; band < num_bands; ++band)
+	{
+		float low_frequency = p_configuration.m_min_frequency * std::pow(frequency_ratio, float(band) / num_bands);
+		float high_frequency = p_configuration.m_min_frequency * std::pow(frequency_ratio, float(band + 1) / num_bands);
+
+		std::size_t begin = std::min(std::size_t(std::lround(low_frequency / bin_width)), num_bins - 1);
+		std::size_t end = std::min(std::size_t(std::lround(high_frequency / bin_width)), num_bins);
+		end = std::max(end, begin + 1);
+
+		m_band_bin_ranges[band * 2 + 0] = begin;
+		m_band_bin_ranges[band * 2 + 1] = end;
+	}
+}
+
+
+void spectrum_analyzer::analyze_buffer(GstBuffer *p_buffer)
+{
+	if (m_configuration_changed.exchange(false))
+	{
+		band_configuration configuration;
+		{
+			std::unique_lock < std::mutex > lock(m_configuration_mutex);
+			configuration = m_configuration;
+		}
+		update_band_ranges(configuration);
+	}
+
+	if ((m_rate == 0) || (m_num_channels == 0))
+		return;
+
+	GstMapInfo map_info;
+	if (!gst_buffer_map(p_buffer, &map_info, GST_MAP_READ))
+		return;
+
+	float const *samples = reinterpret_cast < float const * > (map_info.data);
+	std::size_t num_frames = map_info.size / (sizeof(float) * m_num_channels);
+	std::size_t fft_size = m_fft.get_size();
+	float channel_scale = 1.0f / m_num_channels;
+	GstClockTime pts = GST_BUFFER_PTS(p_buffer);
+
+	for (std::size_t frame = 0; frame < num_frames; ++frame)
+	{
+		float mono_sample = 0.0f;
+		for (guint channel = 0; channel < m_num_channels; ++channel)
+			mono_sample += samples[frame * m_num_channels + channel];
+		m_samples[m_num_samples++] = mono_sample * channel_scale;
+
+		if (m_num_samples == fft_size)
+		{
+			GstClockTime timestamp = GST_CLOCK_TIME_IS_VALID(pts) ? (pts + gst_util_uint64_scale_int(frame + 1, GST_SECOND, m_rate)) : GST_CLOCK_TIME_NONE;
+			publish_spectrum(timestamp);
+
+			// Keep the overlapping part for the next spectrum
+			std::size_t num_kept_samples = fft_size - m_hop_size;
+			std::memmove(&m_samples[0], &m_samples[m_hop_size], num_kept_samples * sizeof(float));
+			m_num_samples = num_kept_samples;
+		}
+	}
+
+	gst_buffer_unmap(p_buffer, &map_info);
+}
+
+
+void spectrum_analyzer::publish_spectrum(GstClockTime const p_timestamp)
+{
+	m_fft.compute_power_spectrum(&m_samples[0], &m_power[0]);
+
+	spectrum_frame &frame = m_frames[m_back_index];
+	std::size_t num_bands = m_band_bin_ranges.size() / 2;
+
+	// This only allocates if the number of bands grew
+	frame.m_band_levels.resize(num_bands);
+	for (std::size_t band = 0; band < num_bands; ++band)
+	{
+		float power_sum = 0.0f;
+		for (std::size_t bin = m_band_bin_ranges[band * 2 + 0]; bin < m_band_bin_ranges[band * 2 + 1]; ++bin)
+			power_sum += m_power[bin];
+		frame.m_band_levels[band] = 10.0f * std::log10(power_sum / hann_noise_bandwidth + 1e-12f);
+	}
+
+	frame.m_timestamp = p_timestamp;
+	frame.m_sequence_number = ++m_sequence_number;
+
+	m_back_index = m_middle_index.exchange(m_back_index | new_frame_flag, std::memory_order_acq_rel) & index_mask;
+}
+
+
+} // namespace nxplay end
@@ -0,0 +1,146 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_SPECTRUM_ANALYZER_HPP
+#define NXPLAY_SPECTRUM_ANALYZER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <gst/gst.h>
+#include "fft.hpp"
+#include "processing_object.hpp"
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// One spectrum produced by spectrum_analyzer.
+struct spectrum_frame
+{
+	spectrum_frame();
+
+	/// Band levels in dB (0 dB = full scale sine), from the lowest to the highest band
+	std::vector < float > m_band_levels;
+	/// Timestamp of the last sample that went into this spectrum, or GST_CLOCK_TIME_NONE
+	GstClockTime m_timestamp;
+	/// Incremented with each new spectrum; 0 means no spectrum was produced yet
+	guint64 m_sequence_number;
+};
+
+
+/// Real-time spectrum analyzer processing object.
+/**
+ * Unlike the GStreamer spectrum element, this does not post bus messages.
+ * Instead, the analysis runs in a pad probe inside the streaming thread, and
+ * the results are published through a lock-free triple buffer. UI threads
+ * can then fetch the latest spectrum at display rate with read_spectrum(),
+ * without ever blocking the streaming thread, the bus watch, or the main
+ * pipeline's mutex.
+ *
+ * Samples are downmixed to mono, and one spectrum is computed every
+ * p_hop_size frames, using real_fft. The FFT bins are then summed up into
+ * logarithmically spaced bands.
+ *
+ * The analyzer processes 32-bit float samples natively. If the format is not
+ * pinned to float32, an audioconvert and a capsfilter are placed in front of
+ * the analysis.
+ */
+class spectrum_analyzer
+	: public processing_object
+{
+public:
+	/// Constructor.
+	/**
+	 * @param p_fft_size FFT size; must be a power of two
+	 * @param p_hop_size Number of frames between two spectra; at most p_fft_size
+	 */
+	explicit spectrum_analyzer(std::size_t const p_fft_size = 2048, std::size_t const p_hop_size = 1024);
+	~spectrum_analyzer();
+
+	virtual bool setup() override;
+	virtual void teardown() override;
+
+	virtual GstElement* get_gst_element() override;
+	virtual processing_formats get_native_format() const override;
+
+	/// Sets the band configuration.
+	/**
+	 * The bands are spaced logarithmically between the two frequencies.
+	 * This can be called at any time; the streaming thread picks up the
+	 * new configuration with the next buffer.
+	 *
+	 * @param p_num_bands Number of bands; must be at least 1
+	 * @param p_min_frequency Lower edge of the lowest band, in Hz
+	 * @param p_max_frequency Upper edge of the highest band, in Hz
+	 */
+	void set_bands(std::size_t const p_num_bands, float const p_min_frequency, float const p_max_frequency);
+
+	/// Retrieves the latest spectrum.
+	/**
+	 * The returned reference stays valid and unchanged until the next
+	 * read_spectrum() call. Only one thread may read spectra at a time.
+	 * This function never blocks.
+	 *
+	 * @param p_is_new If non-null, set to true if the spectrum is newer than
+	 *        the one returned by the previous call
+	 * @return Latest spectrum
+	 */
+	spectrum_frame const & read_spectrum(bool *p_is_new = nullptr);
+
+private:
+	struct band_configuration
+	{
+		std::size_t m_num_bands;
+		float m_min_frequency, m_max_frequency;
+	};
+
+	static GstPadProbeReturn static_analysis_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
+
+	void update_band_ranges(band_configuration const &p_configuration);
+	void analyze_buffer(GstBuffer *p_buffer);
+	void publish_spectrum(GstClockTime const p_timestamp);
+
+	GstElement *m_bin;
+
+	// Band configuration, as set by set_bands(). The flag lets the
+	// streaming thread check for changes without locking the mutex.
+	std::mutex m_configuration_mutex;
+	band_configuration m_configuration;
+	std::atomic < bool > m_configuration_changed;
+
+	// Analysis states; only accessed by the streaming thread
+	real_fft m_fft;
+	std::size_t m_hop_size;
+	std::vector < float > m_samples, m_power;
+	std::size_t m_num_samples;
+	guint m_rate, m_num_channels;
+	band_configuration m_active_configuration;
+	std::vector < std::size_t > m_band_bin_ranges;
+	guint64 m_sequence_number;
+
+	// Triple buffer. The writer fills m_frames[m_back_index], the reader
+	// owns m_frames[m_front_index], and m_middle_index holds the index of
+	// the third frame, plus new_frame_flag if it was published after the
+	// reader last fetched.
+	spectrum_frame m_frames[3];
+	std::size_t m_back_index, m_front_index;
+	std::atomic < std::size_t > m_middle_index;
+};
+
+
+} // namespace nxplay end
+
+
+#endif
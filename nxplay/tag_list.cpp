@@ -7,6 +7,7 @@
  * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
  */
 
+#include <cstring>
 #include "tag_list.hpp"
 
 
@@ -250,6 +251,46 @@ tag_list calculate_new_tags(tag_list const &p_reference, tag_list const &p_other
 }
 
 
+gsize estimate_memory_usage(tag_list const &p_tag_list)
+{
+	if (p_tag_list.is_empty())
+		return 0;
+
+	GstTagList *raw_list = p_tag_list.get_tag_list();
+	gsize size = 0;
+
+	gint num_tags = gst_tag_list_n_tags(raw_list);
+	for (gint num = 0; num < num_tags; ++num)
+	{
+		gchar const *name = gst_tag_list_nth_tag_name(raw_list, num);
+		guint num_values = gst_tag_list_get_tag_size(raw_list, name);
+
+		for (guint index = 0; index < num_values; ++index)
+		{
+			GValue const *value = gst_tag_list_get_value_index(raw_list, name, index);
+
+			size += sizeof(GValue);
+
+			if (G_VALUE_HOLDS_STRING(value))
+			{
+				gchar const *str = g_value_get_string(value);
+				if (str != nullptr)
+					size += std::strlen(str) + 1;
+			}
+			else if (GST_VALUE_HOLDS_SAMPLE(value))
+			{
+				GstSample *sample = gst_value_get_sample(value);
+				GstBuffer *buffer = (sample != nullptr) ? gst_sample_get_buffer(sample) : nullptr;
+				if (buffer != nullptr)
+					size += gst_buffer_get_size(buffer);
+			}
+		}
+	}
+
+	return size;
+}
+
+
 std::string to_string(tag_list const &p_tag_list)
 {
 	gchar *cstr = gst_tag_list_to_string(p_tag_list.get_tag_list());
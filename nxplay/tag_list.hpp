@@ -329,6 +329,18 @@ bool get_value(tag_list const &p_tag_list, std::string const p_name, std::string
  */
 tag_list calculate_new_tags(tag_list const &p_reference, tag_list const &p_other);
 
+/// Estimates how many bytes the tag list occupies in memory.
+/**
+ * This is an approximation. Strings contribute their length, samples (for
+ * example, embedded cover art images) contribute the size of their buffer,
+ * and all other values contribute the size of a GValue. Bookkeeping overhead
+ * inside GStreamer is not included.
+ *
+ * @param p_tag_list Tag list to inspect
+ * @return Estimated size in bytes, or 0 if p_tag_list.is_empty() returns true
+ */
+gsize estimate_memory_usage(tag_list const &p_tag_list);
+
 /// Serializes the tag list to a string
 std::string to_string(tag_list const &p_tag_list);
 /// Deserializes the tag list from a string
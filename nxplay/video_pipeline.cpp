@@ -0,0 +1,1047 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+#include <assert.h>
+#include <algorithm>
+#include <utility>
+#include "alloc_tracking.hpp"
+#include "scope_guard.hpp"
+#include "utility.hpp"
+#include "video_pipeline.hpp"
+
+
+namespace nxplay
+{
+
+
+namespace
+{
+
+
+// playbin's GstPlayFlags are not part of the public headers,
+// so the values needed here are defined explicitely
+guint const play_flag_video = (1 << 0);
+guint const play_flag_audio = (1 << 1);
+guint const play_flag_soft_volume = (1 << 4);
+
+
+std::string parse_error_message(GstMessage *p_msg)
+{
+	GError *error = nullptr;
+	gchar *debug_info = nullptr;
+	gst_message_parse_error(p_msg, &error, &debug_info);
+
+	std::string text = error->message;
+	NXPLAY_LOG_MSG(error, text << " (reported by: " << GST_MESSAGE_SRC_NAME(p_msg) << " debug info: " << ((debug_info == nullptr) ? "<none>" : debug_info) << ")");
+
+	g_error_free(error);
+	g_free(debug_info);
+
+	return text;
+}
+
+
+} // unnamed namespace end
+
+
+
+
+video_frame::video_frame()
+	: m_sample(nullptr)
+{
+	gst_video_info_init(&m_video_info);
+}
+
+
+video_frame::video_frame(GstSample *p_sample, GstVideoInfo const &p_video_info)
+	: m_sample(p_sample)
+	, m_video_info(p_video_info)
+{
+}
+
+
+video_frame::video_frame(video_frame const &p_other)
+	: m_sample(p_other.m_sample)
+	, m_video_info(p_other.m_video_info)
+{
+	if (m_sample != nullptr)
+		gst_sample_ref(m_sample);
+}
+
+
+video_frame::video_frame(video_frame &&p_other)
+	: m_sample(p_other.m_sample)
+	, m_video_info(p_other.m_video_info)
+{
+	p_other.m_sample = nullptr;
+}
+
+
+video_frame::~video_frame()
+{
+	if (m_sample != nullptr)
+		gst_sample_unref(m_sample);
+}
+
+
+video_frame& video_frame::operator = (video_frame const &p_other)
+{
+	if (p_other.m_sample != nullptr)
+		gst_sample_ref(p_other.m_sample);
+	if (m_sample != nullptr)
+		gst_sample_unref(m_sample);
+
+	m_sample = p_other.m_sample;
+	m_video_info = p_other.m_video_info;
+
+	return *this;
+}
+
+
+video_frame& video_frame::operator = (video_frame &&p_other)
+{
+	if (this != &p_other)
+	{
+		if (m_sample != nullptr)
+			gst_sample_unref(m_sample);
+
+		m_sample = p_other.m_sample;
+		m_video_info = p_other.m_video_info;
+		p_other.m_sample = nullptr;
+	}
+
+	return *this;
+}
+
+
+bool video_frame::is_valid() const
+{
+	return m_sample != nullptr;
+}
+
+
+GstSample* video_frame::get_sample() const
+{
+	return m_sample;
+}
+
+
+GstBuffer* video_frame::get_buffer() const
+{
+	return (m_sample != nullptr) ? gst_sample_get_buffer(m_sample) : nullptr;
+}
+
+
+GstVideoInfo const & video_frame::get_video_info() const
+{
+	return m_video_info;
+}
+
+
+GstClockTime video_frame::get_timestamp() const
+{
+	GstBuffer *buffer = get_buffer();
+	return (buffer != nullptr) ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+}
+
+
+bool video_frame::map(GstVideoFrame &p_mapped_frame) const
+{
+	GstBuffer *buffer = get_buffer();
+	if (buffer == nullptr)
+		return false;
+
+	// gst_video_frame_map() expects a non-const video info
+	GstVideoInfo video_info = m_video_info;
+	return gst_video_frame_map(&p_mapped_frame, &video_info, buffer, GST_MAP_READ);
+}
+
+
+
+
+video_pipeline::qos_stats::qos_stats()
+	: m_processed_frames(-1)
+	, m_dropped_frames(-1)
+{
+}
+
+
+video_pipeline::video_pipeline(callbacks const &p_callbacks, video_modes const p_video_mode, gint64 const p_max_lateness, GstVideoFormat const p_video_format, std::string const &p_audiosink_name)
+	: m_callbacks(p_callbacks)
+	, m_video_mode(p_video_mode)
+	, m_max_lateness(p_max_lateness)
+	, m_video_format(p_video_format)
+	, m_audiosink_name(p_audiosink_name)
+	, m_state(state_idle)
+	, m_state_before_transition(state_idle)
+	, m_current_token(0)
+	, m_initial_seek_done(false)
+	, m_next_token(0)
+	, m_next_media_token(0)
+	, m_queued_media_token(0)
+	, m_frame_token(0)
+	, m_pending_frame_token(0)
+	, m_frame_token_pending(false)
+	, m_frame_caps(nullptr)
+	, m_pipeline_elem(nullptr)
+	, m_videosink_elem(nullptr)
+	, m_bus(nullptr)
+	, m_watch_source(nullptr)
+	, m_thread_loop(nullptr)
+	, m_thread_loop_context(nullptr)
+	, m_thread_loop_running(false)
+{
+	gst_video_info_init(&m_frame_video_info);
+
+	// Start the GLib mainloop thread first, since the
+	// bus watch is attached to its context
+	start_thread();
+
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	initialize_pipeline_nolock();
+}
+
+
+video_pipeline::~video_pipeline()
+{
+	log_context_scope log_scope(m_log_context);
+
+	{
+		std::unique_lock < std::mutex > lock(m_loop_mutex);
+		shutdown_pipeline_nolock();
+	}
+
+	stop_thread();
+}
+
+
+void video_pipeline::stop()
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	stop_nolock();
+}
+
+
+guint64 video_pipeline::get_new_token()
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_next_token++;
+}
+
+
+void video_pipeline::set_paused(bool const p_paused)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	switch (m_state)
+	{
+		case state_idle:
+		case state_stopping:
+			break;
+
+		case state_playing:
+		case state_paused:
+		{
+			states new_state = p_paused ? state_paused : state_playing;
+			if (new_state == m_state)
+				break;
+
+			gst_element_set_state(m_pipeline_elem, p_paused ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+			set_state_nolock(new_state);
+			break;
+		}
+
+		default:
+			// Apply the change once the transition is finished
+			m_postponed_paused = p_paused;
+			break;
+	}
+}
+
+
+bool video_pipeline::is_transitioning() const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	switch (m_state)
+	{
+		case state_starting:
+		case state_stopping:
+		case state_seeking:
+		case state_buffering:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+states video_pipeline::get_current_state() const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_state;
+}
+
+
+void video_pipeline::set_current_position(gint64 const p_new_position, position_units const p_unit)
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	seek_nolock(p_new_position, p_unit);
+}
+
+
+gint64 video_pipeline::get_current_position(position_units const p_unit) const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	gint64 position;
+	if ((m_pipeline_elem == nullptr) || (m_state == state_idle) || !gst_element_query_position(m_pipeline_elem, (p_unit == position_unit_bytes) ? GST_FORMAT_BYTES : GST_FORMAT_TIME, &position))
+		return -1;
+
+	return position;
+}
+
+
+gint64 video_pipeline::get_duration(position_units const p_unit) const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	gint64 duration;
+	if ((m_pipeline_elem == nullptr) || (m_state == state_idle) || !gst_element_query_duration(m_pipeline_elem, (p_unit == position_unit_bytes) ? GST_FORMAT_BYTES : GST_FORMAT_TIME, &duration))
+		return -1;
+
+	return duration;
+}
+
+
+void video_pipeline::force_postpone_tag(std::string const &, bool const)
+{
+}
+
+
+bool video_pipeline::prewarm()
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if (m_state != state_idle)
+		return true;
+
+	if ((m_pipeline_elem == nullptr) && !initialize_pipeline_nolock())
+		return false;
+
+	if (gst_element_set_state(m_pipeline_elem, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE)
+	{
+		NXPLAY_LOG_MSG(error, "could not switch video pipeline to READY for prewarming");
+		return false;
+	}
+
+	return true;
+}
+
+
+void video_pipeline::set_max_lateness(gint64 const p_max_lateness)
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	m_max_lateness = p_max_lateness;
+	if (m_videosink_elem != nullptr)
+		g_object_set(G_OBJECT(m_videosink_elem), "max-lateness", m_max_lateness, nullptr);
+}
+
+
+video_pipeline::qos_stats video_pipeline::get_qos_stats() const
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+	return m_qos_stats;
+}
+
+
+log_context & video_pipeline::get_log_context()
+{
+	return m_log_context;
+}
+
+
+bool video_pipeline::play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties)
+{
+	log_context_scope log_scope(m_log_context, p_token);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if ((m_state == state_idle) || p_play_now || (m_current_token == p_token))
+		return play_media_nolock(p_token, std::move(p_media), p_properties);
+
+	if (!is_valid(p_media))
+	{
+		NXPLAY_LOG_MSG(error, "cannot schedule invalid media as next media");
+		return false;
+	}
+
+	NXPLAY_LOG_MSG(debug, "scheduling media with URI " << p_media.get_uri() << " as next media with token " << p_token);
+
+	// The about-to-finish callback picks up the next media
+	std::unique_lock < std::mutex > next_media_lock(m_next_media_mutex);
+	m_next_media = std::move(p_media);
+	m_next_media_token = p_token;
+	m_next_properties = p_properties;
+
+	return true;
+}
+
+
+bool video_pipeline::initialize_pipeline_nolock()
+{
+	GstElement *playbin_elem = nullptr, *videobin_elem = nullptr, *audiosink_elem = nullptr;
+	GstElement *videoconvert_elem = nullptr, *capsfilter_elem = nullptr, *fakesink_elem = nullptr;
+
+	assert(m_pipeline_elem == nullptr);
+
+	auto elems_guard = make_scope_guard([&]()
+	{
+		checked_unref(playbin_elem);
+		checked_unref(videobin_elem);
+		checked_unref(audiosink_elem);
+		checked_unref(videoconvert_elem);
+		checked_unref(capsfilter_elem);
+		checked_unref(fakesink_elem);
+	});
+
+	if (((playbin_elem = gst_element_factory_make("playbin", "video_pipeline_playbin")) == nullptr)
+	 || ((videobin_elem = gst_bin_new("video_sink_bin")) == nullptr)
+	 || ((fakesink_elem = gst_element_factory_make("fakesink", "video_sink")) == nullptr))
+	{
+		NXPLAY_LOG_MSG(error, "could not create video pipeline elements");
+		return false;
+	}
+
+	if (m_video_format != GST_VIDEO_FORMAT_UNKNOWN)
+	{
+		if (((videoconvert_elem = gst_element_factory_make("videoconvert", nullptr)) == nullptr)
+		 || ((capsfilter_elem = gst_element_factory_make("capsfilter", nullptr)) == nullptr))
+		{
+			NXPLAY_LOG_MSG(error, "could not create video conversion elements");
+			return false;
+		}
+
+		GstCaps *caps = gst_caps_new_simple(
+			"video/x-raw",
+			"format", G_TYPE_STRING, gst_video_format_to_string(m_video_format),
+			nullptr
+		);
+		g_object_set(G_OBJECT(capsfilter_elem), "caps", caps, nullptr);
+		gst_caps_unref(caps);
+	}
+
+	guint play_flags = play_flag_video;
+
+	if (m_video_mode == video_mode_playback)
+	{
+		if ((audiosink_elem = gst_element_factory_make(m_audiosink_name.c_str(), "audio_sink")) == nullptr)
+		{
+			NXPLAY_LOG_MSG(error, "could not create audio sink \"" << m_audiosink_name << "\"");
+			return false;
+		}
+
+		// Some sinks (like fakesink) do not synchronize by default,
+		// which would break A/V sync
+		g_object_set(G_OBJECT(audiosink_elem), "sync", gboolean(TRUE), nullptr);
+
+		play_flags |= play_flag_audio | play_flag_soft_volume;
+	}
+
+	// In playback mode, the sink synchronizes against the clock, drops
+	// frames that are later than the maximum lateness, and sends QoS
+	// events upstream so decoders can skip frames. In keyframes-only
+	// mode, frames are delivered as fast as they are decoded.
+	// The last sample is not kept, since this would hold on to an
+	// extra decoder buffer.
+	bool sync = (m_video_mode == video_mode_playback);
+	g_object_set(
+		G_OBJECT(fakesink_elem),
+		"sync", gboolean(sync),
+		"qos", gboolean(sync),
+		"max-lateness", m_max_lateness,
+		"signal-handoffs", gboolean(TRUE),
+		"enable-last-sample", gboolean(FALSE),
+		nullptr
+	);
+
+	GstElement *first_elem;
+	if (videoconvert_elem != nullptr)
+	{
+		gst_bin_add_many(GST_BIN(videobin_elem), videoconvert_elem, capsfilter_elem, fakesink_elem, nullptr);
+		gst_element_link_many(videoconvert_elem, capsfilter_elem, fakesink_elem, nullptr);
+		first_elem = videoconvert_elem;
+	}
+	else
+	{
+		gst_bin_add(GST_BIN(videobin_elem), fakesink_elem);
+		first_elem = fakesink_elem;
+	}
+
+	GstPad *sinkpad = gst_element_get_static_pad(first_elem, "sink");
+	gst_element_add_pad(videobin_elem, gst_ghost_pad_new("sink", sinkpad));
+	gst_object_unref(GST_OBJECT(sinkpad));
+
+	GstPad *fakesink_pad = gst_element_get_static_pad(fakesink_elem, "sink");
+	gst_pad_add_probe(fakesink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, static_stream_start_probe, gpointer(this), nullptr);
+	gst_object_unref(GST_OBJECT(fakesink_pad));
+
+	g_signal_connect(G_OBJECT(fakesink_elem), "handoff", G_CALLBACK(static_handoff_callback), gpointer(this));
+	g_signal_connect(G_OBJECT(playbin_elem), "about-to-finish", G_CALLBACK(static_about_to_finish_callback), gpointer(this));
+
+	// playbin takes ownership over the sinks
+	g_object_set(G_OBJECT(playbin_elem), "flags", play_flags, "video-sink", videobin_elem, nullptr);
+	if (audiosink_elem != nullptr)
+		g_object_set(G_OBJECT(playbin_elem), "audio-sink", audiosink_elem, nullptr);
+
+	m_pipeline_elem = playbin_elem;
+	m_videosink_elem = fakesink_elem;
+	elems_guard.unguard();
+
+	// Set up the bus watch; see main_pipeline::initialize_pipeline_nolock()
+	// for why gst_bus_add_watch() is not used, and why the callback
+	// is converted to GSourceFunc this way
+	m_bus = gst_pipeline_get_bus(GST_PIPELINE(m_pipeline_elem));
+	m_watch_source = gst_bus_create_watch(m_bus);
+	g_source_set_callback(m_watch_source, GSourceFunc(reinterpret_cast < void (*)(void) > (static_bus_watch)), gpointer(this), nullptr);
+	g_source_attach(m_watch_source, m_thread_loop_context);
+
+	set_state_nolock(state_idle);
+
+	NXPLAY_LOG_MSG(debug, "video pipeline initialized");
+
+	return true;
+}
+
+
+void video_pipeline::shutdown_pipeline_nolock()
+{
+	if (m_pipeline_elem == nullptr)
+		return;
+
+	gst_element_set_state(m_pipeline_elem, GST_STATE_NULL);
+
+	g_source_destroy(m_watch_source);
+	g_source_unref(m_watch_source);
+	m_watch_source = nullptr;
+	gst_object_unref(GST_OBJECT(m_bus));
+	m_bus = nullptr;
+
+	gst_object_unref(GST_OBJECT(m_pipeline_elem));
+	m_pipeline_elem = nullptr;
+	m_videosink_elem = nullptr;
+
+	// The streaming threads are gone at this point,
+	// so the frame caps can be safely accessed
+	if (m_frame_caps != nullptr)
+	{
+		gst_caps_unref(m_frame_caps);
+		m_frame_caps = nullptr;
+	}
+
+	m_current_media = media();
+	m_postponed_paused = boost::none;
+	m_postponed_seek = boost::none;
+
+	{
+		std::unique_lock < std::mutex > next_media_lock(m_next_media_mutex);
+		m_next_media = media();
+		m_queued_media = media();
+	}
+
+	m_log_context.set_current_token(0);
+
+	NXPLAY_LOG_MSG(debug, "video pipeline shut down");
+}
+
+
+void video_pipeline::reinitialize_pipeline_nolock()
+{
+	shutdown_pipeline_nolock();
+	if (!initialize_pipeline_nolock())
+		NXPLAY_LOG_MSG(error, "could not reinitialize video pipeline");
+}
+
+
+bool video_pipeline::play_media_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties)
+{
+	if (!is_valid(p_media))
+	{
+		NXPLAY_LOG_MSG(error, "cannot play invalid media");
+		return false;
+	}
+
+	if ((m_pipeline_elem == nullptr) && !initialize_pipeline_nolock())
+		return false;
+
+	NXPLAY_LOG_MSG(debug, "playing media with URI " << p_media.get_uri() << " now with token " << p_token);
+
+	// Any previous playback ends here. Switching to READY
+	// is enough to be able to set a new URI.
+	gst_element_set_state(m_pipeline_elem, GST_STATE_READY);
+
+	// The pipeline only flushes its bus when switching to NULL, so
+	// flush it manually; otherwise, stale EOS, error, and ASYNC_DONE
+	// messages of the previous media would be handled as if they
+	// belonged to the new one
+	gst_bus_set_flushing(m_bus, TRUE);
+	gst_bus_set_flushing(m_bus, FALSE);
+
+	{
+		std::unique_lock < std::mutex > next_media_lock(m_next_media_mutex);
+		m_next_media = media();
+		m_queued_media = media();
+	}
+
+	m_current_media = std::move(p_media);
+	m_current_token = p_token;
+	m_current_properties = p_properties;
+	m_initial_seek_done = false;
+	m_qos_stats = qos_stats();
+	m_postponed_paused = p_properties.m_start_paused;
+	m_postponed_seek = boost::none;
+	m_log_context.set_current_token(p_token);
+
+	m_pending_frame_token = p_token;
+	m_frame_token_pending = true;
+
+	g_object_set(G_OBJECT(m_pipeline_elem), "uri", m_current_media.get_uri().c_str(), nullptr);
+
+	set_state_nolock(state_starting);
+
+	// Preroll first; the actual playback is started once
+	// prerolling is done (see finish_transition_nolock())
+	if (gst_element_set_state(m_pipeline_elem, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE)
+	{
+		NXPLAY_LOG_MSG(error, "could not start playing media with URI " << m_current_media.get_uri());
+		stop_nolock();
+		return false;
+	}
+
+	return true;
+}
+
+
+void video_pipeline::stop_nolock()
+{
+	if ((m_pipeline_elem == nullptr) || (m_state == state_idle))
+		return;
+
+	gst_element_set_state(m_pipeline_elem, GST_STATE_READY);
+	// Discard stale messages of the stopped media (see play_media_nolock())
+	gst_bus_set_flushing(m_bus, TRUE);
+	gst_bus_set_flushing(m_bus, FALSE);
+
+	m_current_media = media();
+	m_postponed_paused = boost::none;
+	m_postponed_seek = boost::none;
+
+	{
+		std::unique_lock < std::mutex > next_media_lock(m_next_media_mutex);
+		m_next_media = media();
+		m_queued_media = media();
+	}
+
+	m_log_context.set_current_token(0);
+
+	set_state_nolock(state_idle);
+}
+
+
+void video_pipeline::set_state_nolock(states const p_new_state)
+{
+	states old_state = m_state;
+	m_state = p_new_state;
+	NXPLAY_LOG_MSG(trace, "state change: old: " << get_state_name(old_state) << " new: " << get_state_name(m_state));
+	if (m_callbacks.m_state_changed_callback)
+		m_callbacks.m_state_changed_callback(old_state, p_new_state);
+}
+
+
+void video_pipeline::seek_nolock(gint64 const p_position, position_units const p_unit)
+{
+	switch (m_state)
+	{
+		case state_idle:
+		case state_stopping:
+			NXPLAY_LOG_MSG(debug, "ignoring seek request, since nothing is playing");
+			break;
+
+		case state_playing:
+		case state_paused:
+			if (send_seek_event_nolock(p_position, p_unit))
+			{
+				m_state_before_transition = m_state;
+				set_state_nolock(state_seeking);
+			}
+			break;
+
+		default:
+			// Seek once the transition is finished
+			m_postponed_seek = std::make_pair(p_position, p_unit);
+			break;
+	}
+}
+
+
+bool video_pipeline::send_seek_event_nolock(gint64 const p_position, position_units const p_unit)
+{
+	GstSeekFlags flags = GST_SEEK_FLAG_FLUSH;
+
+	// In keyframes-only mode, all seeks are trickmode seeks, which
+	// instruct decoders to skip everything except keyframes
+	if (m_video_mode == video_mode_keyframes_only)
+		flags = GstSeekFlags(flags | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO);
+
+	if (!gst_element_seek(m_pipeline_elem, 1.0, (p_unit == position_unit_bytes) ? GST_FORMAT_BYTES : GST_FORMAT_TIME, flags, GST_SEEK_TYPE_SET, p_position, GST_SEEK_TYPE_NONE, -1))
+	{
+		NXPLAY_LOG_MSG(warning, "seeking to position " << p_position << " failed");
+		return false;
+	}
+
+	return true;
+}
+
+
+void video_pipeline::finish_transition_nolock()
+{
+	// After prerolling, perform the initial seek if necessary. In
+	// keyframes-only mode, this is always done, since the trickmode
+	// is enabled by the seek. A seek that was requested during startup
+	// replaces the start position.
+	if ((m_state == state_starting) && !m_initial_seek_done)
+	{
+		m_initial_seek_done = true;
+
+		gint64 position = m_current_properties.m_start_at_position;
+		position_units unit = m_current_properties.m_start_at_position_unit;
+		if (m_postponed_seek)
+		{
+			position = m_postponed_seek->first;
+			unit = m_postponed_seek->second;
+			m_postponed_seek = boost::none;
+		}
+
+		// The seek causes another preroll; this function
+		// is called again once it is finished
+		if (((m_video_mode == video_mode_keyframes_only) || (position > 0)) && send_seek_event_nolock(std::max(position, gint64(0)), unit))
+			return;
+	}
+
+	bool paused = m_postponed_paused ? *m_postponed_paused : (m_state_before_transition == state_paused);
+	m_postponed_paused = boost::none;
+
+	gst_element_set_state(m_pipeline_elem, paused ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+	set_state_nolock(paused ? state_paused : state_playing);
+
+	if (m_postponed_seek)
+	{
+		auto seek = *m_postponed_seek;
+		m_postponed_seek = boost::none;
+		seek_nolock(seek.first, seek.second);
+	}
+}
+
+
+void video_pipeline::static_about_to_finish_callback(GstElement *p_playbin, gpointer p_data)
+{
+	// This is called from a streaming thread shortly before the
+	// current media ends. Setting the URI here lets playbin switch
+	// to the next media without a gap.
+
+	video_pipeline *self = static_cast < video_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
+
+	std::unique_lock < std::mutex > next_media_lock(self->m_next_media_mutex);
+
+	if (!is_valid(self->m_next_media))
+		return;
+
+	NXPLAY_LOG_MSG(debug, "current media is about to end; queuing next media with URI " << self->m_next_media.get_uri());
+
+	g_object_set(G_OBJECT(p_playbin), "uri", self->m_next_media.get_uri().c_str(), nullptr);
+
+	self->m_queued_media = std::move(self->m_next_media);
+	self->m_queued_media_token = self->m_next_media_token;
+	self->m_queued_properties = self->m_next_properties;
+	self->m_next_media = media();
+
+	self->m_pending_frame_token = self->m_queued_media_token;
+	self->m_frame_token_pending = true;
+}
+
+
+void video_pipeline::static_handoff_callback(GstElement *, GstBuffer *p_buffer, GstPad *p_pad, gpointer p_data)
+{
+	NXPLAY_STREAMING_ALLOC_SCOPE("video_pipeline::static_handoff_callback");
+
+	video_pipeline *self = static_cast < video_pipeline* > (p_data);
+	guint64 token = self->m_frame_token;
+	log_context_scope log_scope(self->m_log_context, token);
+
+	if (!(self->m_callbacks.m_new_video_frame_callback))
+		return;
+
+	// Caps objects are immutable once set, so comparing the
+	// pointers is enough to detect a caps change
+	GstCaps *caps = gst_pad_get_current_caps(p_pad);
+	if (caps == nullptr)
+		return;
+	if (caps != self->m_frame_caps)
+	{
+		if (!gst_video_info_from_caps(&(self->m_frame_video_info), caps))
+		{
+			NXPLAY_LOG_MSG(error, "could not parse caps of decoded video frames");
+			gst_caps_unref(caps);
+			return;
+		}
+
+		if (self->m_frame_caps != nullptr)
+			gst_caps_unref(self->m_frame_caps);
+		self->m_frame_caps = caps;
+	}
+	else
+		gst_caps_unref(caps);
+
+	// The sample just adds a reference to the buffer; nothing is copied
+	video_frame frame(gst_sample_new(p_buffer, self->m_frame_caps, nullptr, nullptr), self->m_frame_video_info);
+	self->m_callbacks.m_new_video_frame_callback(token, frame);
+}
+
+
+GstPadProbeReturn video_pipeline::static_stream_start_probe(GstPad *, GstPadProbeInfo *p_info, gpointer p_data)
+{
+	video_pipeline *self = static_cast < video_pipeline* > (p_data);
+
+	// All frames after this event belong to the new media
+	if ((GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(p_info)) == GST_EVENT_STREAM_START) && self->m_frame_token_pending.exchange(false))
+		self->m_frame_token = self->m_pending_frame_token.load();
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+gboolean video_pipeline::static_bus_watch(GstBus *, GstMessage *p_msg, gpointer p_data)
+{
+	NXPLAY_ALLOC_SCOPE("video_pipeline::static_bus_watch");
+
+	video_pipeline *self = static_cast < video_pipeline* > (p_data);
+	log_context_scope log_scope(self->m_log_context);
+
+	std::unique_lock < std::mutex > lock(self->m_loop_mutex);
+
+	// Messages can still arrive after the pipeline was stopped
+	if (self->m_state == state_idle)
+		return TRUE;
+
+	switch (GST_MESSAGE_TYPE(p_msg))
+	{
+		case GST_MESSAGE_STREAM_START:
+		{
+			{
+				// If playbin switched to queued next media, that
+				// media is now the current one
+				std::unique_lock < std::mutex > next_media_lock(self->m_next_media_mutex);
+				if (is_valid(self->m_queued_media))
+				{
+					self->m_current_media = std::move(self->m_queued_media);
+					self->m_current_token = self->m_queued_media_token;
+					self->m_current_properties = self->m_queued_properties;
+					self->m_queued_media = media();
+					self->m_qos_stats = qos_stats();
+					self->m_log_context.set_current_token(self->m_current_token);
+				}
+			}
+
+			NXPLAY_LOG_MSG(debug, "media with URI " << self->m_current_media.get_uri() << " started to play");
+
+			if (self->m_callbacks.m_media_started_callback)
+				self->m_callbacks.m_media_started_callback(self->m_current_media, self->m_current_token);
+
+			break;
+		}
+
+		case GST_MESSAGE_ASYNC_DONE:
+		{
+			if ((self->m_state == state_starting) || (self->m_state == state_seeking))
+				self->finish_transition_nolock();
+			break;
+		}
+
+		case GST_MESSAGE_BUFFERING:
+		{
+			gint percent;
+			gst_message_parse_buffering(p_msg, &percent);
+
+			NXPLAY_LOG_MSG(debug, "buffering reported by " << GST_MESSAGE_SRC_NAME(p_msg) << " at " << percent << "%");
+
+			// Pause while buffering, and resume once done. During
+			// startup and seeking, the prerolling takes care of this.
+			if ((percent < 100) && (self->m_state == state_playing))
+			{
+				gst_element_set_state(self->m_pipeline_elem, GST_STATE_PAUSED);
+				self->m_state_before_transition = state_playing;
+				self->set_state_nolock(state_buffering);
+			}
+			else if ((percent >= 100) && (self->m_state == state_buffering))
+				self->finish_transition_nolock();
+
+			break;
+		}
+
+		case GST_MESSAGE_QOS:
+		{
+			// Only the video sink's QoS messages are of interest,
+			// since these count the dropped frames
+			if (GST_MESSAGE_SRC(p_msg) != GST_OBJECT(self->m_videosink_elem))
+				break;
+
+			GstFormat format;
+			guint64 processed, dropped;
+			gst_message_parse_qos_stats(p_msg, &format, &processed, &dropped);
+			if (format == GST_FORMAT_BUFFERS)
+			{
+				self->m_qos_stats.m_processed_frames = processed;
+				self->m_qos_stats.m_dropped_frames = dropped;
+			}
+
+			NXPLAY_LOG_MSG(trace, "QoS: processed " << processed << " dropped " << dropped << " frames");
+
+			break;
+		}
+
+		case GST_MESSAGE_EOS:
+		{
+			// The next media is normally played gaplessly. If it
+			// was set too late for that, play it now.
+			media next_media;
+			guint64 next_token;
+			playback_properties next_properties;
+			{
+				std::unique_lock < std::mutex > next_media_lock(self->m_next_media_mutex);
+				next_media = std::move(self->m_next_media);
+				next_token = self->m_next_media_token;
+				next_properties = self->m_next_properties;
+				self->m_next_media = media();
+			}
+
+			if (is_valid(next_media))
+			{
+				self->play_media_nolock(next_token, std::move(next_media), next_properties);
+			}
+			else
+			{
+				self->stop_nolock();
+				if (self->m_callbacks.m_end_of_stream_callback)
+					self->m_callbacks.m_end_of_stream_callback();
+			}
+
+			break;
+		}
+
+		case GST_MESSAGE_ERROR:
+		{
+			std::string text = parse_error_message(p_msg);
+			if (self->m_callbacks.m_error_callback)
+				self->m_callbacks.m_error_callback(text);
+
+			// Error messages indicate a nonrecoverable error
+			self->reinitialize_pipeline_nolock();
+
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return TRUE;
+}
+
+
+void video_pipeline::thread_main()
+{
+	log_context_scope log_scope(m_log_context);
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	// See main_pipeline::thread_main() for details about the explicit context
+	m_thread_loop_context = g_main_context_new();
+	g_main_context_push_thread_default(m_thread_loop_context);
+
+	m_thread_loop = g_main_loop_new(m_thread_loop_context, FALSE);
+
+	GSource *idle_source = g_idle_source_new();
+	g_source_set_callback(idle_source, (GSourceFunc)static_loop_start_cb, this, nullptr);
+	g_source_attach(idle_source, m_thread_loop_context);
+	g_source_unref(idle_source);
+
+	lock.unlock();
+	g_main_loop_run(m_thread_loop);
+	lock.lock();
+
+	g_main_loop_unref(m_thread_loop);
+	m_thread_loop = nullptr;
+
+	g_main_context_pop_thread_default(m_thread_loop_context);
+	g_main_context_unref(m_thread_loop_context);
+	m_thread_loop_context = nullptr;
+}
+
+
+void video_pipeline::start_thread()
+{
+	std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+	if (m_thread_loop != nullptr)
+		return;
+
+	m_thread_loop_running = false;
+	m_thread = std::thread(&video_pipeline::thread_main, this);
+
+	while (!m_thread_loop_running)
+		m_condition.wait(lock);
+
+	NXPLAY_LOG_MSG(debug, "thread started");
+}
+
+
+void video_pipeline::stop_thread()
+{
+	{
+		std::unique_lock < std::mutex > lock(m_loop_mutex);
+
+		if (m_thread_loop != nullptr)
+			g_main_loop_quit(m_thread_loop);
+	}
+
+	m_thread.join();
+
+	m_thread_loop_running = false;
+
+	NXPLAY_LOG_MSG(debug, "thread stopped");
+}
+
+
+gboolean video_pipeline::static_loop_start_cb(gpointer p_data)
+{
+	video_pipeline *self = static_cast < video_pipeline* > (p_data);
+
+	std::unique_lock < std::mutex > lock(self->m_loop_mutex);
+	self->m_thread_loop_running = true;
+	self->m_condition.notify_all();
+
+	return G_SOURCE_REMOVE;
+}
+
+
+} // namespace nxplay end
@@ -0,0 +1,320 @@
+/*
+ * nxplay - GStreamer-based media playback library
+ *
+ * Copyright (C) 2015 by Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * Distributed under the Boost Software License, Version 1.0. See accompanying
+ * file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt .
+ */
+
+/** @file */
+
+#ifndef NXPLAY_VIDEO_PIPELINE_HPP
+#define NXPLAY_VIDEO_PIPELINE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <boost/optional.hpp>
+#include "log.hpp"
+#include "media.hpp"
+#include "pipeline.hpp"
+
+
+/** nxplay */
+namespace nxplay
+{
+
+
+/// A decoded video frame.
+/**
+ * The frame refers to the decoder's buffer directly; no pixels are copied.
+ * Copying a video_frame only increases the buffer's refcount. As long as a
+ * frame is held, its buffer cannot be returned to the decoder's buffer pool,
+ * so applications should not hold on to many frames at the same time, since
+ * otherwise the decoder might run out of buffers and stall.
+ */
+class video_frame
+{
+public:
+	/// Constructs an invalid frame.
+	video_frame();
+	/// Constructs a frame out of a sample. The frame takes over the sample's reference.
+	explicit video_frame(GstSample *p_sample, GstVideoInfo const &p_video_info);
+	video_frame(video_frame const &p_other);
+	video_frame(video_frame &&p_other);
+	~video_frame();
+
+	video_frame& operator = (video_frame const &p_other);
+	video_frame& operator = (video_frame &&p_other);
+
+	/// Returns true if the frame refers to a sample.
+	bool is_valid() const;
+
+	/// Returns the underlying sample (or nullptr if the frame is invalid). No extra reference is added.
+	GstSample* get_sample() const;
+	/// Returns the sample's buffer (or nullptr if the frame is invalid). No extra reference is added.
+	GstBuffer* get_buffer() const;
+	/// Returns format, size, strides etc. of the frame.
+	GstVideoInfo const & get_video_info() const;
+	/// Returns the frame's presentation timestamp, or GST_CLOCK_TIME_NONE if it has none.
+	GstClockTime get_timestamp() const;
+
+	/// Maps the frame's planes into memory.
+	/**
+	 * Use the GST_VIDEO_FRAME_PLANE_DATA and GST_VIDEO_FRAME_PLANE_STRIDE
+	 * macros to access the planes, and call gst_video_frame_unmap() once
+	 * done. With system memory buffers, this does not copy anything.
+	 *
+	 * @return true if mapping succeeded
+	 */
+	bool map(GstVideoFrame &p_mapped_frame) const;
+
+private:
+	GstSample *m_sample;
+	GstVideoInfo m_video_info;
+};
+
+
+/// Video modes for video_pipeline.
+enum video_modes
+{
+	/// Regular playback; audio and video are played in sync with the clock.
+	video_mode_playback,
+	/// Only keyframes are decoded and delivered as fast as possible, without audio.
+	/**
+	 * Decoders skip all other frames entirely, which makes this mode much
+	 * cheaper than regular playback. This is useful for generating thumbnails
+	 * and previews.
+	 */
+	video_mode_keyframes_only
+};
+
+
+/// Pipeline for playing media with video.
+/**
+ * Decoded video frames are not rendered; instead, they are passed on to the
+ * new_video_frame_callback as video_frame objects, which refer to the decoded
+ * buffers without copying them. The frames are passed on in sync with the
+ * clock, so audio and video stay in sync. This pipeline is meant for software
+ * decoding, for example for generating previews on servers without a GPU.
+ *
+ * When the CPU cannot keep up, late frames are dropped instead of delaying
+ * the playback. The video sink posts QoS events upstream, which make the
+ * decoders skip the decoding of frames that would be late anyway, and frames
+ * that still arrive too late are not delivered to the callback.
+ * get_qos_stats() reports how many frames were dropped.
+ *
+ * Like main_pipeline, video_pipeline runs its own GLib mainloop thread, and
+ * its callbacks are invoked from that thread, except for the
+ * new_video_frame_callback, which is invoked from a GStreamer streaming thread.
+ * Next media is supported, and switched to in a gapless manner if possible.
+ * Tags and buffering levels are currently not reported.
+ */
+class video_pipeline
+	: public pipeline
+{
+public:
+	/// Callback for notifying about media that started playing.
+	typedef std::function < void(media const &p_current_media, guint64 const p_token) > media_started_callback;
+	/// Callback for notifying about the end of playback. The pipeline is in the idle state at this point.
+	typedef std::function < void() > end_of_stream_callback;
+	/// Callback for notifying about errors. Afterwards, the pipeline is reinitialized and in the idle state.
+	typedef std::function < void(std::string const &p_error_message) > error_callback;
+	/// Callback for notifying about state changes.
+	typedef std::function < void(states const p_old_state, states const p_new_state) > state_changed_callback;
+	/// Callback for notifying about new decoded video frames.
+	/**
+	 * This is called from a GStreamer streaming thread. In
+	 * video_mode_playback, this happens at the time the frame is meant to
+	 * be displayed. The callback should not block for long, since this
+	 * would delay subsequent frames. It also must not call any
+	 * video_pipeline functions. The frame can be copied and kept after the
+	 * callback returns (see video_frame for the implications).
+	 *
+	 * @param p_token Token of the media the frame belongs to
+	 * @param p_frame The new frame
+	 */
+	typedef std::function < void(guint64 const p_token, video_frame const &p_frame) > new_video_frame_callback;
+
+	/// Set of callbacks to be invoked by the pipeline.
+	/**
+	 * All callbacks are optional. If a callback is not defined, it will not be called.
+	 */
+	struct callbacks
+	{
+		media_started_callback   m_media_started_callback;
+		end_of_stream_callback   m_end_of_stream_callback;
+		error_callback           m_error_callback;
+		state_changed_callback   m_state_changed_callback;
+		new_video_frame_callback m_new_video_frame_callback;
+	};
+
+	/// Frame drop statistics for the current media.
+	struct qos_stats
+	{
+		/// Number of frames that were decoded or dropped, or -1 if unknown
+		gint64 m_processed_frames;
+		/// Number of frames that were dropped because they were late, or -1 if unknown
+		gint64 m_dropped_frames;
+
+		qos_stats();
+	};
+
+	/// Constructor. Sets up internal states, and starts the internal thread.
+	/**
+	 * @param p_callbacks Callbacks to use for notifications
+	 * @param p_video_mode Video mode to use
+	 * @param p_max_lateness Frames that are later than this are dropped
+	 *        (in nanoseconds); ignored in video_mode_keyframes_only
+	 * @param p_video_format If not GST_VIDEO_FORMAT_UNKNOWN, frames are
+	 *        converted to this format; otherwise, they are delivered in the
+	 *        decoder's output format, which avoids the conversion
+	 * @param p_audiosink_name Name of the GStreamer audio sink element to use;
+	 *        "fakesink" is useful for playing without audio output while
+	 *        still keeping the video synchronized to the audio timestamps
+	 */
+	explicit video_pipeline(
+		callbacks const &p_callbacks,
+		video_modes const p_video_mode = video_mode_playback,
+		gint64 const p_max_lateness = 20 * GST_MSECOND,
+		GstVideoFormat const p_video_format = GST_VIDEO_FORMAT_UNKNOWN,
+		std::string const &p_audiosink_name = "autoaudiosink"
+	);
+	~video_pipeline();
+
+	virtual void stop() override;
+
+	virtual guint64 get_new_token() override;
+
+	virtual void set_paused(bool const p_paused) override;
+
+	virtual bool is_transitioning() const override;
+
+	virtual states get_current_state() const override;
+
+	/// Seeks to the given position.
+	/**
+	 * In video_mode_keyframes_only, the seek is done to the nearest keyframe.
+	 */
+	virtual void set_current_position(gint64 const p_new_position, position_units const p_unit = position_unit_nanoseconds) override;
+
+	virtual gint64 get_current_position(position_units const p_unit = position_unit_nanoseconds) const override;
+
+	virtual gint64 get_duration(position_units const p_unit = position_unit_nanoseconds) const override;
+
+	/// Does nothing, since video_pipeline does not report tags.
+	virtual void force_postpone_tag(std::string const &p_tag, bool const p_postpone) override;
+
+	/// Builds the GStreamer pipeline if necessary, and switches it to READY.
+	virtual bool prewarm() override;
+
+	/// Sets the maximum lateness of frames, in nanoseconds. Later frames are dropped.
+	/**
+	 * -1 disables dropping of late frames. Ignored in video_mode_keyframes_only.
+	 */
+	void set_max_lateness(gint64 const p_max_lateness);
+
+	/// Returns the frame drop statistics for the current media.
+	qos_stats get_qos_stats() const;
+
+	/// Returns the log context of this pipeline.
+	log_context & get_log_context();
+
+
+protected:
+	virtual bool play_media_impl(guint64 const p_token, media &&p_media, bool const p_play_now, playback_properties const &p_properties) override;
+
+
+private:
+	bool initialize_pipeline_nolock();
+	void shutdown_pipeline_nolock();
+	void reinitialize_pipeline_nolock();
+
+	bool play_media_nolock(guint64 const p_token, media &&p_media, playback_properties const &p_properties);
+	void stop_nolock();
+	void set_state_nolock(states const p_new_state);
+	void seek_nolock(gint64 const p_position, position_units const p_unit);
+	bool send_seek_event_nolock(gint64 const p_position, position_units const p_unit);
+	void finish_transition_nolock();
+
+	static void static_about_to_finish_callback(GstElement *p_playbin, gpointer p_data);
+	static void static_handoff_callback(GstElement *p_fakesink, GstBuffer *p_buffer, GstPad *p_pad, gpointer p_data);
+	static GstPadProbeReturn static_stream_start_probe(GstPad *p_pad, GstPadProbeInfo *p_info, gpointer p_data);
+	static gboolean static_bus_watch(GstBus *p_bus, GstMessage *p_msg, gpointer p_data);
+
+	void thread_main();
+	void start_thread();
+	void stop_thread();
+	static gboolean static_loop_start_cb(gpointer p_data);
+
+	// logging
+	log_context m_log_context;
+
+	// configuration
+	callbacks const m_callbacks;
+	video_modes const m_video_mode;
+	gint64 m_max_lateness;
+	GstVideoFormat const m_video_format;
+	std::string const m_audiosink_name;
+
+	// current states
+	states m_state, m_state_before_transition;
+	media m_current_media;
+	guint64 m_current_token;
+	playback_properties m_current_properties;
+	bool m_initial_seek_done;
+	qos_stats m_qos_stats;
+	guint64 m_next_token;
+
+	// Requests which came in during a transition, and are
+	// performed once the transition is finished
+	boost::optional < bool > m_postponed_paused;
+	boost::optional < std::pair < gint64, position_units > > m_postponed_seek;
+
+	// Next media. This is accessed by the about-to-finish callback in
+	// a streaming thread, so it is protected by its own mutex. Using the
+	// loop mutex there could deadlock when the pipeline is shut down
+	// while the loop mutex is held. Once playbin was given the next
+	// media's URI, the media is moved to the "queued" slot, where it
+	// stays until its stream starts, so a new next media can be set
+	// in the meantime.
+	std::mutex m_next_media_mutex;
+	media m_next_media, m_queued_media;
+	guint64 m_next_media_token, m_queued_media_token;
+	playback_properties m_next_properties, m_queued_properties;
+
+	// Token of the media the frames currently belong to. Frames are
+	// delivered in a streaming thread without locking the loop mutex,
+	// so the token is switched in a probe when a new stream starts.
+	std::atomic < guint64 > m_frame_token, m_pending_frame_token;
+	std::atomic < bool > m_frame_token_pending;
+
+	// Only accessed by the video sink's streaming thread
+	GstCaps *m_frame_caps;
+	GstVideoInfo m_frame_video_info;
+
+	// GStreamer elements
+	GstElement *m_pipeline_elem, *m_videosink_elem;
+	GstBus *m_bus;
+	GSource *m_watch_source;
+
+	// mainloop thread
+	std::thread m_thread;
+	GMainLoop *m_thread_loop;
+	GMainContext *m_thread_loop_context;
+	bool m_thread_loop_running;
+	mutable std::mutex m_loop_mutex;
+	std::condition_variable m_condition;
+};
+
+
+} // namespace nxplay end
+
+
+#endif